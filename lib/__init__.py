@@ -1,14 +1,22 @@
-import plutocracy.api
+import sys
 
+# pluto.py --dedicated and --bot load the dedicated server build, which has no
+# render or interface modules and does not need a display, OpenGL or Pango
+dedicated = len(sys.argv) > 1 and sys.argv[1] in ("--dedicated", "--bot")
+if dedicated:
+    import plutocracy.dedicated as api
+else:
+    import plutocracy.api as api
 
-common = plutocracy.api.common
-network = plutocracy.api.network
-render = plutocracy.api.render
-interface = plutocracy.api.interface
-game = plutocracy.api.game
+common = api.common
+network = api.network
+game = api.game
 
-c_update = plutocracy.api.c_update
-check_exit = plutocracy.api.check_exit
+if not dedicated:
+    render = api.render
+    interface = api.interface
+    c_update = api.c_update
+    check_exit = api.check_exit
 
 def init():
     """Sets everything up for the client"""
@@ -43,7 +51,10 @@ def init():
 def update():
     render.start_frame()
     interface.check_events()
-    
+
+    # Update the game before rendering it
+    game.update()
+
     render.start_globe()
     game.render_globe();
     render.render_border(100)
@@ -59,9 +70,58 @@ def update():
     common.time_update();
     common.throttle_fps();
 
-    # Update the game after rendering everything
-    game.update_host();
-    game.update_client();
+def run_master(port):
+    """Runs only the master server until interrupted, without a window"""
+
+    common.register_variables()
+    network.register_variables()
+    common.open_log_file()
+    network.init()
+    try:
+        network.run_master(port)
+    finally:
+        network.cleanup()
+
+def run_dedicated(config=None):
+    """Hosts games until interrupted, without a window"""
+
+    common.register_variables()
+    network.register_variables()
+    game.register_variables()
+    common.parse_config_file("autoexec.cfg")
+    if config:
+        common.parse_config_file(config)
+    common.open_log_file()
+    common.init_lang()
+    common.translate_vars()
+    network.init()
+    game.init()
+    try:
+        api.serve()
+    finally:
+        game.cleanup()
+        network.cleanup()
+        common.cleanup()
+
+def run_bot(address, interval=1000):
+    """Plays in the game at [address] as a bot until disconnected, without a
+       window. Commands are issued [interval] milliseconds apart on
+       average."""
+
+    common.register_variables()
+    network.register_variables()
+    game.register_variables()
+    common.parse_config_file("autoexec.cfg")
+    common.init_lang()
+    common.translate_vars()
+    network.init()
+    game.init()
+    try:
+        api.play(address, interval)
+    finally:
+        game.cleanup()
+        network.cleanup()
+        common.cleanup()
 
 def cleanup():
     common.cleanup()
@@ -14,7 +14,7 @@
 # more details.                                                               #
 ###############################################################################
 
-import sys, urllib, csv, threading, os
+import sys, csv, os, StringIO
 from distutils.util import get_platform
 from os.path import *
 
@@ -35,9 +35,11 @@ def delete_fonts():
     for file in linked_files:
         os.remove(file)
         
-copy_font("BLKCHCRY.TTF")
-copy_font("LCD2U___.TTF")
-copy_font("SF_Archery_Black.ttf")
+# The dedicated server and bots render no text
+if len(sys.argv) < 2 or sys.argv[1] not in ("--dedicated", "--bot"):
+    copy_font("BLKCHCRY.TTF")
+    copy_font("LCD2U___.TTF")
+    copy_font("SF_Archery_Black.ttf")
 
 import plutocracy
 
@@ -91,17 +93,6 @@ def shipyard_tile_ring_command(shipyard, client_id, tile, icon):
     plutocracy.game.pay(client_id, tile, shipclass.cost, True)
     return
 
-class ServerListRefresh(threading.Thread):
-    def __init__(self, master, url):
-        self.master = master
-        self.url = url
-        threading.Thread.__init__(self)
-    def run(self):
-        global csv_file
-        print "fetching server list"
-        csv_file = urllib.urlopen("http://" + self.master + self.url +
-                                  "?format=csv")
-
 def parse_servers():
     global csv_file
     server_list = csv.DictReader(csv_file)
@@ -117,9 +108,10 @@ def parse_servers():
         print "Parsed server '%s (%s) %s'" % (address, name, info)
         plutocracy.interface.add_server(name, info, address, compatible)
         
-def refresh_servers(master, url):
-    thread = ServerListRefresh(master, url)
-    thread.start()
+def refresh_servers(text):
+    """Called with the server list once the master server has sent it"""
+    global csv_file
+    csv_file = StringIO.StringIO(text)
 
 empty = plutocracy.game.BuildingClass("Empty", "", "")
 empty.connect("tile-click", empty_tile_click)
@@ -186,8 +178,53 @@ plutocracy.game.add_shipclass(galleon)
 
 csv_file = None
 
+# Run a master server instead of playing: pluto.py --master [port]
+if len(sys.argv) > 1 and sys.argv[1] == "--master":
+    try:
+        port = 8080
+        if len(sys.argv) > 2:
+            port = int(sys.argv[2])
+        plutocracy.run_master(port)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        delete_fonts()
+    sys.exit(0)
+
+# Host games without a window: pluto.py --dedicated [config]
+if len(sys.argv) > 1 and sys.argv[1] == "--dedicated":
+    try:
+        config = None
+        if len(sys.argv) > 2:
+            config = sys.argv[2]
+        plutocracy.run_dedicated(config)
+    except KeyboardInterrupt:
+        pass
+    sys.exit(0)
+
+# Play as a bot for tools/loadgen.py: pluto.py --bot <address> [interval]
+if len(sys.argv) > 2 and sys.argv[1] == "--bot":
+    try:
+        interval = 1000
+        if len(sys.argv) > 3:
+            interval = int(sys.argv[3])
+        plutocracy.run_bot(sys.argv[2], interval)
+    except KeyboardInterrupt:
+        pass
+    sys.exit(0)
+
 plutocracy.init()
 plutocracy.game.connect("refresh-servers", refresh_servers)
+
+# Replay a recorded game instead of playing: pluto.py --replay <file>
+if len(sys.argv) > 2 and sys.argv[1] == "--replay":
+    try:
+        matched = plutocracy.game.replay(sys.argv[2])
+    finally:
+        plutocracy.cleanup()
+        delete_fonts()
+    sys.exit(not matched)
+
 try:
     while 1:
         plutocracy.c_update() # C update function
@@ -29,6 +29,11 @@ headers = glob("src/*/*.h")
 if os.name == "posix":
     common_src.remove("src/common/c_os_windows.c")
 
+# The headless stand-ins replace the renderer and interface in the dedicated
+# server only
+render_src.remove("src/render/r_headless.c")
+interface_src.remove("src/interface/i_headless.c")
+
 plutocracy_src = common_src + game_src + interface_src + render_src + \
                  network_src + api_src
 
@@ -68,6 +73,27 @@ api_extension = Extension("plutocracy.api", ["src/plutocracy-lib.c",
 
 extensions.append( api_extension )
 
+# The dedicated server links no OpenGL or Pango and only needs SDL for timers
+# and threads
+dedicated_extension = Extension("plutocracy.dedicated", ["src/dedicated.c",
+                                "src/render/r_tiles.c",
+                                "src/render/r_headless.c",
+                                "src/interface/i_headless.c",
+                                "src/api/common.c", "src/api/network.c",
+                                "src/api/game.c", "src/api/game-classes.c"] +
+                                common_src + game_src + network_src,
+                   include_dirs=[".", "/usr/include/SDL"],
+                   libraries = ['z', 'png'],
+                   define_macros=[("_REENTRANT", None),
+                                  ("PLUTOCRACY_DEDICATED", None),
+                                  ("PACKAGE", '"%s"' % "plutocracy"),
+                                  ("PACKAGE_STRING", '"%s"' % PACKAGE_STRING),
+                                  ("PKGDATADIR", '"%s"' %  PKGDATADIR)],
+                   extra_link_args= ["-lSDL"],
+                   depends = headers)
+
+extensions.append( dedicated_extension )
+
 def df_walk(path):
     datafiles = []
     for x in os.walk(path):
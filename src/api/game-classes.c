@@ -31,6 +31,11 @@ PyObject *Store_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
         g_store_t *self;
         self = (g_store_t *)type->tp_alloc(type, 0);
+        if (self) {
+                self->client = N_INVALID_ID;
+                self->building = -1;
+                self->ship = -1;
+        }
         return (PyObject *)self;
 }
 
@@ -587,3 +592,238 @@ PyTypeObject G_building_type =
  0,                         /* tp_alloc */
  G_building_new,         /* tp_new */
 };
+
+/* Read-only mapping of ids to game objects kept in a C table, such as
+   game.ships and game.buildings */
+typedef struct G_view {
+        PyObject_HEAD;
+        int (*len)(void);
+        PyObject *(*item)(int index, int *id);
+        PyObject *(*lookup)(int id);
+} G_view_t;
+
+static int ships_len(void)
+{
+        return g_ships_len;
+}
+
+static PyObject *ships_item(int index, int *id)
+{
+        *id = g_ships[index]->id;
+        return (PyObject *)g_ships[index];
+}
+
+static PyObject *ships_lookup(int id)
+{
+        return (PyObject *)G_get_ship(id);
+}
+
+static int buildings_len(void)
+{
+        return g_buildings_len;
+}
+
+static PyObject *buildings_item(int index, int *id)
+{
+        *id = g_buildings[index]->id;
+        return (PyObject *)g_buildings[index];
+}
+
+static PyObject *buildings_lookup(int id)
+{
+        return (PyObject *)G_get_building(id);
+}
+
+/* Returns a borrowed reference to the object with id [key] or NULL */
+static PyObject *view_lookup(G_view_t *self, PyObject *key)
+{
+        long id;
+
+        id = PyInt_AsLong(key);
+        if (id == -1 && PyErr_Occurred()) {
+                PyErr_Clear();
+                return NULL;
+        }
+        if (id < 0 || id > C_INT_MAX)
+                return NULL;
+        return self->lookup(id);
+}
+
+static Py_ssize_t G_view_len(G_view_t *self)
+{
+        return self->len();
+}
+
+static PyObject *G_view_subscript(G_view_t *self, PyObject *key)
+{
+        PyObject *value;
+
+        if (!(value = view_lookup(self, key))) {
+                PyErr_SetObject(PyExc_KeyError, key);
+                return NULL;
+        }
+        Py_INCREF(value);
+        return value;
+}
+
+static int G_view_contains(G_view_t *self, PyObject *key)
+{
+        return view_lookup(self, key) != NULL;
+}
+
+/* Returns a list of ids, objects, or (id, object) tuples. Iterating over a
+   list means Python code can add and remove objects while it loops. */
+static PyObject *view_list(G_view_t *self, bool ids, bool values)
+{
+        PyObject *list, *item, *value;
+        int i, id, len;
+
+        len = self->len();
+        if (!(list = PyList_New(len)))
+                return NULL;
+        for (i = 0; i < len; i++) {
+                value = self->item(i, &id);
+                if (ids && values)
+                        item = Py_BuildValue("iO", id, value);
+                else if (ids)
+                        item = PyInt_FromLong(id);
+                else {
+                        item = value;
+                        Py_INCREF(item);
+                }
+                if (!item) {
+                        Py_DECREF(list);
+                        return NULL;
+                }
+                PyList_SET_ITEM(list, i, item);
+        }
+        return list;
+}
+
+static PyObject *G_view_iter(G_view_t *self)
+{
+        PyObject *list, *iter;
+
+        if (!(list = view_list(self, TRUE, FALSE)))
+                return NULL;
+        iter = PyObject_GetIter(list);
+        Py_DECREF(list);
+        return iter;
+}
+
+static PyObject *G_view_keys(G_view_t *self)
+{
+        return view_list(self, TRUE, FALSE);
+}
+
+static PyObject *G_view_values(G_view_t *self)
+{
+        return view_list(self, FALSE, TRUE);
+}
+
+static PyObject *G_view_items(G_view_t *self)
+{
+        return view_list(self, TRUE, TRUE);
+}
+
+static PyObject *G_view_get(G_view_t *self, PyObject *args)
+{
+        PyObject *key, *fallback = Py_None, *value;
+
+        if (!PyArg_ParseTuple(args, "O|O", &key, &fallback))
+                return NULL;
+        if (!(value = view_lookup(self, key)))
+                value = fallback;
+        Py_INCREF(value);
+        return value;
+}
+
+static PyMappingMethods G_view_mapping =
+{
+ (lenfunc)G_view_len,       /* mp_length */
+ (binaryfunc)G_view_subscript, /* mp_subscript */
+ 0,                         /* mp_ass_subscript */
+};
+
+static PySequenceMethods G_view_sequence =
+{
+ 0,                         /* sq_length */
+ 0,                         /* sq_concat */
+ 0,                         /* sq_repeat */
+ 0,                         /* sq_item */
+ 0,                         /* sq_slice */
+ 0,                         /* sq_ass_item */
+ 0,                         /* sq_ass_slice */
+ (objobjproc)G_view_contains, /* sq_contains */
+};
+
+static PyMethodDef G_view_methods[] =
+{
+ {"keys", (PyCFunction)G_view_keys, METH_NOARGS, "List of ids"},
+ {"values", (PyCFunction)G_view_values, METH_NOARGS, "List of objects"},
+ {"items", (PyCFunction)G_view_items, METH_NOARGS,
+  "List of (id, object) pairs"},
+ {"get", (PyCFunction)G_view_get, METH_VARARGS,
+  "Object with an id, or the second argument if there is none"},
+ {NULL}  /* Sentinel */
+};
+
+PyTypeObject G_view_type =
+{
+ PyObject_HEAD_INIT(NULL)
+ 0,                         /*ob_size*/
+ "plutocracy.game.View",    /*tp_name*/
+ sizeof(G_view_t),          /*tp_basicsize*/
+ 0,                         /*tp_itemsize*/
+ 0,                         /*tp_dealloc*/
+ 0,                         /*tp_print*/
+ 0,                         /*tp_getattr*/
+ 0,                         /*tp_setattr*/
+ 0,                         /*tp_compare*/
+ 0,                         /*tp_repr*/
+ 0,                         /*tp_as_number*/
+ &G_view_sequence,          /*tp_as_sequence*/
+ &G_view_mapping,           /*tp_as_mapping*/
+ 0,                         /*tp_hash */
+ 0,                         /*tp_call*/
+ 0,                         /*tp_str*/
+ 0,                         /*tp_getattro*/
+ 0,                         /*tp_setattro*/
+ 0,                         /*tp_as_buffer*/
+ Py_TPFLAGS_DEFAULT,        /*tp_flags*/
+ "Read-only mapping of ids to game objects", /* tp_doc */
+ 0,                         /* tp_traverse */
+ 0,                         /* tp_clear */
+ 0,                         /* tp_richcompare */
+ 0,                         /* tp_weaklistoffset */
+ (getiterfunc)G_view_iter,  /* tp_iter */
+ 0,                         /* tp_iternext */
+ G_view_methods,            /* tp_methods */
+};
+
+/******************************************************************************\
+ Create the views of the ship and building tables. Returns a new reference.
+\******************************************************************************/
+static PyObject *view_new(int (*len)(void),
+                          PyObject *(*item)(int index, int *id),
+                          PyObject *(*lookup)(int id))
+{
+        G_view_t *view;
+
+        if (!(view = (G_view_t *)PyType_GenericAlloc(&G_view_type, 0)))
+                return NULL;
+        view->len = len;
+        view->item = item;
+        view->lookup = lookup;
+        return (PyObject *)view;
+}
+
+PyObject *G_ships_view_new(void)
+{
+        return view_new(ships_len, ships_item, ships_lookup);
+}
+
+PyObject *G_buildings_view_new(void)
+{
+        return view_new(buildings_len, buildings_item, buildings_lookup);
+}
@@ -46,6 +46,11 @@ static PyObject *render_ships(PyObject *self, PyObject *args) {
         Py_RETURN_NONE;
 }
 
+static PyObject *update(PyObject *self, PyObject *args) {
+        G_update();
+        Py_RETURN_NONE;
+}
+
 static PyObject *update_host(PyObject *self, PyObject *args) {
         G_update_host();
         Py_RETURN_NONE;
@@ -134,6 +139,7 @@ static PyObject *ship_spawn(PyObject *self, PyObject *args) {
         ship = G_ship_spawn(index, client, tile, shipclass->class_id);
         if(!ship)
                 Py_RETURN_NONE;
+        Py_INCREF(ship);
         return (PyObject*)ship;
 }
 
@@ -177,6 +183,15 @@ static PyObject *connect(PyObject *self, PyObject *args) {
         Py_RETURN_NONE;
 }
 
+static PyObject *replay(PyObject *self, PyObject *args) {
+        char *filename;
+        if(!PyArg_ParseTuple(args, "s", &filename))
+        {
+                return NULL;
+        }
+        return PyBool_FromLong(G_replay(filename));
+}
+
 static PyMethodDef module_methods[] =
 {
  { "register_variables", register_variables, METH_NOARGS, ""},
@@ -186,6 +201,7 @@ static PyMethodDef module_methods[] =
  { "render_globe", render_globe, METH_NOARGS, ""},
  { "render_ships", render_ships, METH_NOARGS, ""},
  { "render_game_over", render_game_over, METH_NOARGS, ""},
+ { "update", update, METH_NOARGS, ""},
  { "update_host", update_host, METH_NOARGS, ""},
  { "update_client", update_client, METH_NOARGS, ""},
  { "add_shipclass", add_shipclass, METH_VARARGS, ""},
@@ -197,6 +213,7 @@ static PyMethodDef module_methods[] =
  { "ship_spawn", ship_spawn, METH_VARARGS, ""},
  { "ship_class_from_ring_id", ship_class_from_ring_id, METH_VARARGS, ""},
  { "connect", connect, METH_VARARGS, ""},
+ { "replay", replay, METH_VARARGS, ""},
  {NULL}  /* Sentinel */
 };
 
@@ -241,6 +258,12 @@ PyObject *init_game_api(void)
         Py_INCREF(&StoreType);
         PyModule_AddObject(m, "Store", (PyObject *)&StoreType);
 
+        /* Ship and building ids to ships and buildings */
+        if (PyType_Ready(&G_view_type) >= 0) {
+                PyModule_AddObject(m, "ships", G_ships_view_new());
+                PyModule_AddObject(m, "buildings", G_buildings_view_new());
+        }
+
 
         if (m == NULL)
                 return NULL;
@@ -27,11 +27,42 @@ static PyObject *cleanup(PyObject *self, PyObject *args) {
         Py_RETURN_NONE;
 }
 
+static PyObject *run_master(PyObject *self, PyObject *args) {
+        int port;
+        if(!PyArg_ParseTuple(args, "i", &port))
+        {
+                return NULL;
+        }
+        if (!SDL_WasInit(SDL_INIT_TIMER) &&
+            SDL_InitSubSystem(SDL_INIT_TIMER) < 0) {
+                PyErr_SetString(PyExc_RuntimeError, SDL_GetError());
+                return NULL;
+        }
+        C_time_init();
+        if (!N_start_master(port)) {
+                PyErr_SetString(PyExc_RuntimeError,
+                                "Failed to start master server");
+                return NULL;
+        }
+
+        /* Serve until interrupted, sleeping while idle */
+        while (!c_exit && !PyErr_CheckSignals()) {
+                C_time_update();
+                if (!N_poll_master())
+                        SDL_Delay(1);
+        }
+        N_stop_master();
+        if (PyErr_Occurred())
+                return NULL;
+        Py_RETURN_NONE;
+}
+
 static PyMethodDef module_methods[] = 
 {
  { "register_variables", register_variables, METH_NOARGS, ""},
  { "init", init, METH_NOARGS, ""}, 
  { "cleanup", cleanup, METH_NOARGS, ""}, 
+ { "run_master", run_master, METH_VARARGS, ""},
  {NULL}  /* Sentinel */
 };
 
@@ -0,0 +1,113 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Bit sets are plain arrays of words. Declare one with enough words for [n]
+   bits as c_bits_t set[C_BITS_WORDS(n)]. C_zero_buf() clears a set and
+   C_one_buf() fills it. */
+
+typedef unsigned int c_bits_t;
+
+#define C_BITS_WORD 32
+#define C_BITS_WORDS(n) (((n) + C_BITS_WORD - 1) / C_BITS_WORD)
+
+/* Iterate [i] over the set bits of [bits], which has [n] bits */
+#define C_bits_for(i, bits, n) \
+        for ((i) = C_bits_next(bits, n, 0); (i) >= 0; \
+             (i) = C_bits_next(bits, n, (i) + 1))
+
+/******************************************************************************\
+ Get or set a single bit.
+\******************************************************************************/
+static inline bool C_bit_get(const c_bits_t *bits, int i)
+{
+        return (bits[i / C_BITS_WORD] >> (i % C_BITS_WORD)) & 1;
+}
+
+static inline void C_bit_set(c_bits_t *bits, int i, bool value)
+{
+        if (value)
+                bits[i / C_BITS_WORD] |= 1u << (i % C_BITS_WORD);
+        else
+                bits[i / C_BITS_WORD] &= ~(1u << (i % C_BITS_WORD));
+}
+
+/******************************************************************************\
+ Returns the index of the lowest set bit in a non-zero word.
+\******************************************************************************/
+static inline int C_bits_lowest(c_bits_t word)
+{
+#ifdef __GNUC__
+        return __builtin_ctz(word);
+#else
+        int i;
+
+        for (i = 0; !(word & 1); i++)
+                word >>= 1;
+        return i;
+#endif
+}
+
+/******************************************************************************\
+ Returns the index of the first set bit at or after [from], or -1 if there are
+ none before bit [n]. Whole words of zeros are skipped at once.
+\******************************************************************************/
+static inline int C_bits_next(const c_bits_t *bits, int n, int from)
+{
+        c_bits_t word;
+        int w, i;
+
+        if (from >= n)
+                return -1;
+        w = from / C_BITS_WORD;
+        word = bits[w] & (~0u << (from % C_BITS_WORD));
+        for (;;) {
+                if (word) {
+                        i = w * C_BITS_WORD + C_bits_lowest(word);
+                        return i < n ? i : -1;
+                }
+                if (++w >= C_BITS_WORDS(n))
+                        return -1;
+                word = bits[w];
+        }
+}
+
+/******************************************************************************\
+ Returns the number of set bits.
+\******************************************************************************/
+static inline int C_bits_count(const c_bits_t *bits, int n)
+{
+        int i, count;
+
+        count = 0;
+        C_bits_for(i, bits, n)
+                count++;
+        return count;
+}
+
+/******************************************************************************\
+ Combine [src] into [dest] word by word. Both sets have [n] bits.
+\******************************************************************************/
+static inline void C_bits_and(c_bits_t *dest, const c_bits_t *src, int n)
+{
+        int i;
+
+        for (i = 0; i < C_BITS_WORDS(n); i++)
+                dest[i] &= src[i];
+}
+
+static inline void C_bits_or(c_bits_t *dest, const c_bits_t *src, int n)
+{
+        int i;
+
+        for (i = 0; i < C_BITS_WORDS(n); i++)
+                dest[i] |= src[i];
+}
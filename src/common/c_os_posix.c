@@ -17,6 +17,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/time.h>
 
 /* Signals we catch and die on */
 static int catch_signals[] = {SIGSEGV, SIGHUP, SIGINT, SIGTERM,
@@ -97,6 +98,18 @@ void C_signal_handler(c_signal_f func)
                 C_warning("Failed to set signal blocking mask");
 }
 
+/******************************************************************************\
+ Returns a time in microseconds for timing short sections of code. The value
+ wraps around so only differences between calls are meaningful.
+\******************************************************************************/
+unsigned int C_usec(void)
+{
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return (unsigned int)tv.tv_sec * 1000000u + (unsigned int)tv.tv_usec;
+}
+
 /******************************************************************************\
  Returns TRUE for an absolute path.
 \******************************************************************************/
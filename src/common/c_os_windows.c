@@ -73,6 +73,24 @@ void C_signal_handler(c_signal_f func)
 {
 }
 
+/******************************************************************************\
+ Returns a time in microseconds for timing short sections of code. The value
+ wraps around so only differences between calls are meaningful.
+\******************************************************************************/
+unsigned int C_usec(void)
+{
+        static LARGE_INTEGER frequency;
+        LARGE_INTEGER counter;
+
+        if (!frequency.QuadPart)
+                QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        return (unsigned int)(counter.QuadPart / frequency.QuadPart *
+                              1000000 + counter.QuadPart %
+                              frequency.QuadPart * 1000000 /
+                              frequency.QuadPart);
+}
+
 /******************************************************************************\
  Returns TRUE for an absolute path. A bit more complicated on Windows because
  either slash is valid and network paths are different from drive paths.
@@ -37,6 +37,16 @@
 #include <time.h>
 #include <errno.h>
 
+/* The dedicated server is built without OpenGL or Pango. It still needs the
+   OpenGL scalar types that appear in shared structures. */
+#ifdef PLUTOCRACY_DEDICATED
+typedef float GLfloat;
+typedef int GLint, GLsizei;
+typedef unsigned int GLenum, GLuint;
+typedef ptrdiff_t GLsizeiptr;
+typedef void GLvoid;
+#else
+
 /* OpenGL */
 #ifdef DARWIN
 #include <gl.h>
@@ -50,6 +60,7 @@
 
 /* Pango */
 #include <pango/pango.h>
+#endif
 
 /* SDL */
 #include "SDL.h"
@@ -119,6 +130,14 @@
 #define C_rad_to_deg(a) ((a) * 180.f / C_PI)
 #define C_deg_to_rad(a) ((a) * C_PI / 180.f)
 
+/* Full memory barrier for data that is shared between threads without a
+   lock. Only single-producer, single-consumer structures should rely on it. */
+#ifdef _MSC_VER
+#define C_barrier() MemoryBarrier()
+#else
+#define C_barrier() __sync_synchronize()
+#endif
+
 /* Certain functions should not be used. Files that legitimately use these
    should undefine these replacements. This is a bad thing to do because some
    standard library implementations will have strange definitions for these
@@ -223,6 +242,9 @@ typedef int (*c_key_value_f)(const char *key, const char *value);
 /* Callback for signal catchers */
 typedef void (*c_signal_f)(int signal);
 
+/* Function called when a timer goes off */
+typedef void (*c_wheel_f)(int key);
+
 /* Callback for modified variables. Return TRUE to set the value. */
 typedef struct c_var c_var_t;
 typedef int (*c_var_update_f)(c_var_t *, c_var_value_t);
@@ -262,6 +284,21 @@ typedef struct c_ref {
         int refs;
 } c_ref_t;
 
+/* Timer wheel levels and the number of slots in each */
+#define C_WHEEL_LEVELS 4
+#define C_WHEEL_BITS 6
+#define C_WHEEL_SLOTS (1 << C_WHEEL_BITS)
+
+/* Timer wheel. Slots hold the index of their first timer or -1. A zeroed
+   wheel is empty and ready to use. */
+typedef struct c_wheel {
+        struct c_wheel_timer *timers;
+        unsigned int time;
+        int slots[C_WHEEL_LEVELS][C_WHEEL_SLOTS], counts[C_WHEEL_LEVELS],
+            len, timers_len, timers_size, free_timer;
+        bool started;
+} c_wheel_t;
+
 /* A counter for counting how often something happens per frame */
 typedef struct c_count {
         int start_frame, start_time, last_time;
@@ -378,6 +415,7 @@ int C_mkdir(const char *path);
 int C_modified_time(const char *filename);
 const char *C_user_dir(void);
 void C_signal_handler(c_signal_f);
+unsigned int C_usec(void);
 
 /* c_string.c */
 #define C_bool_string(b) ((b) ? "TRUE" : "FALSE")
@@ -455,3 +493,13 @@ void C_write_autogen(void);
 
 extern c_var_t c_max_fps, c_mem_check, c_show_fps, c_test_int, c_show_bps;
 extern int c_exit;
+
+/* c_wheel.c */
+bool C_wheel_cancel(c_wheel_t *, int handle);
+void C_wheel_cleanup(c_wheel_t *);
+int C_wheel_schedule(c_wheel_t *, unsigned int now, int delay, c_wheel_f,
+                     int key);
+void C_wheel_update(c_wheel_t *, unsigned int now);
+
+/* Bit sets */
+#include "c_bits.h"
@@ -331,7 +331,6 @@ static void print_var(const c_var_t *var)
 \******************************************************************************/
 static int config_key_value(const char *key, const char *value)
 {
-        gchar *cleaned_value;
         c_var_t *var;
 
         var = C_resolve_var(key);
@@ -341,12 +340,19 @@ static int config_key_value(const char *key, const char *value)
         }
 
         if (value) {
+#ifdef PLUTOCRACY_DEDICATED
+                /* Nothing is rendered so markup does not need stripping */
+                C_var_set(var, value);
+#else
+                gchar *cleaned_value;
+
                 cleaned_value = NULL;
                 pango_parse_markup(value, strlen(value), 0, NULL,
                                    &cleaned_value, NULL, NULL);
                 if(cleaned_value)
                         C_var_set(var, cleaned_value);
                 g_free(cleaned_value);
+#endif
         }
         else
                 print_var(var);
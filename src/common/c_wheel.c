@@ -0,0 +1,274 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Hierarchical timer wheel. Timers are kept in lists hashed by the time they
+   go off so that updating only touches the timers that are due. The first
+   level has a slot for every millisecond in the next [C_WHEEL_SLOTS]
+   milliseconds, each level after that has slots [C_WHEEL_SLOTS] times as
+   long. Whenever the clock crosses into the time covered by a slot of a
+   higher level, the timers in it are moved down a level.
+
+   The wheel has no clock of its own. Callers pass in the time, in
+   milliseconds, of whatever clock its timers run on.
+
+   Timers are stored in one array and linked by index. A handle names the
+   array entry and how many times it has been reused, so handles of timers
+   that went off do not cancel whatever took their place. */
+
+#include "c_shared.h"
+
+/* Bits of a handle that pick the timer, the rest count its reuses */
+#define HANDLE_BITS 20
+#define GENERATION_MAX (C_INT_MAX >> HANDLE_BITS)
+
+/* Milliseconds covered by all the slots of a level */
+#define LEVEL_SPAN(l) (1u << (C_WHEEL_BITS * ((l) + 1)))
+
+/* A scheduled callback. Free timers are linked through [next]. */
+struct c_wheel_timer {
+        c_wheel_f func;
+        unsigned int time;
+        int key, generation, level, slot, prev, next;
+};
+
+/******************************************************************************\
+ Set up an empty wheel starting at time [now].
+\******************************************************************************/
+static void wheel_start(c_wheel_t *wheel, unsigned int now)
+{
+        C_zero(wheel);
+        C_one_buf(wheel->slots);
+        wheel->free_timer = -1;
+        wheel->time = now;
+        wheel->started = TRUE;
+}
+
+/******************************************************************************\
+ Free the memory used by a wheel. Its timers are dropped without going off.
+\******************************************************************************/
+void C_wheel_cleanup(c_wheel_t *wheel)
+{
+        C_free(wheel->timers);
+        C_zero(wheel);
+}
+
+/******************************************************************************\
+ Link a timer into the slot its time falls in.
+\******************************************************************************/
+static void wheel_insert(c_wheel_t *wheel, int index)
+{
+        struct c_wheel_timer *timer;
+        unsigned int time, delta;
+        int level;
+
+        timer = wheel->timers + index;
+        time = timer->time;
+        delta = time - wheel->time;
+
+        /* Timers in the past go off on the next update and timers further
+           off than the wheel reaches wait in the last level until they get
+           close enough */
+        if ((int)delta < 0) {
+                time = wheel->time;
+                delta = 0;
+        }
+        if (delta >= LEVEL_SPAN(C_WHEEL_LEVELS - 1)) {
+                delta = LEVEL_SPAN(C_WHEEL_LEVELS - 1) - 1;
+                time = wheel->time + delta;
+        }
+
+        for (level = 0; level < C_WHEEL_LEVELS - 1; level++)
+                if (delta < LEVEL_SPAN(level))
+                        break;
+        timer->level = level;
+        timer->slot = (time >> (C_WHEEL_BITS * level)) & (C_WHEEL_SLOTS - 1);
+        timer->prev = -1;
+        timer->next = wheel->slots[level][timer->slot];
+        if (timer->next >= 0)
+                wheel->timers[timer->next].prev = index;
+        wheel->slots[level][timer->slot] = index;
+        wheel->counts[level]++;
+}
+
+/******************************************************************************\
+ Unlink a timer from its slot.
+\******************************************************************************/
+static void wheel_unlink(c_wheel_t *wheel, int index)
+{
+        struct c_wheel_timer *timer;
+
+        timer = wheel->timers + index;
+        if (timer->prev >= 0)
+                wheel->timers[timer->prev].next = timer->next;
+        else
+                wheel->slots[timer->level][timer->slot] = timer->next;
+        if (timer->next >= 0)
+                wheel->timers[timer->next].prev = timer->prev;
+        wheel->counts[timer->level]--;
+}
+
+/******************************************************************************\
+ Put an unlinked timer back on the free list. Its handle stops working.
+\******************************************************************************/
+static void wheel_release(c_wheel_t *wheel, int index)
+{
+        struct c_wheel_timer *timer;
+
+        timer = wheel->timers + index;
+        timer->func = NULL;
+        timer->generation = timer->generation % GENERATION_MAX + 1;
+        timer->next = wheel->free_timer;
+        wheel->free_timer = index;
+        wheel->len--;
+}
+
+/******************************************************************************\
+ Schedule [func] to be called with [key] once [delay] milliseconds have
+ passed since time [now]. Keys are usually the id of whatever the timer is
+ for so that the callback can look it up and find out if it is still around.
+ Returns a handle that can be used to cancel the timer, which is never zero,
+ or zero if there is no room for more timers.
+\******************************************************************************/
+int C_wheel_schedule(c_wheel_t *wheel, unsigned int now, int delay,
+                     c_wheel_f func, int key)
+{
+        struct c_wheel_timer *timer;
+        int index;
+
+        C_assert(func);
+        if (!wheel->started)
+                wheel_start(wheel, now);
+
+        /* Grow the timer array when nothing is free */
+        if (wheel->free_timer < 0) {
+                if (wheel->timers_len >= 1 << HANDLE_BITS) {
+                        C_warning("Out of timers");
+                        return 0;
+                }
+                if (wheel->timers_len >= wheel->timers_size) {
+                        wheel->timers_size = wheel->timers_size ?
+                                             2 * wheel->timers_size : 256;
+                        wheel->timers = C_realloc(wheel->timers,
+                                                  wheel->timers_size *
+                                                  sizeof (*wheel->timers));
+                }
+                timer = wheel->timers + wheel->timers_len;
+                timer->func = NULL;
+                timer->generation = 1;
+                timer->next = -1;
+                wheel->free_timer = wheel->timers_len++;
+        }
+
+        index = wheel->free_timer;
+        timer = wheel->timers + index;
+        wheel->free_timer = timer->next;
+        timer->func = func;
+        timer->key = key;
+        timer->time = now + (delay > 0 ? delay : 0);
+        wheel_insert(wheel, index);
+        wheel->len++;
+        return (timer->generation << HANDLE_BITS) | index;
+}
+
+/******************************************************************************\
+ Cancel the timer named by [handle]. Returns FALSE if it has already gone off
+ or been cancelled.
+\******************************************************************************/
+bool C_wheel_cancel(c_wheel_t *wheel, int handle)
+{
+        struct c_wheel_timer *timer;
+        int index;
+
+        index = handle & ((1 << HANDLE_BITS) - 1);
+        if (handle <= 0 || index >= wheel->timers_len)
+                return FALSE;
+        timer = wheel->timers + index;
+        if (!timer->func || timer->generation != handle >> HANDLE_BITS)
+                return FALSE;
+        wheel_unlink(wheel, index);
+        wheel_release(wheel, index);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Move the timers in a slot of a higher level down to where they belong now.
+\******************************************************************************/
+static void wheel_cascade(c_wheel_t *wheel, int level, int slot)
+{
+        int index, next;
+
+        index = wheel->slots[level][slot];
+        wheel->slots[level][slot] = -1;
+        for (; index >= 0; index = next) {
+                next = wheel->timers[index].next;
+                wheel->counts[level]--;
+                wheel_insert(wheel, index);
+        }
+}
+
+/******************************************************************************\
+ Call the callbacks of every timer that is due at time [now]. Callbacks may
+ schedule and cancel timers, including scheduling themselves again.
+\******************************************************************************/
+void C_wheel_update(c_wheel_t *wheel, unsigned int now)
+{
+        if (!wheel->started)
+                return;
+        while ((int)(now - wheel->time) >= 0) {
+                unsigned int tick, next;
+                int level, index, *head;
+
+                /* Nothing to do at all */
+                tick = wheel->time;
+                if (!wheel->len) {
+                        wheel->time = now + 1;
+                        break;
+                }
+
+                /* With the first level empty nothing can happen until the
+                   clock reaches the next slot of the second level */
+                if (!wheel->counts[0] && (tick & (C_WHEEL_SLOTS - 1))) {
+                        next = (tick | (C_WHEEL_SLOTS - 1)) + 1;
+                        if ((int)(next - now) > 0) {
+                                wheel->time = now + 1;
+                                break;
+                        }
+                        wheel->time = next;
+                        continue;
+                }
+
+                /* Bring timers down from every level whose slot just began,
+                   highest first so they can fall all the way */
+                for (level = 1; level < C_WHEEL_LEVELS; level++)
+                        if (tick & (LEVEL_SPAN(level - 1) - 1))
+                                break;
+                while (--level > 0)
+                        wheel_cascade(wheel, level,
+                                      (tick >> (C_WHEEL_BITS * level)) &
+                                      (C_WHEEL_SLOTS - 1));
+
+                /* Everything in this slot is due now. The callback is taken
+                   off the wheel first since it may reuse the timer. */
+                head = wheel->slots[0] + (tick & (C_WHEEL_SLOTS - 1));
+                while ((index = *head) >= 0) {
+                        c_wheel_f func;
+                        int key;
+
+                        func = wheel->timers[index].func;
+                        key = wheel->timers[index].key;
+                        wheel_unlink(wheel, index);
+                        wheel_release(wheel, index);
+                        func(key);
+                }
+                wheel->time++;
+        }
+}
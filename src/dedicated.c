@@ -0,0 +1,168 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* This file forms the starting point for the dedicated server. It is built
+   with PLUTOCRACY_DEDICATED defined and links only the common, network and
+   game code, with r_headless.c and i_headless.c standing in for the renderer
+   and the interface. It needs neither a display nor OpenGL or Pango. Ship
+   and building classes still come from Python, so this is a module that
+   pluto.py loads in place of the client. The same module also runs the bots
+   that tools/loadgen.py uses to put load on a server, which play through the
+   real client code. */
+
+#include "common/c_shared.h"
+#include "network/n_shared.h"
+#include "render/r_shared.h"
+#include "interface/i_shared.h"
+#include "game/g_shared.h"
+#include "plutocracy-lib.h"
+
+/* Longest the server sleeps while nobody is connected. The game only moves
+   on when it wakes up. */
+#define IDLE_MSEC 250
+
+/* How long the results of a game stay up before the next one starts */
+#define RESTART_MSEC 30000
+
+/* How often a bot reports its statistics and how long it may take to join */
+#define REPORT_MSEC 1000
+#define JOIN_MSEC 10000
+
+/******************************************************************************\
+ Host games until interrupted. Between ticks the server sleeps and while
+ nobody is connected it sleeps until someone tries to, so idle servers cost
+ next to nothing.
+\******************************************************************************/
+static PyObject *serve(PyObject *self, PyObject *args)
+{
+        int restart_time;
+
+        if (!SDL_WasInit(SDL_INIT_TIMER) &&
+            SDL_InitSubSystem(SDL_INIT_TIMER) < 0) {
+                PyErr_SetString(PyExc_RuntimeError, SDL_GetError());
+                return NULL;
+        }
+        C_time_init();
+        C_rand_seed((unsigned int)time(NULL));
+        G_host_game();
+        if (i_limbo) {
+                PyErr_SetString(PyExc_RuntimeError, "Failed to start server");
+                return NULL;
+        }
+
+        for (restart_time = 0; !c_exit && !PyErr_CheckSignals(); ) {
+                C_time_update();
+                G_update();
+
+                /* Host the next game once the last one has been over for
+                   long enough */
+                if (!g_game_over)
+                        restart_time = 0;
+                else if (!restart_time)
+                        restart_time = c_time_msec + RESTART_MSEC;
+                else if (c_time_msec >= restart_time) {
+                        C_status("Starting a new game");
+                        G_host_game();
+                        if (i_limbo) {
+                                PyErr_SetString(PyExc_RuntimeError,
+                                                "Failed to restart server");
+                                break;
+                        }
+                }
+
+                /* Wake up for the next tick or as soon as there are
+                   messages to handle */
+                N_wait_server(n_clients_num > 1 ? G_tick_wait() : IDLE_MSEC);
+        }
+        G_leave_game();
+        if (PyErr_Occurred())
+                return NULL;
+        Py_RETURN_NONE;
+}
+
+/******************************************************************************\
+ Join the game at [address] as a bot that issues a command every [interval]
+ milliseconds on average, until it is disconnected or interrupted. Every
+ second a line is printed with whether it is in the game, the bytes it has
+ received and sent, the commands it has issued and its round-trip time for
+ tools/loadgen.py to collect.
+\******************************************************************************/
+static PyObject *play(PyObject *self, PyObject *args)
+{
+        const char *address;
+        int interval, report_time, join_time;
+        bool joined;
+
+        interval = 1000;
+        if (!PyArg_ParseTuple(args, "s|i", &address, &interval))
+                return NULL;
+        if (interval < 1)
+                interval = 1;
+        if (!SDL_WasInit(SDL_INIT_TIMER) &&
+            SDL_InitSubSystem(SDL_INIT_TIMER) < 0) {
+                PyErr_SetString(PyExc_RuntimeError, SDL_GetError());
+                return NULL;
+        }
+        C_time_init();
+        G_join_game(address);
+        join_time = c_time_msec + JOIN_MSEC;
+
+        for (joined = FALSE, report_time = 0;
+             !c_exit && !PyErr_CheckSignals(); ) {
+                C_time_update();
+                G_update();
+                G_bot_update(interval);
+
+                /* Stop once disconnected or if joining takes too long */
+                if (!i_limbo)
+                        joined = TRUE;
+                else if (joined || c_time_msec > join_time)
+                        break;
+
+                if (c_time_msec >= report_time) {
+                        printf("%d %d %d %d %d\n", !i_limbo,
+                               n_bytes_received, n_bytes_sent,
+                               g_bot_commands, G_bot_ping());
+                        fflush(stdout);
+                        report_time = c_time_msec + REPORT_MSEC;
+                }
+                SDL_Delay(G_tick_wait());
+        }
+        G_leave_game();
+        if (PyErr_Occurred())
+                return NULL;
+        Py_RETURN_NONE;
+}
+
+static PyMethodDef module_methods[] =
+{
+  { "play", play, METH_VARARGS, ""},
+  { "serve", serve, METH_NOARGS, ""},
+  {NULL}  /* Sentinel */
+};
+
+#ifndef PyMODINIT_FUNC  /* declarations for DLL import/export */
+#define PyMODINIT_FUNC void
+#endif
+PyMODINIT_FUNC initdedicated(void)
+{
+  PyObject* m;
+
+  m = Py_InitModule3("dedicated", module_methods, "");
+
+  if (m == NULL)
+    return;
+
+  PyModule_AddObject( m, "common", (PyObject*)init_common_api() );
+  PyModule_AddObject( m, "network", (PyObject*)init_network_api() );
+  PyModule_AddObject( m, "game", (PyObject*)init_game_api() );
+}
@@ -0,0 +1,135 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Synthetic player for load testing. It plays through the same client code
+   the interface uses: it joins a nation, then selects its own ships and moves
+   them around, trades, changes prices and chats at random. */
+
+#include "g_common.h"
+
+/* Number of commands the bot has issued */
+int g_bot_commands;
+
+/* Phrases the bot chats with */
+static const char *phrases[] = {
+        "ahoy", "anyone selling iron?", "nice ship", "gg",
+        "stop following me", "buying rations, good prices",
+};
+#define PHRASES (int)(sizeof (phrases) / sizeof (*phrases))
+
+/* Time of the next command */
+static int next_time;
+
+/******************************************************************************\
+ Returns a random number for the bot's choices. The game's generator is
+ seeded by the server and shared with the client's simulation, so the bot
+ keeps its own and every bot plays differently.
+\******************************************************************************/
+static int bot_rand(void)
+{
+        static unsigned int state;
+
+        if (!state)
+                state = ((unsigned int)time(NULL) ^ C_usec()) | 1;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (int)(state >> 1);
+}
+
+/******************************************************************************\
+ Returns the round-trip time the server last measured for the bot, or -1 if
+ it is not in a game.
+\******************************************************************************/
+int G_bot_ping(void)
+{
+        if (i_limbo || n_client_id < 0 || n_client_id >= N_CLIENTS_MAX)
+                return -1;
+        return g_clients[n_client_id].ping_time;
+}
+
+/******************************************************************************\
+ Returns a random ship of the bot's, or NULL if it has none.
+\******************************************************************************/
+static g_ship_t *random_own_ship(void)
+{
+        int i, count;
+
+        for (count = i = 0; i < g_ships_len; i++)
+                if (g_ships[i]->client == n_client_id)
+                        count++;
+        if (!count)
+                return NULL;
+        count = bot_rand() % count;
+        for (i = 0; i < g_ships_len; i++)
+                if (g_ships[i]->client == n_client_id && !count--)
+                        return g_ships[i];
+        return NULL;
+}
+
+/******************************************************************************\
+ Order [ship] somewhere, usually toward another ship.
+\******************************************************************************/
+static void move_ship(g_ship_t *ship)
+{
+        int tile;
+
+        if (g_ships_len > 1 && bot_rand() % 10 < 7) {
+                tile = g_ships[bot_rand() % g_ships_len]->tile;
+                if (tile == ship->tile)
+                        return;
+        } else
+                tile = bot_rand() % r_tiles_max;
+        if (G_tile_open(tile, NULL))
+                G_send_cm_ship_move(N_SERVER_ID, ship->id, tile);
+}
+
+/******************************************************************************\
+ Issue the next command once it is due. Commands come [interval]
+ milliseconds apart on average.
+\******************************************************************************/
+void G_bot_update(int interval)
+{
+        g_ship_t *ship;
+        g_cargo_type_t cargo;
+        int roll, buy;
+        char chat[64];
+
+        if (i_limbo || g_game_over || c_time_msec < next_time)
+                return;
+        next_time = c_time_msec + bot_rand() % (2 * interval + 1);
+        g_bot_commands++;
+
+        /* Join a nation first */
+        if (g_clients[n_client_id].nation == G_NN_NONE) {
+                G_change_nation(G_NN_RED + bot_rand() % 3);
+                return;
+        }
+
+        if (!(ship = random_own_ship()))
+                return;
+        G_ship_select(ship);
+        cargo = 1 + bot_rand() % (G_CARGO_TYPES - 1);
+        roll = bot_rand() % 100;
+        if (roll < 50)
+                move_ship(ship);
+        else if (roll < 75)
+                G_buy_cargo(cargo, bot_rand() % 21 - 10);
+        else if (roll < 95) {
+                buy = 1 + bot_rand() % 100;
+                G_trade_params(cargo, buy, buy + bot_rand() % 51, 0,
+                               bot_rand() % 201);
+        } else {
+                C_strncpy_buf(chat, phrases[bot_rand() % PHRASES]);
+                G_input_chat(chat);
+        }
+}
@@ -19,34 +19,41 @@ g_client_t g_clients[N_CLIENTS_MAX + 1];
 
 bool g_initilized;
 
+/* Token the server gave us for opening the side channel */
+static int udp_token;
+
+/* Server list being fetched from the master server */
+static char *servers_list;
+static int servers_list_len, servers_list_size;
+static bool servers_fetching, servers_failed;
+
 /******************************************************************************\
  The server has sent an echo request
 \******************************************************************************/
 static void sm_echo_back(void)
 {
-        int echo_data;
+        g_sm_echo_request_t msg;
 
-        echo_data = N_receive_int();
-        N_send(N_SERVER_ID, "14", G_CM_ECHO_BACK, echo_data);
+        if (!G_receive_sm_echo_request(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        G_send_cm_echo_back(N_SERVER_ID, msg.echo_data);
 }
 /******************************************************************************\
  Client is receving a popup message from the server.
 \******************************************************************************/
 static void sm_popup(void)
 {
+        g_sm_popup_t msg;
         c_vec3_t *goto_pos;
-        int focus_tile;
-        char token[32], message[256];
 
-        focus_tile = N_receive_short();
-        if (focus_tile >= r_tiles_max) {
+        if (!G_receive_sm_popup(&msg) || msg.tile >= r_tiles_max) {
                 G_corrupt_disconnect();
                 return;
         }
-        goto_pos = focus_tile >= 0 ? &r_tiles[focus_tile].origin : NULL;
-        N_receive_string(token, sizeof (token));
-        N_receive_string(message, sizeof (message));
-        I_popup(goto_pos, C_str(token, message));
+        goto_pos = msg.tile >= 0 ? &r_tiles[msg.tile].origin : NULL;
+        I_popup(goto_pos, C_str(msg.token, msg.message));
 }
 
 /******************************************************************************\
@@ -54,13 +61,18 @@ static void sm_popup(void)
 \******************************************************************************/
 static void sm_affiliate(void)
 {
+        g_sm_affiliate_t msg;
         c_vec3_t *goto_pos;
         const char *fmt;
         int client, nation, tile;
 
-        client = N_receive_char();
-        nation = N_receive_char();
-        tile = N_receive_short();
+        if (!G_receive_sm_affiliate(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        client = msg.client;
+        nation = msg.nation;
+        tile = msg.tile;
         if (nation < 0 || !N_client_valid(client)) {
                 G_corrupt_disconnect();
                 return;
@@ -131,16 +143,18 @@ static void sm_affiliate(void)
 \******************************************************************************/
 static void sm_client(void)
 {
+        g_sm_client_t msg;
         n_client_id_t client;
 
-        client = N_receive_char();
-        if (client < 0 || client >= N_CLIENTS_MAX) {
+        if (!G_receive_sm_client(&msg) ||
+            msg.client < 0 || msg.client >= N_CLIENTS_MAX) {
                 G_corrupt_disconnect();
                 return;
         }
+        client = msg.client;
         n_clients[client].connected = TRUE;
-        g_clients[client].nation = N_receive_char();
-        N_receive_string_buf(g_clients[client].name);
+        g_clients[client].nation = msg.nation;
+        C_strncpy_buf(g_clients[client].name, msg.name);
         C_debug("Client %d is '%s'", client, g_clients[client].name);
 
         /* Update players window */
@@ -154,11 +168,18 @@ static void sm_client(void)
 \******************************************************************************/
 static void sm_game_over(void)
 {
+        g_sm_game_over_t msg;
         g_nation_name_t nation;
         const char *fmt;
+        int i;
 
-        if ((nation = G_receive_nation(-1)) < 0)
+        if (!G_receive_sm_game_over(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!G_check_nation(-1, msg.nation))
                 return;
+        nation = msg.nation;
 
         /* Tie */
         if (nation == G_NN_NONE)
@@ -166,12 +187,10 @@ static void sm_game_over(void)
 
         /* Pirate won */
         else if (nation == G_NN_PIRATE) {
-                n_client_id_t client;
-
-                if ((client = G_receive_client(-1)) < 0)
+                if (!G_check_client(-1, msg.client))
                         return;
                 fmt = C_str("g-victory-pirate", "%s won the game!");
-                I_popup(NULL, C_va(fmt, g_clients[client].name));
+                I_popup(NULL, C_va(fmt, g_clients[msg.client].name));
         }
 
         /* Nation won */
@@ -183,6 +202,12 @@ static void sm_game_over(void)
         g_game_over = TRUE;
         G_ship_reselect(NULL, -1);
         I_select_nation(-1);
+
+        /* Everything can be seen once the game is over */
+        for (i = 0; i < g_ships_len; i++)
+                G_ship_queue_visible(g_ships[i]);
+        for (i = 0; i < g_buildings_len; i++)
+                G_building_queue_update(g_buildings[i]);
 }
 
 /******************************************************************************\
@@ -190,8 +215,7 @@ static void sm_game_over(void)
 \******************************************************************************/
 static void sm_init(void)
 {
-        float variance;
-        int protocol, subdiv4, islands, island_size;
+        g_sm_init_t msg;
 
         C_assert(n_client_id != N_HOST_CLIENT_ID);
         G_reset_elements();
@@ -199,10 +223,11 @@ static void sm_init(void)
         /* Start off nation-less */
         I_select_nation(G_NN_NONE);
 
-        /* Check the server's protocol */
-        if ((protocol = N_receive_short()) != G_PROTOCOL) {
+        /* Check the server's protocol. The protocol number always comes
+           first so check it before the rest of the message. */
+        if (!G_receive_sm_init(&msg) || msg.protocol != G_PROTOCOL) {
                 C_warning("Server protocol (%d) not equal to client (%d)",
-                          protocol, G_PROTOCOL);
+                          msg.protocol, G_PROTOCOL);
                 I_popup(NULL, C_str("g-incompatible",
                                     "Server protocol is not compatible"));
                 N_disconnect();
@@ -210,29 +235,32 @@ static void sm_init(void)
         }
 
         /* Get the client ID */
-        if ((n_client_id = G_receive_range(-1, 0, N_CLIENTS_MAX)) < 0)
+        if (!G_check_range(-1, msg.client, 0, N_CLIENTS_MAX))
                 return;
+        n_client_id = msg.client;
         n_clients[n_client_id].connected = TRUE;
 
         /* Maximum number of clients */
-        if ((g_clients_max = G_receive_range(-1, 1, N_CLIENTS_MAX)) < 0)
+        if (!G_check_range(-1, msg.clients_max, 1, N_CLIENTS_MAX))
                 return;
+        g_clients_max = msg.clients_max;
         I_configure_player_num(g_clients_max);
         C_debug("Client ID %d of %d", n_client_id, g_clients_max);
 
         /* Generate matching globe */
-        subdiv4 = N_receive_char();
-        g_globe_seed.value.n = N_receive_int();
-        islands = N_receive_short();
-        island_size = N_receive_short();
-        variance = N_receive_float();
-        G_generate_globe(subdiv4, islands, island_size, variance);
+        g_globe_seed.value.n = msg.seed;
+        G_generate_globe(msg.subdiv4, msg.islands, msg.island_size,
+                         msg.variance);
 
         /* Get solar angle */
-        r_solar_angle = N_receive_float();
+        r_solar_angle = msg.solar_angle;
+
+        /* Try to open the side channel for movement hints */
+        N_udp_connect(msg.udp_token);
+        udp_token = msg.udp_token;
 
         /* Get time limit */
-        g_time_limit_msec = c_time_msec + N_receive_int();
+        g_time_limit_msec = c_time_msec + msg.time_left;
 
         I_leave_limbo();
 }
@@ -242,13 +270,19 @@ static void sm_init(void)
 \******************************************************************************/
 static void sm_name(void)
 {
+        g_sm_name_t msg;
         int client;
         char old_name[G_NAME_MAX];
 
-        if ((client = G_receive_cargo(-1)) < 0)
+        if (!G_receive_sm_name(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!G_check_range(-1, msg.client, 0, N_CLIENTS_MAX))
                 return;
+        client = msg.client;
         C_strncpy_buf(old_name, g_clients[client].name);
-        N_receive_string_buf(g_clients[client].name);
+        C_strncpy_buf(g_clients[client].name, msg.name);
 
         /* Update players window */
         I_configure_player(client, g_clients[client].name,
@@ -269,25 +303,25 @@ static void sm_name(void)
 \******************************************************************************/
 static void sm_chat(void)
 {
+        g_sm_chat_t msg;
         i_color_t color;
         int client;
-        char buffer[N_SYNC_MAX], *name;
+        char *name;
 
-        client = N_receive_char();
-        N_receive_string_buf(buffer);
-        if (!buffer[0])
+        if (!G_receive_sm_chat(&msg) || !msg.message[0])
                 return;
 
         /* Normal chat message */
+        client = msg.client;
         if (client >= 0 && client < N_CLIENTS_MAX) {
                 color = G_nation_to_color(g_clients[client].nation);
                 name = g_clients[client].name;
-                I_print_chat(name, color, buffer);
+                I_print_chat(name, color, msg.message);
                 return;
         }
 
         /* No-text message */
-        I_print_chat(buffer, I_COLOR, NULL);
+        I_print_chat(msg.message, I_COLOR, NULL);
 }
 
 /******************************************************************************\
@@ -295,27 +329,26 @@ static void sm_chat(void)
 \******************************************************************************/
 static void sm_privmsg(void)
 {
+        g_sm_privmsg_t msg;
         i_color_t color;
-        int client, clients;
-        char buffer[N_SYNC_MAX], *name;
+        int client;
+        char *name;
 
-        client = N_receive_char();
-        clients = N_receive_int();
-        N_receive_string_buf(buffer);
-        if (!buffer[0])
+        if (!G_receive_sm_privmsg(&msg) || !msg.message[0])
                 return;
 
         /* Private chat message */
+        client = msg.client;
         if (client >= 0 && client < N_CLIENTS_MAX) {
                 color = G_nation_to_color(g_clients[client].nation);
                 name = C_va("%s -> %s", g_clients[client].name,
                                         g_clients[n_client_id].name);
-                I_print_chat(name, I_COLOR, buffer);
+                I_print_chat(name, I_COLOR, msg.message);
                 return;
         }
 
         /* No-text message */
-        I_print_chat(buffer, I_COLOR, NULL);
+        I_print_chat(msg.message, I_COLOR, NULL);
 }
 
 /******************************************************************************\
@@ -323,17 +356,12 @@ static void sm_privmsg(void)
 \******************************************************************************/
 static void sm_ship_spawn(void)
 {
-        g_ship_type_t type;
-        n_client_id_t client;
-        int tile, id;
+        g_sm_ship_spawn_t msg;
 
         if (n_client_id == N_HOST_CLIENT_ID)
                 return;
-        id = N_receive_short();
-        client = N_receive_char();
-        tile = N_receive_short();
-        type = N_receive_char();
-        if (!G_ship_spawn(id, client, tile, type))
+        if (!G_receive_sm_ship_spawn(&msg) ||
+            !G_ship_spawn(msg.id, msg.client, msg.tile, msg.type))
                 G_corrupt_disconnect();
 }
 
@@ -342,25 +370,28 @@ static void sm_ship_spawn(void)
 \******************************************************************************/
 static void sm_ship_state(void)
 {
-        g_ship_id id, boarding_ship_id;
+        g_sm_ship_state_t msg;
+        g_ship_id boarding_ship_id;
         int boarding;
         g_ship_t *ship, *boarding_ship;
 
-        if (!(ship = G_receive_ship(-1)))
+        if (!G_receive_sm_ship_state(&msg)) {
+                G_corrupt_disconnect();
                 return;
-
-        id = ship->id;
-        ship->health = N_receive_char();
-        ship->store->cargo[G_CT_CREW].amount = N_receive_short();
+        }
+        if (!(ship = G_check_ship(msg.id)))
+                return;
+        ship->health = msg.health;
+        ship->store->cargo[G_CT_CREW].amount = msg.crew;
 
         /* Remote client boarding announcements */
-        boarding = N_receive_char();
-        boarding_ship_id = N_receive_short();
+        boarding = msg.boarding;
+        boarding_ship_id = msg.boarding_ship;
         if(boarding_ship_id >= 0)
                 boarding_ship = G_get_ship(boarding_ship_id);
         else
                 boarding_ship = NULL;
-        if (boarding_ship_id >= 0 && ship->boarding_ship == NULL &&
+        if (boarding_ship && ship->boarding_ship == NULL &&
             G_ship_controlled_by(ship, n_client_id))
                 I_popup(&ship->model->origin,
                         C_va(C_str("g-boarding", "%s boarding the %s."),
@@ -376,32 +407,49 @@ static void sm_ship_state(void)
         ship->boarding_ship = boarding_ship;
 }
 
+/******************************************************************************\
+ The server no longer sends us updates for a ship.
+\******************************************************************************/
+static void sm_ship_forget(void)
+{
+        g_sm_ship_forget_t msg;
+
+        if (n_client_id == N_HOST_CLIENT_ID)
+                return;
+        if (!G_receive_sm_ship_forget(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        G_ship_forget(G_check_ship(msg.id));
+}
+
 /******************************************************************************\
  The buy/sell prices of a cargo item have changed on some ship.
 \******************************************************************************/
 static void sm_ship_prices(void)
 {
+        g_sm_ship_prices_t msg;
         g_cargo_t *cargo;
         g_ship_t  *ship;
-        int cargo_i, buy_price, sell_price;
 
-        ship = G_receive_ship(-1);
-        cargo_i = G_receive_cargo(-1);
-        if (!ship || cargo_i < 0)
+        if (!G_receive_sm_ship_prices(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        ship = G_check_ship(msg.id);
+        if (!G_check_cargo(-1, msg.cargo) || !ship)
                 return;
 
         /* Save prices */
-        buy_price = N_receive_short();
-        sell_price = N_receive_short();
-        cargo = ship->store->cargo + cargo_i;
-        if ((cargo->auto_buy = buy_price >= 0))
-                cargo->buy_price = buy_price;
-        if ((cargo->auto_sell = sell_price >= 0))
-                cargo->sell_price = sell_price;
+        cargo = ship->store->cargo + msg.cargo;
+        if ((cargo->auto_buy = msg.buy_price >= 0))
+                cargo->buy_price = msg.buy_price;
+        if ((cargo->auto_sell = msg.sell_price >= 0))
+                cargo->sell_price = msg.sell_price;
 
         /* Save quantities */
-        cargo->minimum = N_receive_short();
-        cargo->maximum = N_receive_short();
+        cargo->minimum = msg.minimum;
+        cargo->maximum = msg.maximum;
 
         /* Update trade window */
         G_ship_reselect(ship, -1);
@@ -410,16 +458,167 @@ static void sm_ship_prices(void)
                 G_ship_reselect(NULL, -1);
 }
 
+/******************************************************************************\
+ A gib spawned or vanished.
+\******************************************************************************/
+static void sm_gib(void)
+{
+        g_sm_gib_t msg;
+
+        if (n_client_id == N_HOST_CLIENT_ID)
+                return;
+        if (!G_receive_sm_gib(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!G_check_tile(-1, msg.tile))
+                return;
+        G_tile_gib(msg.tile, msg.type);
+}
+
+/******************************************************************************\
+ A ship's path changed.
+\******************************************************************************/
+static void sm_ship_path(void)
+{
+        g_sm_ship_path_t msg;
+        g_ship_t *ship;
+
+        if (n_client_id == N_HOST_CLIENT_ID)
+                return;
+        if (!G_receive_sm_ship_path(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!(ship = G_check_ship(msg.id)))
+                return;
+        G_ship_move_to(ship, msg.tile);
+        ship->progress = msg.progress;
+        C_strncpy_buf(ship->path, msg.path);
+        if (g_selected_ship == ship && ship->client == n_client_id)
+                R_select_path(ship->tile, ship->path);
+}
+
+/******************************************************************************\
+ A ship changed names.
+\******************************************************************************/
+static void sm_ship_name(void)
+{
+        g_sm_ship_name_t msg;
+        g_ship_t *ship;
+
+        if (!G_receive_sm_ship_name(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!(ship = G_check_ship(msg.id)))
+                return;
+        C_strncpy_buf(ship->name, msg.name);
+        G_count_name(G_NT_SHIP, ship->name);
+        G_ship_reselect(ship, -1);
+}
+
+/******************************************************************************\
+ A ship changed owners.
+\******************************************************************************/
+static void sm_ship_owner(void)
+{
+        g_sm_ship_owner_t msg;
+        g_ship_t *ship;
+
+        if (!G_receive_sm_ship_owner(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!(ship = G_check_ship(msg.id)) ||
+            !G_check_client(-1, msg.client) || ship->client == msg.client)
+                return;
+        if (ship->client == n_client_id)
+                I_popup(&ship->model->origin,
+                        C_va(C_str("g-ship-lost", "Lost the %s!"),
+                             ship->name));
+        else if (msg.client == n_client_id)
+                I_popup(&ship->model->origin,
+                        C_va(C_str("g-ship-captured", "Captured the %s."),
+                             ship->name));
+        G_ship_set_client(ship, msg.client);
+        G_ship_reselect(ship, -1);
+}
+
+/******************************************************************************\
+ A building changed.
+\******************************************************************************/
+static void sm_building(void)
+{
+        g_sm_building_t msg;
+
+        if (n_client_id == N_HOST_CLIENT_ID)
+                return;
+        if (!G_receive_sm_building(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!G_check_tile(-1, msg.tile) ||
+            !G_check_range(-1, msg.type, 0, G_BUILDING_TYPES))
+                return;
+        if ((msg.client != -2 && !N_client_valid(msg.client)) ||
+            (msg.type != G_BT_NONE &&
+             (msg.id < 0 || (msg.id & (G_BUILDING_TILES - 1)) != msg.tile))) {
+                G_corrupt_drop(-1);
+                return;
+        }
+        G_tile_build(msg.tile, msg.id, msg.type, msg.client);
+}
+
+/******************************************************************************\
+ Somebody connected but we don't have their name yet.
+\******************************************************************************/
+static void sm_connected(void)
+{
+        g_sm_connected_t msg;
+
+        if (!G_receive_sm_connected(&msg)) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!G_check_range(-1, msg.client, 0, N_CLIENTS_MAX))
+                return;
+        n_clients[msg.client].connected = TRUE;
+        C_zero(g_clients + msg.client);
+        C_debug("Client %d connected", msg.client);
+}
+
+/******************************************************************************\
+ Somebody disconnected.
+\******************************************************************************/
+static void sm_disconnected(void)
+{
+        g_sm_disconnected_t msg;
+
+        if (!G_receive_sm_disconnected(&msg) ||
+            msg.client < 0 || msg.client >= N_CLIENTS_MAX) {
+                G_corrupt_disconnect();
+                return;
+        }
+        n_clients[msg.client].connected = FALSE;
+        I_print_chat(C_va(msg.kicked ? C_str("g-kicked", "%s was kicked.") :
+                                       C_str("g-left", "%s left the game."),
+                          g_clients[msg.client].name), I_COLOR, NULL);
+        I_configure_player(msg.client, NULL, I_COLOR, FALSE);
+        C_debug("Client %d disconnected", msg.client);
+}
+
 /******************************************************************************\
  Receive ping and gold info
 \******************************************************************************/
 static void sm_client_update(void)
 {
-        int i, client_array;
-        client_array = N_receive_int();
-        for (i = 0; i < N_CLIENTS_MAX; i++) {
-                if (!(client_array & (1 << i)))
-                        continue;
+        n_client_set_t clients;
+        int i;
+
+        if (!N_receive_clients(clients))
+                return;
+        N_clients_for(i, clients) {
                 g_clients[i].gold = N_receive_int();
                 g_clients[i].ping_time = N_receive_short();
                 I_update_player(i, g_clients[i].gold, g_clients[i].ping_time);
@@ -434,7 +633,34 @@ static int name_update(c_var_t *var, c_var_value_t value)
         if (!value.s[0])
                 return FALSE;
         C_sanitize(value.s);
-        N_send(N_SERVER_ID, "1s", G_CM_NAME, value.s);
+        G_send_cm_name(N_SERVER_ID, value.s);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Run the codec benchmark when the test variable is set.
+\******************************************************************************/
+static int test_codecs_update(c_var_t *var, c_var_value_t value)
+{
+        G_test_codecs(value.n);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Run the ship lookup benchmark when the test variable is set.
+\******************************************************************************/
+static int test_ships_update(c_var_t *var, c_var_value_t value)
+{
+        G_test_ships(value.n);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Run the tile layout benchmark when the test variable is set.
+\******************************************************************************/
+static int test_tiles_update(c_var_t *var, c_var_value_t value)
+{
+        G_test_tiles(value.n);
         return TRUE;
 }
 
@@ -446,7 +672,6 @@ void G_client_callback(int client, n_event_t event)
         g_server_msg_t token;
         g_ship_t *ship;
         g_building_t *building;
-        int i, j, k;
 
         C_assert(client == N_SERVER_ID);
 
@@ -476,6 +701,19 @@ void G_client_callback(int client, n_event_t event)
                 return;
         }
 
+        /* Side channel is open, tell the server it can use it */
+        if (event == N_EV_UDP_READY) {
+                G_send_cm_udp_ready(N_SERVER_ID, udp_token);
+                return;
+        }
+
+        /* Datagrams only carry movement hints */
+        if (event == N_EV_DATAGRAM) {
+                if (N_receive_char() == G_SM_SHIP_HINTS)
+                        G_receive_ship_hints();
+                return;
+        }
+
         /* Process messages */
         if (event != N_EV_MESSAGE)
                 return;
@@ -493,6 +731,9 @@ void G_client_callback(int client, n_event_t event)
         case G_SM_INIT:
                 sm_init();
                 break;
+        case G_SM_SNAPSHOT:
+                G_receive_snapshot();
+                break;
         case G_SM_NAME:
                 sm_name();
                 break;
@@ -520,6 +761,9 @@ void G_client_callback(int client, n_event_t event)
         case G_SM_SHIP_PRICES:
                 sm_ship_prices();
                 break;
+        case G_SM_SHIP_FORGET:
+                sm_ship_forget();
+                break;
 
         /* A ship's cargo manifest changed */
         case G_SM_SHIP_CARGO:
@@ -535,66 +779,20 @@ void G_client_callback(int client, n_event_t event)
                 G_ship_update_trade_ui(ship);
                 break;
 
-        /* A gib spawned or vanished */
         case G_SM_GIB:
-                if (n_client_id == N_HOST_CLIENT_ID ||
-                    (i = G_receive_tile(-1)) < 0)
-                        return;
-                G_tile_gib(i, N_receive_char());
+                sm_gib();
                 break;
-
-        /* Ship path changed */
         case G_SM_SHIP_PATH:
-                if (n_client_id == N_HOST_CLIENT_ID ||
-                    !(ship = G_receive_ship(-1)))
-                        return;
-                G_ship_move_to(ship, N_receive_short());
-                ship->progress = N_receive_float();
-                N_receive_string_buf(ship->path);
-                if (g_selected_ship == ship && ship->client == n_client_id)
-                        R_select_path(ship->tile, ship->path);
+                sm_ship_path();
                 break;
-
-        /* Ship changed names */
         case G_SM_SHIP_NAME:
-                if (!(ship = G_receive_ship(-1)))
-                        return;
-                N_receive_string_buf(ship->name);
-                G_count_name(G_NT_SHIP, ship->name);
-                G_ship_reselect(ship, -1);
+                sm_ship_name();
                 break;
-
-        /* Ship changed owners */
         case G_SM_SHIP_OWNER:
-                if (!(ship = G_receive_ship(-1)) ||
-                    (j = G_receive_client(-1)) < 0 ||
-                    ship->client == j)
-                        return;
-                if (ship->client == n_client_id)
-                        I_popup(&ship->model->origin,
-                                C_va(C_str("g-ship-lost", "Lost the %s!"),
-                                     ship->name));
-                else if (j == n_client_id)
-                        I_popup(&ship->model->origin,
-                                C_va(C_str("g-ship-captured",
-                                           "Captured the %s."),
-                                     ship->name));
-                ship->client = j;
-                G_ship_reselect(ship, -1);
+                sm_ship_owner();
                 break;
-
-        /* Building changed */
         case G_SM_BUILDING:
-                if (n_client_id == N_HOST_CLIENT_ID ||
-                    (i = G_receive_tile(-1)) < 0 ||
-                    (j = G_receive_range(-1, 0, G_BUILDING_TYPES)) < 0)
-                        return;
-                k = N_receive_char();
-                if (k != -2 && !N_client_valid(k)) {
-                        G_corrupt_drop(-1);
-                        return;
-                }
-                G_tile_build(i, j, k);
+                sm_building();
                 break;
 
         /* A building's cargo manifest changed */
@@ -613,29 +811,11 @@ void G_client_callback(int client, n_event_t event)
 
                 break;
 
-        /* Somebody connected but we don't have their name yet */
         case G_SM_CONNECTED:
-                if ((i = G_receive_range(-1, 0, N_CLIENTS_MAX)) < 0)
-                        return;
-                n_clients[i].connected = TRUE;
-                C_zero(g_clients + i);
-                C_debug("Client %d connected", i);
+                sm_connected();
                 break;
-
-        /* Somebody disconnected */
         case G_SM_DISCONNECTED:
-                i = N_receive_char();
-                if (i < 0 || i >= N_CLIENTS_MAX) {
-                        G_corrupt_disconnect();
-                        return;
-                }
-                k = N_receive_char();
-                n_clients[i].connected = FALSE;
-                I_print_chat(C_va(k ? C_str("g-kicked", "%s was kicked.") :
-                                      C_str("g-left", "%s left the game."),
-                                  g_clients[i].name), I_COLOR, NULL);
-                I_configure_player(i, NULL, I_COLOR, FALSE);
-                C_debug("Client %d disconnected", i);
+                sm_disconnected();
                 break;
 
         default:
@@ -644,13 +824,13 @@ void G_client_callback(int client, n_event_t event)
 }
 
 /******************************************************************************\
- Called to update client-side structures.
+ Called every tick to update client-side structures.
 \******************************************************************************/
 void G_update_client(void)
 {
-        N_poll_client();
         if (i_limbo)
                 return;
+        G_interest_send_focus();
         G_update_ships();
         G_update_buildings();
 }
@@ -661,8 +841,6 @@ void G_update_client(void)
 void G_init(void)
 {
         C_status("Initializing client");
-        g_ship_dict = PyDict_New();
-        g_building_dict = PyDict_New();
 
         G_init_elements();
         G_init_globe();
@@ -672,6 +850,14 @@ void G_init(void)
         g_name.update = (c_var_update_f)name_update;
         g_name.edit = C_VE_FUNCTION;
 
+        /* Benchmarks run when set */
+        C_var_update(&g_test_codecs, test_codecs_update);
+        C_var_update(&g_test_ships, test_ships_update);
+        C_var_update(&g_test_tiles, test_tiles_update);
+
+        /* Name messages in network statistics and set their priorities */
+        G_name_messages();
+
         /* Parse names config */
         G_load_names();
         /* Set initilized var */
@@ -683,37 +869,80 @@ void G_init(void)
 \******************************************************************************/
 void G_cleanup(void)
 {
+        G_record_stop();
+        C_wheel_cleanup(&g_timers);
         G_cleanup_ships();
         G_cleanup_tiles();
-        Py_CLEAR(g_ship_dict);
-        Py_CLEAR(g_building_dict);
         /* Set initilized var */
         g_initilized = FALSE;
 }
 
 /******************************************************************************\
- Connect to the master server and refresh game servers.
+ Collects the server list as it arrives from the master server and hands it
+ to the "refresh-servers" callback once it is complete.
 \******************************************************************************/
-void G_refresh_servers(void)
+static void servers_callback(n_event_t event, const char *text, int len)
 {
         PyObject *callback, *args, *res;
+
+        if (!servers_fetching)
+                return;
+        if (event == N_EV_MESSAGE) {
+                if (!text) {
+                        servers_failed = TRUE;
+                        return;
+                }
+                if (servers_list_len + len > servers_list_size) {
+                        if (!servers_list_size)
+                                servers_list_size = 4096;
+                        while (servers_list_len + len > servers_list_size)
+                                servers_list_size *= 2;
+                        servers_list = C_realloc(servers_list,
+                                                 servers_list_size);
+                }
+                memcpy(servers_list + servers_list_len, text, len);
+                servers_list_len += len;
+                return;
+        }
+        if (event == N_EV_CONNECT_FAILED || event == N_EV_DISCONNECTED) {
+                C_warning("Failed to fetch server list");
+                servers_failed = TRUE;
+        } else if (event != N_EV_RECEIVE_COMPLETE)
+                return;
+
+        /* Finished, one way or another */
+        callback = PyDict_GetItemString(g_callbacks, "refresh-servers");
+        if (!servers_failed && callback) {
+                args = Py_BuildValue("(s#)", servers_list ? servers_list : "",
+                                     servers_list_len);
+                res = PyObject_CallObject(callback, args);
+                if (!res)
+                        PyErr_Print();
+                Py_XDECREF(args);
+                Py_XDECREF(res);
+        }
+        C_free(servers_list);
+        servers_list = NULL;
+        servers_list_len = servers_list_size = 0;
+        servers_fetching = servers_failed = FALSE;
+}
+
+/******************************************************************************\
+ Connect to the master server and refresh game servers. The request shares
+ the connection the host uses for heartbeats.
+\******************************************************************************/
+void G_refresh_servers(void)
+{
         C_var_unlatch(&g_master);
         if (!g_master.value.s[0])
                 return;
         C_var_unlatch(&g_master_url);
-        callback = PyDict_GetItemString(g_callbacks, "refresh-servers");
-        if(!callback)
-        {
-                /* TODO: This is probably a fatal error and should be
-                 *  checked at somepoint in initilization */
+        if (servers_fetching)
                 return;
-        }
-        args = Py_BuildValue("ss", g_master.value.s, g_master_url.value.s);
-        res = PyObject_CallObject(callback, args);
-        if(!res) {
-                PyErr_Print();
-        }
-        Py_XDECREF(args);
-        Py_XDECREF(res);
+        servers_fetching = TRUE;
+        if (!N_connect_http(g_master.value.s,
+                            (n_callback_http_f)servers_callback))
+                return;
+        N_send_get(C_va("%s?format=csv", g_master_url.value.s));
 }
 
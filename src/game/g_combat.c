@@ -20,49 +20,6 @@
 /* Number of dice to roll for a boarding attack */
 #define BOARD_DICE 5
 
-/******************************************************************************\
- Check if we want to start boarding.
-\******************************************************************************/
-static void start_boarding(g_ship_t *ship)
-{
-        int i, neighbors[3];
-        g_ship_t *target_ship;
-
-        if (!ship->target_board)
-                return;
-        target_ship = ship->target_ship;
-
-        /* The target may have turned friendly in the mean time */
-        if (!G_ship_hostile(ship, target_ship->client)) {
-                ship->target_board = FALSE;
-                Py_CLEAR(ship->target_ship);
-                return;
-        }
-
-        /* The ship must be adjacent to begin boarding */
-        R_tile_neighbors(ship->tile, neighbors);
-        for (i = 0; g_tiles[neighbors[i]].ship != target_ship; i++)
-                if (i >= 2)
-                        return;
-
-        /* Start a boarding attack */
-        Py_INCREF(target_ship);
-        ship->boarding_ship = target_ship;
-        ship->boarding++;
-        ship->modified = TRUE;
-        target_ship->boarding++;
-
-        /* Host boarding announcements */
-        if (G_ship_controlled_by(ship, n_client_id))
-                I_popup(&ship->model->origin,
-                        C_va(C_str("g-boarding", "%s boarding the %s!"),
-                             target_ship->name, ship->name));
-        else if (G_ship_controlled_by(target_ship, n_client_id))
-                I_popup(&ship->model->origin,
-                        C_va(C_str("g-boarded", "%s is being boarded!"),
-                             ship->name));
-}
-
 /******************************************************************************\
  Perform a boarding attack/defend roll. Returns TRUE on victory.
 \******************************************************************************/
@@ -107,19 +64,68 @@ static bool ship_board_attack(g_ship_t *ship, g_ship_t *defender, int power)
 }
 
 /******************************************************************************\
- Update boarding mechanics.
+ Roll a round of a boarding fight. Called by the boarding ship's combat timer,
+ which is scheduled again until one side wins.
 \******************************************************************************/
-static void ship_update_board(g_ship_t *ship)
+static void ship_board(g_ship_id id)
 {
-        if (c_time_msec < ship->combat_time ||
-                        ship->boarding_ship == NULL)
+        g_ship_t *ship;
+
+        if (!(ship = G_get_ship(id)) || g_game_over ||
+            ship->boarding_ship == NULL)
                 return;
         if (ship_board_attack(ship, ship->boarding_ship, 4) ||
             ship_board_attack(ship->boarding_ship, ship, 6)) {
                 Py_CLEAR(ship->boarding_ship);
                 return;
         }
-        ship->combat_time = c_time_msec + BOARD_INTERVAL;
+        ship->combat_timer = C_wheel_schedule(&g_timers, g_time_msec,
+                                              BOARD_INTERVAL, ship_board, id);
+}
+
+/******************************************************************************\
+ Check if we want to start boarding.
+\******************************************************************************/
+static void start_boarding(g_ship_t *ship)
+{
+        int i, neighbors[3];
+        g_ship_t *target_ship;
+
+        if (!ship->target_board)
+                return;
+        target_ship = ship->target_ship;
+
+        /* The target may have turned friendly in the mean time */
+        if (!G_ship_hostile(ship, target_ship->client)) {
+                ship->target_board = FALSE;
+                Py_CLEAR(ship->target_ship);
+                return;
+        }
+
+        /* The ship must be adjacent to begin boarding */
+        R_tile_neighbors(ship->tile, neighbors);
+        for (i = 0; g_tiles[neighbors[i]].ship != target_ship; i++)
+                if (i >= 2)
+                        return;
+
+        /* Start a boarding attack */
+        Py_INCREF(target_ship);
+        ship->boarding_ship = target_ship;
+        ship->boarding++;
+        ship->modified = TRUE;
+        target_ship->boarding++;
+        ship->combat_timer = C_wheel_schedule(&g_timers, g_time_msec, 0,
+                                              ship_board, ship->id);
+
+        /* Host boarding announcements */
+        if (G_ship_controlled_by(ship, n_client_id))
+                I_popup(&ship->model->origin,
+                        C_va(C_str("g-boarding", "%s boarding the %s!"),
+                             target_ship->name, ship->name));
+        else if (G_ship_controlled_by(target_ship, n_client_id))
+                I_popup(&ship->model->origin,
+                        C_va(C_str("g-boarded", "%s is being boarded!"),
+                             ship->name));
 }
 
 /******************************************************************************\
@@ -131,11 +137,9 @@ void G_ship_update_combat(g_ship_t *ship)
         if (n_client_id != N_HOST_CLIENT_ID)
                 return;
 
-        /* In a boarding fight */
-        if (ship->boarding > 0) {
-                ship_update_board(ship);
+        /* In a boarding fight, the combat timer rolls the rounds */
+        if (ship->boarding > 0)
                 return;
-        }
 
         /* Can't start a fight or don't want to */
         if (ship->rear_tile >= 0 || !ship->target_ship ||
@@ -35,7 +35,7 @@ void G_change_nation(int index)
 {
         if (g_game_over)
                 return;
-        N_send(N_SERVER_ID, "11", G_CM_AFFILIATE, index);
+        G_send_cm_affiliate(N_SERVER_ID, index);
 }
 
 /******************************************************************************\
@@ -45,7 +45,7 @@ void G_tile_ring_callback(int icon)
 {
         if (g_selected_tile < 0 || g_game_over)
                 return;
-        N_send(N_SERVER_ID, "121", G_CM_TILE_RING, g_selected_tile, icon);
+        G_send_cm_tile_ring(N_SERVER_ID, g_selected_tile, icon);
 }
 
 /******************************************************************************\
@@ -55,8 +55,7 @@ static void ship_ring(i_ring_icon_t icon)
 {
         if (!g_selected_ship || ring_ship < 0 || g_game_over)
                 return;
-        N_send(N_SERVER_ID, "1212", G_CM_SHIP_RING, g_selected_ship->id,
-               icon, ring_ship);
+        G_send_cm_ship_ring(N_SERVER_ID, g_selected_ship->id, icon, ring_ship);
 }
 
 /******************************************************************************\
@@ -105,8 +104,8 @@ bool G_process_click(int button)
 
                 /* Ordered an ocean move */
                 if (g_hover_tile >= 0 && G_tile_open(g_hover_tile, NULL))
-                        N_send(N_SERVER_ID, "122", G_CM_SHIP_MOVE,
-                               g_selected_ship->id, g_hover_tile);
+                        G_send_cm_ship_move(N_SERVER_ID, g_selected_ship->id,
+                                            g_hover_tile);
 
                 /* Right-clicked on another ship */
                 if (g_hover_ship && g_hover_ship != g_selected_ship) {
@@ -196,15 +195,15 @@ void G_input_chat(char *message)
         color = G_nation_to_color(g_clients[n_client_id].nation);
         C_sanitize(message);
         I_print_chat(g_clients[n_client_id].name, color, message);
-        N_send(N_SERVER_ID, "1s", G_CM_CHAT, message);
+        G_send_cm_chat(N_SERVER_ID, message);
 }
 
 /******************************************************************************\
  The user has typed chat into the box and pressed the PM button
 \******************************************************************************/
-void G_input_privmsg(char *message, int clients)
+void G_input_privmsg(char *message, const c_bits_t *clients)
 {
-        int i, recipients;
+        int recipients;
         char *name;
         i_color_t color;
 
@@ -213,19 +212,14 @@ void G_input_privmsg(char *message, int clients)
         color = G_nation_to_color(g_clients[n_client_id].nation);
         C_sanitize(message);
 
-        recipients = 0;
-        for (i = 0; i < N_CLIENTS_MAX; i++) {
-                if (!(clients & (1 << i)))
-                        continue;
-                recipients++;
-        }
+        recipients = C_bits_count(clients, N_CLIENTS_MAX);
 
         name = C_va("%s -> %d recipient%s", g_clients[n_client_id].name,
                     recipients, (recipients>1) ? "s" : "");
 
         I_print_chat(name, I_COLOR, message);
 
-        N_send(N_SERVER_ID, "14s", G_CM_PRIVMSG, clients, message);
+        G_send_cm_privmsg(N_SERVER_ID, clients, message);
 }
 
 /******************************************************************************\
@@ -264,8 +258,8 @@ void G_trade_params(g_cargo_type_t index, int buy_price, int sell_price,
                 return;
 
         /* Tell the server */
-        N_send(N_SERVER_ID, "1212222", G_CM_SHIP_PRICES, g_selected_ship->id,
-               index, buy_price, sell_price, minimum, maximum);
+        G_send_cm_ship_prices(N_SERVER_ID, g_selected_ship->id, index,
+                              buy_price, sell_price, minimum, maximum);
 }
 
 /******************************************************************************\
@@ -306,8 +300,12 @@ void G_buy_cargo(g_cargo_type_t cargo, int amount)
         if (!(amount = G_limit_purchase(ship->store, store,
                                         cargo, amount, free)))
                 return;
-        N_send(N_SERVER_ID, "12212", (building) ? G_CM_BUILDING_BUY: G_CM_SHIP_BUY,
-               g_selected_ship->id, ship->trade_tile, cargo, amount);
+        if (building)
+                G_send_cm_building_buy(N_SERVER_ID, g_selected_ship->id,
+                                       ship->trade_tile, cargo, amount);
+        else
+                G_send_cm_ship_buy(N_SERVER_ID, g_selected_ship->id,
+                                   ship->trade_tile, cargo, amount);
 }
 
 /******************************************************************************\
@@ -324,8 +322,7 @@ void G_drop_cargo(g_cargo_type_t cargo, int amount)
         ship = g_selected_ship;
         if (!g_selected_ship)
                 return;
-        N_send(N_SERVER_ID, "1212", G_CM_SHIP_DROP, g_selected_ship->id,
-               cargo, amount);
+        G_send_cm_ship_drop(N_SERVER_ID, g_selected_ship->id, cargo, amount);
 }
 
 /******************************************************************************\
@@ -19,7 +19,7 @@
 
 /* Network protocol used by the client and server. Increment when no longer
    compatible before releasing a new version of the game.*/
-#define G_PROTOCOL 7
+#define G_PROTOCOL 14
 
 /* Invalid island index */
 #define G_ISLAND_INVALID 255
@@ -55,6 +55,12 @@ typedef enum {
         G_CM_SHIP_RING,
         G_CM_TILE_RING,
 
+        /* Interest management */
+        G_CM_FOCUS,
+
+        /* Side channel negotiation */
+        G_CM_UDP_READY,
+
         G_CLIENT_MESSAGES
 } g_client_msg_t;
 
@@ -65,6 +71,7 @@ typedef enum {
         /* Synchronization messages */
         G_SM_CLIENT,
         G_SM_INIT,
+        G_SM_SNAPSHOT,
 
         /* Echo request */
         G_SM_ECHO_REQUEST,
@@ -91,6 +98,8 @@ typedef enum {
         G_SM_SHIP_SPAWN,
         G_SM_SHIP_STATE,
         G_SM_SHIP_TRANSACT,
+        G_SM_SHIP_FORGET,
+        G_SM_SHIP_HINTS,
         G_SM_BUILDING,
         G_SM_BUILDING_CARGO,
         G_SM_GIB,
@@ -98,6 +107,9 @@ typedef enum {
         G_SERVER_MESSAGES
 } g_server_msg_t;
 
+/* Message codecs */
+#include "g_messages.h"
+
 /* Ship types */
 typedef enum {
         G_ST_NONE,
@@ -145,11 +157,22 @@ typedef struct g_store {
         g_cargo_t cargo[G_CARGO_TYPES];
         int modified;
         short space_used, capacity;
-        bool visible[N_CLIENTS_MAX];
+        n_client_set_t visible;
+        n_client_id_t client;
+        int building, ship;
 } g_store_t;
 
-/* Type used for ship ids */
-typedef short g_ship_id;
+/* Running totals of what each client owns. Only kept by the host. */
+typedef struct g_totals {
+        int ships, buildings, cargo[G_CARGO_TYPES];
+} g_totals_t;
+
+/* Type used for ship ids. The low bits pick a slot and the rest count how
+   many times the slot has been reused. */
+typedef int g_ship_id;
+#define G_SHIP_SLOT_BITS 16
+#define G_SHIP_SLOTS (1 << G_SHIP_SLOT_BITS)
+
 /* Structure containing ship information */
 typedef struct g_ship g_ship_t;
 struct g_ship {
@@ -158,13 +181,14 @@ struct g_ship {
         r_model_t *model;
         c_vec3_t forward;
         float progress;
-        int boarding, client, combat_time, focus_stamp, health,
-            lunch_time, rear_tile, target, tile, trade_tile;
+        int boarding, client, combat_timer, focus_stamp, food_timer, health,
+            rear_tile, target, tile, trade_tile;
         char path[R_PATH_MAX], name[G_NAME_MAX];
-        bool in_use, modified, target_board;
+        bool in_use, modified, target_board, visible_queued;
         g_ship_t *boarding_ship, *target_ship;
         g_store_t *store;
         ShipClass *class;
+        n_client_set_t known;
 };
 
 /* Structure to represent resource cost */
@@ -179,10 +203,16 @@ typedef struct g_building_class {
         int health;
 } g_building_class_t;
 
+/* Building ids are the tile the building is on in the low bits and a count
+   of the buildings built before it above them */
+#define G_BUILDING_TILE_BITS 16
+#define G_BUILDING_TILES (1 << G_BUILDING_TILE_BITS)
+
 /* Structure containing building information */
 typedef struct g_building {
         PyObject_HEAD;
-        int id;
+        struct g_building *client_prev, *client_next;
+        int id, index;
         g_building_type_t type;
         g_nation_name_t nation;
         n_client_id_t client;
@@ -190,7 +220,7 @@ typedef struct g_building {
         int gold, health;
         BuildingClass *class;
         g_store_t *store;
-        bool modified;
+        bool modified, queued;
         int tile;
 } g_building_t;
 
@@ -201,21 +231,27 @@ typedef struct g_gib {
         r_model_t *model;
 } g_gib_t;
 
-/* A tile on the globe */
+/* A tile on the globe. State that loops over every tile need is kept in
+   parallel arrays instead so that they only touch what they use. */
 typedef struct g_tile {
         g_building_t *building;
         g_gib_t *gib;
-        int island, search_parent, search_stamp;
         g_ship_t *ship;
-        bool visible;
+        int island;
 } g_tile_t;
 
+/* Pathfinding scratch space for a tile. The parent is only valid if the
+   stamp is that of the current search. */
+typedef struct g_search {
+        int parent, stamp;
+} g_search_t;
+
 /* Structure for each player */
 typedef struct g_client {
-        int gold, nation, ships, buildings;
+        int gold, nation;
         char name[G_NAME_MAX];
         bool kicked;
-        int echo_time, echo_data;
+        int echo_time, echo_data, focus_tile;
         short ping_time;
 } g_client_t;
 
@@ -258,11 +294,29 @@ extern g_island_t g_islands[G_ISLAND_NUM];
 extern int g_islands_len;
 
 /* g_host.c */
+void G_poll_host(void);
+void G_server_callback(int client, n_event_t);
+
+extern c_wheel_t g_timers;
 extern bool g_host_inited;
 
+/* g_interest.c */
+void G_init_interest(int subdiv4);
+void G_interest_focus(int tile);
+void G_interest_reset_client(n_client_id_t);
+void G_interest_send_focus(void);
+void G_interest_update_ship(g_ship_t *ship);
+n_client_id_t G_ship_route(const g_ship_t *ship, n_client_id_t);
+void G_update_interest(void);
+
+extern int g_focus_tile;
+
 /* g_movement.c */
 bool G_ship_move_to(g_ship_t *ship, int new_tile);
+void G_receive_ship_hints(void);
+void G_send_ship_hints(void);
 void G_ship_path(g_ship_t *ship, int target);
+void G_position_ships(void);
 void G_ship_send_path(g_ship_t *ship, n_client_id_t client);
 void G_ship_update_move(g_ship_t *ship);
 
@@ -273,15 +327,29 @@ void G_get_name(g_name_type_t, char *buffer, int buffer_size);
 void G_load_names(void);
 void G_reset_name_counts(void);
 
+/* g_record.c */
+void G_record_event(n_client_id_t, n_event_t);
+void G_record_frame(void);
+void G_record_polled(void);
+void G_record_start(void);
+void G_record_stop(void);
+
+extern bool g_replaying;
+
 /* g_ship.c */
 void G_cleanup_ships(void);
 void G_focus_next_ship(void);
+g_ship_t *G_get_ship(g_ship_id);
 bool G_ship_can_trade_with(g_ship_t *ship, int tile);
 void G_ship_change_client(g_ship_t *ship, n_client_id_t client);
 void G_ship_collect_gib(g_ship_t *ship);
 bool G_ship_controlled_by(g_ship_t *ship, n_client_id_t);
 void G_ship_drop_cargo(g_ship_t *ship, g_cargo_type_t type, int amount);
+void G_ship_feed(g_ship_t *ship);
+void G_ship_forget(g_ship_t *ship);
 bool G_ship_hostile(g_ship_t *ship, n_client_id_t to);
+void G_ship_queue_visible(g_ship_t *ship);
+void G_ship_set_client(g_ship_t *ship, n_client_id_t);
 void G_ship_hover(g_ship_t *ship);
 void G_ship_reselect(g_ship_t *ship, n_client_id_t);
 void G_ship_select(g_ship_t *ship);
@@ -296,15 +364,34 @@ void G_update_ships(void);
 ShipClass *G_ship_class_from_ring_id(i_ring_icon_t id);
 int G_ship_class_index_from_ring_id(i_ring_icon_t id);
 void G_ship_update_trade_ui(g_ship_t *ship);
+void G_test_ships(int count);
 
-#define G_get_ship(i) \
-        ((g_ship_t*)PyDict_GetItemString(g_ship_dict, C_va("%hd", i)))
-#define G_set_ship(i, s) \
-        PyDict_SetItemString(g_ship_dict, C_va("%hd", i), (PyObject*)s)
-extern PyObject *g_ship_dict;
-extern g_ship_t *g_hover_ship, *g_selected_ship;
+extern g_ship_t **g_ships, *g_hover_ship, *g_selected_ship;
+extern int g_ships_len;
+
+/* g_snapshot.c */
+void G_receive_snapshot(void);
+void G_snapshot_begin(n_client_id_t);
+void G_snapshot_end(n_client_id_t);
+void G_update_snapshots(void);
 
 /* g_sync.c */
+#define G_check_cargo(c, v) G_check_range((c), (v), 0, G_CARGO_TYPES)
+#define G_check_client(c, v) G_check_client_full(__FILE__, __LINE__, \
+                                                 __func__, (c), (v))
+bool G_check_client_full(const char *file, int line, const char *func,
+                         n_client_id_t, int index);
+#define G_check_nation(c, v) G_check_range((c), (v), 0, G_NATION_NAMES)
+#define G_check_range(c, v, min, max) \
+        G_check_range_full(__FILE__, __LINE__, __func__, (c), (v), (min), (max))
+bool G_check_range_full(const char *file, int line, const char *func,
+                        n_client_id_t, int index, int min, int max);
+g_ship_t *G_check_ship(int id);
+#define G_check_tile(c, v) G_check_tile_full(__FILE__, __LINE__, __func__, \
+                                             (c), (v))
+bool G_check_tile_full(const char *file, int line, const char *func,
+                       n_client_id_t, int index);
+void G_name_messages(void);
 #define G_corrupt_disconnect() G_corrupt_drop(N_SERVER_ID)
 #define G_corrupt_drop(c) G_corrupt_drop_full(__FILE__, __LINE__, __func__, c)
 void G_corrupt_drop_full(const char *file, int line, const char *func,
@@ -329,10 +416,14 @@ int G_receive_tile_full(const char *file, int line, const char *func,
         G_receive_building_full(__FILE__, __LINE__, __func__, (c))
 g_building_t *G_receive_building_full(const char *file, int line,
                                       const char *func, int nation);
+void G_test_codecs(int iterations);
 
 /* g_tile.c */
+void G_building_queue_update(g_building_t *);
 void G_cleanup_tiles(void);
-void G_tile_build(int tile, int, n_client_id_t);
+g_building_t *G_get_building(int id);
+void G_reset_open_tiles(void);
+void G_tile_build(int tile, int id, int, n_client_id_t);
 BuildingClass *G_building_class_from_ring_id(i_ring_icon_t id);
 int G_building_class_index_from_ring_id(i_ring_icon_t id);
 int G_tile_gib(int tile, g_gib_type_t);
@@ -341,22 +432,29 @@ void G_tile_hover(int tile);
 void G_tile_select(int tile);
 void G_tile_send_building(int tile, n_client_id_t);
 void G_tile_send_gib(int tile, n_client_id_t);
+void G_tile_set_ship(int tile, g_ship_t *);
+#define G_tile_search(t) (g_tiles_search + (t))
+#define G_tile_set_visible(t, v) (g_tiles_visible[t] = (v))
+#define G_tile_visible(t) g_tiles_visible[t]
 bool G_tile_open(int tile, g_ship_t *exclude_ship);
 void G_tile_position_model(int tile, r_model_t *);
 void G_update_buildings(void);
 int G_random_open_tile(void);
-
-#define G_get_building(i) ((g_building_t*)PyDict_GetItemString(g_building_dict,\
-                                                       C_va("%d", i)))
-#define G_set_building(i, s) PyDict_SetItemString(g_building_dict, \
-                                                  C_va("%d", i), (PyObject*)s)
+void G_test_tiles(int passes);
 
 #define G_get_building_class(i) \
         ((BuildingClass*)PyList_GET_ITEM(g_building_class_list, i))
 
 extern g_tile_t g_tiles[R_TILES_MAX];
-extern int g_gibs, g_hover_tile, g_selected_tile;
-extern PyObject *g_building_dict;
+extern g_search_t g_tiles_search[R_TILES_MAX];
+extern bool g_tiles_visible[R_TILES_MAX];
+extern g_building_t *g_buildings[R_TILES_MAX],
+                    *g_client_buildings[N_CLIENTS_MAX];
+extern int g_buildings_len, g_gibs, g_hover_tile, g_selected_tile;
+
+/* g_tick.c */
+extern int g_tick_usec, g_time_msec;
+extern float g_tick_alpha, g_tick_sec;
 
 /* g_trade.c */
 int G_build_time(const g_cost_t *);
@@ -372,9 +470,13 @@ int G_store_fits(const g_store_t *, g_cargo_type_t);
 g_store_t *G_store_init(int capacity);
 void G_store_receive(g_store_t *, bool ignore_prices);
 void G_store_select_clients(const g_store_t *);
+bool G_store_select_new(const g_store_t *, const c_bits_t *old_visible);
 void G_store_send(g_store_t *, bool force);
+void G_store_set_client(g_store_t *, n_client_id_t);
 int G_store_space(g_store_t *);
 
+extern g_totals_t g_totals[N_CLIENTS_MAX + 1];
+
 /* g_classes.c */
 int Store_init(g_store_t *, PyObject *);
 PyObject *Store_new(PyTypeObject *, PyObject *, PyObject *);
@@ -386,13 +488,19 @@ PyTypeObject ShipType;
 int G_building_init(g_building_t *, PyObject *);
 PyObject *G_building_new(PyTypeObject *, PyObject *, PyObject *);
 PyTypeObject G_building_type;
+PyObject *G_buildings_view_new(void);
+PyObject *G_ships_view_new(void);
+PyTypeObject G_view_type;
 
 /* g_variables.c */
-extern c_var_t g_forest, g_debug_net, g_globe_seed, g_globe_subdiv4,
-               g_island_num, g_island_size, g_island_variance,
+extern c_var_t g_forest, g_debug_net, g_debug_totals, g_globe_seed,
+               g_globe_subdiv4, g_island_num, g_island_size, g_island_variance,
                g_master, g_master_url, g_name, g_nation_colors[G_NATION_NAMES],
-               g_players, g_test_globe, g_time_limit, g_victory_gold,
-               g_player_ship_limit, g_player_building_limit, g_echo_rate;
+               g_players, g_show_ticks, g_test_codecs, g_test_globe,
+               g_test_ships, g_test_tiles, g_tick_rate,
+               g_time_limit, g_victory_gold, g_player_ship_limit,
+               g_player_building_limit,
+               g_echo_rate, g_interest_radius, g_record;
 
 /* game api */
 extern PyObject *g_callbacks;
@@ -138,6 +138,7 @@ void G_reset_elements(void)
 
         g_host_inited = FALSE;
         g_game_over = FALSE;
+        C_wheel_cleanup(&g_timers);
         G_cleanup_ships();
         G_cleanup_tiles();
 
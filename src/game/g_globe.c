@@ -323,10 +323,14 @@ void G_generate_globe(int subdiv4, int override_islands, int override_size,
                 variance = override_variance;
         grow_islands(islands, island_size, variance);
         sanitise_terrain();
+        G_reset_open_tiles();
 
         /* This call actually raises the tiles to match terrain height */
         R_configure_globe();
 
+        /* Divide the globe into patches for interest management */
+        G_init_interest(subdiv4);
+
         /* Deselect everything */
         g_hover_tile = g_selected_tile = -1;
         Py_CLEAR(g_hover_ship);
@@ -407,7 +411,8 @@ void G_render_globe(void)
         /* Render tile models */
 //        R_start_globe();
         for (i = 0; i < r_tiles_max; i++) {
-                g_tiles[i].visible = is_visible(r_tiles[i].origin);
+                G_tile_set_visible(i, is_visible(r_tiles[i].origin));
+                G_interest_focus(i);
 
                 /* Render the tile's building */
                 if ((building = g_tiles[i].building)) {
@@ -513,7 +518,7 @@ void G_mouse_ray(c_vec3_t origin, c_vec3_t forward)
         int i, tile;
 
         /* We can quit early if the hover tile is still being hovered over */
-        if (g_hover_tile >= 0 && g_tiles[g_hover_tile].visible &&
+        if (g_hover_tile >= 0 && G_tile_visible(g_hover_tile) &&
             ray_intersects_tile(origin, forward, g_hover_tile)) {
                 G_tile_hover(g_hover_tile);
                 return;
@@ -521,7 +526,7 @@ void G_mouse_ray(c_vec3_t origin, c_vec3_t forward)
 
         /* Iterate over all visible tiles to find the selected tile */
         for (i = 0, tile = -1, tile_z = 0.f; i < r_tiles_max; i++) {
-                if (!g_tiles[i].visible ||
+                if (!G_tile_visible(i) ||
                     !ray_intersects_tile(origin, forward, i))
                         continue;
 
@@ -21,6 +21,16 @@
 /* Milliseconds between master server heartbeats */
 #define PUBLISH_INTERVAL 300000
 
+/* Milliseconds before retrying a heartbeat that did not get through. The
+   delay doubles with each failure up to the maximum, at which point a dead
+   heartbeat is given up on. */
+#define PUBLISH_RETRY 2000
+#define PUBLISH_RETRY_MAX 64000
+
+/* Milliseconds between checks for the end of the game and between client
+   gold and ping updates */
+#define CHECK_INTERVAL 1000
+
 /* This game's client limit */
 int g_clients_max;
 
@@ -30,21 +40,34 @@ bool g_host_inited;
 /* Time at which game ends */
 int g_time_limit_msec;
 
+/* Timers the host runs the game on. Keys are ship ids for ship timers. */
+c_wheel_t g_timers;
+
+/* Master server heartbeat state */
+static int publish_time, publish_retry;
+static bool alive_sending, dead_sending, publish_dead;
+
 /******************************************************************************\
  Client has sent back our echo
 \******************************************************************************/
 static void cm_echo_back(int client)
 {
-        int echo_data, round_trip_time;
-        echo_data = N_receive_int();
-        if (g_clients[client].echo_data != echo_data) {
+        g_cm_echo_back_t msg;
+        int round_trip_time;
+
+        if (!G_receive_cm_echo_back(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        if (g_clients[client].echo_data != msg.echo_data) {
                 C_debug("Client '%s' (%d) sent non-matching echo data, "
                         "wanted: %d got: %d", g_clients[client].name, client,
-                        g_clients[client].echo_data, echo_data);
+                        g_clients[client].echo_data, msg.echo_data);
                 /* Drop them? */
         }
         round_trip_time = c_time_msec - g_clients[client].echo_time;
         g_clients[client].ping_time = round_trip_time;
+        N_stats_rtt(client, round_trip_time);
         C_debug("Reply from Client '%s' (%d) ping time: %d msec",
                 g_clients[client].name, client, round_trip_time);
 
@@ -55,11 +78,16 @@ static void cm_echo_back(int client)
 \******************************************************************************/
 static void cm_affiliate(int client)
 {
+        g_cm_affiliate_t msg;
         g_ship_t *ship;
         int nation, old, tile;
 
-        if ((nation = G_receive_nation(client)) < 0 ||
-            nation == g_clients[client].nation)
+        if (!G_receive_cm_affiliate(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        if (!G_check_nation(client, msg.nation) ||
+            (nation = msg.nation) == g_clients[client].nation)
                 return;
         old = g_clients[client].nation;
 
@@ -81,7 +109,7 @@ static void cm_affiliate(int client)
                 G_store_add(ship->store, G_CT_RATIONS, 25);
         }
 
-        N_broadcast("1112", G_SM_AFFILIATE, client, nation, tile);
+        G_send_sm_affiliate(N_BROADCAST_ID, client, nation, tile);
 }
 
 /******************************************************************************\
@@ -89,15 +117,19 @@ static void cm_affiliate(int client)
 \******************************************************************************/
 static void cm_ship_move(int client)
 {
-        int tile;
+        g_cm_ship_move_t msg;
         g_ship_t *ship;
 
-        if (!(ship = G_receive_ship(client)) ||
-            (tile = G_receive_tile(client)) < 0 ||
+        if (!G_receive_cm_ship_move(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        if (!(ship = G_check_ship(msg.id)) ||
+            !G_check_tile(client, msg.tile) ||
             !G_ship_controlled_by(ship, client))
                 return;
         Py_CLEAR(ship->target_ship);
-        G_ship_path(ship, tile);
+        G_ship_path(ship, msg.tile);
 }
 
 /******************************************************************************\
@@ -105,10 +137,15 @@ static void cm_ship_move(int client)
 \******************************************************************************/
 static void cm_name(int client)
 {
+        g_cm_name_t msg;
         int i, suffixes, name_len;
         char name_buf[G_NAME_MAX];
 
-        N_receive_string_buf(name_buf);
+        if (!G_receive_cm_name(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        C_strncpy_buf(name_buf, msg.name);
 
         /* Must have a valid name */
         C_sanitize(name_buf);
@@ -140,7 +177,7 @@ static void cm_name(int client)
 
         C_debug("Client '%s' (%d) renamed to '%s'",
                 g_clients[client].name, client, name_buf);
-        N_broadcast("11s", G_SM_NAME, client, name_buf);
+        G_send_sm_name(N_BROADCAST_ID, client, name_buf);
 }
 
 /******************************************************************************\
@@ -148,19 +185,23 @@ static void cm_name(int client)
 \******************************************************************************/
 static void cm_ship_name(int client)
 {
+        g_cm_ship_name_t msg;
         g_ship_t *ship;
         char new_name[G_NAME_MAX];
 
-        if (!(ship = G_receive_ship(client)) ||
+        if (!G_receive_cm_ship_name(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        if (!(ship = G_check_ship(msg.id)) ||
             !G_ship_controlled_by(ship, client))
                 return;
-        N_receive_string_buf(new_name);
+        C_strncpy_buf(new_name, msg.name);
         C_sanitize(new_name);
         if (!new_name[0])
                 return;
         C_strncpy_buf(ship->name, new_name);
-        N_broadcast_except(client, "12s", G_SM_SHIP_NAME, ship->id,
-                           ship->name);
+        G_ship_send_name(ship, N_EXCEPT_ID(client));
         C_debug("'%s' named ship %d '%s'", g_clients[client].name,
                 ship->id, new_name);
 }
@@ -170,41 +211,37 @@ static void cm_ship_name(int client)
 \******************************************************************************/
 static void cm_ship_prices(int client)
 {
+        g_cm_ship_prices_t msg;
         g_ship_t *ship;
-        int cargo, buy_price, sell_price, minimum, maximum;
 
-        if (!(ship = G_receive_ship(client)) ||
-            !G_ship_controlled_by(ship, client))
-                return;
-        cargo = N_receive_char();
-        if (cargo < 0 || cargo >= G_CARGO_TYPES) {
+        if (!G_receive_cm_ship_prices(&msg)) {
                 G_corrupt_drop(client);
                 return;
         }
+        if (!(ship = G_check_ship(msg.id)) ||
+            !G_ship_controlled_by(ship, client) ||
+            !G_check_cargo(client, msg.cargo))
+                return;
 
         /* Prices */
-        buy_price = N_receive_short();
-        sell_price = N_receive_short();
-        if (buy_price > 999)
-                buy_price = 999;
-        if (sell_price > 999)
-                sell_price = 999;
-
-        /* Quantities */
-        minimum = N_receive_short();
-        maximum = N_receive_short();
-
-        /* Select clients that can see this store */
+        if (msg.buy_price > 999)
+                msg.buy_price = 999;
+        if (msg.sell_price > 999)
+                msg.sell_price = 999;
+
+        /* Select clients that know about the ship and can see this store */
         G_store_select_clients(ship->store);
+        C_bits_and(n_selected, ship->known, N_CLIENTS_MAX);
 
         /* The host needs to see this message to process the update */
-        n_clients[N_HOST_CLIENT_ID].selected = TRUE;
+        C_bit_set(n_selected, N_HOST_CLIENT_ID, TRUE);
 
         /* Originating client already knows what the prices are */
-        n_clients[client].selected = FALSE;
+        C_bit_set(n_selected, client, FALSE);
 
-        N_send_selected("1212222", G_SM_SHIP_PRICES, ship->id, cargo,
-                        buy_price, sell_price, minimum, maximum);
+        G_send_sm_ship_prices(N_SELECTED_ID, ship->id, msg.cargo,
+                              msg.buy_price, msg.sell_price, msg.minimum,
+                              msg.maximum);
 }
 
 /******************************************************************************\
@@ -212,18 +249,25 @@ static void cm_ship_prices(int client)
 \******************************************************************************/
 static void cm_ship_buy(int client)
 {
+        g_cm_ship_buy_t msg;
         g_ship_t *ship, *partner;
         g_store_t *buyer, *seller;
         int trade_tile, cargo, amount, gold;
         bool free;
 
-        if (!(ship = G_receive_ship(client)) ||
-            (trade_tile = G_receive_tile(client)) < 0 ||
-            (cargo = G_receive_cargo(client)) < 0 ||
+        if (!G_receive_cm_ship_buy(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        trade_tile = msg.tile;
+        cargo = msg.cargo;
+        amount = msg.amount;
+        if (!(ship = G_check_ship(msg.id)) ||
+            !G_check_tile(client, trade_tile) ||
+            !G_check_cargo(client, cargo) ||
             !G_ship_controlled_by(ship, client) ||
             !G_ship_can_trade_with(ship, trade_tile))
                 return;
-        amount = N_receive_short();
         partner = g_tiles[trade_tile].ship;
         free = ship->client == partner->client;
         buyer = ship->store;
@@ -255,18 +299,25 @@ static void cm_ship_buy(int client)
 \******************************************************************************/
 static void cm_building_buy(int client)
 {
+        g_cm_building_buy_t msg;
         g_ship_t *ship;
         g_building_t *partner;
         g_store_t *buyer, *seller;
         int trade_tile, cargo, amount;
 
-        if (!(ship = G_receive_ship(client)) ||
-            (trade_tile = G_receive_tile(client)) < 0 ||
-            (cargo = G_receive_cargo(client)) < 0 ||
+        if (!G_receive_cm_building_buy(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        trade_tile = msg.tile;
+        cargo = msg.cargo;
+        amount = msg.amount;
+        if (!(ship = G_check_ship(msg.id)) ||
+            !G_check_tile(client, trade_tile) ||
+            !G_check_cargo(client, cargo) ||
             !G_ship_controlled_by(ship, client) ||
             !G_ship_can_trade_with(ship, trade_tile))
                 return;
-        amount = N_receive_short();
         partner = g_tiles[trade_tile].building;
         buyer = ship->store;
         seller = partner->store;
@@ -291,15 +342,18 @@ static void cm_building_buy(int client)
 \******************************************************************************/
 static void cm_ship_drop(int client)
 {
+        g_cm_ship_drop_t msg;
         g_ship_t *ship;
-        int cargo, amount;
 
-        if (!(ship = G_receive_ship(client)) ||
-            (cargo = G_receive_cargo(client)) < 0 ||
-            !G_ship_controlled_by(ship, client) ||
-            (amount = N_receive_short()) < 0)
+        if (!G_receive_cm_ship_drop(&msg)) {
+                G_corrupt_drop(client);
                 return;
-        G_ship_drop_cargo(ship, cargo, amount);
+        }
+        if (!(ship = G_check_ship(msg.id)) ||
+            !G_check_cargo(client, msg.cargo) ||
+            !G_ship_controlled_by(ship, client) || msg.amount < 0)
+                return;
+        G_ship_drop_cargo(ship, msg.cargo, msg.amount);
 }
 
 /******************************************************************************\
@@ -307,14 +361,18 @@ static void cm_ship_drop(int client)
 \******************************************************************************/
 static void cm_chat(int client)
 {
+        g_cm_chat_t msg;
         char chat_buffer[N_SYNC_MAX];
 
-        N_receive_string_buf(chat_buffer);
-
+        if (!G_receive_cm_chat(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        C_strncpy_buf(chat_buffer, msg.message);
         C_sanitize(chat_buffer);
         if (!chat_buffer[0])
                 return;
-        N_broadcast_except(client, "11s", G_SM_CHAT, client, chat_buffer);
+        G_send_sm_chat(N_EXCEPT_ID(client), client, chat_buffer);
 }
 
 /******************************************************************************\
@@ -322,19 +380,51 @@ static void cm_chat(int client)
 \******************************************************************************/
 static void cm_privmsg(int client)
 {
+        g_cm_privmsg_t msg;
         char chat_buffer[N_SYNC_MAX];
-        int i ,clients;
 
-        clients = N_receive_int();
-
-        N_receive_string_buf(chat_buffer);
+        if (!G_receive_cm_privmsg(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        C_strncpy_buf(chat_buffer, msg.message);
         C_sanitize(chat_buffer);
         if (!chat_buffer[0])
                 return;
-        for (i = 0; i < N_CLIENTS_MAX; i++)
-                n_clients[i].selected = (clients & (1 << i)) ? TRUE : FALSE;
-        n_clients[client].selected = FALSE;
-        N_send_selected("114s", G_SM_PRIVMSG, client, clients, chat_buffer);
+        memcpy(n_selected, msg.clients, sizeof (n_selected));
+        C_bit_set(n_selected, client, FALSE);
+        G_send_sm_privmsg(N_SELECTED_ID, client, msg.clients, chat_buffer);
+}
+
+/******************************************************************************\
+ Client reported where its camera is looking.
+\******************************************************************************/
+static void cm_focus(int client)
+{
+        g_cm_focus_t msg;
+
+        if (!G_receive_cm_focus(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        if (!G_check_tile(client, msg.tile))
+                return;
+        g_clients[client].focus_tile = msg.tile;
+}
+
+/******************************************************************************\
+ Client can hear our datagrams, movement hints can go over UDP now.
+\******************************************************************************/
+static void cm_udp_ready(int client)
+{
+        g_cm_udp_ready_t msg;
+
+        if (!G_receive_cm_udp_ready(&msg)) {
+                G_corrupt_drop(client);
+                return;
+        }
+        if (msg.udp_token == N_udp_token(client))
+                N_udp_confirm(client);
 }
 
 /******************************************************************************\
@@ -343,14 +433,20 @@ static void cm_privmsg(int client)
 static void cm_tile_ring(int client)
 {
 //        g_building_class_t *bc;
+        g_cm_tile_ring_t msg;
         BuildingClass *bc;
         i_ring_icon_t icon;
         int tile;
 
-        tile = G_receive_tile(client);
-        icon = (i_ring_icon_t)G_receive_range(client, 0, I_RING_ICONS);
-        if (tile < 0 || icon < 0)
+        if (!G_receive_cm_tile_ring(&msg)) {
+                G_corrupt_drop(client);
                 return;
+        }
+        if (!G_check_tile(client, msg.tile) ||
+            !G_check_range(client, msg.icon, 0, I_RING_ICONS))
+                return;
+        tile = msg.tile;
+        icon = (i_ring_icon_t)msg.icon;
 
         /* Client wants to build a shipyard (tech preview) */
         bc = G_building_class_from_ring_id(icon);
@@ -365,33 +461,18 @@ static void cm_tile_ring(int client)
                 if (!G_pay(client, tile, &cost, FALSE))
                         return;
                 /* Building limits */
-                if(n_client_id == N_HOST_CLIENT_ID) {
-                        int buildings, limit;
-                        g_building_t *building;
-                        PyObject *key;
-                        Py_ssize_t pos = 0;
-                        buildings = 0;
-                        limit = g_player_building_limit.value.n;
-                        /* Count ships */
-                        while (PyDict_Next(g_building_dict, &pos, &key,
-                                           (PyObject**)&building)) {
-                                if(building->health <= 0 ||
-                                   client != building->client)
-                                        continue;
-                                buildings++;
-                        }
-                        if (buildings >= limit) {
-                                N_send(client, "12ss", G_SM_POPUP, tile,
-                                       "g-building-limit",
-                                       "You have reached the maximum number of "
-                                       "buildings");
-                                return;
-                        }
+                if (n_client_id == N_HOST_CLIENT_ID &&
+                    g_totals[client].buildings >=
+                    g_player_building_limit.value.n) {
+                        G_send_sm_popup(client, tile, "g-building-limit",
+                                        "You have reached the maximum number "
+                                        "of buildings");
+                        return;
                 }
 
                 /* Pay for and build the town hall */
                 G_pay(client, tile, &cost, TRUE);
-                G_tile_build(tile, building_id, client);
+                G_tile_build(tile, -1, building_id, client);
                 return;
         }
 
@@ -429,14 +510,19 @@ static void cm_tile_ring(int client)
 \******************************************************************************/
 static void cm_ship_ring(int client)
 {
+        g_cm_ship_ring_t msg;
         i_ring_icon_t icon;
         g_ship_t *ship, *target_ship;
 
-        if (!(ship = G_receive_ship(client)))
+        if (!G_receive_cm_ship_ring(&msg)) {
+                G_corrupt_drop(client);
                 return;
-        icon = (i_ring_icon_t)G_receive_range(client, 0, I_RING_ICONS);
-        if (!(target_ship = G_receive_ship(client)))
+        }
+        if (!(ship = G_check_ship(msg.id)) ||
+            !G_check_range(client, msg.icon, 0, I_RING_ICONS) ||
+            !(target_ship = G_check_ship(msg.target)))
                 return;
+        icon = (i_ring_icon_t)msg.icon;
 
         /* Follow the target */
         if (icon == I_RI_FOLLOW)
@@ -459,15 +545,55 @@ static void cm_ship_ring(int client)
 }
 
 /******************************************************************************\
- Initialize a new client.
+ Send the globe and everything on it to [client].
 \******************************************************************************/
-static void init_client(int client)
+static void send_world(int client)
 {
-        g_ship_t *ship;
-        PyObject *key;
-        Py_ssize_t pos = 0;
         int i;
 
+        /* Communicate the globe info */
+        G_send_sm_init(client, G_PROTOCOL, client, g_clients_max,
+                       g_globe_subdiv4.value.n, g_globe_seed.value.n,
+                       g_island_num.value.n, g_island_size.value.n,
+                       g_island_variance.value.f, r_solar_angle,
+                       g_time_limit_msec - c_time_msec, N_udp_token(client));
+
+        /* Everything else goes into the world snapshot */
+        G_snapshot_begin(client);
+
+        /* Tell them about everyone already here. Clients that have not
+           named themselves yet are only known to be connected. */
+        for (i = 0; i < N_CLIENTS_MAX; i++) {
+                if (!n_clients[i].connected)
+                        continue;
+                if (g_clients[i].name[0])
+                        G_send_sm_client(client, i, g_clients[i].nation,
+                                         g_clients[i].name);
+                else if (i != client)
+                        G_send_sm_connected(client, i);
+        }
+
+        /* Tell them about the buildings and gibs on them globe */
+        for (i = 0; i < r_tiles_max; i++) {
+                if (g_tiles[i].building)
+                        G_tile_send_building(i, client);
+                if (g_tiles[i].gib)
+                        G_tile_send_gib(i, client);
+        }
+
+        /* Ships are sent as the client becomes interested in them, including
+           any it is interested in right away */
+        G_interest_reset_client(client);
+        G_update_interest();
+
+        G_snapshot_end(client);
+}
+
+/******************************************************************************\
+ Initialize a new client.
+\******************************************************************************/
+static void init_client(int client)
+{
         /* The server already has all of the information */
         if (client == N_HOST_CLIENT_ID)
                 return;
@@ -475,82 +601,112 @@ static void init_client(int client)
         /* This client has already been counted toward the total, kick them
            if this is more players than we want */
         if (n_clients_num > g_clients_max) {
-                N_send(client, "12ss", G_SM_POPUP,
-                       "g-host-full", "Server is full.");
+                G_send_sm_popup(client, -1, "g-host-full", "Server is full.");
                 N_drop_client(client);
                 return;
         }
 
         C_debug("Initializing client %d", client);
         C_zero(g_clients + client);
+        send_world(client);
+}
 
-        /* Communicate the globe info */
-        N_send(client, "12111422ff4", G_SM_INIT, G_PROTOCOL, client,
-               g_clients_max, g_globe_subdiv4.value.n, g_globe_seed.value.n,
-               g_island_num.value.n, g_island_size.value.n,
-               g_island_variance.value.f, r_solar_angle,
-               g_time_limit_msec - c_time_msec);
-
-        /* Tell them about everyone already here */
-        for (i = 0; i < N_CLIENTS_MAX; i++)
-                if (n_clients[i].connected && g_clients[i].name[0])
-                        N_send(client, "111s", G_SM_CLIENT, i,
-                               g_clients[i].nation, g_clients[i].name);
-
-        /* Tell them about the buildings and gibs on them globe */
-        for (i = 0; i < r_tiles_max; i++) {
-                if (g_tiles[i].building)
-                        G_tile_send_building(i, client);
-                if (g_tiles[i].gib)
-                        G_tile_send_gib(i, client);
-        }
+/******************************************************************************\
+ A heartbeat did not get through, try again later with a longer delay.
+ Returns FALSE once the delay has reached its maximum.
+\******************************************************************************/
+static bool publish_failed(void)
+{
+        bool capped;
+
+        publish_retry = publish_retry ? 2 * publish_retry : PUBLISH_RETRY;
+        if ((capped = publish_retry > PUBLISH_RETRY_MAX))
+                publish_retry = PUBLISH_RETRY_MAX;
+        publish_time = c_time_msec + publish_retry;
+        C_debug("Failed to reach master server, retrying in %d sec",
+                publish_retry / 1000);
+        return !capped;
+}
 
-        /* Tell them about all the ships on the globe */
-        while (PyDict_Next(g_ship_dict, &pos, &key, (PyObject**)&ship)) {
-                if (!ship->in_use)
-                        continue;
-                G_ship_send_spawn(ship, client);
-                G_ship_send_name(ship, client);
-                if (!ship->modified)
-                        G_ship_send_state(ship, client);
-                G_ship_send_path(ship, client);
+/******************************************************************************\
+ Callback for the heartbeats sent while the game is alive.
+\******************************************************************************/
+static void alive_callback(n_event_t event, const char *text, int len)
+{
+        if (!alive_sending)
+                return;
+        if (event == N_EV_RECEIVE_COMPLETE) {
+                C_debug("Sent heartbeat to master server");
+                alive_sending = FALSE;
+                publish_retry = 0;
+        } else if (event == N_EV_CONNECT_FAILED ||
+                   event == N_EV_DISCONNECTED) {
+                alive_sending = FALSE;
+                publish_failed();
         }
 }
 
 /******************************************************************************\
- Publish callback function.
+ Callback for the heartbeat that tells the master server the game is over.
 \******************************************************************************/
-static void publish_callback(n_event_t event, const char *text, int len)
+static void dead_callback(n_event_t event, const char *text, int len)
 {
-        if (event == N_EV_SEND_COMPLETE) {
-                C_debug("Sent heartbeat to master server");
-                N_disconnect_http();
+        if (!dead_sending)
+                return;
+        if (event == N_EV_RECEIVE_COMPLETE) {
+                C_debug("Told master server the game is over");
+                dead_sending = publish_dead = FALSE;
+                publish_retry = 0;
+        } else if (event == N_EV_CONNECT_FAILED ||
+                   event == N_EV_DISCONNECTED) {
+                dead_sending = FALSE;
+                if (!publish_failed()) {
+                        C_debug("Gave up informing master server");
+                        publish_dead = FALSE;
+                }
         }
 }
 
 /******************************************************************************\
- Inform the master server that our game is over.
+ Connect to the master server unless it is already connected. Returns FALSE
+ if there is no master server or connecting failed right away, in which case
+ the callback has already been told. The heartbeat is queued after this
+ returns and goes out once the connection is made.
 \******************************************************************************/
-static void publish_game_dead(void)
+static bool publish_connect(n_callback_http_f callback)
 {
         /* Disable if blank master server name */
         C_var_unlatch(&g_master);
         if (!*g_master.value.s)
-                return;
+                return FALSE;
         C_var_unlatch(&g_master_url);
+        return N_connect_http(g_master.value.s, callback);
+}
 
-        /* Wait on this connection so we make sure we get the dead hearbeat
-           out if the game quit */
-        if (!N_connect_http_wait(g_master.value.s,
-                                 (n_callback_http_f)publish_callback)) {
-                C_debug("Failed to connect to master server");
+/******************************************************************************\
+ Inform the master server that our game is over.
+\******************************************************************************/
+static void send_game_dead(void)
+{
+        dead_sending = TRUE;
+        if (!publish_connect((n_callback_http_f)dead_callback)) {
+                if (dead_sending)
+                        publish_dead = dead_sending = FALSE;
                 return;
         }
 
         /* Since we are no longer alive, send invalid values */
         N_send_post(g_master_url.value.s,
                     "port", C_va("%d", n_port.value.n));
-        N_poll_http();
+}
+
+static void publish_game_dead(void)
+{
+        if (g_replaying)
+                return;
+        publish_dead = TRUE;
+        publish_retry = 0;
+        send_game_dead();
 }
 
 /******************************************************************************\
@@ -559,21 +715,22 @@ static void publish_game_dead(void)
 \******************************************************************************/
 static void publish_game_alive(bool force)
 {
-        static int publish_time;
-
-        if ((c_time_msec < publish_time && !force) || g_game_over)
+        if (force) {
+                publish_dead = FALSE;
+                publish_retry = 0;
+        } else if (c_time_msec < publish_time || alive_sending)
+                return;
+        if (g_game_over || g_replaying)
                 return;
         publish_time = c_time_msec + PUBLISH_INTERVAL;
-
-        /* Disable if blank master server name */
-        C_var_unlatch(&g_master);
-        if (!*g_master.value.s)
+        alive_sending = TRUE;
+        if (!publish_connect((n_callback_http_f)alive_callback)) {
+                alive_sending = FALSE;
                 return;
-        C_var_unlatch(&g_master_url);
+        }
 
         /* Send game info key/value pairs, the server can figure out our
            ip adress on its own */
-        N_connect_http(g_master.value.s, (n_callback_http_f)publish_callback);
         N_send_post(g_master_url.value.s,
                     "protocol", C_va("%d", G_PROTOCOL),
                     "name", g_name.value.s,
@@ -582,14 +739,26 @@ static void publish_game_alive(bool force)
                     "port", C_va("%d", n_port.value.n));
 }
 
+/******************************************************************************\
+ Poll the master server connection and retry a dead heartbeat that did not
+ get through. This keeps going after we stop hosting so that the master
+ server hears that the game is over.
+\******************************************************************************/
+static void poll_publish(void)
+{
+        if (g_replaying)
+                return;
+        N_poll_http();
+        if (publish_dead && !dead_sending && c_time_msec >= publish_time)
+                send_game_dead();
+}
+
 /******************************************************************************\
  A client has left the game and we need to clean up.
 \******************************************************************************/
 static void client_disconnected(int client)
 {
-        g_ship_t *ship;
-        PyObject *key;
-        Py_ssize_t pos = 0;
+        int i;
 
         C_debug("Client %d disconnected", client);
 
@@ -601,13 +770,13 @@ static void client_disconnected(int client)
 
         /* Let everyone know about it */
         if (g_clients[client].name[0])
-                N_broadcast("111", G_SM_DISCONNECTED, client,
-                            g_clients[client].kicked);
+                G_send_sm_disconnected(N_BROADCAST_ID, client,
+                                       g_clients[client].kicked);
 
         /* Disown their ships */
-        while (PyDict_Next(g_ship_dict, &pos, &key, (PyObject**)&ship))
-                if (ship->client == client)
-                        G_ship_change_client(ship, N_SERVER_ID);
+        for (i = 0; i < g_ships_len; i++)
+                if (g_ships[i]->client == client)
+                        G_ship_change_client(g_ships[i], N_SERVER_ID);
 }
 
 /******************************************************************************\
@@ -640,6 +809,10 @@ static const char *cm_to_string(g_client_msg_t msg)
                 return "G_CM_SHIP_RING";
         case G_CM_TILE_RING:
                 return "G_CM_TILE_RING";
+        case G_CM_FOCUS:
+                return "G_CM_FOCUS";
+        case G_CM_UDP_READY:
+                return "G_CM_UDP_READY";
         default:
                 return C_va("%d", msg);
         }
@@ -649,19 +822,30 @@ static const char *cm_to_string(g_client_msg_t msg)
  Called from within the network namespace when a network event arrives for the
  server from one of the clients (including the server's client).
 \******************************************************************************/
-static void server_callback(int client, n_event_t event)
+void G_server_callback(int client, n_event_t event)
 {
         g_client_msg_t token;
 
+        /* The host leaving ends the recording */
+        if (client == N_HOST_CLIENT_ID && event == N_EV_DISCONNECTED)
+                G_record_stop();
+        G_record_event(client, event);
+
         /* Special client events */
         if (event == N_EV_CONNECTED) {
-                N_broadcast_except(N_HOST_CLIENT_ID, "11",
-                                   G_SM_CONNECTED, client);
+                G_send_sm_connected(N_EXCEPT_ID(N_HOST_CLIENT_ID), client);
                 init_client(client);
                 return;
         } else if (event == N_EV_DISCONNECTED) {
                 client_disconnected(client);
                 return;
+        } else if (event == N_EV_RESYNC) {
+
+                /* Resumed too far behind, the client keeps its slot but
+                   gets the whole world again */
+                C_debug("Resending the world to client %d", client);
+                send_world(client);
+                return;
         }
 
         /* Handle messages */
@@ -723,6 +907,12 @@ static void server_callback(int client, n_event_t event)
         case G_CM_TILE_RING:
                 cm_tile_ring(client);
                 break;
+        case G_CM_FOCUS:
+                cm_focus(client);
+                break;
+        case G_CM_UDP_READY:
+                cm_udp_ready(client);
+                break;
         default:
                 break;
         }
@@ -739,7 +929,7 @@ static void initial_buildings(void)
                 if (R_terrain_base(r_tiles[i].terrain) != R_T_GROUND)
                         continue;
                 if (C_rand_real() < g_forest.value.f)
-                        G_tile_build(i, G_BT_TREE, -2);
+                        G_tile_build(i, -1, G_BT_TREE, -2);
         }
 }
 
@@ -752,156 +942,86 @@ void G_kick_client(n_client_id_t client)
            client disconnection channels */
         g_clients[client].kicked = TRUE;
 
-        N_send(client, "12ss", G_SM_POPUP, -1,
-               "g-host-kicked", "Kicked by host.");
+        G_send_sm_popup(client, -1, "g-host-kicked", "Kicked by host.");
         N_drop_client(client);
 }
 
 /******************************************************************************\
- Host a new game.
+ Broadcast a game-over message.
 \******************************************************************************/
-void G_host_game(void)
+static void game_over(g_nation_name_t nation, n_client_id_t client)
 {
-        int i;
-
-        if (n_client_id != N_HOST_CLIENT_ID)
-                G_leave_game();
-        C_var_unlatch(&g_victory_gold);
-        G_reset_elements();
-
-        /* Reset time limit */
-        C_var_unlatch(&g_time_limit);
-        g_time_limit_msec = c_time_msec + g_time_limit.value.n * 60000;
-
-        /* Start off nation-less */
-        I_select_nation(G_NN_NONE);
-
-        /* Maximum number of clients */
-        C_var_unlatch(&g_players);
-        if (g_players.value.n < 1)
-                g_players.value.n = 1;
-        if (g_players.value.n > N_CLIENTS_MAX)
-                g_players.value.n = N_CLIENTS_MAX;
-        I_configure_player_num(g_clients_max = g_players.value.n);
-
-        /* Start the network server */
-        if (!N_start_server((n_callback_f)server_callback,
-                            (n_callback_f)G_client_callback)) {
-                I_popup(NULL, "Failed to start server.");
-                I_enter_limbo();
-                return;
-        }
-
-        /* Generate a new globe */
-        C_var_unlatch(&g_globe_subdiv4);
-        C_var_unlatch(&g_island_num);
-        C_var_unlatch(&g_island_size);
-        C_var_unlatch(&g_island_variance);
-        C_var_unlatch(&g_name);
-        if (g_globe_subdiv4.value.n < 3)
-                g_globe_subdiv4.value.n = 3;
-        if (g_globe_subdiv4.value.n > 5)
-                g_globe_subdiv4.value.n = 5;
-        if (g_island_variance.value.f > 1.f)
-                g_island_variance.value.f = 1.f;
-        if (!C_var_unlatch(&g_globe_seed))
-                g_globe_seed.value.n = (int)time(NULL);
-        G_generate_globe(g_globe_subdiv4.value.n, g_island_num.value.n,
-                         g_island_size.value.n, g_island_variance.value.f);
-        initial_buildings();
-
-        /* Set our name */
-        C_var_unlatch(&g_name);
-        C_sanitize(g_name.value.s);
-        C_strncpy_buf(g_clients[N_HOST_CLIENT_ID].name, g_name.value.s);
-
-        /* Reinitialize any connected clients */
-        for (i = 0; i < N_CLIENTS_MAX; i++) {
-                if (!n_clients[i].connected)
-                        continue;
-                init_client(i);
-                I_configure_player(i, g_clients[i].name,
-                                   G_nation_to_color(g_clients[i].nation),
-                                   TRUE);
-        }
-
-        /* Tell remote clients that we rehosted */
-        N_broadcast_except(N_HOST_CLIENT_ID, "12ss", G_SM_POPUP, -1,
-                           "g-host-rehost", "Host started a new game.");
-
-        I_leave_limbo();
-        I_popup(NULL, "Hosted a new game.");
-
-        /* Finished initialization */
-        g_host_inited = TRUE;
-        publish_game_alive(TRUE);
+        G_send_sm_game_over(N_BROADCAST_ID, nation, client);
 }
 
 /******************************************************************************\
- Broadcast a game-over message.
+ Count what each client owns the slow way and complain about running totals
+ that do not match. The totals are corrected so that one mistake is only
+ reported once.
 \******************************************************************************/
-static void game_over(g_nation_name_t nation, n_client_id_t client)
+static void check_totals(void)
 {
-        N_broadcast("111", G_SM_GAME_OVER, nation, client);
+        static g_totals_t counted[N_CLIENTS_MAX + 1];
+        int i, j, client;
+
+        C_zero_buf(counted);
+        for (i = 0; i < g_ships_len; i++) {
+                client = g_ships[i]->client;
+                if (client < 0 || client > N_CLIENTS_MAX)
+                        continue;
+                counted[client].ships++;
+                for (j = 0; j < G_CARGO_TYPES; j++)
+                        counted[client].cargo[j] +=
+                                g_ships[i]->store->cargo[j].amount;
+        }
+        for (i = 0; i < g_buildings_len; i++) {
+                client = g_buildings[i]->client;
+                if (client < 0 || client > N_CLIENTS_MAX)
+                        continue;
+                counted[client].buildings++;
+                for (j = 0; j < G_CARGO_TYPES; j++)
+                        counted[client].cargo[j] +=
+                                g_buildings[i]->store->cargo[j].amount;
+        }
+        for (i = 0; i <= N_CLIENTS_MAX; i++) {
+                if (!memcmp(counted + i, g_totals + i, sizeof (*counted)))
+                        continue;
+                C_warning("Client %d totals are off: %d/%d ships, "
+                          "%d/%d buildings, %d/%d gold", i, g_totals[i].ships,
+                          counted[i].ships, g_totals[i].buildings,
+                          counted[i].buildings,
+                          g_totals[i].cargo[G_CT_GOLD],
+                          counted[i].cargo[G_CT_GOLD]);
+                g_totals[i] = counted[i];
+        }
 }
 
 /******************************************************************************\
- Periodically scan through clients and ships to check for winners and losers.
+ Periodically check clients for winners and losers. Stops once the game is
+ over.
 \******************************************************************************/
-static void check_game_over(void)
+static void check_game_over(int unused)
 {
-        static int check_time;
         g_nation_name_t best_nation, client_nation;
         int i, best_gold;
         n_client_id_t best_client;
-        g_ship_t *ship;
-        g_building_t *b;
-        PyObject *key;
-        Py_ssize_t pos = 0;
 
-        /* Check clients periodically */
-        if (c_time_msec < check_time || g_game_over)
+        if (g_game_over)
                 return;
+        C_wheel_schedule(&g_timers, g_time_msec, CHECK_INTERVAL,
+                         check_game_over, 0);
         best_nation = G_NN_NONE;
         best_gold = -1;
         best_client = -1;
-        check_time = c_time_msec + 1000;
-
-        /* Reset counts */
-        for (i = 0; i < N_CLIENTS_MAX; i++) {
-                g_clients[i].ships = 0;
-                g_clients[i].buildings = 0;
-                g_clients[i].gold = 0;
-        }
+        if (g_debug_totals.value.n)
+                check_totals();
         for (i = 0; i < G_NATION_NAMES; i++)
                 g_nations[i].gold = 0;
 
-        /* Count ships */
-        while (PyDict_Next(g_ship_dict, &pos, &key, (PyObject**)&ship)) {
-                n_client_id_t client;
-
-                if (!ship->in_use || ship->health <= 0)
-                        continue;
-                client = ship->client;
-                g_clients[client].ships++;
-                g_clients[client].gold += ship->store->cargo[G_CT_GOLD].amount;
-        }
-
-        /* Count buildings */
-        pos = 0;
-        while (PyDict_Next(g_building_dict, &pos, &key, (PyObject**)&b)) {
-                n_client_id_t client;
-
-                if (b->health <= 0)
-                        continue;
-                client = b->client;
-                g_clients[client].buildings++;
-                g_clients[client].gold += b->store->cargo[G_CT_GOLD].amount;
-        }
-
         /* Client pass */
-        for (i = 0; i < N_CLIENTS_MAX; i++) {
-                if (!N_client_valid(i) || g_clients[i].nation == G_NN_NONE)
+        N_clients_for(i, n_connected) {
+                g_clients[i].gold = g_totals[i].cargo[G_CT_GOLD];
+                if (g_clients[i].nation == G_NN_NONE)
                         continue;
 
                 /* Count gold toward nation */
@@ -948,10 +1068,10 @@ static void check_game_over(void)
 
 
                 /* Check for players that lost their ships */
-                if (g_clients[i].ships > 0)
+                if (g_totals[i].ships > 0)
                         continue;
                 g_clients[i].nation = G_NN_NONE;
-                N_broadcast("1112", G_SM_AFFILIATE, i, G_NN_NONE, -1);
+                G_send_sm_affiliate(N_BROADCAST_ID, i, G_NN_NONE, -1);
         }
 
         /* Timelimit ends the game */
@@ -960,62 +1080,47 @@ static void check_game_over(void)
 }
 
 /******************************************************************************\
- Send echo requests
+ Periodically send echo requests. While echoes are turned off, checks back
+ every so often in case they are turned on.
 \******************************************************************************/
-void G_ping_clients(void)
+static void ping_clients(int unused)
 {
-        static int check_time;
         int i, echo_data;
 
-        if(g_echo_rate.value.n == 0)
+        if(g_echo_rate.value.n == 0) {
+                C_wheel_schedule(&g_timers, g_time_msec, CHECK_INTERVAL,
+                                 ping_clients, 0);
                 return;
+        }
         /* Limit echo rate */
         if(g_echo_rate.value.n < 100)
                 C_var_set(&g_echo_rate, "100");
+        C_wheel_schedule(&g_timers, g_time_msec, g_echo_rate.value.n,
+                         ping_clients, 0);
 
-        if (c_time_msec < check_time)
-                return;
-        check_time = c_time_msec + g_echo_rate.value.n;
-
-        echo_data = C_rand();
+        echo_data = c_time_msec;
 
-        for (i = 0; i < N_CLIENTS_MAX; i++) {
-                if (!N_client_valid(i))
-                        continue;
+        N_clients_for(i, n_connected) {
                 g_clients[i].echo_time = c_time_msec;
                 g_clients[i].echo_data = echo_data;
         }
 
-        N_broadcast("14", G_SM_ECHO_REQUEST, echo_data);
+        G_send_sm_echo_request(N_BROADCAST_ID, echo_data);
 }
 
 /******************************************************************************\
- Send ping time and gold info to clients
+ Periodically send ping time and gold info to clients
 \******************************************************************************/
-void G_update_clients(void)
+static void update_clients(int unused)
 {
-        static int check_time;
-        int i, client_array;
-
-        if (c_time_msec < check_time)
-                return;
-        check_time = c_time_msec + 1000;
-
-        client_array = 0;
-
-        for (i = 0; i < N_CLIENTS_MAX; i++) {
-                if (N_client_valid(i)) {
-                        client_array |= 1 << i;
-                }
-        }
+        int i;
 
+        C_wheel_schedule(&g_timers, g_time_msec, CHECK_INTERVAL,
+                         update_clients, 0);
         N_send_start();
         N_send_char(G_SM_CLIENT_UPDATE);
-        N_send_int(client_array);
-
-        for (i = 0; i < N_CLIENTS_MAX; i++) {
-                if (!N_client_valid(i))
-                        continue;
+        N_send_clients(n_connected);
+        N_clients_for(i, n_connected) {
                 N_send_int(g_clients[i].gold);
                 N_send_short(g_clients[i].ping_time);
         }
@@ -1024,17 +1129,111 @@ void G_update_clients(void)
 }
 
 /******************************************************************************\
- Called to update server-side structures. Does nothing if not hosting.
+ Host a new game.
+\******************************************************************************/
+void G_host_game(void)
+{
+        int i;
+
+        if (n_client_id != N_HOST_CLIENT_ID)
+                G_leave_game();
+        C_var_unlatch(&g_victory_gold);
+        G_reset_elements();
+
+        /* Reset time limit */
+        C_var_unlatch(&g_time_limit);
+        g_time_limit_msec = c_time_msec + g_time_limit.value.n * 60000;
+
+        /* Start off nation-less */
+        I_select_nation(G_NN_NONE);
+
+        /* Maximum number of clients */
+        C_var_unlatch(&g_players);
+        if (g_players.value.n < 1)
+                g_players.value.n = 1;
+        if (g_players.value.n > N_CLIENTS_MAX)
+                g_players.value.n = N_CLIENTS_MAX;
+        I_configure_player_num(g_clients_max = g_players.value.n);
+
+        /* Start the network server */
+        if (!N_start_server((n_callback_f)G_server_callback,
+                            (n_callback_f)G_client_callback)) {
+                I_popup(NULL, "Failed to start server.");
+                I_enter_limbo();
+                return;
+        }
+
+        /* Generate a new globe */
+        C_var_unlatch(&g_globe_subdiv4);
+        C_var_unlatch(&g_island_num);
+        C_var_unlatch(&g_island_size);
+        C_var_unlatch(&g_island_variance);
+        C_var_unlatch(&g_name);
+        if (g_globe_subdiv4.value.n < 3)
+                g_globe_subdiv4.value.n = 3;
+        if (g_globe_subdiv4.value.n > 5)
+                g_globe_subdiv4.value.n = 5;
+        if (g_island_variance.value.f > 1.f)
+                g_island_variance.value.f = 1.f;
+        if (!C_var_unlatch(&g_globe_seed))
+                g_globe_seed.value.n = (int)time(NULL);
+        G_generate_globe(g_globe_subdiv4.value.n, g_island_num.value.n,
+                         g_island_size.value.n, g_island_variance.value.f);
+        initial_buildings();
+        G_record_start();
+
+        /* Set our name */
+        C_var_unlatch(&g_name);
+        C_sanitize(g_name.value.s);
+        C_strncpy_buf(g_clients[N_HOST_CLIENT_ID].name, g_name.value.s);
+
+        /* Reinitialize any connected clients */
+        N_clients_for(i, n_connected) {
+                init_client(i);
+                I_configure_player(i, g_clients[i].name,
+                                   G_nation_to_color(g_clients[i].nation),
+                                   TRUE);
+        }
+
+        /* Tell remote clients that we rehosted */
+        G_send_sm_popup(N_EXCEPT_ID(N_HOST_CLIENT_ID), -1, "g-host-rehost",
+                        "Host started a new game.");
+
+        I_leave_limbo();
+        I_popup(NULL, "Hosted a new game.");
+
+        /* Start the periodic timers */
+        C_wheel_schedule(&g_timers, g_time_msec, 0, ping_clients, 0);
+        C_wheel_schedule(&g_timers, g_time_msec, 0, check_game_over, 0);
+        C_wheel_schedule(&g_timers, g_time_msec, 0, update_clients, 0);
+
+        /* Finished initialization */
+        g_host_inited = TRUE;
+        publish_game_alive(TRUE);
+}
+
+/******************************************************************************\
+ Called every frame to accept new connections and send and receive data.
+ Only the master server connection is polled if not hosting. A replay feeds
+ its recorded events in by itself.
+\******************************************************************************/
+void G_poll_host(void)
+{
+        poll_publish();
+        if (n_client_id != N_HOST_CLIENT_ID || i_limbo || g_replaying)
+                return;
+        N_poll_server();
+        G_record_polled();
+}
+
+/******************************************************************************\
+ Called every tick to update server-side structures.
 \******************************************************************************/
 void G_update_host(void)
 {
         if (n_client_id != N_HOST_CLIENT_ID || i_limbo)
                 return;
-        /* Send echo requests */
-        G_ping_clients();
-        /* Accept new connections and sent/receive data */
-        N_poll_server();
-        N_poll_http();
+        G_record_frame();
 
         /* Spawn crates for the players */
         while (g_gibs < CRATES_MAX) {
@@ -1054,9 +1253,15 @@ void G_update_host(void)
                 loot->cargo[G_CT_IRON] = C_roll_dice(5, 10) - 25;
         }
 
-        check_game_over();
-        /* Send gold and ping time updates to clients */
-        G_update_clients();
+        /* Timers for ships, echo requests, client updates and checking for
+           the end of the game */
+        C_wheel_update(&g_timers, g_time_msec);
+        /* Route ships to the clients that are interested in them */
+        G_update_interest();
+        /* Movement hints over the side channel */
+        G_send_ship_hints();
+        /* Stream world snapshots to joining clients */
+        G_update_snapshots();
 
         publish_game_alive(FALSE);
 }
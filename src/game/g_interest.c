@@ -0,0 +1,249 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Interest management. The globe is divided into patches, each patch being a
+   tile of the globe at subdivision level PATCH_LEVEL together with all of its
+   descendants. Clients subscribe to the patches around their ships, buildings
+   and camera. The host keeps track of which clients know about each ship and
+   only routes ship updates to those clients, sending the full ship state when
+   a client becomes interested and withdrawing the ship when it loses
+   interest. */
+
+#include "g_common.h"
+
+/* Subdivision level at which the globe is divided into patches */
+#define PATCH_LEVEL 2
+
+/* Maximum number of patches */
+#define PATCHES_MAX (20 << (2 * PATCH_LEVEL))
+
+/* Milliseconds between recomputing subscriptions */
+#define INTEREST_INTERVAL 500
+
+/* Milliseconds between client focus updates */
+#define FOCUS_INTERVAL 1000
+
+/* Set of patches, one bit per patch */
+typedef c_bits_t patch_set_t[C_BITS_WORDS(PATCHES_MAX)];
+
+/* Tile the client camera is looking at */
+int g_focus_tile = -1;
+
+/* Patch adjacency including the patch itself */
+static patch_set_t patch_near[PATCHES_MAX];
+
+/* Clients subscribed to each patch */
+static n_client_set_t subscribers[PATCHES_MAX];
+
+static int patch_shift, patches_len, update_time;
+
+/******************************************************************************\
+ Returns the patch that [tile] belongs to. Subdividing tile [i] produces tiles
+ [4i] through [4i + 3] so the patch is the tile's ancestor at PATCH_LEVEL.
+\******************************************************************************/
+static int tile_patch(int tile)
+{
+        return tile >> patch_shift;
+}
+
+/******************************************************************************\
+ Divide a freshly generated globe into patches and find which patches border
+ each other.
+\******************************************************************************/
+void G_init_interest(int subdiv4)
+{
+        int i, j, len, region[12];
+
+        patch_shift = subdiv4 > PATCH_LEVEL ? 2 * (subdiv4 - PATCH_LEVEL) : 0;
+        patches_len = r_tiles_max >> patch_shift;
+        C_assert(patches_len <= PATCHES_MAX);
+        C_zero_buf(patch_near);
+        C_zero_buf(subscribers);
+        for (i = 0; i < r_tiles_max; i++) {
+                c_bits_t *near;
+
+                near = patch_near[tile_patch(i)];
+                C_bit_set(near, tile_patch(i), TRUE);
+                len = R_tile_region(i, region);
+                for (j = 0; j < len; j++)
+                        C_bit_set(near, tile_patch(region[j]), TRUE);
+        }
+        update_time = 0;
+}
+
+/******************************************************************************\
+ Narrow down a message about [ship] to the clients that know about it. If
+ [client] is a broadcast, the known clients (minus an excepted one) are
+ selected and N_SELECTED_ID is returned. Otherwise [client] is returned.
+\******************************************************************************/
+n_client_id_t G_ship_route(const g_ship_t *ship, n_client_id_t client)
+{
+        if (client >= 0 && client != N_BROADCAST_ID)
+                return client;
+        memcpy(n_selected, ship->known, sizeof (n_selected));
+        if (client < 0)
+                C_bit_set(n_selected, -client - 1, FALSE);
+        return N_SELECTED_ID;
+}
+
+/******************************************************************************\
+ Recompute which clients should know about [ship], sending its full state to
+ newly interested clients and telling clients that lost interest to forget
+ it.
+\******************************************************************************/
+void G_interest_update_ship(g_ship_t *ship)
+{
+        n_client_set_t want;
+        int i;
+
+        if (n_client_id != N_HOST_CLIENT_ID || !ship->in_use)
+                return;
+
+        /* Everyone is interested when interest management is disabled */
+        if (g_interest_radius.value.n < 0)
+                memcpy(want, n_connected, sizeof (want));
+        else {
+                memcpy(want, subscribers[tile_patch(ship->tile)],
+                       sizeof (want));
+                if (N_client_in(n_connected, ship->client))
+                        C_bit_set(want, ship->client, TRUE);
+                C_bits_and(want, n_connected, N_CLIENTS_MAX);
+        }
+
+        /* The host shares the game state so it always knows */
+        C_bit_set(want, N_HOST_CLIENT_ID, TRUE);
+
+        /* Clients that lost interest */
+        N_clients_for(i, ship->known)
+                if (!C_bit_get(want, i) && C_bit_get(n_connected, i))
+                        G_send_sm_ship_forget(i, ship->id);
+
+        /* Clients that gained interest get the complete ship */
+        N_clients_for(i, want) {
+                if (C_bit_get(ship->known, i) || i == N_HOST_CLIENT_ID)
+                        continue;
+                C_bit_set(ship->known, i, TRUE);
+                G_ship_send_spawn(ship, i);
+                G_ship_send_name(ship, i);
+                G_ship_send_state(ship, i);
+                G_ship_send_path(ship, i);
+                G_ship_send_cargo(ship, i);
+        }
+
+        memcpy(ship->known, want, sizeof (want));
+}
+
+/******************************************************************************\
+ Forget everything a newly connected [client] in this slot was told about.
+ Subscriptions are recomputed on the next update.
+\******************************************************************************/
+void G_interest_reset_client(n_client_id_t client)
+{
+        int i;
+
+        g_clients[client].focus_tile = -1;
+        for (i = 0; i < g_ships_len; i++)
+                C_bit_set(g_ships[i]->known, client, FALSE);
+        update_time = 0;
+}
+
+/******************************************************************************\
+ Add the patch containing [tile] to the patches [client] is interested in.
+\******************************************************************************/
+static void interest_add(patch_set_t *interest, int client, int tile)
+{
+        if (client < 0 || client >= N_CLIENTS_MAX || tile < 0 ||
+            tile >= r_tiles_max)
+                return;
+        C_bit_set(interest[client], tile_patch(tile), TRUE);
+}
+
+/******************************************************************************\
+ Recompute patch subscriptions and update every ship's known clients. Called
+ periodically by the host.
+\******************************************************************************/
+void G_update_interest(void)
+{
+        static patch_set_t interest[N_CLIENTS_MAX];
+        patch_set_t ring;
+        g_building_t *building;
+        g_ship_t *ship;
+        int i, j, p, radius;
+
+        if (n_client_id != N_HOST_CLIENT_ID || c_time_msec < update_time)
+                return;
+        update_time = c_time_msec + INTEREST_INTERVAL;
+        C_var_unlatch(&g_interest_radius);
+        radius = g_interest_radius.value.n;
+
+        /* Patches that contain something each client cares about */
+        C_zero_buf(interest);
+        for (i = 0; i < g_ships_len; i++) {
+                ship = g_ships[i];
+                if (ship->in_use)
+                        interest_add(interest, ship->client, ship->tile);
+        }
+        for (i = 0; i < N_CLIENTS_MAX; i++)
+                for (building = g_client_buildings[i]; building;
+                     building = building->client_next)
+                        interest_add(interest, i, building->tile);
+
+        /* Expand each client's patches by the interest radius and subscribe
+           the client to them */
+        C_zero_buf(subscribers);
+        N_clients_for(i, n_connected) {
+                interest_add(interest, i, g_clients[i].focus_tile);
+                for (j = 0; j < radius; j++) {
+                        memcpy(ring, interest[i], sizeof (ring));
+                        C_bits_for(p, interest[i], patches_len)
+                                C_bits_or(ring, patch_near[p], PATCHES_MAX);
+                        memcpy(interest[i], ring, sizeof (ring));
+                }
+                C_bits_for(p, interest[i], patches_len)
+                        C_bit_set(subscribers[p], i, TRUE);
+        }
+
+        /* Route ships to their new subscribers */
+        for (i = 0; i < g_ships_len; i++)
+                G_interest_update_ship(g_ships[i]);
+}
+
+/******************************************************************************\
+ Track the tile the camera is looking at most directly. Called for each tile
+ while rendering the globe, starting from tile zero.
+\******************************************************************************/
+void G_interest_focus(int tile)
+{
+        static float best;
+        float dot;
+
+        dot = C_vec3_dot(r_cam_forward, r_tiles[tile].origin);
+        if (!tile || dot < best) {
+                best = dot;
+                g_focus_tile = tile;
+        }
+}
+
+/******************************************************************************\
+ Periodically tell the server where our camera is looking so that it can send
+ us the ships there.
+\******************************************************************************/
+void G_interest_send_focus(void)
+{
+        static int send_time;
+
+        if (n_client_id == N_HOST_CLIENT_ID || c_time_msec < send_time ||
+            g_focus_tile < 0)
+                return;
+        send_time = c_time_msec + FOCUS_INTERVAL;
+        G_send_cm_focus(N_SERVER_ID, g_focus_tile);
+}
@@ -0,0 +1,235 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Message schemas and the codecs generated from them. A schema lists the
+   fields that follow the token byte in wire order as F(type, name), where
+   type is one of char, short, int, float, clients or string. Client sets and
+   strings are variable length and must come after every other field.
+
+   G_CODEC(G_SM_GIB, sm_gib) then defines:
+
+     g_sm_gib_t                          decoded message structure
+     G_write_sm_gib(m, tile, type)       pack into message [m]
+     G_read_sm_gib(m, &msg)              unpack from [m] after the token
+     G_send_sm_gib(client, tile, type)   pack and send to [client]
+     G_receive_sm_gib(&msg)              unpack the message being received
+
+   The encoder knows the size of the message up front and writes every field
+   at a fixed offset. The decoder checks the length of the fixed fields once.
+   Decoded strings point into the message they were read from.
+
+   Messages with repeated groups (G_SM_CLIENT_UPDATE and the cargo messages)
+   are still packed by hand. */
+
+/* Server to client */
+#define G_SM_POPUP_FIELDS(F) \
+        F(short, tile) F(string, token) F(string, message)
+#define G_SM_ECHO_REQUEST_FIELDS(F) \
+        F(int, echo_data)
+#define G_SM_CLIENT_FIELDS(F) \
+        F(short, client) F(char, nation) F(string, name)
+#define G_SM_INIT_FIELDS(F) \
+        F(short, protocol) F(short, client) F(short, clients_max) \
+        F(char, subdiv4) F(int, seed) F(short, islands) \
+        F(short, island_size) F(float, variance) F(float, solar_angle) \
+        F(int, time_left) F(int, udp_token)
+#define G_SM_AFFILIATE_FIELDS(F) \
+        F(short, client) F(char, nation) F(short, tile)
+#define G_SM_CONNECTED_FIELDS(F) \
+        F(short, client)
+#define G_SM_DISCONNECTED_FIELDS(F) \
+        F(short, client) F(char, kicked)
+#define G_SM_NAME_FIELDS(F) \
+        F(short, client) F(string, name)
+#define G_SM_GAME_OVER_FIELDS(F) \
+        F(char, nation) F(short, client)
+#define G_SM_CHAT_FIELDS(F) \
+        F(short, client) F(string, message)
+#define G_SM_PRIVMSG_FIELDS(F) \
+        F(short, client) F(clients, clients) F(string, message)
+#define G_SM_SHIP_NAME_FIELDS(F) \
+        F(int, id) F(string, name)
+#define G_SM_SHIP_OWNER_FIELDS(F) \
+        F(int, id) F(short, client)
+#define G_SM_SHIP_PATH_FIELDS(F) \
+        F(int, id) F(short, tile) F(float, progress) F(string, path)
+#define G_SM_SHIP_PRICES_FIELDS(F) \
+        F(int, id) F(char, cargo) F(short, buy_price) \
+        F(short, sell_price) F(short, minimum) F(short, maximum)
+#define G_SM_SHIP_SPAWN_FIELDS(F) \
+        F(int, id) F(short, client) F(short, tile) F(char, type)
+#define G_SM_SHIP_STATE_FIELDS(F) \
+        F(int, id) F(char, health) F(short, crew) F(char, boarding) \
+        F(int, boarding_ship)
+#define G_SM_SHIP_FORGET_FIELDS(F) \
+        F(int, id)
+#define G_SM_BUILDING_FIELDS(F) \
+        F(short, tile) F(int, id) F(char, type) F(short, client)
+#define G_SM_GIB_FIELDS(F) \
+        F(short, tile) F(char, type)
+
+/* Client to server */
+#define G_CM_AFFILIATE_FIELDS(F) \
+        F(char, nation)
+#define G_CM_NAME_FIELDS(F) \
+        F(string, name)
+#define G_CM_ECHO_BACK_FIELDS(F) \
+        F(int, echo_data)
+#define G_CM_CHAT_FIELDS(F) \
+        F(string, message)
+#define G_CM_PRIVMSG_FIELDS(F) \
+        F(clients, clients) F(string, message)
+#define G_CM_SHIP_BUY_FIELDS(F) \
+        F(int, id) F(short, tile) F(char, cargo) F(short, amount)
+#define G_CM_BUILDING_BUY_FIELDS(F) \
+        G_CM_SHIP_BUY_FIELDS(F)
+#define G_CM_SHIP_DROP_FIELDS(F) \
+        F(int, id) F(char, cargo) F(short, amount)
+#define G_CM_SHIP_MOVE_FIELDS(F) \
+        F(int, id) F(short, tile)
+#define G_CM_SHIP_NAME_FIELDS(F) \
+        F(int, id) F(string, name)
+#define G_CM_SHIP_PRICES_FIELDS(F) \
+        G_SM_SHIP_PRICES_FIELDS(F)
+#define G_CM_SHIP_RING_FIELDS(F) \
+        F(int, id) F(char, icon) F(int, target)
+#define G_CM_TILE_RING_FIELDS(F) \
+        F(short, tile) F(char, icon)
+#define G_CM_FOCUS_FIELDS(F) \
+        F(short, tile)
+#define G_CM_UDP_READY_FIELDS(F) \
+        F(int, udp_token)
+
+/* Field type properties */
+#define G_CODEC_TYPE_char int
+#define G_CODEC_TYPE_short int
+#define G_CODEC_TYPE_int int
+#define G_CODEC_TYPE_float float
+#define G_CODEC_TYPE_clients n_client_set_t
+#define G_CODEC_TYPE_string const char *
+#define G_CODEC_PARAM_char int
+#define G_CODEC_PARAM_short int
+#define G_CODEC_PARAM_int int
+#define G_CODEC_PARAM_float float
+#define G_CODEC_PARAM_clients const c_bits_t *
+#define G_CODEC_PARAM_string const char *
+#define G_CODEC_SIZE_char 1
+#define G_CODEC_SIZE_short 2
+#define G_CODEC_SIZE_int 4
+#define G_CODEC_SIZE_float 4
+#define G_CODEC_SIZE_clients 0
+#define G_CODEC_SIZE_string 0
+#define G_CODEC_LEN_char(v) 0
+#define G_CODEC_LEN_short(v) 0
+#define G_CODEC_LEN_int(v) 0
+#define G_CODEC_LEN_float(v) 0
+#define G_CODEC_LEN_clients(v) N_clients_size(v)
+#define G_CODEC_LEN_string(v) (C_strlen(v) + 1)
+#define G_CODEC_UNPACK_char(n) p = N_unpack_char(p, &msg->n);
+#define G_CODEC_UNPACK_short(n) p = N_unpack_short(p, &msg->n);
+#define G_CODEC_UNPACK_int(n) p = N_unpack_int(p, &msg->n);
+#define G_CODEC_UNPACK_float(n) p = N_unpack_float(p, &msg->n);
+#define G_CODEC_UNPACK_clients(n) \
+        if (!N_message_read_clients(m, msg->n)) \
+                return FALSE;
+#define G_CODEC_UNPACK_string(n) \
+        if (!(msg->n = N_message_read_string_ptr(m))) \
+                return FALSE;
+
+/* Per-field expansions */
+#define G_CODEC_MEMBER(t, n) G_CODEC_TYPE_##t n;
+#define G_CODEC_PARAM(t, n) , G_CODEC_PARAM_##t n
+#define G_CODEC_ARG(t, n) , n
+#define G_CODEC_FIXED(t, n) + G_CODEC_SIZE_##t
+#define G_CODEC_LEN(t, n) + G_CODEC_LEN_##t(n)
+#define G_CODEC_PACK(t, n) p = N_pack_##t(p, n);
+#define G_CODEC_UNPACK(t, n) G_CODEC_UNPACK_##t(n)
+
+/* Generate the structure, encoders and decoders for message [token] */
+#define G_CODEC(token, name) \
+        typedef struct { \
+                token##_FIELDS(G_CODEC_MEMBER) \
+        } g_##name##_t; \
+        \
+        static inline bool G_write_##name(n_message_t *m \
+                                          token##_FIELDS(G_CODEC_PARAM)) \
+        { \
+                char *p; \
+                \
+                if (!(p = N_message_reserve(m, 1 token##_FIELDS(G_CODEC_FIXED) \
+                                            token##_FIELDS(G_CODEC_LEN)))) { \
+                        C_warning("Outgoing " #token " overflowed"); \
+                        return FALSE; \
+                } \
+                p = N_pack_char(p, token); \
+                token##_FIELDS(G_CODEC_PACK) \
+                return TRUE; \
+        } \
+        \
+        static inline void G_send_##name(int to token##_FIELDS(G_CODEC_PARAM)) \
+        { \
+                if (G_write_##name(&n_send_msg token##_FIELDS(G_CODEC_ARG))) \
+                        N_message_send(&n_send_msg, to); \
+        } \
+        \
+        static inline bool G_read_##name(n_message_t *m, g_##name##_t *msg) \
+        { \
+                const char *p; \
+                \
+                if (!(p = N_message_read_reserve(m, 0 \
+                                        token##_FIELDS(G_CODEC_FIXED)))) \
+                        return FALSE; \
+                token##_FIELDS(G_CODEC_UNPACK) \
+                (void)p; \
+                return TRUE; \
+        } \
+        \
+        static inline bool G_receive_##name(g_##name##_t *msg) \
+        { \
+                return G_read_##name(&n_receive_msg, msg); \
+        }
+
+G_CODEC(G_SM_POPUP, sm_popup)
+G_CODEC(G_SM_ECHO_REQUEST, sm_echo_request)
+G_CODEC(G_SM_CLIENT, sm_client)
+G_CODEC(G_SM_INIT, sm_init)
+G_CODEC(G_SM_AFFILIATE, sm_affiliate)
+G_CODEC(G_SM_CONNECTED, sm_connected)
+G_CODEC(G_SM_DISCONNECTED, sm_disconnected)
+G_CODEC(G_SM_NAME, sm_name)
+G_CODEC(G_SM_GAME_OVER, sm_game_over)
+G_CODEC(G_SM_CHAT, sm_chat)
+G_CODEC(G_SM_PRIVMSG, sm_privmsg)
+G_CODEC(G_SM_SHIP_NAME, sm_ship_name)
+G_CODEC(G_SM_SHIP_OWNER, sm_ship_owner)
+G_CODEC(G_SM_SHIP_PATH, sm_ship_path)
+G_CODEC(G_SM_SHIP_PRICES, sm_ship_prices)
+G_CODEC(G_SM_SHIP_SPAWN, sm_ship_spawn)
+G_CODEC(G_SM_SHIP_STATE, sm_ship_state)
+G_CODEC(G_SM_SHIP_FORGET, sm_ship_forget)
+G_CODEC(G_SM_BUILDING, sm_building)
+G_CODEC(G_SM_GIB, sm_gib)
+G_CODEC(G_CM_AFFILIATE, cm_affiliate)
+G_CODEC(G_CM_NAME, cm_name)
+G_CODEC(G_CM_ECHO_BACK, cm_echo_back)
+G_CODEC(G_CM_CHAT, cm_chat)
+G_CODEC(G_CM_PRIVMSG, cm_privmsg)
+G_CODEC(G_CM_SHIP_BUY, cm_ship_buy)
+G_CODEC(G_CM_BUILDING_BUY, cm_building_buy)
+G_CODEC(G_CM_SHIP_DROP, cm_ship_drop)
+G_CODEC(G_CM_SHIP_MOVE, cm_ship_move)
+G_CODEC(G_CM_SHIP_NAME, cm_ship_name)
+G_CODEC(G_CM_SHIP_PRICES, cm_ship_prices)
+G_CODEC(G_CM_SHIP_RING, cm_ship_ring)
+G_CODEC(G_CM_TILE_RING, cm_tile_ring)
+G_CODEC(G_CM_FOCUS, cm_focus)
+G_CODEC(G_CM_UDP_READY, cm_udp_ready)
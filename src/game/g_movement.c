@@ -14,6 +14,15 @@
 
 #include "g_common.h"
 
+/* Milliseconds between movement hints */
+#define HINT_INTERVAL 100
+
+/* Size of one movement hint: id, tile, progress and forward vector */
+#define HINT_SIZE 22
+
+/* Maximum number of movement hints in one datagram */
+#define HINTS_MAX 48
+
 /* Maximum breadth of a path search */
 #define SEARCH_BREADTH (R_PATH_MAX * 3)
 
@@ -87,9 +96,96 @@ void G_ship_send_path(g_ship_t *ship, n_client_id_t client)
 {
         if (!ship->in_use)
                 return;
-        N_send(client, "122fs", G_SM_SHIP_PATH,
-               ship->id, ship->tile, ship->progress,
-               ship->path);
+        G_send_sm_ship_path(G_ship_route(ship, client), ship->id, ship->tile,
+                            ship->progress, ship->path);
+}
+
+/******************************************************************************\
+ Send movement hints for moving ships to clients with an open side channel.
+ Hints are sent unreliably and each batch supersedes the last, so the path
+ messages sent over TCP remain authoritative.
+\******************************************************************************/
+void G_send_ship_hints(void)
+{
+        static n_message_t msg;
+        static int hint_time;
+        g_ship_t *ship;
+        int i, j, hints;
+
+        if (n_client_id != N_HOST_CLIENT_ID || c_time_msec < hint_time)
+                return;
+        hint_time = c_time_msec + HINT_INTERVAL;
+        N_clients_for(i, n_connected) {
+                if (!N_udp_ready(i))
+                        continue;
+                hints = 0;
+                for (j = 0; j < g_ships_len; j++) {
+                        ship = g_ships[j];
+                        if (!ship->in_use || !C_bit_get(ship->known, i) ||
+                            (ship->rear_tile < 0 && ship->path[0] <= 0))
+                                continue;
+                        if (!hints) {
+                                N_message_start(&msg);
+                                N_message_write_char(&msg, G_SM_SHIP_HINTS);
+                        }
+                        N_message_write_int(&msg, ship->id);
+                        N_message_write_short(&msg, ship->tile);
+                        N_message_write_float(&msg, ship->progress);
+                        N_message_write_float(&msg, ship->forward.x);
+                        N_message_write_float(&msg, ship->forward.y);
+                        N_message_write_float(&msg, ship->forward.z);
+                        if (++hints >= HINTS_MAX) {
+                                N_message_send_udp(&msg, i);
+                                hints = 0;
+                        }
+                }
+                if (hints)
+                        N_message_send_udp(&msg, i);
+        }
+}
+
+/******************************************************************************\
+ Apply movement hints received over the side channel. Hints only correct a
+ ship's progress and heading on its current tile. A hint for the next tile on
+ the ship's path finishes the current move so the ship catches up, any other
+ tile change waits for the path message.
+\******************************************************************************/
+void G_receive_ship_hints(void)
+{
+        g_ship_t *ship;
+        c_vec3_t forward;
+        float progress;
+        const char *p;
+        int id, tile, neighbors[3];
+
+        while ((p = N_message_read_reserve(&n_receive_msg, HINT_SIZE))) {
+                p = N_unpack_int(p, &id);
+                p = N_unpack_short(p, &tile);
+                p = N_unpack_float(p, &progress);
+                p = N_unpack_float(p, &forward.x);
+                p = N_unpack_float(p, &forward.y);
+                N_unpack_float(p, &forward.z);
+                if (!(ship = G_check_ship(id)) || tile < 0 ||
+                    tile >= r_tiles_max)
+                        continue;
+
+                /* Behind by a tile */
+                if (ship->tile != tile) {
+                        if (ship->path[0] <= 0)
+                                continue;
+                        R_tile_neighbors(ship->tile, neighbors);
+                        if (neighbors[ship->path[0] - 1] == tile)
+                                ship->progress = 1.f;
+                        continue;
+                }
+
+                if (progress < 0.f)
+                        progress = 0.f;
+                if (progress > 1.f)
+                        progress = 1.f;
+                ship->progress = progress;
+                ship->forward = forward;
+        }
 }
 
 /******************************************************************************\
@@ -135,8 +231,8 @@ void G_ship_path(g_ship_t *ship, int target)
         nodes[0].dist = tile_dist(nodes[0].tile, target);
         nodes[0].moves = 0;
         nodes_len = 1;
-        g_tiles[nodes[0].tile].search_parent = -1;
-        g_tiles[nodes[0].tile].search_stamp = search_stamp;
+        G_tile_search(nodes[0].tile)->parent = -1;
+        G_tile_search(nodes[0].tile)->stamp = search_stamp;
         closest = 0;
 
         for (;;) {
@@ -176,16 +272,16 @@ void G_ship_path(g_ship_t *ship, int target)
                                ship_leaving_tile(neighbors[i]);
 
                         /* Can we open this node? */
-                        stamp = g_tiles[neighbors[i]].search_stamp;
+                        stamp = G_tile_search(neighbors[i])->stamp;
                         C_assert(stamp <= search_stamp);
                         if (stamp == search_stamp || !open ||
                             R_land_bridge(node.tile, neighbors[i]))
                                 continue;
-                        g_tiles[neighbors[i]].search_stamp = search_stamp;
+                        G_tile_search(neighbors[i])->stamp = search_stamp;
 
                         /* Add to array */
                         nodes[nodes_len].tile = neighbors[i];
-                        g_tiles[neighbors[i]].search_parent = node.tile;
+                        G_tile_search(neighbors[i])->parent = node.tile;
 
                         /* Did we make it onto the target? */
                         if (neighbors[i] == target)
@@ -207,7 +303,7 @@ void G_ship_path(g_ship_t *ship, int target)
 
 rewind: /* Count length of the path */
         path_len = -1;
-        for (i = nodes[nodes_len].tile; i >= 0; i = g_tiles[i].search_parent)
+        for (i = nodes[nodes_len].tile; i >= 0; i = G_tile_search(i)->parent)
                 path_len++;
 
         /* The path is too long */
@@ -223,7 +319,7 @@ rewind: /* Count length of the path */
         for (i = nodes[nodes_len].tile; i >= 0; ) {
                 int j, parent;
 
-                parent = g_tiles[i].search_parent;
+                parent = G_tile_search(i)->parent;
                 if (parent < 0)
                         break;
                 R_tile_neighbors(parent, neighbors);
@@ -299,11 +395,13 @@ static float ship_speed(g_ship_t *ship)
 }
 
 /******************************************************************************\
- Position and orient the ship's model.
+ Position and orient the ship's model. A moving ship is drawn as far along as
+ it will have sailed by the time the next tick runs.
 \******************************************************************************/
 static void ship_position_model(g_ship_t *ship)
 {
         r_model_t *model;
+        float progress;
         int new_tile, old_tile;
 
         if (!ship->in_use)
@@ -320,12 +418,18 @@ static void ship_position_model(g_ship_t *ship)
 
         /* Otherwise interpolate normal and origin */
         else {
+                progress = ship->progress;
+                if (!g_game_over)
+                        progress += g_tick_alpha * g_tick_sec *
+                                    ship_speed(ship);
+                if (progress > 1.f)
+                        progress = 1.f;
                 model->normal = C_vec3_lerp(r_tiles[old_tile].normal,
-                                            ship->progress,
+                                            progress,
                                             r_tiles[new_tile].normal);
                 model->normal = C_vec3_norm(model->normal);
                 model->origin = C_vec3_lerp(r_tiles[old_tile].origin,
-                                            ship->progress,
+                                            progress,
                                             r_tiles[new_tile].origin);
         }
 
@@ -360,13 +464,13 @@ bool G_ship_move_to(g_ship_t *ship, int new_tile)
         C_assert(ship->rear_tile != ship->tile);
         if (ship->rear_tile >= 0 &&
             g_tiles[ship->rear_tile].ship == ship)
-                Py_CLEAR(g_tiles[ship->rear_tile].ship);
+                G_tile_set_ship(ship->rear_tile, NULL);
 
         /* Move to the new tile */
         ship->rear_tile = old_tile;
         ship->tile = new_tile;
-        Py_INCREF(ship);
-        g_tiles[new_tile].ship = ship;
+        G_tile_set_ship(new_tile, ship);
+        G_ship_queue_visible(ship);
 
         /* Make a new path to our target */
         G_ship_path(ship, ship->target);
@@ -393,7 +497,7 @@ static void ship_move(g_ship_t *ship)
         /* Is this ship moving? */
         if (ship->path[0] <= 0 && ship->rear_tile < 0)
                 return;
-        ship->progress += c_frame_sec * ship_speed(ship);
+        ship->progress += g_tick_sec * ship_speed(ship);
 
         /* Still in progress */
         if (ship->progress < 1.f)
@@ -432,7 +536,7 @@ static void ship_move(g_ship_t *ship)
         C_assert(ship->rear_tile != ship->tile);
         if (ship->rear_tile >= 0 &&
             g_tiles[ship->rear_tile].ship == ship)
-                Py_CLEAR(g_tiles[ship->rear_tile].ship);
+                G_tile_set_ship(ship->rear_tile, NULL);
 
         /* See if we hit an obstacle */
         if (!arrived) {
@@ -466,8 +570,8 @@ static void ship_move(g_ship_t *ship)
         ship->rear_tile = old_tile;
         ship->tile = new_tile;
         ship->forward = forward;
-        Py_INCREF(ship);
-        g_tiles[new_tile].ship = ship;
+        G_tile_set_ship(new_tile, ship);
+        G_ship_queue_visible(ship);
 
         /* Pick up crate gibs */
         G_ship_collect_gib(ship);
@@ -479,6 +583,16 @@ static void ship_move(g_ship_t *ship)
 void G_ship_update_move(g_ship_t *ship)
 {
         ship_move(ship);
-        ship_position_model(ship);
+}
+
+/******************************************************************************\
+ Position every ship's model for rendering. Called every frame.
+\******************************************************************************/
+void G_position_ships(void)
+{
+        int i;
+
+        for (i = 0; i < g_ships_len; i++)
+                ship_position_model(g_ships[i]);
 }
 
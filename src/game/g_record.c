@@ -0,0 +1,463 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Recording and replaying of hosted games. While recording, the host writes
+   the settings the game was started with, the random seed, the time, game
+   time and length of every tick and every network event that reaches the
+   server callback. A replay
+   hosts a game with the same settings and feeds the events back in as fast as
+   possible, without a network, then checks that the world ended up the same
+   way it did when it was recorded.
+
+   The file starts with a header and is followed by records, each starting
+   with a record type character. */
+
+#include "g_common.h"
+
+/* Identifies recording files */
+#define RECORD_MAGIC "PLRC"
+#define RECORD_VERSION 2
+
+/* Header is the magic bytes followed by this many integers */
+#define HEADER_INTS 14
+
+/* Record types */
+typedef enum {
+        RT_FRAME = 'F',
+        RT_EVENT = 'E',
+        RT_POLLED = 'P',
+        RT_END = 'X',
+} record_type_t;
+
+/* TRUE while a recording is being replayed */
+bool g_replaying;
+
+static c_file_t record_file;
+static bool recording;
+
+/* Recording being replayed */
+static char *replay_data;
+static int replay_len, replay_pos, replay_seed;
+
+/******************************************************************************\
+ Add a value to the running checksum.
+\******************************************************************************/
+static uLong checksum_int(uLong crc, int value)
+{
+        char buffer[4];
+
+        N_pack_int(buffer, value);
+        return crc32(crc, (const Bytef *)buffer, 4);
+}
+
+/******************************************************************************\
+ Compute a checksum of the state of the world. Tiles are visited in order so
+ the result does not depend on the order ships are stored in.
+\******************************************************************************/
+static int world_checksum(void)
+{
+        uLong crc;
+        int i, j;
+
+        crc = crc32(0, NULL, 0);
+        for (i = 0; i < N_CLIENTS_MAX; i++) {
+                if (!n_clients[i].connected)
+                        continue;
+                crc = checksum_int(crc, i);
+                crc = checksum_int(crc, g_clients[i].gold);
+                crc = checksum_int(crc, g_clients[i].nation);
+        }
+        for (i = 0; i < r_tiles_max; i++) {
+                g_building_t *building;
+                g_ship_t *ship;
+                g_gib_t *gib;
+
+                if ((building = g_tiles[i].building)) {
+                        crc = checksum_int(crc, i);
+                        crc = checksum_int(crc, building->type);
+                        crc = checksum_int(crc, building->client);
+                        crc = checksum_int(crc, building->health);
+                }
+                if ((gib = g_tiles[i].gib)) {
+                        crc = checksum_int(crc, i);
+                        crc = checksum_int(crc, gib->type);
+                        for (j = 0; j < G_CARGO_TYPES; j++)
+                                crc = checksum_int(crc, gib->loot.cargo[j]);
+                }
+                if ((ship = g_tiles[i].ship)) {
+                        crc = checksum_int(crc, ship->id);
+                        crc = checksum_int(crc, ship->client);
+                        crc = checksum_int(crc, ship->tile);
+                        crc = checksum_int(crc, ship->rear_tile);
+                        crc = checksum_int(crc, ship->health);
+                        crc = crc32(crc, (const Bytef *)ship->path,
+                                    C_strlen(ship->path));
+                        for (j = 0; j < G_CARGO_TYPES; j++)
+                                crc = checksum_int(crc, ship->store->
+                                                        cargo[j].amount);
+                }
+        }
+        return (int)crc;
+}
+
+/******************************************************************************\
+ Finish the current recording, if there is one.
+\******************************************************************************/
+void G_record_stop(void)
+{
+        char buffer[5];
+
+        if (!recording)
+                return;
+        recording = FALSE;
+        buffer[0] = RT_END;
+        N_pack_int(buffer + 1, world_checksum());
+        C_file_write(&record_file, buffer, sizeof (buffer));
+        C_file_cleanup(&record_file);
+        C_debug("Finished recording");
+}
+
+/******************************************************************************\
+ Start recording a newly hosted game if [g_record] names a file. Called once
+ the globe has been generated. Play from here on uses a fresh random seed
+ that goes into the recording, or the recorded seed when replaying.
+\******************************************************************************/
+void G_record_start(void)
+{
+        char buffer[4 + HEADER_INTS * 4], *p;
+        unsigned int seed;
+
+        G_record_stop();
+        if (g_replaying) {
+                C_rand_seed(replay_seed);
+                srand(replay_seed);
+                return;
+        }
+        C_var_unlatch(&g_record);
+        if (!g_record.value.s[0])
+                return;
+        if (!C_file_init_write(&record_file, g_record.value.s)) {
+                C_warning("Failed to open '%s' for recording",
+                          g_record.value.s);
+                return;
+        }
+        seed = (unsigned int)time(NULL) ^ (unsigned int)c_time_msec;
+        C_rand_seed(seed);
+        srand(seed);
+
+        /* Header */
+        memcpy(buffer, RECORD_MAGIC, 4);
+        p = N_pack_int(buffer + 4, RECORD_VERSION);
+        p = N_pack_int(p, G_PROTOCOL);
+        p = N_pack_int(p, (int)seed);
+        p = N_pack_int(p, c_time_msec);
+        p = N_pack_int(p, g_globe_subdiv4.value.n);
+        p = N_pack_int(p, g_globe_seed.value.n);
+        p = N_pack_int(p, g_island_num.value.n);
+        p = N_pack_int(p, g_island_size.value.n);
+        p = N_pack_float(p, g_island_variance.value.f);
+        p = N_pack_float(p, g_forest.value.f);
+        p = N_pack_int(p, g_clients_max);
+        p = N_pack_int(p, g_time_limit_msec - c_time_msec);
+        p = N_pack_int(p, g_victory_gold.value.n);
+        p = N_pack_int(p, g_player_ship_limit.value.n);
+        C_file_write(&record_file, buffer, (int)(p - buffer));
+        recording = TRUE;
+        C_debug("Recording to '%s' with seed %u", g_record.value.s, seed);
+}
+
+/******************************************************************************\
+ Record the start of a host tick. Replays refer to ticks as frames.
+\******************************************************************************/
+void G_record_frame(void)
+{
+        char buffer[13], *p;
+
+        if (!recording)
+                return;
+        buffer[0] = RT_FRAME;
+        p = N_pack_int(buffer + 1, c_time_msec);
+        p = N_pack_int(p, g_time_msec);
+        N_pack_int(p, g_tick_usec);
+        C_file_write(&record_file, buffer, sizeof (buffer));
+}
+
+/******************************************************************************\
+ Record that the host finished polling the network. Events recorded after this
+ came from the host's own client and are replayed after the frame.
+\******************************************************************************/
+void G_record_polled(void)
+{
+        char type;
+
+        if (!recording)
+                return;
+        type = RT_POLLED;
+        C_file_write(&record_file, &type, 1);
+}
+
+/******************************************************************************\
+ Record a network event for the server. Message events include the message
+ as it was received.
+\******************************************************************************/
+void G_record_event(n_client_id_t client, n_event_t event)
+{
+        char buffer[6], *p;
+        int size;
+
+        if (!recording)
+                return;
+        size = event == N_EV_MESSAGE ? n_receive_msg.size : 0;
+        buffer[0] = RT_EVENT;
+        p = N_pack_short(buffer + 1, client);
+        p = N_pack_char(p, event);
+        N_pack_short(p, size);
+        C_file_write(&record_file, buffer, sizeof (buffer));
+        if (size > 0)
+                C_file_write(&record_file, n_receive_msg.buffer, size);
+}
+
+/******************************************************************************\
+ Returns a pointer to the next [size] bytes of the recording and skips past
+ them, or NULL if the recording ends first.
+\******************************************************************************/
+static const char *replay_read(int size)
+{
+        const char *data;
+
+        if (replay_pos + size > replay_len)
+                return NULL;
+        data = replay_data + replay_pos;
+        replay_pos += size;
+        return data;
+}
+
+/******************************************************************************\
+ Feed the recorded events up to the end of the next network poll to the
+ server.
+\******************************************************************************/
+static void replay_events(void)
+{
+        const char *p;
+        int client, event, size;
+
+        while (replay_pos < replay_len && replay_data[replay_pos] == RT_EVENT) {
+                if (!(p = replay_read(6)))
+                        break;
+                p = N_unpack_short(p + 1, &client);
+                p = N_unpack_char(p, &event);
+                N_unpack_short(p, &size);
+                if (size < 0 || !(p = replay_read(size)) ||
+                    client <= N_HOST_CLIENT_ID || client >= N_CLIENTS_MAX) {
+
+                        /* The host's own client connects by itself */
+                        if (client == N_HOST_CLIENT_ID &&
+                            event == N_EV_MESSAGE && p &&
+                            N_message_load(&n_receive_msg, p, size))
+                                G_server_callback(client, event);
+                        continue;
+                }
+
+                /* Clients the host dropped by itself while recording are
+                   dropped again by the replay */
+                if (event == N_EV_CONNECTED)
+                        N_attach_client(client, TRUE);
+                else if (!n_clients[client].connected)
+                        continue;
+                else if (event == N_EV_DISCONNECTED)
+                        N_attach_client(client, FALSE);
+                else if (event == N_EV_MESSAGE) {
+                        if (N_message_load(&n_receive_msg, p, size))
+                                G_server_callback(client, event);
+                } else
+                        G_server_callback(client, event);
+        }
+        if (replay_pos < replay_len && replay_data[replay_pos] == RT_POLLED)
+                replay_pos++;
+}
+
+/******************************************************************************\
+ Read a whole recording into memory. Returns FALSE if it cannot be read.
+\******************************************************************************/
+static bool replay_load(const char *filename)
+{
+        c_file_t file;
+        int size, len;
+
+        if (!C_file_init_read(&file, filename))
+                return FALSE;
+        replay_len = 0;
+        for (size = 64 * 1024; ; size *= 2) {
+                replay_data = C_realloc(replay_data, size);
+                len = C_file_read(&file, replay_data + replay_len,
+                                  size - replay_len);
+                if (len <= 0)
+                        break;
+                replay_len += len;
+        }
+        C_file_cleanup(&file);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Compare function for sorting frame times.
+\******************************************************************************/
+static int compare_floats(const void *a, const void *b)
+{
+        float fa, fb;
+
+        fa = *(const float *)a;
+        fb = *(const float *)b;
+        return fa < fb ? -1 : fa > fb;
+}
+
+/******************************************************************************\
+ Set a variable to a recorded value right away.
+\******************************************************************************/
+static void replay_var(c_var_t *var, const char *value)
+{
+        C_var_set(var, value);
+        C_var_unlatch(var);
+}
+
+/******************************************************************************\
+ Replay a recorded game from [filename] as fast as possible and report how
+ long the host took per frame. Returns TRUE if the world ended up the same as
+ when it was recorded.
+\******************************************************************************/
+bool G_replay(const char *filename)
+{
+        const char *p;
+        float *frame_times, total, variance, forest;
+        int i, ints[HEADER_INTS], frames, frames_size, checksum, expected;
+        bool ended;
+
+        if (!replay_load(filename) || replay_len < 4 + HEADER_INTS * 4 ||
+            memcmp(replay_data, RECORD_MAGIC, 4)) {
+                C_warning("Failed to load recording '%s'", filename);
+                C_free(replay_data);
+                replay_data = NULL;
+                return FALSE;
+        }
+        p = replay_data + 4;
+        for (i = 0; i < HEADER_INTS; i++)
+                p = N_unpack_int(p, ints + i);
+        if (ints[0] != RECORD_VERSION || ints[1] != G_PROTOCOL) {
+                C_warning("Recording '%s' is from an incompatible version",
+                          filename);
+                C_free(replay_data);
+                replay_data = NULL;
+                return FALSE;
+        }
+        replay_pos = (int)(p - replay_data);
+
+        /* Host the game with the recorded settings */
+        replay_seed = ints[2];
+        c_time_msec = ints[3];
+        N_unpack_float(replay_data + 4 + 8 * 4, &variance);
+        N_unpack_float(replay_data + 4 + 9 * 4, &forest);
+        replay_var(&g_globe_subdiv4, C_va("%d", ints[4]));
+        replay_var(&g_globe_seed, C_va("%d", ints[5]));
+        replay_var(&g_island_num, C_va("%d", ints[6]));
+        replay_var(&g_island_size, C_va("%d", ints[7]));
+        replay_var(&g_island_variance, C_va("%.9g", variance));
+        replay_var(&g_forest, C_va("%.9g", forest));
+        replay_var(&g_players, C_va("%d", ints[10]));
+        replay_var(&g_time_limit, C_va("%d", ints[11] / 60000));
+        replay_var(&g_victory_gold, C_va("%d", ints[12]));
+        replay_var(&g_player_ship_limit, C_va("%d", ints[13]));
+        g_replaying = TRUE;
+        G_host_game();
+        if (n_client_id != N_HOST_CLIENT_ID) {
+                g_replaying = FALSE;
+                return FALSE;
+        }
+        g_time_limit_msec = c_time_msec + ints[11];
+        C_status("Replaying '%s'", filename);
+
+        /* Run the recorded frames */
+        frame_times = NULL;
+        frames = frames_size = 0;
+        ended = FALSE;
+        expected = 0;
+        while (replay_pos < replay_len) {
+                clock_t start;
+                int type;
+
+                type = replay_data[replay_pos];
+                if (type == RT_END) {
+                        if ((p = replay_read(5)))
+                                N_unpack_int(p + 1, &expected);
+                        ended = p != NULL;
+                        break;
+                }
+
+                /* Events from outside a frame */
+                if (type == RT_EVENT || type == RT_POLLED) {
+                        replay_events();
+                        continue;
+                }
+                if (type != RT_FRAME || !(p = replay_read(13))) {
+                        C_warning("Recording is corrupt at byte %d",
+                                  replay_pos);
+                        break;
+                }
+                p = N_unpack_int(p + 1, &c_time_msec);
+                p = N_unpack_int(p, &g_time_msec);
+                N_unpack_int(p, &g_tick_usec);
+                g_tick_sec = g_tick_usec / 1000000.f;
+                c_frame++;
+
+                /* Run the host and client updates and throw away whatever
+                   would have been sent */
+                start = clock();
+                G_update_host();
+                for (i = 1; i <= N_CLIENTS_MAX; i++)
+                        N_discard(i);
+                N_poll_client();
+                G_update_client();
+                if (frames >= frames_size) {
+                        frames_size = frames_size ? frames_size * 2 : 1024;
+                        frame_times = C_realloc(frame_times, frames_size *
+                                                sizeof (*frame_times));
+                }
+                frame_times[frames++] = 1000.f * (clock() - start) /
+                                        CLOCKS_PER_SEC;
+        }
+
+        /* Report */
+        checksum = world_checksum();
+        if (frames > 0) {
+                for (total = 0.f, i = 0; i < frames; i++)
+                        total += frame_times[i];
+                qsort(frame_times, frames, sizeof (*frame_times),
+                      compare_floats);
+                C_status("Replayed %d frames in %.0f msec: %.3f msec mean, "
+                         "%.3f median, %.3f 99th percentile, %.3f max", frames,
+                         total, total / frames, frame_times[frames / 2],
+                         frame_times[frames * 99 / 100],
+                         frame_times[frames - 1]);
+        }
+        if (!ended)
+                C_warning("Recording ended early, cannot check the world");
+        else if (checksum != expected)
+                C_warning("World differs from the recording (%08x, "
+                          "expected %08x)", checksum, expected);
+        else
+                C_status("World matches the recording");
+        C_free(frame_times);
+        C_free(replay_data);
+        replay_data = NULL;
+        replay_len = replay_pos = 0;
+        g_replaying = FALSE;
+        return ended && checksum == expected;
+}
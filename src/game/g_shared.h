@@ -63,6 +63,12 @@ typedef struct g_nation {
         int gold;
 } g_nation_t;
 
+/* g_bot.c */
+int G_bot_ping(void);
+void G_bot_update(int interval);
+
+extern int g_bot_commands;
+
 /* g_client.c */
 void G_cleanup(void);
 void G_init(void);
@@ -73,7 +79,7 @@ void G_update_client(void);
 void G_buy_cargo(g_cargo_type_t, int amount);
 void G_drop_cargo(g_cargo_type_t, int amount);
 void G_input_chat(char *message);
-void G_input_privmsg(char *message, int clients);
+void G_input_privmsg(char *message, const c_bits_t *clients);
 void G_join_game(const char *address);
 void G_leave_game(void);
 void G_tile_ring_callback(int icon);
@@ -104,6 +110,13 @@ void G_update_host(void);
 
 extern int g_clients_max, g_time_limit_msec;
 
+/* g_record.c */
+bool G_replay(const char *filename);
+
+/* g_tick.c */
+int G_tick_wait(void);
+void G_update(void);
+
 /* g_variables.c */
 void G_register_variables(void);
 
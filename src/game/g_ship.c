@@ -20,24 +20,211 @@
 /* Maximum crew value */
 #define CREW_MAX (G_SHIP_OPTIMAL_CREW * 400)
 
-/* Ships dict */
-PyObject *g_ship_dict;
-
-/* Current ship id */
-g_ship_id ship_id = 0;
+/* Ship slot map. Every ship is kept in [g_ships], densely packed in no
+   particular order. A ship id names a slot that holds the index of the ship
+   in [g_ships] and the generation of the id that is using it. Generations
+   go up every time a slot is freed so ids of ships that are gone do not find
+   the ships that replaced them. Free slots are linked both ways through
+   [prev] and [next] so that any one of them can be taken in constant time. */
+typedef struct ship_slot {
+        int generation, index, prev, next;
+} ship_slot_t;
+
+g_ship_t **g_ships;
+int g_ships_len;
+
+static ship_slot_t *slots;
+static int slots_len, slots_size, ships_size, free_slot = -1;
 
 /* The ship the mouse is hovering over and the currently selected ship */
 g_ship_t *g_hover_ship, *g_selected_ship;
 
 static int focus_stamp;
 
+/* Ids of ships that may have changed who can see their cargo */
+static c_array_t visible_queue;
+
+/******************************************************************************\
+ Count a ship toward the totals of the client that owns it. Only the host
+ keeps totals.
+\******************************************************************************/
+static void tally_ship(g_ship_t *ship)
+{
+        if (n_client_id != N_HOST_CLIENT_ID || !ship->store ||
+            ship->client < 0 || ship->client > N_CLIENTS_MAX)
+                return;
+        g_totals[ship->client].ships++;
+        G_store_set_client(ship->store, ship->client);
+}
+
+/******************************************************************************\
+ Take a ship out of the totals it was counted toward, if any.
+\******************************************************************************/
+static void untally_ship(g_ship_t *ship)
+{
+        if (!ship->store || ship->store->client < 0)
+                return;
+        g_totals[ship->store->client].ships--;
+        G_store_set_client(ship->store, N_INVALID_ID);
+}
+
 /******************************************************************************\
  Cleanup all ships.
 \******************************************************************************/
 void G_cleanup_ships(void)
 {
-        ship_id = 0;
-        PyDict_Clear(g_ship_dict);
+        for (; g_ships_len > 0; g_ships_len--) {
+                untally_ship(g_ships[g_ships_len - 1]);
+                Py_DECREF(g_ships[g_ships_len - 1]);
+        }
+        C_array_cleanup(&visible_queue);
+        C_free(g_ships);
+        C_free(slots);
+        g_ships = NULL;
+        slots = NULL;
+        ships_size = slots_len = slots_size = 0;
+        free_slot = -1;
+}
+
+/******************************************************************************\
+ Returns the ship with [id] or NULL if there is no such ship.
+\******************************************************************************/
+g_ship_t *G_get_ship(g_ship_id id)
+{
+        const ship_slot_t *slot;
+
+        if (id < 0 || (id & (G_SHIP_SLOTS - 1)) >= slots_len)
+                return NULL;
+        slot = slots + (id & (G_SHIP_SLOTS - 1));
+        if (slot->index < 0 || slot->generation != id >> G_SHIP_SLOT_BITS)
+                return NULL;
+        return g_ships[slot->index];
+}
+
+/******************************************************************************\
+ Put a slot at the head of the free list.
+\******************************************************************************/
+static void link_slot(int slot)
+{
+        slots[slot].prev = -1;
+        slots[slot].next = free_slot;
+        if (free_slot >= 0)
+                slots[free_slot].prev = slot;
+        free_slot = slot;
+}
+
+/******************************************************************************\
+ Take a slot out of the free list.
+\******************************************************************************/
+static void unlink_slot(int slot)
+{
+        if (slots[slot].prev >= 0)
+                slots[slots[slot].prev].next = slots[slot].next;
+        else {
+                C_assert(free_slot == slot);
+                free_slot = slots[slot].next;
+        }
+        if (slots[slot].next >= 0)
+                slots[slots[slot].next].prev = slots[slot].prev;
+}
+
+/******************************************************************************\
+ Make sure there are at least [len] slots. New slots go on the free list.
+\******************************************************************************/
+static void grow_slots(int len)
+{
+        if (len > slots_size) {
+                slots_size = slots_size ? slots_size * 2 : 256;
+                while (slots_size < len)
+                        slots_size *= 2;
+                slots = C_realloc(slots, slots_size * sizeof (*slots));
+        }
+        for (; slots_len < len; slots_len++) {
+                slots[slots_len].generation = 0;
+                slots[slots_len].index = -1;
+                link_slot(slots_len);
+        }
+}
+
+/******************************************************************************\
+ Take a slot off the free list and return the id for it. If [id] is not
+ negative, that id is used, as when the server tells us the ids of its ships.
+ Returns -1 if the slot is not available.
+\******************************************************************************/
+static g_ship_id take_slot(g_ship_id id)
+{
+        int slot;
+
+        if (id < 0) {
+                if (free_slot < 0) {
+                        if (slots_len >= G_SHIP_SLOTS)
+                                return -1;
+                        grow_slots(slots_len + 1);
+                }
+                slot = free_slot;
+                unlink_slot(slot);
+                return (slots[slot].generation << G_SHIP_SLOT_BITS) | slot;
+        }
+
+        /* Unlink a particular slot */
+        slot = id & (G_SHIP_SLOTS - 1);
+        grow_slots(slot + 1);
+        if (slots[slot].index >= 0)
+                return -1;
+        unlink_slot(slot);
+        slots[slot].generation = id >> G_SHIP_SLOT_BITS;
+        return id;
+}
+
+/******************************************************************************\
+ Add a ship to the slot map under its id. The slot map keeps a reference.
+\******************************************************************************/
+static void add_ship(g_ship_t *ship)
+{
+        if (g_ships_len >= ships_size) {
+                ships_size = ships_size ? ships_size * 2 : 256;
+                g_ships = C_realloc(g_ships, ships_size * sizeof (*g_ships));
+        }
+        slots[ship->id & (G_SHIP_SLOTS - 1)].index = g_ships_len;
+        g_ships[g_ships_len++] = ship;
+        Py_INCREF(ship);
+}
+
+/******************************************************************************\
+ Remove a ship from the slot map and free its slot. The last ship is moved
+ into its place so do not remove ships while iterating forward over them.
+\******************************************************************************/
+static void remove_ship(g_ship_t *ship)
+{
+        ship_slot_t *slot;
+        g_ship_t *last;
+
+        if (G_get_ship(ship->id) != ship)
+                return;
+        slot = slots + (ship->id & (G_SHIP_SLOTS - 1));
+        last = g_ships[--g_ships_len];
+        g_ships[slot->index] = last;
+        slots[last->id & (G_SHIP_SLOTS - 1)].index = slot->index;
+        slot->index = -1;
+        slot->generation = (slot->generation + 1) &
+                           (C_INT_MAX >> G_SHIP_SLOT_BITS);
+        link_slot((int)(slot - slots));
+        C_wheel_cancel(&g_timers, ship->food_timer);
+        C_wheel_cancel(&g_timers, ship->combat_timer);
+        untally_ship(ship);
+        Py_DECREF(ship);
+}
+
+/******************************************************************************\
+ Change the client that owns a ship here. G_ship_change_client() is what
+ tells everyone about it.
+\******************************************************************************/
+void G_ship_set_client(g_ship_t *ship, n_client_id_t client)
+{
+        untally_ship(ship);
+        ship->client = client;
+        tally_ship(ship);
+        G_ship_queue_visible(ship);
 }
 
 /******************************************************************************\
@@ -47,8 +234,8 @@ void G_ship_send_spawn(g_ship_t *ship, n_client_id_t client)
 {
         if (!ship->in_use)
                 return;
-        N_send(client, "12121", G_SM_SHIP_SPAWN, ship->id,
-               ship->client, ship->tile, ship->class->class_id);
+        G_send_sm_ship_spawn(G_ship_route(ship, client), ship->id,
+                             ship->client, ship->tile, ship->class->class_id);
 }
 
 /******************************************************************************\
@@ -58,14 +245,86 @@ void G_ship_send_name(g_ship_t *ship, n_client_id_t client)
 {
         if (!ship->in_use)
                 return;
-        N_send(client, "12s", G_SM_SHIP_NAME, ship->id, ship->name);
+        G_send_sm_ship_name(G_ship_route(ship, client), ship->id, ship->name);
+}
+
+/******************************************************************************\
+ Remove a ship that the server has stopped telling us about. The ship will be
+ spawned again if it comes back into our area of interest.
+\******************************************************************************/
+void G_ship_forget(g_ship_t *ship)
+{
+        if (!ship)
+                return;
+        if (g_selected_ship == ship)
+                G_ship_select(NULL);
+        if (g_hover_ship == ship)
+                G_ship_hover(NULL);
+        if (g_tiles[ship->tile].ship == ship)
+                G_tile_set_ship(ship->tile, NULL);
+        if (ship->rear_tile >= 0 && g_tiles[ship->rear_tile].ship == ship)
+                G_tile_set_ship(ship->rear_tile, NULL);
+        ship->in_use = FALSE;
+        remove_ship(ship);
+}
+
+/******************************************************************************\
+ Feed the ship's crew. Called by the host's food timer for the ship, which is
+ scheduled again for the next meal. A ship without crew has no timer until
+ crew comes aboard again.
+\******************************************************************************/
+static void ship_eat(g_ship_id id)
+{
+        g_ship_t *ship;
+        int crew, available;
+
+        if (!(ship = G_get_ship(id)))
+                return;
+        ship->food_timer = 0;
+        crew = ship->store->cargo[G_CT_CREW].amount;
+        if (crew <= 0 || g_game_over)
+                return;
+
+        /* Consume rations first */
+        if (ship->store->cargo[G_CT_RATIONS].amount > 0) {
+                available = G_cargo_nutritional_value(G_CT_RATIONS);
+                G_store_add(ship->store, G_CT_RATIONS, -1);
+        }
+
+        /* Out of food, it's cannibalism time */
+        else {
+                available = G_cargo_nutritional_value(G_CT_CREW);
+                G_store_add(ship->store, G_CT_CREW, -1);
+        }
+
+        /* Did the crew just starve to death? */
+        if (ship->store->cargo[G_CT_CREW].amount <= 0) {
+                G_ship_change_client(ship, N_SERVER_ID);
+                return;
+        }
+
+        ship->food_timer = C_wheel_schedule(&g_timers, g_time_msec,
+                                            available / crew, ship_eat, id);
+}
+
+/******************************************************************************\
+ Start the host's food timer for a ship that has crew aboard and is not
+ being fed yet.
+\******************************************************************************/
+void G_ship_feed(g_ship_t *ship)
+{
+        if (!ship || ship->food_timer || n_client_id != N_HOST_CLIENT_ID ||
+            ship->store->cargo[G_CT_CREW].amount <= 0)
+                return;
+        ship->food_timer = C_wheel_schedule(&g_timers, g_time_msec, 0,
+                                            ship_eat, ship->id);
 }
 
 /******************************************************************************\
  Find an available tile around [tile] (including [tile]) and spawn a new ship
  of the given class there. If [tile] is negative, the ship will be placed on
- a random open tile. If [id] is negative, ship_id will be used instead and
- ship_id will be incremented.
+ a random open tile. If [id] is negative, the ship is given a free slot.
+ Otherwise a ship already using the slot of [id] is forgotten.
 \******************************************************************************/
 g_ship_t *G_ship_spawn(g_ship_id id, n_client_id_t client, int tile,
                 g_ship_type_t type)
@@ -80,37 +339,25 @@ g_ship_t *G_ship_spawn(g_ship_id id, n_client_id_t client, int tile,
                 return NULL;
         }
 
-        /* Get new id if [id] is not given */
-        if (id < 0) {
-                if(ship_id == C_SHORT_MAX && n_client_id == N_HOST_CLIENT_ID) {
-                        N_send(client, "12ss", G_SM_POPUP, tile, "g-ship-max",
-                               "Wow you have reached the maximum limit of 32767"
-                               " ships");
-                        return NULL;
-                }
-                id = ship_id++;
+        /* Check for a free slot */
+        if (id < 0 && free_slot < 0 && slots_len >= G_SHIP_SLOTS) {
+                if (n_client_id == N_HOST_CLIENT_ID)
+                        G_send_sm_popup(client, tile, "g-ship-max",
+                                        "There are too many ships in the "
+                                        "game");
+                return NULL;
         }
+        if (id >= 0 && (id & (G_SHIP_SLOTS - 1)) < slots_len &&
+            slots[id & (G_SHIP_SLOTS - 1)].index >= 0)
+                G_ship_forget(g_ships[slots[id & (G_SHIP_SLOTS - 1)].index]);
 
         /* Ship limits */
-        if(n_client_id == N_HOST_CLIENT_ID) {
-                int ships, limit;
-                g_ship_t *ship;
-                PyObject *key;
-                Py_ssize_t pos = 0;
-                ships = 0;
-                limit = g_player_ship_limit.value.n;
-                /* Count ships */
-                while (PyDict_Next(g_ship_dict, &pos, &key, (PyObject**)&ship)){
-                        if (!ship->in_use || ship->health <= 0 ||
-                            client != ship->client)
-                                continue;
-                        ships++;
-                }
-                if (ships >= limit) {
-                        N_send(client, "12ss", G_SM_POPUP, tile, "g-ship-limit",
-                               "You have reached the maximum number of ships");
-                        return NULL;
-                }
+        if (n_client_id == N_HOST_CLIENT_ID &&
+            g_totals[client].ships >= g_player_ship_limit.value.n) {
+                G_send_sm_popup(client, tile, "g-ship-limit",
+                                "You have reached the maximum number of "
+                                "ships");
+                return NULL;
         }
 
         /* If we are to spawn the ship anywhere, pick a random tile */
@@ -137,7 +384,6 @@ g_ship_t *G_ship_spawn(g_ship_id id, n_client_id_t client, int tile,
         /* Initialize ship structure */
         ship = (g_ship_t*)Ship_new(&ShipType, NULL, NULL);
         ship->in_use = TRUE;
-        ship->id = id;
         ship->tile = ship->target = tile;
         ship->target_ship = NULL;
         ship->rear_tile = -1;
@@ -151,9 +397,6 @@ g_ship_t *G_ship_spawn(g_ship_id id, n_client_id_t client, int tile,
         Py_INCREF(sc);
         ship->class = sc;
 
-        /* Start out unnamed */
-        C_strncpy_buf(ship->name, C_va("Unnamed id: %d", ship->id));
-
         /* Initialize store */
         ship->store = G_store_init(sc->cargo);
 
@@ -165,19 +408,30 @@ g_ship_t *G_ship_spawn(g_ship_id id, n_client_id_t client, int tile,
                 return NULL;
         }
         G_tile_position_model(tile, ship->model);
-        Py_INCREF(ship);
-        g_tiles[tile].ship = ship;
+        G_tile_set_ship(tile, ship);
+
+        /* Store the ship in its slot. The slot map now holds the reference
+           we were given. */
+        ship->id = id = take_slot(id);
+        C_assert(id >= 0);
+        add_ship(ship);
+        tally_ship(ship);
+        G_ship_queue_visible(ship);
+        Py_DECREF(ship);
+
+        /* The host feeds the crew once some comes aboard */
+        ship->store->ship = id;
 
-        G_set_ship(id, ship);
+        /* Start out unnamed */
+        C_strncpy_buf(ship->name, C_va("Unnamed id: %d", ship->id));
 
-        /* If we are the server, tell other clients */
-        if (n_client_id == N_HOST_CLIENT_ID)
-                G_ship_send_spawn(ship, N_BROADCAST_ID);
+        /* If we are the server, tell interested clients */
+        G_interest_update_ship(ship);
 
         /* If this is one of ours, name it */
         if (client == n_client_id) {
                 G_get_name_buf(G_NT_SHIP, ship->name);
-                N_send(N_SERVER_ID, "12s", G_CM_SHIP_NAME, id, ship->name);
+                G_send_cm_ship_name(N_SERVER_ID, id, ship->name);
         }
 
         /* If we spawned on a gib, collect it */
@@ -193,22 +447,20 @@ void G_render_ships(void)
 {
         ShipClass *ship_class;
         g_ship_t *ship;
-        PyObject *key;
-        Py_ssize_t pos = 0;
-        const g_tile_t *tile;
         c_color_t color;
         float crew, crew_max, health, health_max;
+        int i;
 
         if (i_limbo)
                 return;
-        while (PyDict_Next(g_ship_dict, &pos, &key, (PyObject**)&ship)) {
+        for (i = 0; i < g_ships_len; i++) {
+                ship = g_ships[i];
                 if (!ship->in_use)
                         continue;
                 C_assert(ship->tile >= 0 && ship->tile < r_tiles_max);
-                tile = g_tiles + ship->tile;
 
                 /* Don't bother rendering if the ship isn't visible */
-                if (!tile->visible)
+                if (!G_tile_visible(ship->tile))
                         continue;
 
                 /* Draw the status display */
@@ -246,7 +498,7 @@ static void ship_configure_trade(g_ship_t *ship)
 
         /* Our client can't actually see this cargo -- we probably don't have
            the right data for it anyway! */
-        if (!ship || !ship->store->visible[n_client_id]) {
+        if (!ship || !N_client_in(ship->store->visible, n_client_id)) {
                 I_disable_trade();
                 return;
         }
@@ -421,7 +673,6 @@ static void ship_update_trade(g_ship_t *ship)
 void G_ship_send_cargo(g_ship_t *ship, n_client_id_t client)
 {
         g_ship_id id;
-        int i;
         bool broadcast;
 
         /* Host already knows everything */
@@ -438,41 +689,40 @@ void G_ship_send_cargo(g_ship_t *ship, n_client_id_t client)
         /* Pack all the cargo information */
         N_send_start();
         N_send_char(G_SM_SHIP_CARGO);
-        N_send_short(id);
+        N_send_int(id);
         G_store_send(ship->store,
                      !broadcast || client == N_SELECTED_ID);
 
-        /* Already selected the target clients */
-        if (client == N_SELECTED_ID) {
-                N_send_selected(NULL);
-                return;
-        }
-
-        /* Send to clients that can see complete cargo information */
-        if (broadcast) {
-                for (i = 0; i < N_CLIENTS_MAX; i++)
-                        n_clients[i].selected = ship->store->visible[i];
+        /* Send to clients that know about the ship and can see complete
+           cargo information, unless the target clients are already
+           selected */
+        if (client == N_SELECTED_ID || broadcast) {
+                if (client != N_SELECTED_ID)
+                        G_store_select_clients(ship->store);
+                C_bits_and(n_selected, ship->known, N_CLIENTS_MAX);
                 N_send_selected(NULL);
                 return;
         }
 
         /* Send to a single client */
-        if (ship->store->visible[client])
+        if (N_client_in(ship->store->visible, client))
                 N_send(client, NULL);
 }
 
 /******************************************************************************\
- Sends out the ship's current state.
+ Sends out the ship's current state. Pass a negative [client] to send to all
+ clients that know about the ship except the host.
 \******************************************************************************/
 void G_ship_send_state(g_ship_t *ship, n_client_id_t client)
 {
         if (n_client_id != N_HOST_CLIENT_ID)
                 return;
-        N_broadcast_except(N_HOST_CLIENT_ID, "121212", G_SM_SHIP_STATE,
-                           ship->id, ship->health,
-                           ship->store->cargo[G_CT_CREW].amount,
-                           ship->boarding, (ship->boarding_ship) ?
-                                                 ship->boarding_ship->id : -1);
+        if (client < 0)
+                client = N_EXCEPT_ID(N_HOST_CLIENT_ID);
+        G_send_sm_ship_state(G_ship_route(ship, client), ship->id,
+                             ship->health, ship->store->cargo[G_CT_CREW].amount,
+                             ship->boarding, (ship->boarding_ship) ?
+                                             ship->boarding_ship->id : -1);
 }
 
 /******************************************************************************\
@@ -481,8 +731,7 @@ void G_ship_send_state(g_ship_t *ship, n_client_id_t client)
 \******************************************************************************/
 static void ship_update_visible(g_ship_t *ship)
 {
-        int i;
-        bool old_visible[N_CLIENTS_MAX], selected;
+        n_client_set_t old_visible;
 
         memcpy(old_visible, ship->store->visible, sizeof (old_visible));
 
@@ -491,7 +740,8 @@ static void ship_update_visible(g_ship_t *ship)
 
         /* Reselect if our client's visibility toward this ship changed and
            we have it selected */
-        if (old_visible[n_client_id] != ship->store->visible[n_client_id])
+        if (N_client_in(old_visible, n_client_id) !=
+            N_client_in(ship->store->visible, n_client_id))
                 G_ship_reselect(ship, -1);
 
         /* No need to send updates here if we aren't hosting */
@@ -500,52 +750,22 @@ static void ship_update_visible(g_ship_t *ship)
 
         /* Only send the update to clients that can see the store now but
            couldn't see it before */
-        for (selected = FALSE, i = 0; i < N_CLIENTS_MAX; i++) {
-                n_clients[i].selected = FALSE;
-                if (i == N_HOST_CLIENT_ID || old_visible[i] ||
-                    !ship->store->visible[i])
-                        continue;
-                n_clients[i].selected = TRUE;
-                selected = TRUE;
-        }
-        if (selected)
+        if (G_store_select_new(ship->store, old_visible))
                 G_ship_send_cargo(ship, N_SELECTED_ID);
 }
 
 /******************************************************************************\
- Feed the ship's crew at regular interval.
+ Have the ship's cargo visibility updated on the next frame. Call whenever
+ something that decides who can see it changes, such as the owner or tile.
 \******************************************************************************/
-static void ship_update_food(g_ship_t *ship)
+void G_ship_queue_visible(g_ship_t *ship)
 {
-        int crew, available;
-
-        /* Only the host updates food */
-        if (n_client_id != N_HOST_CLIENT_ID)
+        if (ship->visible_queued)
                 return;
-
-        /* Not time to eat yet */
-        if (c_time_msec < ship->lunch_time ||
-            ship->store->cargo[G_CT_CREW].amount <= 0)
-                return;
-        crew = ship->store->cargo[G_CT_CREW].amount;
-
-        /* Consume rations first */
-        if (ship->store->cargo[G_CT_RATIONS].amount > 0) {
-                available = G_cargo_nutritional_value(G_CT_RATIONS);
-                G_store_add(ship->store, G_CT_RATIONS, -1);
-        }
-
-        /* Out of food, it's cannibalism time */
-        else {
-                available = G_cargo_nutritional_value(G_CT_CREW);
-                G_store_add(ship->store, G_CT_CREW, -1);
-        }
-
-        ship->lunch_time = c_time_msec + available / crew;
-
-        /* Did the crew just starve to death? */
-        if (ship->store->cargo[G_CT_CREW].amount <= 0)
-                G_ship_change_client(ship, N_SERVER_ID);
+        if (!visible_queue.item_size)
+                C_array_init(&visible_queue, g_ship_id, 64);
+        ship->visible_queued = TRUE;
+        C_array_append(&visible_queue, &ship->id);
 }
 
 /******************************************************************************\
@@ -554,10 +774,10 @@ static void ship_update_food(g_ship_t *ship)
 void G_update_ships(void)
 {
         g_ship_t *ship;
-        PyObject *key;
-        Py_ssize_t pos = 0;
+        int i;
 
-        while (PyDict_Next(g_ship_dict, &pos, &key, (PyObject**)&ship)) {
+        for (i = 0; i < g_ships_len; i++) {
+                ship = g_ships[i];
                 if (!ship->in_use)
                         continue;
                 /* Reset modified status */
@@ -567,9 +787,7 @@ void G_update_ships(void)
                         G_ship_update_move(ship);
                         G_ship_update_combat(ship);
                         ship_update_trade(ship);
-                        ship_update_food(ship);
                 }
-                ship_update_visible(ship);
 
                 /* If the cargo manfiest changed, send updates once per frame */
                 if (ship->store->modified)
@@ -579,6 +797,18 @@ void G_update_ships(void)
                 if (ship->modified)
                         G_ship_send_state(ship, -1);
         }
+
+        /* Only ships that were queued can have changed who sees their cargo.
+           Ships that are gone by now are not found. */
+        for (i = 0; i < visible_queue.len; i++) {
+                ship = G_get_ship(*C_array_get(&visible_queue, g_ship_id, i));
+                if (!ship)
+                        continue;
+                ship->visible_queued = FALSE;
+                if (ship->in_use)
+                        ship_update_visible(ship);
+        }
+        visible_queue.len = 0;
 }
 
 /******************************************************************************\
@@ -662,7 +892,7 @@ static void ship_quick_info(g_ship_t *ship)
                 return;
 
         /* Food supply before resorting to cannibalism */
-        if (!ship->store->visible[n_client_id])
+        if (!N_client_in(ship->store->visible, n_client_id))
                 return;
         for (total = i = 0; i < G_CARGO_TYPES; i++) {
                 if (i == G_CT_CREW)
@@ -773,11 +1003,9 @@ bool G_ship_hostile(g_ship_t *ship, n_client_id_t to_client)
 \******************************************************************************/
 void G_focus_next_ship(void)
 {
-        PyObject *key;
-        Py_ssize_t pos = 0;
         g_ship_t *ship, *best_ship;
         float best_dist;
-        int tile, available;
+        int i, tile, available;
 
         /* If we have a ship selected, just center on that */
         if (g_selected_ship) {
@@ -791,10 +1019,11 @@ void G_focus_next_ship(void)
         best_ship = NULL;
         best_dist = C_FLOAT_MAX;
 
-        while (PyDict_Next(g_ship_dict, &pos, &key, (PyObject**)&ship)) {
+        for (i = 0; i < g_ships_len; i++) {
                 c_vec3_t origin;
                 float dist;
 
+                ship = g_ships[i];
                 if (!G_ship_controlled_by(ship, n_client_id) ||
                     ship->focus_stamp >= focus_stamp)
                         continue;
@@ -820,7 +1049,8 @@ void G_focus_next_ship(void)
 \******************************************************************************/
 void G_ship_change_client(g_ship_t *ship, n_client_id_t client)
 {
-        N_broadcast("121", G_SM_SHIP_OWNER, ship->id, client);
+        G_send_sm_ship_owner(G_ship_route(ship, N_BROADCAST_ID), ship->id,
+                             client);
 }
 
 /******************************************************************************\
@@ -933,3 +1163,74 @@ void G_ship_update_trade_ui(g_ship_t *ship)
                 return;
         ship_configure_trade(g_selected_ship);
 }
+
+/******************************************************************************\
+ Benchmark looking up and iterating over [count] ships in the slot map
+ against the string-keyed dictionary ships used to be kept in. Only runs
+ while there are no ships in play since it fills the slot map with bare
+ ships and frees their slots afterwards.
+\******************************************************************************/
+void G_test_ships(int count)
+{
+        PyObject *dict, *key, *value;
+        Py_ssize_t pos;
+        g_ship_t *ship;
+        int i, j, sum, passes, map_lookup, map_iterate, dict_lookup,
+            dict_iterate;
+
+        if (count <= 0)
+                return;
+        if (g_ships_len) {
+                C_warning("Can't benchmark ships with ships in play");
+                return;
+        }
+        if (count > G_SHIP_SLOTS)
+                count = G_SHIP_SLOTS;
+        dict = PyDict_New();
+        for (i = 0; i < count; i++) {
+                ship = (g_ship_t *)Ship_new(&ShipType, NULL, NULL);
+                ship->id = take_slot(-1);
+                add_ship(ship);
+                PyDict_SetItemString(dict, C_va("%d", ship->id),
+                                     (PyObject *)ship);
+                Py_DECREF(ship);
+        }
+
+        /* Look every ship up and walk the whole set enough times to take a
+           measurable amount of time */
+        passes = 1 + 1000000 / count;
+        sum = 0;
+        C_timer();
+        for (j = 0; j < passes; j++)
+                for (i = 0; i < count; i++)
+                        sum += G_get_ship(g_ships[i]->id)->id;
+        map_lookup = C_timer();
+        for (j = 0; j < passes; j++)
+                for (i = 0; i < g_ships_len; i++)
+                        sum += g_ships[i]->id;
+        map_iterate = C_timer();
+        for (j = 0; j < passes; j++)
+                for (i = 0; i < count; i++) {
+                        value = PyDict_GetItemString(dict,
+                                                     C_va("%d",
+                                                          g_ships[i]->id));
+                        sum += ((g_ship_t *)value)->id;
+                }
+        dict_lookup = C_timer();
+        for (j = 0; j < passes; j++)
+                for (pos = 0; PyDict_Next(dict, &pos, &key, &value); )
+                        sum += ((g_ship_t *)value)->id;
+        dict_iterate = C_timer();
+
+        /* Free the slots from the back so nothing gets moved */
+        while (g_ships_len > 0)
+                remove_ship(g_ships[g_ships_len - 1]);
+        Py_DECREF(dict);
+
+        C_status("Ship benchmark, %d ships x %d passes (checksum %d)",
+                 count, passes, sum);
+        C_status("Slot map: lookup %d msec, iterate %d msec",
+                 map_lookup, map_iterate);
+        C_status("Dictionary: lookup %d msec, iterate %d msec",
+                 dict_lookup, dict_iterate);
+}
@@ -0,0 +1,202 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* World snapshots for joining clients. While a client is being initialized,
+   everything sent to it is held back and then compressed into one snapshot.
+   The snapshot is streamed in chunks as the client's send buffer drains and
+   anything sent to the client in the meantime waits behind it. The client
+   applies the whole snapshot at once when the last chunk arrives. */
+
+#include "g_common.h"
+
+/* Compressed snapshot bytes per message */
+#define CHUNK_SIZE 8192
+
+/* Largest uncompressed snapshot a client will accept */
+#define SNAPSHOT_MAX (16 * 1024 * 1024)
+
+/* Snapshot being streamed to a client */
+typedef struct snapshot {
+        char *data;
+        int size, raw_size, sent, start_time, peak;
+} snapshot_t;
+
+static snapshot_t snapshots[N_CLIENTS_MAX];
+
+/* Snapshot being received from the server */
+static char *recv_data;
+static int recv_len, recv_size;
+
+/******************************************************************************\
+ Start holding messages sent to [client] so they can go into its snapshot.
+\******************************************************************************/
+void G_snapshot_begin(n_client_id_t client)
+{
+        C_free(snapshots[client].data);
+        C_zero(snapshots + client);
+        snapshots[client].start_time = c_time_msec;
+        N_hold(client, TRUE);
+}
+
+/******************************************************************************\
+ Compress everything held for [client] into its snapshot and start streaming
+ it. The client stays held until the snapshot has been sent.
+\******************************************************************************/
+void G_snapshot_end(n_client_id_t client)
+{
+        snapshot_t *snapshot;
+        uLongf size;
+        char *raw;
+        int raw_size;
+
+        snapshot = snapshots + client;
+        raw = N_hold_take(client, &raw_size);
+        if (raw_size <= 0) {
+                C_free(raw);
+                N_hold(client, FALSE);
+                return;
+        }
+        size = compressBound(raw_size);
+        snapshot->data = C_malloc(size);
+        if (compress((Bytef *)snapshot->data, &size, (Bytef *)raw,
+                     raw_size) != Z_OK) {
+                C_warning("Failed to compress snapshot for client %d",
+                          client);
+                C_free(raw);
+                C_free(snapshot->data);
+                snapshot->data = NULL;
+                N_drop_client(client);
+                return;
+        }
+        C_free(raw);
+        snapshot->size = (int)size;
+        snapshot->raw_size = raw_size;
+        C_debug("Snapshot for client %d is %d bytes, %d compressed", client,
+                raw_size, snapshot->size);
+}
+
+/******************************************************************************\
+ Stream pending snapshots to clients as their send buffers drain.
+\******************************************************************************/
+void G_update_snapshots(void)
+{
+        static n_message_t msg;
+        int i;
+
+        if (n_client_id != N_HOST_CLIENT_ID)
+                return;
+        for (i = 0; i < N_CLIENTS_MAX; i++) {
+                snapshot_t *snapshot;
+                int len, buffered;
+
+                snapshot = snapshots + i;
+                if (!snapshot->data)
+                        continue;
+                if (!n_clients[i].connected) {
+                        C_free(snapshot->data);
+                        snapshot->data = NULL;
+                        continue;
+                }
+                while (snapshot->sent < snapshot->size) {
+                        len = snapshot->size - snapshot->sent;
+                        if (len > CHUNK_SIZE)
+                                len = CHUNK_SIZE;
+                        N_message_start(&msg);
+                        N_message_write_char(&msg, G_SM_SNAPSHOT);
+                        N_message_write_int(&msg, snapshot->raw_size);
+                        N_message_write_int(&msg, snapshot->size);
+                        N_message_write_int(&msg, snapshot->sent);
+                        N_message_write_data(&msg, snapshot->data +
+                                                   snapshot->sent, len);
+                        if (!N_message_send_ahead(&msg, i))
+                                break;
+                        snapshot->sent += len;
+                }
+                buffered = n_clients[i].buffer_len + n_clients[i].held_len +
+                           n_clients[i].queued_len;
+                if (buffered > snapshot->peak)
+                        snapshot->peak = buffered;
+                if (snapshot->sent < snapshot->size)
+                        continue;
+                C_debug("Sent snapshot to client %d in %d msec, peak "
+                        "buffered %d bytes", i,
+                        c_time_msec - snapshot->start_time, snapshot->peak);
+                C_free(snapshot->data);
+                snapshot->data = NULL;
+                N_hold(i, FALSE);
+        }
+}
+
+/******************************************************************************\
+ Apply a received snapshot by dispatching every message in it.
+\******************************************************************************/
+static void apply_snapshot(int raw_size)
+{
+        uLongf size;
+        char *raw;
+        int pos, msg_size;
+
+        raw = C_malloc(raw_size);
+        size = raw_size;
+        if (uncompress((Bytef *)raw, &size, (Bytef *)recv_data,
+                       recv_size) != Z_OK || (int)size != raw_size) {
+                C_free(raw);
+                G_corrupt_disconnect();
+                return;
+        }
+        C_debug("Applying %d byte snapshot", raw_size);
+        for (pos = 0; pos + 2 <= raw_size && n_client_id >= 0;
+             pos += msg_size) {
+                N_unpack_short(raw + pos, &msg_size);
+                if (pos + msg_size > raw_size ||
+                    !N_message_load(&n_receive_msg, raw + pos, msg_size)) {
+                        G_corrupt_disconnect();
+                        break;
+                }
+                G_client_callback(N_SERVER_ID, N_EV_MESSAGE);
+        }
+        C_free(raw);
+}
+
+/******************************************************************************\
+ Receive a chunk of the world snapshot.
+\******************************************************************************/
+void G_receive_snapshot(void)
+{
+        const char *chunk;
+        int raw_size, size, offset, len;
+
+        raw_size = N_receive_int();
+        size = N_receive_int();
+        offset = N_receive_int();
+        len = n_receive_msg.size - n_receive_msg.pos;
+        chunk = N_message_read_reserve(&n_receive_msg, len);
+        if (!chunk || raw_size <= 0 || raw_size > SNAPSHOT_MAX ||
+            size <= 0 || size > SNAPSHOT_MAX || offset + len > size ||
+            (offset && (size != recv_size || offset != recv_len))) {
+                G_corrupt_disconnect();
+                return;
+        }
+        if (!offset) {
+                recv_len = 0;
+                recv_size = size;
+                recv_data = C_realloc(recv_data, size);
+        }
+        memcpy(recv_data + offset, chunk, len);
+        recv_len += len;
+        if (recv_len < recv_size)
+                return;
+        apply_snapshot(raw_size);
+        C_free(recv_data);
+        recv_data = NULL;
+        recv_len = recv_size = 0;
+}
@@ -14,6 +14,79 @@
 
 #include "g_common.h"
 
+/* Message token names for network statistics */
+#define NAME(t) [t] = #t
+static const char *server_msg_names[G_SERVER_MESSAGES] = {
+        NAME(G_SM_CLIENT),
+        NAME(G_SM_INIT),
+        NAME(G_SM_SNAPSHOT),
+        NAME(G_SM_ECHO_REQUEST),
+        NAME(G_SM_AFFILIATE),
+        NAME(G_SM_CONNECTED),
+        NAME(G_SM_DISCONNECTED),
+        NAME(G_SM_NAME),
+        NAME(G_SM_GAME_OVER),
+        NAME(G_SM_CLIENT_UPDATE),
+        NAME(G_SM_CHAT),
+        NAME(G_SM_PRIVMSG),
+        NAME(G_SM_POPUP),
+        NAME(G_SM_SHIP_CARGO),
+        NAME(G_SM_SHIP_NAME),
+        NAME(G_SM_SHIP_OWNER),
+        NAME(G_SM_SHIP_PATH),
+        NAME(G_SM_SHIP_PRICES),
+        NAME(G_SM_SHIP_SPAWN),
+        NAME(G_SM_SHIP_STATE),
+        NAME(G_SM_SHIP_TRANSACT),
+        NAME(G_SM_SHIP_FORGET),
+        NAME(G_SM_SHIP_HINTS),
+        NAME(G_SM_BUILDING),
+        NAME(G_SM_BUILDING_CARGO),
+        NAME(G_SM_GIB),
+};
+
+static const char *client_msg_names[G_CLIENT_MESSAGES] = {
+        NAME(G_CM_AFFILIATE),
+        NAME(G_CM_NAME),
+        NAME(G_CM_ECHO_BACK),
+        NAME(G_CM_CHAT),
+        NAME(G_CM_PRIVMSG),
+        NAME(G_CM_SHIP_BUY),
+        NAME(G_CM_BUILDING_BUY),
+        NAME(G_CM_SHIP_DROP),
+        NAME(G_CM_SHIP_MOVE),
+        NAME(G_CM_SHIP_NAME),
+        NAME(G_CM_SHIP_PRICES),
+        NAME(G_CM_SHIP_RING),
+        NAME(G_CM_TILE_RING),
+        NAME(G_CM_FOCUS),
+        NAME(G_CM_UDP_READY),
+};
+
+/******************************************************************************\
+ Give the network namespace the names of the message tokens and the send
+ priorities of the server messages. Everything not listed is critical. The
+ key sizes cover the object id, and for cargo the mask of the cargo types
+ included, so that only updates of the same fields supersede each other.
+\******************************************************************************/
+void G_name_messages(void)
+{
+        N_stats_names(server_msg_names, G_SERVER_MESSAGES, client_msg_names,
+                      G_CLIENT_MESSAGES);
+        N_queue_class(G_SM_SHIP_STATE, N_CLASS_CRITICAL, 4);
+        N_queue_class(G_SM_SHIP_PATH, N_CLASS_MOVEMENT, 4);
+        N_queue_class(G_SM_CLIENT_UPDATE, N_CLASS_TRADE, 0);
+        N_queue_class(G_SM_SHIP_CARGO, N_CLASS_TRADE, 8);
+        N_queue_class(G_SM_SHIP_PRICES, N_CLASS_TRADE, 5);
+        N_queue_class(G_SM_BUILDING_CARGO, N_CLASS_TRADE, 8);
+        N_queue_class(G_SM_CHAT, N_CLASS_CHAT, 0);
+        N_queue_class(G_SM_PRIVMSG, N_CLASS_CHAT, 0);
+        N_queue_class(G_SM_POPUP, N_CLASS_CHAT, 0);
+        N_queue_class(G_SM_SNAPSHOT, N_CLASS_BULK, 0);
+        N_queue_class(G_SM_SHIP_HINTS, N_CLASS_BULK, 0);
+        N_queue_class(G_SM_GIB, N_CLASS_BULK, 0);
+}
+
 /******************************************************************************\
  Disconnect if the server has sent corrupted data.
 \******************************************************************************/
@@ -26,12 +99,26 @@ void G_corrupt_drop_full(const char *file, int line, const char *func,
                 I_popup(NULL, "Server sent invalid data.");
                 N_disconnect();
         } else {
-                N_send(client, "12ss", G_SM_POPUP, -1,
-                       "g-host-invalid", "Your client sent invalid data.");
+                G_send_sm_popup(client, -1, "g-host-invalid",
+                                "Your client sent invalid data.");
                 N_drop_client(client);
         }
 }
 
+/******************************************************************************\
+ Convenience function to check a client index that was received and disconnect
+ [client] if it is invalid. Returns FALSE if the index was not valid.
+\******************************************************************************/
+bool G_check_client_full(const char *file, int line, const char *func,
+                         n_client_id_t client, int index)
+{
+        if (!N_client_valid(index)) {
+                G_corrupt_drop_full(file, line, func, client);
+                return FALSE;
+        }
+        return TRUE;
+}
+
 /******************************************************************************\
  Convenience function to receive a client index and disconnect if it is invalid.
  Returns a negative index if the received index was not valid.
@@ -42,13 +129,26 @@ int G_receive_client_full(const char *file, int line, const char *func,
         int index;
 
         index = N_receive_char();
-        if (!N_client_valid(index)) {
-                G_corrupt_drop_full(file, line, func, client);
+        if (!G_check_client_full(file, line, func, client, index))
                 return -1;
-        }
         return index;
 }
 
+/******************************************************************************\
+ Convenience function to check a received index and disconnect if it is out of
+ range. Returns FALSE if the index was not valid. Note that [min] is inclusive
+ but [max] is exclusive.
+\******************************************************************************/
+bool G_check_range_full(const char *file, int line, const char *func,
+                        n_client_id_t client, int index, int min, int max)
+{
+        if (index < min || index >= max) {
+                G_corrupt_drop_full(file, line, func, client);
+                return FALSE;
+        }
+        return TRUE;
+}
+
 /******************************************************************************\
  Convenience function to receive a one-byte index and disconnect if it is out
  of range. Returns a negative index if the received index was not valid.
@@ -60,31 +160,46 @@ int G_receive_range_full(const char *file, int line, const char *func,
         int index;
 
         index = N_receive_char();
-        if (index < min || index >= max) {
-                G_corrupt_drop_full(file, line, func, client);
+        if (!G_check_range_full(file, line, func, client, index, min, max))
                 return -1;
-        }
         return index;
 }
 
 /******************************************************************************\
- Convenience function to receive a ship id and check if it belongs to
- [client]. Pass a negative value for [client] to ignore this check. Returns a
- negative index if the received id was not valid.
+ Returns the ship with a received [id] or NULL if there is no such ship.
 \******************************************************************************/
-g_ship_t *G_receive_ship_full(const char *file, int line, const char *func,
-                        int client)
+g_ship_t *G_check_ship(int id)
 {
         g_ship_t *ship;
-        short id;
 
-        id = N_receive_short();
         ship = G_get_ship(id);
         if (!ship || !ship->in_use)
                 return NULL;
         return ship;
 }
 
+/******************************************************************************\
+ Convenience function to receive a ship id and check if it belongs to
+ [client]. Pass a negative value for [client] to ignore this check. Returns a
+ negative index if the received id was not valid.
+\******************************************************************************/
+g_ship_t *G_receive_ship_full(const char *file, int line, const char *func,
+                        int client)
+{
+        return G_check_ship(N_receive_int());
+}
+
+/******************************************************************************\
+ Convenience function to check a received tile index and disconnect if it is
+ invalid. Returns FALSE if the index was not valid.
+\******************************************************************************/
+bool G_check_tile_full(const char *file, int line, const char *func,
+                       n_client_id_t client, int index)
+{
+        return G_check_range_full(file, line, func, client, index, 0,
+                                  r_tiles_max);
+}
+
 /******************************************************************************\
  Convenience function to receive a tile index. Returns a negative index if the
  received index was not valid.
@@ -95,10 +210,8 @@ int G_receive_tile_full(const char *file, int line, const char *func,
         int index;
 
         index = N_receive_short();
-        if (index < 0 || index >= r_tiles_max) {
-                G_corrupt_drop_full(file, line, func, client);
+        if (!G_check_tile_full(file, line, func, client, index))
                 return -1;
-        }
         return index;
 }
 
@@ -119,3 +232,108 @@ g_building_t *G_receive_building_full(const char *file, int line,
                 return NULL;
         return building;
 }
+
+/******************************************************************************\
+ Benchmark the generated message codecs against the format string path. Ship
+ state and path messages are encoded into the host client's send buffer and
+ decoded back out of a private message [iterations] times each way. Only works
+ while hosting since the messages need somewhere to go.
+\******************************************************************************/
+void G_test_codecs(int iterations)
+{
+        static n_message_t msg;
+        g_sm_ship_state_t state;
+        g_sm_ship_path_t path;
+        int i, sum, buffer_len, old_encode, old_decode, new_encode, new_decode;
+        char path_buf[64];
+
+        if (iterations <= 0)
+                return;
+        if (n_client_id != N_HOST_CLIENT_ID) {
+                C_warning("Must be hosting to benchmark codecs");
+                return;
+        }
+        memset(path_buf, '1', sizeof (path_buf) - 1);
+        path_buf[sizeof (path_buf) - 1] = NUL;
+        buffer_len = n_clients[N_HOST_CLIENT_ID].buffer_len;
+        sum = 0;
+
+        /* Encode via format strings */
+        C_timer();
+        for (i = 0; i < iterations; i++) {
+                N_send(N_HOST_CLIENT_ID, "141214", G_SM_SHIP_STATE, i, 100,
+                       20, 0, -1);
+                N_send(N_HOST_CLIENT_ID, "142fs", G_SM_SHIP_PATH, i, i, 0.5f,
+                       path_buf);
+                n_clients[N_HOST_CLIENT_ID].buffer_len = buffer_len;
+        }
+        old_encode = C_timer();
+
+        /* Encode via codecs */
+        for (i = 0; i < iterations; i++) {
+                G_send_sm_ship_state(N_HOST_CLIENT_ID, i, 100, 20, 0, -1);
+                G_send_sm_ship_path(N_HOST_CLIENT_ID, i, i, 0.5f, path_buf);
+                n_clients[N_HOST_CLIENT_ID].buffer_len = buffer_len;
+        }
+        new_encode = C_timer();
+
+        /* Decode via individual receive calls */
+        G_write_sm_ship_state(&msg, 1, 100, 20, 0, -1);
+        C_timer();
+        for (i = 0; i < iterations; i++) {
+                N_message_rewind(&msg);
+                N_message_read_char(&msg);
+                sum += N_message_read_int(&msg);
+                sum += N_message_read_char(&msg);
+                sum += N_message_read_short(&msg);
+                sum += N_message_read_char(&msg);
+                sum += N_message_read_int(&msg);
+        }
+        old_decode = C_timer();
+        G_write_sm_ship_path(&msg, 1, 2, 0.5f, path_buf);
+        C_timer();
+        for (i = 0; i < iterations; i++) {
+                char buffer[R_PATH_MAX];
+
+                N_message_rewind(&msg);
+                N_message_read_char(&msg);
+                sum += N_message_read_int(&msg);
+                sum += N_message_read_short(&msg);
+                sum += (int)N_message_read_float(&msg);
+                N_message_read_string_buf(&msg, buffer);
+                sum += buffer[0];
+        }
+        old_decode += C_timer();
+
+        /* Decode via codecs */
+        G_write_sm_ship_state(&msg, 1, 100, 20, 0, -1);
+        C_timer();
+        for (i = 0; i < iterations; i++) {
+                N_message_rewind(&msg);
+                N_message_read_char(&msg);
+                G_read_sm_ship_state(&msg, &state);
+                sum += state.id + state.health + state.crew + state.boarding +
+                       state.boarding_ship;
+        }
+        new_decode = C_timer();
+        G_write_sm_ship_path(&msg, 1, 2, 0.5f, path_buf);
+        C_timer();
+        for (i = 0; i < iterations; i++) {
+                char buffer[R_PATH_MAX];
+
+                N_message_rewind(&msg);
+                N_message_read_char(&msg);
+                G_read_sm_ship_path(&msg, &path);
+                sum += path.id + path.tile + (int)path.progress;
+                C_strncpy_buf(buffer, path.path);
+                sum += buffer[0];
+        }
+        new_decode += C_timer();
+
+        C_status("Codec benchmark, %d ship state + path pairs (checksum %d)",
+                 iterations, sum);
+        C_status("Format strings: encode %d msec, decode %d msec",
+                 old_encode, old_decode);
+        C_status("Codecs: encode %d msec, decode %d msec",
+                 new_encode, new_decode);
+}
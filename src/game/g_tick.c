@@ -0,0 +1,129 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Runs the game at a fixed tick rate. The network is polled every frame, but
+   the time each frame takes is added up and the host and client are only
+   updated once for every whole tick of it, so the game advances by the same
+   steps however fast frames are rendered. Each tick also advances the game
+   clock that the game's timers run on. Ship models are positioned every
+   frame, in between ticks. */
+
+#include "g_common.h"
+
+/* Most ticks that are run in one frame. Time beyond that is dropped so that
+   a long frame slows the game down rather than making the next one longer
+   still. */
+#define TICKS_MAX 5
+
+/* Milliseconds between tick statistics reports */
+#define STATS_INTERVAL 5000
+
+/* Length of a tick */
+int g_tick_usec;
+float g_tick_sec;
+
+/* Proportion of a tick that has passed since the last one ran */
+float g_tick_alpha;
+
+/* Game time in milliseconds. It only moves when a tick runs. */
+int g_time_msec;
+
+/* Microseconds that have passed and not been ticked yet, and the part of a
+   millisecond of game time that has not been added to [g_time_msec] */
+static int accumulated, time_usec;
+
+/* Tick statistics for the current report */
+static float stats_total, stats_max;
+static int stats_ticks, stats_dropped, stats_time;
+
+/******************************************************************************\
+ Log how long ticks have been taking if [g_show_ticks] is set.
+\******************************************************************************/
+static void report_stats(void)
+{
+        if (c_time_msec < stats_time + STATS_INTERVAL)
+                return;
+        if (g_show_ticks.value.n && stats_ticks > 0)
+                C_status("%d ticks in %d msec: %.3f msec mean, %.3f max, "
+                         "%d msec dropped", stats_ticks,
+                         c_time_msec - stats_time, stats_total / stats_ticks,
+                         stats_max, stats_dropped / 1000);
+        stats_time = c_time_msec;
+        stats_total = stats_max = 0.f;
+        stats_ticks = stats_dropped = 0;
+}
+
+/******************************************************************************\
+ Advance the game clock by the length of a tick.
+\******************************************************************************/
+static void advance_time(void)
+{
+        time_usec += g_tick_usec;
+        g_time_msec += time_usec / 1000;
+        time_usec %= 1000;
+}
+
+/******************************************************************************\
+ Poll the network and then run as many game ticks as the time since the last
+ frame covers and position ship models for rendering. Call once per frame,
+ before rendering.
+\******************************************************************************/
+void G_update(void)
+{
+        int rate;
+
+        /* The tick rate can change at any time */
+        rate = g_tick_rate.value.n;
+        if (rate < 1)
+                rate = 1;
+        if (rate > 1000)
+                rate = 1000;
+        g_tick_usec = 1000000 / rate;
+        g_tick_sec = g_tick_usec / 1000000.f;
+
+        /* Messages are handled as soon as they arrive rather than waiting
+           for the next tick */
+        G_poll_host();
+        N_poll_client();
+
+        accumulated += c_frame_msec * 1000;
+        if (accumulated > TICKS_MAX * g_tick_usec) {
+                stats_dropped += accumulated - TICKS_MAX * g_tick_usec;
+                accumulated = TICKS_MAX * g_tick_usec;
+        }
+        for (; accumulated >= g_tick_usec; accumulated -= g_tick_usec) {
+                unsigned int start;
+                float msec;
+
+                start = C_usec();
+                advance_time();
+                G_update_host();
+                G_update_client();
+                msec = (C_usec() - start) / 1000.f;
+                stats_total += msec;
+                if (msec > stats_max)
+                        stats_max = msec;
+                stats_ticks++;
+        }
+        g_tick_alpha = (float)accumulated / g_tick_usec;
+        G_position_ships();
+        report_stats();
+}
+
+/******************************************************************************\
+ Returns the number of milliseconds until G_update() will run the next tick.
+\******************************************************************************/
+int G_tick_wait(void)
+{
+        return g_tick_usec > accumulated ?
+               (g_tick_usec - accumulated + 999) / 1000 : 0;
+}
@@ -15,18 +15,107 @@
 /* Island tiles with game data */
 g_tile_t g_tiles[R_TILES_MAX];
 
+/* Tile state kept apart from the tiles: pathfinding scratch space and whether
+   each tile was in view when the globe was last rendered */
+g_search_t g_tiles_search[R_TILES_MAX];
+bool g_tiles_visible[R_TILES_MAX];
+
 /* The tile the mouse is hovering over and the currently selected tile */
 int g_hover_tile, g_selected_tile;
 
 /* Number of gibs on the globe */
 int g_gibs;
 
-/* Ships dict */
-PyObject *g_building_dict;
+/* Every building densely packed in no particular order, and the first of
+   each client's buildings. A client's buildings are linked through the
+   buildings themselves. */
+g_building_t *g_buildings[R_TILES_MAX], *g_client_buildings[N_CLIENTS_MAX];
+int g_buildings_len;
+
+/* Number of buildings ever built, makes up the upper bits of building ids */
+static int buildings_built;
 
+/* Ids of buildings that need their cargo visibility or cargo updates sent */
+static c_array_t update_queue;
 
-/* Current ship id */
-int g_building_id = 0;
+/* Tiles a ship can sail into, water tiles without a ship in them. The bit set
+   answers whether a tile is open and the packed list, with the position of
+   each open tile in it, is for picking one at random. */
+static c_bits_t open_bits[C_BITS_WORDS(R_TILES_MAX)];
+static int open_tiles[R_TILES_MAX], open_index[R_TILES_MAX], open_len;
+
+/******************************************************************************\
+ Returns the building with [id] or NULL if there is no such building.
+\******************************************************************************/
+g_building_t *G_get_building(int id)
+{
+        g_building_t *building;
+        int tile;
+
+        tile = id & (G_BUILDING_TILES - 1);
+        if (id < 0 || tile >= r_tiles_max ||
+            !(building = g_tiles[tile].building) || building->id != id)
+                return NULL;
+        return building;
+}
+
+/******************************************************************************\
+ Count a building toward the totals of the client that owns it. Only the host
+ keeps totals.
+\******************************************************************************/
+static void tally_building(g_building_t *building)
+{
+        if (n_client_id != N_HOST_CLIENT_ID || !building->store ||
+            building->client < 0 || building->client > N_CLIENTS_MAX)
+                return;
+        g_totals[building->client].buildings++;
+        G_store_set_client(building->store, building->client);
+}
+
+/******************************************************************************\
+ Add a building to the building table and its client's list. The table keeps
+ a reference.
+\******************************************************************************/
+static void add_building(g_building_t *building)
+{
+        g_building_t **head;
+
+        building->index = g_buildings_len;
+        g_buildings[g_buildings_len++] = building;
+        Py_INCREF(building);
+        building->client_prev = building->client_next = NULL;
+        if (building->client < 0 || building->client >= N_CLIENTS_MAX)
+                return;
+        head = g_client_buildings + building->client;
+        if ((building->client_next = *head))
+                (*head)->client_prev = building;
+        *head = building;
+}
+
+/******************************************************************************\
+ Remove a building from the building table and its client's list. The last
+ building in the table is moved into its place.
+\******************************************************************************/
+static void remove_building(g_building_t *building)
+{
+        g_building_t *last;
+
+        last = g_buildings[--g_buildings_len];
+        g_buildings[building->index] = last;
+        last->index = building->index;
+        if (building->client_prev)
+                building->client_prev->client_next = building->client_next;
+        else if (building->client >= 0 && building->client < N_CLIENTS_MAX)
+                g_client_buildings[building->client] = building->client_next;
+        if (building->client_next)
+                building->client_next->client_prev = building->client_prev;
+        building->client_prev = building->client_next = NULL;
+        if (building->store && building->store->client >= 0) {
+                g_totals[building->store->client].buildings--;
+                G_store_set_client(building->store, N_INVALID_ID);
+        }
+        Py_DECREF(building);
+}
 
 /******************************************************************************\
  Cleanup a gib structure.
@@ -49,15 +138,16 @@ void G_cleanup_tiles(void)
 
         for (i = 0; i < r_tiles_max; i++) {
                 Py_CLEAR(g_tiles[i].ship);
-                if(g_tiles[i].building) {
-                        int id;
-                        id = g_tiles[i].building->id;
+                if (g_tiles[i].building) {
+                        remove_building(g_tiles[i].building);
                         Py_CLEAR(g_tiles[i].building);
                 }
                 gib_free(g_tiles[i].gib);
                 C_zero(g_tiles + i);
         }
-        PyDict_Clear(g_building_dict);
+        C_array_cleanup(&update_queue);
+        C_zero_buf(open_bits);
+        open_len = 0;
 }
 
 /******************************************************************************\
@@ -302,17 +392,19 @@ void G_tile_position_model(int tile, r_model_t *model)
 void G_tile_send_building(int tile, n_client_id_t client)
 {
         if (!g_tiles[tile].building) {
-                N_send(client, "121", G_SM_BUILDING, tile, G_BT_NONE);
+                G_send_sm_building(client, tile, -1, G_BT_NONE, -2);
                 return;
         }
-        N_send(client, "1211", G_SM_BUILDING, tile,
-               g_tiles[tile].building->type, g_tiles[tile].building->client);
+        G_send_sm_building(client, tile, g_tiles[tile].building->id,
+                           g_tiles[tile].building->type,
+                           g_tiles[tile].building->client);
 }
 
 /******************************************************************************\
- Start constructing a building on this tile.
+ Start constructing a building on this tile. If [id] is negative, the building
+ is given a new id, otherwise it has the id the server gave it.
 \******************************************************************************/
-void G_tile_build(int tile, int bc_index, n_client_id_t client)
+void G_tile_build(int tile, int id, int bc_index, n_client_id_t client)
 {
         g_building_t *building;
         BuildingClass *bc;
@@ -323,10 +415,8 @@ void G_tile_build(int tile, int bc_index, n_client_id_t client)
             bc_index < 0 || bc_index >= PyList_GET_SIZE(g_building_class_list))
                 return;
 
-        if(g_tiles[tile].building) {
-                int id;
-                id = g_tiles[tile].building->id;
-                PyDict_DelItemString(g_building_dict, C_va("%d", id));
+        if (g_tiles[tile].building) {
+                remove_building(g_tiles[tile].building);
                 Py_CLEAR(g_tiles[tile].building);
         }
 
@@ -343,7 +433,11 @@ void G_tile_build(int tile, int bc_index, n_client_id_t client)
                 if(nation == G_NN_NONE && bc->buildable)
                         return;
                 building = (g_building_t*)G_building_new(&G_building_type, NULL, NULL);
-                building->id = g_building_id++;
+                if (id < 0)
+                        id = (buildings_built++ & (C_INT_MAX >>
+                                                   G_BUILDING_TILE_BITS)) <<
+                             G_BUILDING_TILE_BITS | tile;
+                building->id = id;
                 building->type = bc_index;
                 building->client = client;
                 building->nation = nation;
@@ -354,12 +448,15 @@ void G_tile_build(int tile, int bc_index, n_client_id_t client)
                 Py_INCREF(bc);
                 building->class = bc;
                 g_tiles[tile].building = building;
-                G_set_building(building->id, building);
+                add_building(building);
 
                 /* Initialize store */
                 building->store = G_store_init(bc->cargo);
                 /* Building's have no minimum crew */
                 building->store->cargo[G_CT_CREW].minimum = 0;
+                building->store->building = building->id;
+                tally_building(building);
+                G_building_queue_update(building);
 
                 /* Start out selected */
                 if (g_selected_tile == tile) {
@@ -419,6 +516,53 @@ int G_building_class_index_from_ring_id(i_ring_icon_t id)
         return -1;
 }
 
+/******************************************************************************\
+ Add a tile to or take it out of the open tiles. The last open tile in the
+ list is moved into the place of one that is taken out.
+\******************************************************************************/
+static void tile_set_open(int tile, bool open)
+{
+        int last;
+
+        if (C_bit_get(open_bits, tile) == open)
+                return;
+        C_bit_set(open_bits, tile, open);
+        if (open) {
+                open_index[tile] = open_len;
+                open_tiles[open_len++] = tile;
+                return;
+        }
+        last = open_tiles[--open_len];
+        open_tiles[open_index[tile]] = last;
+        open_index[last] = open_index[tile];
+}
+
+/******************************************************************************\
+ Find the open tiles of a newly generated globe.
+\******************************************************************************/
+void G_reset_open_tiles(void)
+{
+        int i;
+
+        C_zero_buf(open_bits);
+        open_len = 0;
+        for (i = 0; i < r_tiles_max; i++)
+                tile_set_open(i, !g_tiles[i].ship &&
+                                 R_water_terrain(r_tiles[i].terrain));
+}
+
+/******************************************************************************\
+ Put a ship in a tile or empty it if [ship] is NULL. The tile keeps a
+ reference. Always go through here so the open tiles are kept up to date.
+\******************************************************************************/
+void G_tile_set_ship(int tile, g_ship_t *ship)
+{
+        Py_XINCREF(ship);
+        Py_CLEAR(g_tiles[tile].ship);
+        g_tiles[tile].ship = ship;
+        tile_set_open(tile, !ship && R_water_terrain(r_tiles[tile].terrain));
+}
+
 /******************************************************************************\
  Returns TRUE if a ship can sail into the given tile. If [exclude_ship] is
  non-negative then the tile is still considered open if [exclude_ship] is
@@ -426,8 +570,9 @@ int G_building_class_index_from_ring_id(i_ring_icon_t id)
 \******************************************************************************/
 bool G_tile_open(int tile, g_ship_t *exclude_ship)
 {
-        return (!g_tiles[tile].ship ||
-                (exclude_ship && g_tiles[tile].ship == exclude_ship)) &&
+        if (C_bit_get(open_bits, tile))
+                return TRUE;
+        return exclude_ship && g_tiles[tile].ship == exclude_ship &&
                R_water_terrain(r_tiles[tile].terrain);
 }
 
@@ -436,19 +581,12 @@ bool G_tile_open(int tile, g_ship_t *exclude_ship)
 \******************************************************************************/
 int G_random_open_tile(void)
 {
-        int start, tile;
-
-        start = C_rand() % r_tiles_max;
-        for (tile = start + 1; tile < r_tiles_max; tile++)
-                if (G_tile_open(tile, NULL))
-                        return tile;
-        for (tile = 0; tile <= start; tile++)
-                if (G_tile_open(tile, NULL))
-                        return tile;
-
         /* If this happens, the globe is completely full! */
-        C_warning("Globe is full");
-        return -1;
+        if (open_len <= 0) {
+                C_warning("Globe is full");
+                return -1;
+        }
+        return open_tiles[C_rand() % open_len];
 }
 
 /******************************************************************************\
@@ -459,7 +597,7 @@ void G_tile_send_gib(int tile, n_client_id_t client)
         g_gib_type_t type;
 
         type = !g_tiles[tile].gib ? G_GT_NONE : g_tiles[tile].gib->type;
-        N_send(client, "121", G_SM_GIB, tile, type);
+        G_send_sm_gib(client, tile, type);
 }
 
 /******************************************************************************\
@@ -509,7 +647,7 @@ bool G_building_controlled_by(g_building_t *building, n_client_id_t client)
 \******************************************************************************/
 void G_building_send_cargo(g_building_t *building, n_client_id_t client)
 {
-        int i, id;
+        int id;
         bool broadcast;
 
         /* Host already knows everything */
@@ -538,14 +676,13 @@ void G_building_send_cargo(g_building_t *building, n_client_id_t client)
 
         /* Send to clients that can see complete cargo information */
         if (broadcast) {
-                for (i = 0; i < N_CLIENTS_MAX; i++)
-                        n_clients[i].selected = building->store->visible[i];
+                G_store_select_clients(building->store);
                 N_send_selected(NULL);
                 return;
         }
 
         /* Send to a single client */
-        if (building->store->visible[client])
+        if (N_client_in(building->store->visible, client))
                 N_send(client, NULL);
 }
 
@@ -554,8 +691,8 @@ void G_building_send_cargo(g_building_t *building, n_client_id_t client)
 \******************************************************************************/
 static void building_update_visible(g_building_t *building)
 {
-        int i, nation;
-        bool old_visible[N_CLIENTS_MAX], selected;
+        n_client_set_t old_visible;
+        int nation;
 
         if(!building->class || !building->store || building->class->cargo <= 0)
                 return;
@@ -576,31 +713,145 @@ static void building_update_visible(g_building_t *building)
 
         /* Only send the update to clients that can see the store now but
            couldn't see it before */
-        for (selected = FALSE, i = 0; i < N_CLIENTS_MAX; i++) {
-                n_clients[i].selected = FALSE;
-                if (i == N_HOST_CLIENT_ID || old_visible[i])
-                        continue;
-                n_clients[i].selected = TRUE;
-                selected = TRUE;
-        }
-        if (selected)
+        if (G_store_select_new(building->store, old_visible))
                 G_building_send_cargo(building, N_SELECTED_ID);
 }
 
+/******************************************************************************\
+ Have the building's cargo visibility updated and any cargo changes sent on
+ the next frame. Buildings do nothing on their own so only queued buildings
+ are looked at.
+\******************************************************************************/
+void G_building_queue_update(g_building_t *building)
+{
+        if (!building || building->queued)
+                return;
+        if (!update_queue.item_size)
+                C_array_init(&update_queue, int, 64);
+        building->queued = TRUE;
+        C_array_append(&update_queue, &building->id);
+}
+
 /******************************************************************************\
  Updates building status and actions.
 \******************************************************************************/
 void G_update_buildings(void)
 {
         g_building_t *building;
-        PyObject *key;
-        Py_ssize_t pos = 0;
+        int i;
 
-        while (PyDict_Next(g_building_dict, &pos, &key, (PyObject**)&building)) {
+        for (i = 0; i < update_queue.len; i++) {
+                building = G_get_building(*C_array_get(&update_queue, int, i));
+                if (!building)
+                        continue;
+                building->queued = FALSE;
                 building_update_visible(building);
+
                 /* If the cargo manfiest changed, send updates once per frame */
                 if (building->store && building->store->modified)
                         G_building_send_cargo(building, -1);
         }
+        update_queue.len = 0;
+}
+
+
+/******************************************************************************\
+ Flood the globe from [start] through open tiles the way pathfinding expands
+ its search, with the search stamps and parents in a structure of [size]
+ bytes at [base]. Returns the number of tiles reached.
+\******************************************************************************/
+static int test_flood(char *base, int size, int start, int stamp, int *queue)
+{
+        int i, j, len, tile, neighbors[3];
+        g_search_t *search;
+
+        search = (g_search_t *)(base + start * size);
+        search->stamp = stamp;
+        queue[0] = start;
+        for (len = 1, i = 0; i < len; i++) {
+                R_tile_neighbors(queue[i], neighbors);
+                for (j = 0; j < 3; j++) {
+                        tile = neighbors[j];
+                        search = (g_search_t *)(base + tile * size);
+                        if (search->stamp == stamp || !G_tile_open(tile, NULL))
+                                continue;
+                        search->stamp = stamp;
+                        search->parent = queue[i];
+                        queue[len++] = tile;
+                }
+        }
+        return len;
 }
 
+/******************************************************************************\
+ Benchmark the loops that run over every tile with the tile state in parallel
+ arrays against the same loops over tiles laid out the way they used to be,
+ with everything in one structure. Marking and counting visible tiles is what
+ rendering and mouse picking do and flooding the globe is what pathfinding
+ does. Scratch copies are used so the game's own state is not touched.
+\******************************************************************************/
+void G_test_tiles(int passes)
+{
+        struct old_tile {
+                g_building_t *building;
+                g_gib_t *gib;
+                g_search_t search;
+                int island;
+                g_ship_t *ship;
+                bool visible;
+        } *old;
+        g_search_t *search;
+        bool *visible;
+        int i, j, sum, *queue, old_visible, old_flood, new_visible, new_flood;
+
+        if (passes <= 0)
+                return;
+        if (r_tiles_max <= 0) {
+                C_warning("Can't benchmark tiles without a globe");
+                return;
+        }
+        old = C_calloc(r_tiles_max * sizeof (*old));
+        search = C_calloc(r_tiles_max * sizeof (*search));
+        visible = C_calloc(r_tiles_max * sizeof (*visible));
+        queue = C_malloc(r_tiles_max * sizeof (*queue));
+        sum = 0;
+
+        /* One structure per tile */
+        C_timer();
+        for (j = 0; j < passes; j++) {
+                for (i = 0; i < r_tiles_max; i++)
+                        old[i].visible = (i + j) % 3 != 0;
+                for (i = 0; i < r_tiles_max; i++)
+                        sum += old[i].visible;
+        }
+        old_visible = C_timer();
+        for (j = 0; j < passes; j++)
+                sum += test_flood((char *)&old->search, sizeof (*old),
+                                  j % r_tiles_max, j + 1, queue);
+        old_flood = C_timer();
+
+        /* Parallel arrays */
+        for (j = 0; j < passes; j++) {
+                for (i = 0; i < r_tiles_max; i++)
+                        visible[i] = (i + j) % 3 != 0;
+                for (i = 0; i < r_tiles_max; i++)
+                        sum += visible[i];
+        }
+        new_visible = C_timer();
+        for (j = 0; j < passes; j++)
+                sum += test_flood((char *)search, sizeof (*search),
+                                  j % r_tiles_max, j + 1, queue);
+        new_flood = C_timer();
+
+        C_free(old);
+        C_free(search);
+        C_free(visible);
+        C_free(queue);
+        C_status("Tile benchmark, %d tiles x %d passes (checksum %d)",
+                 r_tiles_max, passes, sum);
+        C_status("One structure (%d bytes): visibility %d msec, "
+                 "flood %d msec", (int)sizeof (*old), old_visible, old_flood);
+        C_status("Parallel arrays (%d bytes): visibility %d msec, "
+                 "flood %d msec", (int)(sizeof (*search) + sizeof (*visible)),
+                 new_visible, new_flood);
+}
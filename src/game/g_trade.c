@@ -14,6 +14,9 @@
 
 #include "g_common.h"
 
+/* What each client owns, updated as it changes hands */
+g_totals_t g_totals[N_CLIENTS_MAX + 1];
+
 /******************************************************************************\
  Returns FALSE if the two cargo structures differ in a significant way.
 \******************************************************************************/
@@ -71,7 +74,7 @@ int G_store_space(g_store_t *store)
 \******************************************************************************/
 int G_store_add(g_store_t *store, g_cargo_type_t cargo, int amount)
 {
-        int excess;
+        int excess, old_amount;
 
         if(amount == 0)
                 return 0;
@@ -80,12 +83,15 @@ int G_store_add(g_store_t *store, g_cargo_type_t cargo, int amount)
         if (store->space_used > store->capacity)
                 return 0;
         store->modified |= 1 << cargo;
+        if (store->building >= 0)
+                G_building_queue_update(G_get_building(store->building));
 
         /* Don't take more than what's there */
         if (amount < -store->cargo[cargo].amount)
                 amount = -store->cargo[cargo].amount;
 
         /* Don't put in more than it can hold */
+        old_amount = store->cargo[cargo].amount;
         store->cargo[cargo].amount += amount;
         if ((excess = G_store_space(store) - store->capacity) > 0) {
                 store->cargo[cargo].amount -= (int)(excess /
@@ -93,6 +99,14 @@ int G_store_add(g_store_t *store, g_cargo_type_t cargo, int amount)
                 store->space_used = store->capacity;
         }
         C_assert(store->cargo[cargo].amount >= 0);
+        if (store->client >= 0)
+                g_totals[store->client].cargo[cargo] +=
+                        store->cargo[cargo].amount - old_amount;
+
+        /* A ship that takes on crew again needs feeding */
+        if (cargo == G_CT_CREW && store->ship >= 0 && old_amount <= 0 &&
+            store->cargo[cargo].amount > 0)
+                G_ship_feed(G_get_ship(store->ship));
 
         return amount;
 }
@@ -108,6 +122,28 @@ void G_store_add_cost(g_store_t *store, const g_cost_t *cost)
                 G_store_add(store, i, cost->cargo[i]);
 }
 
+/******************************************************************************\
+ Move the cargo in [store] from the totals of the client that owned it to the
+ totals of [client]. Pass N_INVALID_ID when the store is no longer owned.
+\******************************************************************************/
+void G_store_set_client(g_store_t *store, n_client_id_t client)
+{
+        int i;
+
+        if (client < 0 || client > N_CLIENTS_MAX)
+                client = N_INVALID_ID;
+        if (client == store->client)
+                return;
+        for (i = 0; i < G_CARGO_TYPES; i++) {
+                if (store->client >= 0)
+                        g_totals[store->client].cargo[i] -=
+                                store->cargo[i].amount;
+                if (client >= 0)
+                        g_totals[client].cargo[i] += store->cargo[i].amount;
+        }
+        store->client = client;
+}
+
 /******************************************************************************\
  Returns the amount of a cargo that a store can transfer from another store.
 \******************************************************************************/
@@ -181,12 +217,25 @@ int G_limit_purchase(g_store_t *buyer, g_store_t *seller,
 \******************************************************************************/
 void G_store_select_clients(const g_store_t *store)
 {
-        int i;
-
         if (!store)
                 return;
-        for (i = 0; i < N_CLIENTS_MAX; i++)
-                n_clients[i].selected = store->visible[i];
+        memcpy(n_selected, store->visible, sizeof (n_selected));
+}
+
+/******************************************************************************\
+ Select the connected clients other than the host that can see this store now
+ but could not see it when its visibility was [old_visible]. Returns FALSE if
+ no clients were selected.
+\******************************************************************************/
+bool G_store_select_new(const g_store_t *store, const c_bits_t *old_visible)
+{
+        int i;
+
+        for (i = 0; i < C_BITS_WORDS(N_CLIENTS_MAX); i++)
+                n_selected[i] = store->visible[i] & ~old_visible[i] &
+                                n_connected[i];
+        C_bit_set(n_selected, N_HOST_CLIENT_ID, FALSE);
+        return C_bits_next(n_selected, N_CLIENTS_MAX, 0) >= 0;
 }
 
 /******************************************************************************\
@@ -315,7 +364,7 @@ void G_store_send(g_store_t *store, bool force)
 {
         int i;
 
-        C_assert(N_CLIENTS_MAX <= 32);
+        C_assert(G_CARGO_TYPES <= 32);
         N_send_int(force ? -1 : store->modified);
         for (i = 0; i < G_CARGO_TYPES; i++) {
                 g_cargo_t *cargo;
@@ -341,7 +390,7 @@ void G_store_receive(g_store_t *store, bool ignore_prices)
 {
         int i, modified;
 
-        C_assert(N_CLIENTS_MAX <= 32);
+        C_assert(G_CARGO_TYPES <= 32);
         modified = N_receive_int();
         if (!modified)
                 return;
@@ -13,7 +13,8 @@
 #include "g_common.h"
 
 /* Game testing */
-c_var_t g_debug_net, g_test_globe;
+c_var_t g_debug_net, g_debug_totals, g_show_ticks, g_test_codecs,
+        g_test_globe, g_test_ships, g_test_tiles;
 
 /* Globe variables */
 c_var_t g_forest, g_globe_seed, g_globe_subdiv4, g_island_num, g_island_size,
@@ -27,7 +28,8 @@ c_var_t g_draw_distance, g_name;
 
 /* Server settings */
 c_var_t g_players, g_time_limit, g_victory_gold;
-c_var_t g_player_ship_limit, g_player_building_limit, g_echo_rate;
+c_var_t g_player_ship_limit, g_player_building_limit, g_echo_rate,
+        g_interest_radius, g_record, g_tick_rate;
 
 /* Master server */
 c_var_t g_master, g_master_url;
@@ -44,6 +46,21 @@ void G_register_variables(void)
         C_register_integer(&g_debug_net, "g_debug_net", FALSE,
                            "log network messages");
         g_debug_net.edit = C_VE_ANYTIME;
+        C_register_integer(&g_debug_totals, "g_debug_totals", FALSE,
+                           "check running totals against a full count");
+        g_debug_totals.edit = C_VE_ANYTIME;
+        C_register_integer(&g_show_ticks, "g_show_ticks", FALSE,
+                           "log how long game ticks take");
+        g_show_ticks.edit = C_VE_ANYTIME;
+        C_register_integer(&g_test_codecs, "g_test_codecs", 0,
+                           "benchmark message codecs for this many messages");
+        g_test_codecs.archive = FALSE;
+        C_register_integer(&g_test_ships, "g_test_ships", 0,
+                           "benchmark ship lookup with this many ships");
+        g_test_ships.archive = FALSE;
+        C_register_integer(&g_test_tiles, "g_test_tiles", 0,
+                           "benchmark tile loops for this many passes");
+        g_test_tiles.archive = FALSE;
 
         /* Globe variables */
         C_register_integer(&g_globe_seed, "g_globe_seed", C_rand(),
@@ -93,6 +110,17 @@ void G_register_variables(void)
                            "number of milliseconds between sending echo "
                            "requests, set to 0 to disable");
         g_echo_rate.edit = C_VE_ANYTIME;
+        C_register_integer(&g_interest_radius, "g_interest_radius", 2,
+                           "rings of globe patches around a client's ships, "
+                           "buildings and camera that it receives ship "
+                           "updates for, -1 to send everything");
+        g_interest_radius.edit = C_VE_ANYTIME;
+        C_register_integer(&g_tick_rate, "g_tick_rate", 30,
+                           "game updates per second");
+        g_tick_rate.edit = C_VE_ANYTIME;
+        C_register_string(&g_record, "g_record", "",
+                          "file to record hosted games to for replaying");
+        g_record.archive = FALSE;
 
         /* Master server */
         C_register_string(&g_master, "g_master", "master.plutocracy.ca",
@@ -192,17 +192,18 @@ void I_hide_chat(void)
 \******************************************************************************/
 static void input_enter(void)
 {
-        int i, clients;
+        n_client_set_t clients;
+        int i;
         bool all;
 
-        clients = 0;
+        C_zero_buf(clients);
         all = TRUE;
 
         for (i = 0; i < PLAYERS; i++) {
                 if(!N_client_valid(i) || i == n_client_id)
                         continue;
                 if(player_lines[i].checkbox.checkbox_checked)
-                        clients |= 1 << i;
+                        C_bit_set(clients, i, TRUE);
                 else
                         all = FALSE;
         }
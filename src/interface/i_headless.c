@@ -0,0 +1,128 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Stands in for the interface in the dedicated server. Nobody is looking at
+   the server so chat and popups go to the log and everything else does
+   nothing. This file is not part of the client. */
+
+#include "../common/c_shared.h"
+#include "../render/r_shared.h"
+#include "i_shared.h"
+
+/* The game stays in limbo until it is hosted */
+int i_limbo = TRUE;
+
+/* Ring icons of the ship commands */
+int i_ri_board, i_ri_follow;
+
+/******************************************************************************\
+ Limbo is left while a game is being hosted.
+\******************************************************************************/
+void I_enter_limbo(void)
+{
+        i_limbo = TRUE;
+}
+
+void I_leave_limbo(void)
+{
+        i_limbo = FALSE;
+}
+
+/******************************************************************************\
+ Log chat. Messages from the game have no sender and come in [name].
+\******************************************************************************/
+void I_print_chat(const char *name, i_color_t color, const char *message)
+{
+        if (message)
+                C_status("%s: %s", name, message);
+        else
+                C_status("%s", name);
+}
+
+/******************************************************************************\
+ Log a popup message.
+\******************************************************************************/
+void I_popup(c_vec3_t *goto_pos, const char *message)
+{
+        C_status("%s", message);
+}
+
+/******************************************************************************\
+ Interface calls made by the game.
+\******************************************************************************/
+void I_add_to_ring(i_ring_icon_t icon, int enabled, const char *label,
+                   const char *sub_label)
+{
+}
+
+void I_configure_cargo(int index, const i_cargo_info_t *info)
+{
+}
+
+void I_configure_player(int index, const char *name, i_color_t color,
+                        bool host)
+{
+}
+
+void I_configure_player_num(int num)
+{
+}
+
+void I_disable_trade(void)
+{
+}
+
+void I_enable_nation(int nation, bool enable)
+{
+}
+
+void I_enable_trade(bool left_own, bool right_own, const char *partner,
+                    int used, int capacity)
+{
+}
+
+void I_quick_info_add(const char *label, const char *value)
+{
+}
+
+void I_quick_info_add_color(const char *label, const char *value,
+                            i_color_t color)
+{
+}
+
+void I_quick_info_close(void)
+{
+}
+
+void I_quick_info_show(const char *title, const c_vec3_t *goto_pos)
+{
+}
+
+void I_reset_ring(void)
+{
+}
+
+void I_select_nation(int nation)
+{
+}
+
+void I_show_ring(i_ring_f callback)
+{
+}
+
+void I_update_colors(void)
+{
+}
+
+void I_update_player(int player, int gold, short ping)
+{
+}
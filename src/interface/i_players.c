@@ -13,7 +13,7 @@
 #include "i_common.h"
 
 /* Largest number of players the window supports */
-#define PLAYERS 32
+#define PLAYERS N_CLIENTS_MAX
 
 /* Structure for player entries */
 typedef struct player_line {
@@ -12,10 +12,29 @@
 
 #include "n_common.h"
 
+/* Milliseconds between attempts to reconnect when resuming a session */
+#define RETRY_INTERVAL 1000
+
 /* ID of this client in the game */
 n_client_id_t n_client_id;
 
-static int connect_time;
+/* Server address for reconnecting */
+static char server_host[256], server_ip[32];
+static int server_port;
+
+static int connect_time, retry_time;
+static bool connecting, resolving, resuming;
+
+/******************************************************************************\
+ Prints the network statistics when set. The value is never kept so that it
+ can be set again.
+\******************************************************************************/
+static int stats_print_update(c_var_t *var, c_var_value_t value)
+{
+        if (value.n)
+                N_stats_print();
+        return FALSE;
+}
 
 /******************************************************************************\
  Initializes the network namespace.
@@ -30,6 +49,7 @@ void N_init(void)
 #endif
         n_client_id = N_INVALID_ID;
         n_clients[N_SERVER_ID].socket = INVALID_SOCKET;
+        C_var_update(&n_stats_print, stats_print_update);
 }
 
 /******************************************************************************\
@@ -37,29 +57,90 @@ void N_init(void)
 \******************************************************************************/
 void N_cleanup(void)
 {
+        int i;
+
 #ifdef WINDOWS
         WSACleanup();
 #endif
         N_stop_server();
+        N_stop_thread();
+        N_stop_master();
+        N_finish_http(1000);
+        N_stop_resolver();
+        N_cleanup_stats();
+        N_queue_cleanup();
+
+        /* Free client send buffers */
+        for (i = 0; i <= N_CLIENTS_MAX; i++) {
+                C_free(n_clients[i].buffer);
+                C_free(n_clients[i].held);
+                n_clients[i].buffer = n_clients[i].held = NULL;
+                n_clients[i].buffer_size = n_clients[i].held_size = 0;
+        }
 }
 
 /******************************************************************************\
- Connect the client to the given [address] (ip or hostname) and [port].
+ Stop connecting to the server. Unless [cancelled], the client is told that
+ the connection failed.
 \******************************************************************************/
-void N_connect(const char *address, n_callback_f client_func)
+static void stop_connecting(bool cancelled)
 {
-        int port;
-        char ip[32];
+        if (!connecting)
+                return;
+        connecting = resolving = FALSE;
+        if (n_clients[N_SERVER_ID].socket != INVALID_SOCKET) {
+                closesocket(n_clients[N_SERVER_ID].socket);
+                n_clients[N_SERVER_ID].socket = INVALID_SOCKET;
+        }
+        if (cancelled)
+                return;
+        C_warning("Failed to connect to '%s'", server_host);
+        if (n_client_func)
+                n_client_func(N_SERVER_ID, N_EV_CONNECT_FAILED);
+}
 
+/******************************************************************************\
+ Connect the client to the given [address] (ip or hostname) and [port]. The
+ hostname is resolved and the connection made during N_poll_client().
+\******************************************************************************/
+void N_connect(const char *address, n_callback_f client_func)
+{
+        stop_connecting(TRUE);
         n_client_func = client_func;
-
-        /* Resolve the hostname */
+        N_session_forget();
+        resuming = FALSE;
+        C_strncpy_buf(server_host, address);
         C_var_unlatch(&n_port);
-        port = n_port.value.n;
-        N_resolve_buf(ip, &port, address);
+        server_port = n_port.value.n;
+        connecting = resolving = TRUE;
+        connect_time = c_time_msec;
+}
 
-        n_clients[N_SERVER_ID].socket = N_connect_socket(ip, port);
+/******************************************************************************\
+ Resolve the server's hostname and start connecting once it is known. Returns
+ FALSE while still resolving or if the connection failed.
+\******************************************************************************/
+static bool poll_resolve(void)
+{
+        switch (N_resolve_buf(server_ip, &server_port, server_host)) {
+        case N_RESOLVE_PENDING:
+                if (c_time_msec <= connect_time + CONNECT_TIMEOUT)
+                        return FALSE;
+        case N_RESOLVE_FAILED:
+                stop_connecting(FALSE);
+                return FALSE;
+        default:
+                break;
+        }
+        resolving = FALSE;
         connect_time = c_time_msec;
+        n_clients[N_SERVER_ID].socket = N_connect_socket(server_ip,
+                                                         server_port);
+        if (n_clients[N_SERVER_ID].socket == INVALID_SOCKET) {
+                stop_connecting(FALSE);
+                return FALSE;
+        }
+        return TRUE;
 }
 
 /******************************************************************************\
@@ -67,6 +148,7 @@ void N_connect(const char *address, n_callback_f client_func)
 \******************************************************************************/
 void N_disconnect(void)
 {
+        stop_connecting(TRUE);
         if (n_client_id == N_INVALID_ID)
                 return;
         if (n_client_func)
@@ -75,38 +157,128 @@ void N_disconnect(void)
                                            N_EV_DISCONNECTED);
         if (n_client_id == N_HOST_CLIENT_ID)
                 N_stop_server();
+        N_stop_thread();
         if (n_clients[N_SERVER_ID].socket != INVALID_SOCKET) {
                 closesocket(n_clients[N_SERVER_ID].socket);
                 n_clients[N_SERVER_ID].socket = INVALID_SOCKET;
         }
-        n_clients[N_SERVER_ID].connected = FALSE;
+        N_udp_close();
+        N_session_forget();
+        N_set_connected(N_SERVER_ID, FALSE);
         n_client_id = N_INVALID_ID;
+        resuming = FALSE;
         C_debug("Disconnected from server");
 }
 
+/******************************************************************************\
+ The connection to the server was lost. Returns FALSE if the session cannot be
+ resumed, otherwise drops the connection and starts reconnecting. Anything
+ not yet sent is discarded as it may end partway through a message.
+\******************************************************************************/
+static bool start_resume(void)
+{
+        if (!N_session_resumable())
+                return FALSE;
+        N_stop_thread();
+        closesocket(n_clients[N_SERVER_ID].socket);
+        n_clients[N_SERVER_ID].socket = INVALID_SOCKET;
+        n_clients[N_SERVER_ID].buffer_len = 0;
+        retry_time = c_time_msec;
+        resuming = TRUE;
+        return TRUE;
+}
+
+/******************************************************************************\
+ The connection to the server has been made. Hand it to the network thread
+ if there is to be one.
+\******************************************************************************/
+static void connection_made(void)
+{
+        C_var_unlatch(&n_thread);
+        if (n_thread.value.n)
+                N_thread_connect(n_clients[N_SERVER_ID].socket);
+}
+
+/******************************************************************************\
+ Keep trying to reconnect until the session can be resumed or the server will
+ have given up on us.
+\******************************************************************************/
+static void poll_resume(void)
+{
+        SOCKET *socket;
+
+        if (!N_session_resumable()) {
+                C_warning("Could not resume session");
+                N_disconnect();
+                return;
+        }
+        socket = &n_clients[N_SERVER_ID].socket;
+        if (*socket == INVALID_SOCKET) {
+                if (c_time_msec < retry_time)
+                        return;
+                *socket = N_connect_socket(server_ip, server_port);
+                retry_time = c_time_msec + RETRY_INTERVAL;
+                return;
+        }
+        if (!N_socket_select(*socket, 0)) {
+                if (c_time_msec >= retry_time) {
+                        closesocket(*socket);
+                        *socket = INVALID_SOCKET;
+                }
+                return;
+        }
+        resuming = FALSE;
+        connection_made();
+        N_session_hello();
+}
+
 /******************************************************************************\
  Receive events from the server.
 \******************************************************************************/
 void N_poll_client(void)
 {
+        bool alive;
+
+        N_poll_stats();
+
+        /* Reconnecting to resume a lost session */
+        if (resuming) {
+                poll_resume();
+                return;
+        }
+
         /* See if we have connected yet */
         if (n_client_id == N_INVALID_ID) {
-                if (n_clients[N_SERVER_ID].socket == INVALID_SOCKET ||
-                    !N_socket_select(n_clients[N_SERVER_ID].socket, 0)) {
+                if (!connecting || (resolving && !poll_resolve()))
+                        return;
+                if (!N_socket_select(n_clients[N_SERVER_ID].socket, 0)) {
                         if (connect_time + CONNECT_TIMEOUT < c_time_msec)
-                                N_disconnect();
+                                stop_connecting(FALSE);
                         return;
                 }
-                n_clients[N_SERVER_ID].connected = TRUE;
-                n_clients[N_SERVER_ID].buffer_len = 0;
+                connecting = FALSE;
+                connection_made();
+                N_set_connected(N_SERVER_ID, TRUE);
                 n_client_id = N_UNASSIGNED_ID;
+                N_session_hello();
                 n_client_func(N_SERVER_ID, N_EV_CONNECTED);
                 return;
         }
 
-        /* Send and receive data */
-        if (!N_send_buffer(N_SERVER_ID) || !N_receive(N_SERVER_ID))
-                N_disconnect();
+        /* Send and receive data. The network thread does that for a remote
+           server while the host's own connection is always local. */
+        if (n_threaded && n_client_id != N_HOST_CLIENT_ID)
+                alive = N_poll_thread_client();
+        else
+                alive = N_send_buffer(N_SERVER_ID) && N_receive(N_SERVER_ID);
+        if (!alive) {
+                if (!start_resume())
+                        N_disconnect();
+                return;
+        }
+        if (n_client_id == N_INVALID_ID)
+                return;
+        N_poll_udp();
 }
 
 /******************************************************************************\
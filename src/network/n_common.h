@@ -38,6 +38,38 @@ typedef int socklen_t;
 /* Connection timeout in milliseconds */
 #define CONNECT_TIMEOUT 5000
 
+/* n_http.c */
+void N_finish_http(int msec);
+
+/* n_queue.c */
+void N_queue_charge(n_client_id_t, int size);
+void N_queue_cleanup(void);
+const char *N_queue_peek(n_client_id_t, int *size);
+void N_queue_pop(n_client_id_t);
+bool N_queue_push(n_client_id_t, const char *data, int size);
+bool N_queue_ready(n_client_id_t);
+void N_queue_reset(n_client_id_t);
+
+/* n_resolve.c */
+void N_stop_resolver(void);
+
+/* n_server.c */
+void N_set_connected(n_client_id_t, bool connected);
+
+/* n_session.c */
+void N_poll_sessions(void);
+int N_rand(void);
+void N_session_accept(n_client_id_t);
+bool N_session_control(n_client_id_t);
+void N_session_forget(void);
+void N_session_hello(void);
+bool N_session_lost(n_client_id_t);
+void N_session_record(n_client_id_t, const char *data, int size);
+void N_session_reset(n_client_id_t);
+bool N_session_resumable(void);
+bool N_session_suspended(n_client_id_t);
+void N_stop_sessions(void);
+
 /* n_socket.c */
 SOCKET N_connect_socket(const char *address, int port);
 SOCKET N_client_to_socket(n_client_id_t);
@@ -46,12 +78,41 @@ void N_socket_no_block(SOCKET);
 bool N_socket_select(SOCKET, int timeout);
 int N_socket_send(SOCKET, const char *data, int size);
 
+/* n_stats.c */
+void N_cleanup_stats(void);
+void N_poll_stats(void);
+void N_stats_encoded(n_message_t *);
+void N_stats_received(int token, int size, unsigned int usec);
+void N_stats_reset(n_client_id_t);
+void N_stats_sent(n_client_id_t, const char *data, int size);
+
 /* n_sync.c */
 bool N_receive(int client);
+void N_receive_buffer(n_client_id_t, const char *data, int size);
 bool N_send_buffer(int client);
+void N_send_pending(n_client_id_t, int backlog);
+bool N_send_raw(n_client_id_t, const char *data, int size);
 
 extern n_callback_f n_client_func, n_server_func;
 
+/* n_thread.c */
+void N_poll_thread(void);
+bool N_poll_thread_client(void);
+bool N_start_thread(SOCKET listen_socket);
+void N_stop_thread(void);
+bool N_thread_connect(SOCKET);
+void N_thread_drop(n_client_id_t);
+
+extern bool n_threaded;
+
+/* n_udp.c */
+void N_poll_udp(void);
+void N_udp_close(void);
+bool N_udp_open(int port);
+void N_udp_reset(n_client_id_t);
+SOCKET N_udp_socket(void);
+
 /* n_variables.c */
-extern c_var_t n_port;
+extern c_var_t n_client_rate, n_port, n_resume_grace, n_stats, n_stats_csv,
+               n_stats_interval, n_stats_print, n_thread;
 
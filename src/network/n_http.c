@@ -10,76 +10,429 @@
  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
 \******************************************************************************/
 
+/* This file handles the HTTP connection. The connection is kept open between
+   requests and requests are pipelined on it. Each request remembers the
+   callback it was sent with. Responses are parsed as they arrive and their
+   bodies are handed to that callback piece by piece with N_EV_MESSAGE,
+   followed by N_EV_RECEIVE_COMPLETE, so neither requests nor responses have a
+   size limit. */
+
 #include "n_common.h"
 
-/* This file handles the HTTP connection */
+/* Longest status or header line accepted */
+#define HEADER_LINE_MAX 8192
+
+/* Response parser states */
+typedef enum {
+        PARSE_STATUS,
+        PARSE_HEADERS,
+        PARSE_BODY,
+        PARSE_CHUNK_SIZE,
+        PARSE_CHUNK_DATA,
+        PARSE_CHUNK_END,
+        PARSE_TRAILERS,
+        PARSE_UNTIL_CLOSE,
+} parse_state_t;
+
+/* A request waiting for its response. [end] is where the request ends in the
+   output stream so that we know when it has been sent. */
+typedef struct request {
+        n_callback_http_f func;
+        int end;
+        bool sent;
+} request_t;
 
 static n_callback_http_f http_func;
-static SOCKET http_socket;
-static int http_connect_time, http_buffer_len, http_port;
-static char http_address[32], http_buffer[4096], http_host[256];
-static bool http_connected;
+static SOCKET http_socket = INVALID_SOCKET;
+static request_t *requests;
+static int http_connect_time, http_port, http_generation, requests_len,
+           requests_size, out_len, out_size, out_total, out_sent, in_len,
+           in_size;
+static char http_address[32], http_host[256], *out, *in;
+static bool http_connected, http_resolving;
+
+/* Response being parsed */
+static parse_state_t parse_state;
+static int parse_left, parse_status;
+static bool parse_close, parse_chunked, parse_sized;
 
 /******************************************************************************\
- Starts connecting to the HTTP server.
+ Returns TRUE if the connection is open or being made.
 \******************************************************************************/
-void N_connect_http(const char *address, n_callback_http_f callback)
+static bool connection_open(void)
 {
-        N_disconnect_http();
+        return http_resolving || http_socket != INVALID_SOCKET;
+}
 
-        /* Resolve the address only if it has changed */
-        http_port = 80;
-        if (strcmp(address, http_host)) {
-                C_strncpy_buf(http_host, address);
-                N_resolve_buf(http_address, &http_port, address);
+/******************************************************************************\
+ Close the connection and fail every request that is still waiting. Each
+ distinct callback gets [event] once. The callback of the connection is told
+ even if nothing was waiting.
+\******************************************************************************/
+static void close_connection(n_event_t event)
+{
+        n_callback_http_f func;
+        request_t *waiting;
+        int i, j, waiting_len;
+
+        http_connected = FALSE;
+        http_resolving = FALSE;
+        http_generation++;
+        if (http_socket != INVALID_SOCKET) {
+                closesocket(http_socket);
+                http_socket = INVALID_SOCKET;
         }
+        out_len = in_len = 0;
+        out_total = out_sent = 0;
+        parse_state = PARSE_STATUS;
+        parse_close = FALSE;
+        C_debug("Closed HTTP connection");
 
-        http_func = callback;
-        http_socket = N_connect_socket(http_address, http_port);
+        /* Detach the queue first, the callbacks may send new requests */
+        waiting = requests;
+        waiting_len = requests_len;
+        requests = NULL;
+        requests_len = requests_size = 0;
+        func = http_func;
+        for (i = 0; i < waiting_len; i++) {
+                for (j = 0; j < i; j++)
+                        if (waiting[j].func == waiting[i].func)
+                                break;
+                if (j < i)
+                        continue;
+                if (waiting[i].func == func)
+                        func = NULL;
+                waiting[i].func(event, NULL, -1);
+        }
+        C_free(waiting);
+        if (func)
+                func(event, NULL, -1);
+}
+
+/******************************************************************************\
+ Close the HTTP connection if it is still open or being made.
+\******************************************************************************/
+void N_disconnect_http(void)
+{
+        if (!connection_open())
+                return;
+        close_connection(http_connected ? N_EV_DISCONNECTED :
+                                          N_EV_CONNECT_FAILED);
+}
+
+/******************************************************************************\
+ Resolve the HTTP server's hostname and start connecting once it is known.
+ Returns FALSE while still resolving or if the connection failed.
+\******************************************************************************/
+static bool poll_resolve(void)
+{
+        switch (N_resolve_buf(http_address, &http_port, http_host)) {
+        case N_RESOLVE_PENDING:
+                if (c_time_msec <= http_connect_time + CONNECT_TIMEOUT)
+                        return FALSE;
+                C_warning("Timed out resolving '%s'", http_host);
+        case N_RESOLVE_FAILED:
+                N_disconnect_http();
+                return FALSE;
+        default:
+                break;
+        }
         http_connect_time = c_time_msec;
+        if ((http_socket = N_connect_socket(http_address, http_port)) ==
+            INVALID_SOCKET) {
+                N_disconnect_http();
+                return FALSE;
+        }
+        http_resolving = FALSE;
+        return TRUE;
 }
 
 /******************************************************************************\
- Waits for an HTTP connection to complete.
+ Starts connecting to the HTTP server. If the connection to [address] is
+ already open or being made it is kept and only the callback changes. The
+ hostname is resolved and the connection made during N_poll_http() so this
+ never blocks. Requests can be sent right away, they go out once the
+ connection is made. Returns FALSE if connecting failed right away, the
+ callback has been told already.
 \******************************************************************************/
-bool N_connect_http_wait(const char *address, n_callback_http_f callback)
+bool N_connect_http(const char *address, n_callback_http_f callback)
 {
-        N_connect_http(address, callback);
-        if (N_socket_select(http_socket, 1))
+        if (connection_open() && !strcmp(address, http_host)) {
+                http_func = callback;
                 return TRUE;
-        return FALSE;
+        }
+        N_disconnect_http();
+        C_strncpy_buf(http_host, address);
+        http_port = 80;
+        http_func = callback;
+        http_resolving = TRUE;
+        http_connect_time = c_time_msec;
+        poll_resolve();
+        return connection_open();
 }
 
 /******************************************************************************\
- Close the HTTP connection if it is still open.
+ Gives requests that have not gone out yet up to [msec] milliseconds to be
+ sent. Only used when quitting, the game loop never waits on the HTTP
+ connection.
 \******************************************************************************/
-void N_disconnect_http(void)
+void N_finish_http(int msec)
+{
+        unsigned int end;
+
+        end = SDL_GetTicks() + msec;
+        while (out_len > 0 && SDL_GetTicks() < end && connection_open()) {
+                N_poll_http();
+                SDL_Delay(10);
+        }
+}
+
+/******************************************************************************\
+ Returns the next complete line of the input starting at [pos] and moves
+ [pos] past it. Returns NULL if the line has not all arrived yet.
+\******************************************************************************/
+static char *next_line(int *pos)
 {
-        if (!http_connected)
+        char *start, *end;
+
+        start = in + *pos;
+        if (!(end = memchr(start, '\n', in_len - *pos)))
+                return NULL;
+        *pos = (int)(end - in) + 1;
+        if (end > start && end[-1] == '\r')
+                end--;
+        *end = NUL;
+        return start;
+}
+
+/******************************************************************************\
+ Hand a piece of the response body to the request's callback. Bodies of
+ error responses are dropped.
+\******************************************************************************/
+static void deliver(const char *data, int len)
+{
+        if (len <= 0 || parse_status < 200 || parse_status >= 300)
                 return;
-        if (http_connected)
-                http_func(N_EV_DISCONNECTED, NULL, -1);
-        else
-                http_func(N_EV_CONNECT_FAILED, NULL, -1);
-        http_connected = FALSE;
-        if (http_socket != INVALID_SOCKET) {
-                closesocket(http_socket);
-                http_socket = INVALID_SOCKET;
+        requests[0].func(N_EV_MESSAGE, data, len);
+}
+
+/******************************************************************************\
+ The response to the oldest request has been received.
+\******************************************************************************/
+static void finish_response(void)
+{
+        n_callback_http_f func;
+
+        func = requests[0].func;
+        memmove(requests, requests + 1, --requests_len * sizeof (*requests));
+        parse_state = PARSE_STATUS;
+        func(N_EV_RECEIVE_COMPLETE, NULL, 0);
+}
+
+/******************************************************************************\
+ Parse the status line. Returns FALSE if the response is invalid.
+\******************************************************************************/
+static bool parse_status_line(const char *line)
+{
+        if (strncmp(line, "HTTP/", 5)) {
+                C_warning("HTTP server sent invalid status: %s", line);
+                return FALSE;
         }
-        C_debug("Closed HTTP connection");
+        parse_close = !strncmp(line, "HTTP/1.0", 8);
+        parse_status = atoi(C_skip_spaces(line + 8));
+        parse_chunked = parse_sized = FALSE;
+        parse_left = 0;
+        parse_state = PARSE_HEADERS;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Parse a header line. At the end of the headers, decides how the body is
+ sent.
+\******************************************************************************/
+static void parse_header(const char *line)
+{
+        const char *value;
+
+        /* End of the headers */
+        if (!*line) {
+
+                /* Interim response, the real one follows */
+                if (parse_status >= 100 && parse_status < 200) {
+                        parse_state = PARSE_STATUS;
+                        return;
+                }
+
+                if (parse_status < 200 || parse_status >= 300) {
+                        C_warning("HTTP server code: %d", parse_status);
+                        requests[0].func(N_EV_MESSAGE, NULL, -1);
+                }
+                if (parse_status == 204 || parse_status == 304)
+                        parse_state = PARSE_BODY;
+                else if (parse_chunked)
+                        parse_state = PARSE_CHUNK_SIZE;
+                else if (parse_sized)
+                        parse_state = PARSE_BODY;
+                else {
+                        parse_state = PARSE_UNTIL_CLOSE;
+                        parse_close = TRUE;
+                }
+                return;
+        }
+
+        if (!(value = strchr(line, ':')))
+                return;
+        value = C_skip_spaces(value + 1);
+        if (!strncasecmp(line, "Content-Length:", 15)) {
+                parse_left = atoi(value);
+                parse_sized = TRUE;
+        } else if (!strncasecmp(line, "Transfer-Encoding:", 18))
+                parse_chunked = !strncasecmp(value, "chunked", 7);
+        else if (!strncasecmp(line, "Connection:", 11)) {
+                if (!strncasecmp(value, "close", 5))
+                        parse_close = TRUE;
+                else if (!strncasecmp(value, "keep-alive", 10))
+                        parse_close = FALSE;
+        }
+}
+
+/******************************************************************************\
+ Parse as much of the received data as possible. Returns FALSE if the
+ connection was closed.
+\******************************************************************************/
+static bool parse_response(void)
+{
+        int pos, len, generation;
+        char *line;
+
+        generation = http_generation;
+        for (pos = 0; pos < in_len && http_generation == generation; ) {
+
+                /* Data that nobody asked for */
+                if (requests_len < 1) {
+                        C_warning("HTTP server sent unexpected data");
+                        N_disconnect_http();
+                        return FALSE;
+                }
+
+                /* Body data */
+                if (parse_state == PARSE_BODY ||
+                    parse_state == PARSE_CHUNK_DATA ||
+                    parse_state == PARSE_UNTIL_CLOSE) {
+                        len = in_len - pos;
+                        if (parse_state != PARSE_UNTIL_CLOSE &&
+                            len > parse_left)
+                                len = parse_left;
+                        deliver(in + pos, len);
+                        if (http_generation != generation)
+                                return FALSE;
+                        pos += len;
+                        parse_left -= len;
+                        if (parse_left > 0 ||
+                            parse_state == PARSE_UNTIL_CLOSE)
+                                continue;
+                        if (parse_state == PARSE_BODY)
+                                finish_response();
+                        else
+                                parse_state = PARSE_CHUNK_END;
+                        continue;
+                }
+
+                /* Everything else comes in lines */
+                if (!(line = next_line(&pos))) {
+                        if (in_len - pos <= HEADER_LINE_MAX)
+                                break;
+                        C_warning("HTTP server sent an overlong line");
+                        N_disconnect_http();
+                        return FALSE;
+                }
+                switch (parse_state) {
+                case PARSE_STATUS:
+                        if (!*line)
+                                break;
+                        if (!parse_status_line(line)) {
+                                N_disconnect_http();
+                                return FALSE;
+                        }
+                        break;
+                case PARSE_HEADERS:
+                        parse_header(line);
+                        if (http_generation != generation)
+                                return FALSE;
+                        if (parse_state == PARSE_BODY && parse_left <= 0)
+                                finish_response();
+                        break;
+                case PARSE_CHUNK_SIZE:
+                        parse_left = (int)strtol(line, NULL, 16);
+                        parse_state = parse_left > 0 ? PARSE_CHUNK_DATA :
+                                                       PARSE_TRAILERS;
+                        break;
+                case PARSE_CHUNK_END:
+                        parse_state = PARSE_CHUNK_SIZE;
+                        break;
+                case PARSE_TRAILERS:
+                        if (!*line)
+                                finish_response();
+                        break;
+                default:
+                        break;
+                }
+
+                /* The server is closing after this response */
+                if (parse_state == PARSE_STATUS && parse_close &&
+                    http_generation == generation) {
+                        N_disconnect_http();
+                        return FALSE;
+                }
+        }
+        if (http_generation != generation)
+                return FALSE;
+        in_len -= pos;
+        memmove(in, in + pos, in_len);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Send as much of the queued requests as the socket will take. Returns FALSE
+ if the connection was closed.
+\******************************************************************************/
+static bool send_requests(void)
+{
+        int i, ret, generation;
+
+        if (out_len <= 0)
+                return TRUE;
+        if ((ret = N_socket_send(http_socket, out, out_len)) < 0) {
+                N_disconnect_http();
+                return FALSE;
+        }
+        out_len -= ret;
+        out_sent += ret;
+        memmove(out, out + ret, out_len);
+
+        /* Tell the senders of the requests that went out */
+        generation = http_generation;
+        for (i = 0; i < requests_len && requests[i].end <= out_sent; i++) {
+                if (requests[i].sent)
+                        continue;
+                requests[i].sent = TRUE;
+                requests[i].func(N_EV_SEND_COMPLETE, NULL, -1);
+                if (http_generation != generation)
+                        return FALSE;
+        }
+        return TRUE;
 }
 
 /******************************************************************************\
  Check for data received from the HTTP connection or other events.
- TODO: Support HTML/1.1 chunking
 \******************************************************************************/
 void N_poll_http(void)
 {
-        int len, content_len;
         const char *error;
-        char buffer[4096], *pos, *line, *token;
-        bool end;
+        int len;
 
+        if (http_resolving && !poll_resolve())
+                return;
         if (http_socket == INVALID_SOCKET)
                 return;
 
@@ -99,140 +452,115 @@ void N_poll_http(void)
                 /* Success! */
                 http_connected = TRUE;
                 http_func(N_EV_CONNECTED, NULL, -1);
+                if (http_socket == INVALID_SOCKET)
+                        return;
         }
 
-        /* Overflow */
-        if (http_buffer_len >= sizeof (http_buffer)) {
-                C_warning("HTTP buffer overflow");
-                http_buffer_len = 0;
-                N_disconnect_http();
+        if (!send_requests())
                 return;
-        }
 
-        /* Try sending the buffer */
-        if (http_buffer_len > 0) {
-                int ret;
-
-                ret = N_socket_send(http_socket, http_buffer, http_buffer_len);
-                if (ret > 0) {
-                        http_buffer_len = 0;
-                        http_func(N_EV_SEND_COMPLETE, NULL, -1);
-                        if (http_socket == INVALID_SOCKET)
-                                return;
-                } else if (ret < 0)
+        /* Receive everything that has arrived */
+        for (;;) {
+                if (in_size - in_len < 4096) {
+                        in_size = in_size ? 2 * in_size : 8192;
+                        in = C_realloc(in, in_size);
+                }
+                len = (int)recv(http_socket, in + in_len, in_size - in_len, 0);
+
+                /* Orderly shutdown. A response that lasts until the
+                   connection closes is complete. */
+                if (!len) {
+                        if (parse_state == PARSE_UNTIL_CLOSE &&
+                            requests_len > 0)
+                                finish_response();
                         N_disconnect_http();
                         return;
-        }
-
-        /* Receive the message size */
-        len = (int)recv(http_socket, buffer, sizeof (buffer), 0);
-
-        /* Orderly shutdown */
-        if (!len) {
-                N_disconnect_http();
-                return;
-        }
-
-        /* Error */
-        if ((error = N_socket_error(len))) {
-                C_debug("HTTP socket error: %s", error);
-                return;
-        }
-        if (len < 0)
-                return;
+                }
 
-        /* Parse the first line */
-        buffer[len] = NUL;
-        pos = buffer;
-        line = C_line(&pos, &end);
+                /* Error */
+                if ((error = N_socket_error(len))) {
+                        C_debug("HTTP socket error: %s", error);
+                        N_disconnect_http();
+                        return;
+                }
+                if (len < 0)
+                        return;
 
-        /* "HTTP/1.0" */
-        token = C_token(&line, NULL);
-        if (strncmp(token, "HTTP", 4)) {
-                C_warning("HTTP server sent invalid header: %s", token);
-                return;
+                in_len += len;
+                if (!parse_response())
+                        return;
         }
-        if (strcmp(token, "HTTP/1.1"))
-                C_warning("Server did not send a HTTP/1.1 response: %s", token);
+}
 
-        /* HTTP return code */
-        token = C_token(&line, NULL);
-        if (!strcmp(token, "100"))
-                return;
-        if (strcmp(token, "200")) {
-                C_warning("HTTP server code: %s", token);
-                http_func(N_EV_MESSAGE, NULL, -1);
-                return;
+/******************************************************************************\
+ Append [len] bytes to the output stream.
+\******************************************************************************/
+static void out_append(const char *data, int len)
+{
+        if (out_len + len > out_size) {
+                out_size = out_size ? out_size : 4096;
+                while (out_len + len > out_size)
+                        out_size *= 2;
+                out = C_realloc(out, out_size);
         }
+        memcpy(out + out_len, data, len);
+        out_len += len;
+        out_total += len;
+}
 
-        /* Parse header lines */
-        content_len = 0;
-        while (*(line = C_line(&pos, &end))) {
-                token = C_token(&line, NULL);
-
-                /* Content-Length */
-                if (!strcasecmp(token, "Content-Length:")) {
-                        token = C_token(&line, NULL);
-                        content_len = atoi(token);
-                }
-
-                /* Transfer-Encoding */
-                if (!strcasecmp(token, "Transfer-Encoding:"))
-                        C_warning("Transfer-Encoding not supported");
+/******************************************************************************\
+ Queue the request that was just appended to the output stream.
+\******************************************************************************/
+static void queue_request(void)
+{
+        if (requests_len >= requests_size) {
+                requests_size = requests_size ? 2 * requests_size : 8;
+                requests = C_realloc(requests,
+                                     requests_size * sizeof (*requests));
         }
-
-        /* Make sure we don't overrun */
-        if (pos + content_len > buffer + sizeof (buffer))
-                content_len = (int)(buffer + sizeof (buffer) - pos);
-
-        /* The rest is "content" */
-        http_func(N_EV_MESSAGE, pos, content_len);
+        requests[requests_len].func = http_func;
+        requests[requests_len].end = out_total;
+        requests[requests_len].sent = FALSE;
+        requests_len++;
 }
 
 /******************************************************************************\
- URL-encode [src] into [dest]. Returns FALSE if the entire string could not
- fit.
+ URL-encode [src] into [dest], which must have room for three times the
+ length of [src]. Returns the position after the encoded string.
 \******************************************************************************/
-static bool url_encode(char **dest, int dest_size, const char *src)
+static char *url_encode(char *dest, const char *src)
 {
-        if (!src)
-                return FALSE;
-        while (*src) {
-                int len;
-
-                if (dest_size < 1)
-                        return FALSE;
+        for (; *src; src++) {
 
                 /* Safe ranges */
                 if ((*src >= '0' && *src <= '9') ||
                     (*src >= 'a' && *src <= 'z') ||
                     (*src >= 'A' && *src <= 'Z') || *src == '_') {
-                        *((*dest)++) = *(src++);
-                        dest_size--;
+                        *(dest++) = *src;
                         continue;
                 }
 
                 /* Hex-encode */
-                if (dest_size < 3)
-                        return FALSE;
-                len = snprintf(*dest, dest_size, "%%%02x", *(src++));
-                dest_size -= len;
-                *dest += len;
+                dest += sprintf(dest, "%%%02x", (unsigned char)*src);
         }
-        return TRUE;
+        return dest;
 }
 
 /******************************************************************************\
- Send GET method data through the HTTP connection.
+ Send GET method data through the HTTP connection. Requests are dropped if
+ there is no connection, the callback was already told when it failed.
 \******************************************************************************/
 void N_send_get(const char *url)
 {
-        http_buffer_len += snprintf(http_buffer + http_buffer_len,
-                                    sizeof (http_buffer) - http_buffer_len,
-                                    "GET %s HTTP/1.1\n"
-                                    "Host: %s:%d\n"
-                                    "Connection: close\n\n",
-                                    url, http_host, http_port);
+        const char *header;
+
+        if (!connection_open())
+                return;
+        header = C_va("GET %s HTTP/1.1\n"
+                      "Host: %s\n"
+                      "Connection: keep-alive\n\n", url, http_host);
+        out_append(header, C_strlen(header));
+        queue_request();
 }
 
 /******************************************************************************\
@@ -242,58 +570,43 @@ void N_send_get(const char *url)
 void N_send_post_full(const char *url, ...)
 {
         va_list va;
-        int text_len;
-        char text[4096], *pos;
-        bool first;
-
-        /* Pack text buffer */
-        first = TRUE;
-        va_start(va, url);
-        for (pos = text; ; ) {
-                const char *key, *value;
-                int len;
+        int text_size;
+        char *text, *pos;
+        const char *key, *value, *header;
 
-                if (!(key = va_arg(va, const char *)) ||
-                    !(value = va_arg(va, const char *)))
-                        break;
+        if (!connection_open())
+                return;
 
-                /* See if we have enough room */
-                len = C_strlen(key) + C_strlen(value) + 2;
-                if (sizeof (text) + text - pos <= len)
-                        break;
+        /* Encoding at most triples the size of each character */
+        text_size = 1;
+        va_start(va, url);
+        while ((key = va_arg(va, const char *)) &&
+               (value = va_arg(va, const char *)))
+                text_size += 3 * (C_strlen(key) + C_strlen(value)) + 2;
+        va_end(va);
 
-                /* Separate keys */
-                if (first)
-                        first = FALSE;
-                else
+        /* Pack text buffer */
+        text = pos = C_malloc(text_size);
+        va_start(va, url);
+        while ((key = va_arg(va, const char *)) &&
+               (value = va_arg(va, const char *))) {
+                if (pos > text)
                         *(pos++) = '&';
-
-                /* Encode key */
-                if (!url_encode(&pos, (int)(text + sizeof (text) - pos) - 1,
-                                key))
-                        break;
-
-                /* Separator */
+                pos = url_encode(pos, key);
                 *(pos++) = '=';
-
-                /* Encode value */
-                if (!url_encode(&pos, (int)(text + sizeof (text) - pos),
-                                value))
-                        break;
+                pos = url_encode(pos, value);
         }
-        *pos = NUL;
-        text_len = (int)(pos - text);
         va_end(va);
 
         /* Send the message */
-        http_buffer_len += snprintf(http_buffer + http_buffer_len,
-                                    sizeof (http_buffer) - http_buffer_len,
-                                    "POST %s HTTP/1.1\n"
-                                    "Host: %s:%d\n"
-                                    "Connection: close\n"
-                                    "Content-Type:"
-                                    " application/x-www-form-urlencoded\n"
-                                    "Content-Length: %d\n\n%s",
-                                    url, http_host, http_port, text_len, text);
+        header = C_va("POST %s HTTP/1.1\n"
+                      "Host: %s\n"
+                      "Connection: keep-alive\n"
+                      "Content-Type: application/x-www-form-urlencoded\n"
+                      "Content-Length: %d\n\n", url, http_host,
+                      (int)(pos - text));
+        out_append(header, C_strlen(header));
+        out_append(text, (int)(pos - text));
+        C_free(text);
+        queue_request();
 }
-
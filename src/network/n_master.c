@@ -0,0 +1,767 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Embedded master server. Speaks the same protocol as tools/master.py: hosts
+   POST heartbeats with their port, protocol, name and info and a POST without
+   a name removes the game. Any request with a format of "csv" or "html" gets
+   the server list back. The registry is kept in memory. Entries expire from a
+   timer wheel with one slot per second, and the listings are built once and
+   shared until the registry changes. Connections are kept alive so that hosts
+   can send their heartbeats on one connection for the whole game. */
+
+#include "n_common.h"
+
+/* Seconds after which a server entry expires */
+#define SERVER_TTL 360
+
+/* Timer wheel slots, a power of two larger than SERVER_TTL */
+#define WHEEL_SLOTS 512
+
+/* Registry size, the number of hash buckets is a power of two */
+#define SERVERS_MAX 4096
+#define BUCKETS 4096
+
+/* Longest name or info string accepted */
+#define STRING_MAX 16
+
+/* Simultaneous connections and the largest request accepted */
+#define CONNECTIONS_MAX 256
+#define REQUEST_MAX 8192
+
+/* Milliseconds an idle connection is kept open for another request */
+#define KEEPALIVE_TIMEOUT 15000
+
+/* Listing formats */
+typedef enum {
+        FORMAT_NONE,
+        FORMAT_HTML,
+        FORMAT_CSV,
+        FORMATS,
+} format_t;
+
+/* A registered game. Free entries are chained through [bucket_next]. */
+typedef struct server {
+        char address[24], name[STRING_MAX + 1], info[STRING_MAX + 1];
+        int protocol, expire, bucket_next, wheel_prev, wheel_next;
+        bool used;
+} server_t;
+
+/* The status and body of an HTTP response. Connections hold a reference
+   while sending it so that the cached listings can be replaced at any
+   time. */
+typedef struct response {
+        const char *status, *type;
+        int refs, len;
+        char data[1];
+} response_t;
+
+/* A client connection. Connections are kept open and requests that arrive
+   before the previous response is sent wait in the buffer. [used] is the
+   size of the request being answered. */
+typedef struct connection {
+        SOCKET socket;
+        response_t *response;
+        int len, used, sent, header_len, time;
+        char address[16], header[160], buffer[REQUEST_MAX + 1];
+        bool close;
+} connection_t;
+
+static server_t servers[SERVERS_MAX];
+static connection_t *connections;
+static response_t *listings[FORMATS];
+static SOCKET master_socket = INVALID_SOCKET;
+static int buckets[BUCKETS], wheel[WHEEL_SLOTS], wheel_second, free_server,
+           servers_num;
+
+/******************************************************************************\
+ Allocate a response and fill it in. The body is [len] bytes of [body].
+\******************************************************************************/
+static response_t *new_response(const char *status, const char *type,
+                                const char *body, int len)
+{
+        response_t *response;
+
+        response = C_malloc(sizeof (*response) + len);
+        response->status = status;
+        response->type = type;
+        response->refs = 1;
+        response->len = len;
+        memcpy(response->data, body, len);
+        return response;
+}
+
+/******************************************************************************\
+ Release a reference to a response.
+\******************************************************************************/
+static void release_response(response_t **response)
+{
+        if (!*response)
+                return;
+        if (--(*response)->refs <= 0)
+                C_free(*response);
+        *response = NULL;
+}
+
+/******************************************************************************\
+ Append formatted text to a growing buffer.
+\******************************************************************************/
+static void append(char **buffer, int *len, int *size, const char *fmt, ...)
+{
+        va_list va;
+        int ret;
+
+        for (;;) {
+                va_start(va, fmt);
+                ret = vsnprintf(*buffer + *len, *size - *len, fmt, va);
+                va_end(va);
+                if (ret >= 0 && ret < *size - *len)
+                        break;
+                *size *= 2;
+                *buffer = C_realloc(*buffer, *size);
+        }
+        *len += ret;
+}
+
+/******************************************************************************\
+ Build the server listing in the given format.
+\******************************************************************************/
+static response_t *build_listing(format_t format)
+{
+        response_t *response;
+        int i, len, size;
+        char *body;
+
+        size = 4096;
+        body = C_malloc(size);
+        len = 0;
+        if (format == FORMAT_CSV)
+                append(&body, &len, &size,
+                       "\"protocol\",\"address\",\"name\",\"info\"\n");
+        else
+                append(&body, &len, &size,
+                       "<html>\n<body>\n<table border=\"1\">\n<tr>\n"
+                       "<th>protocol</th>\n<th>address</th>\n"
+                       "<th>name</th>\n<th>info</th>\n</tr>\n");
+        for (i = 0; i < SERVERS_MAX; i++) {
+                if (!servers[i].used)
+                        continue;
+                if (format == FORMAT_CSV)
+                        append(&body, &len, &size,
+                               "\"%d\",\"%s\",\"%s\",\"%s\"\n",
+                               servers[i].protocol, servers[i].address,
+                               servers[i].name, servers[i].info);
+                else
+                        append(&body, &len, &size,
+                               "<tr>\n<td>%d</td>\n<td>%s</td>\n"
+                               "<td>%s</td>\n<td>%s</td>\n</tr>\n",
+                               servers[i].protocol, servers[i].address,
+                               servers[i].name, servers[i].info);
+        }
+        if (format != FORMAT_CSV)
+                append(&body, &len, &size, "</table>\n</body>\n</html>\n");
+        response = new_response("200 OK", format == FORMAT_CSV ?
+                                          "text/plain" : "text/html",
+                                body, len);
+        C_free(body);
+        return response;
+}
+
+/******************************************************************************\
+ Returns a reference to the cached listing in the given format, building it
+ if the registry has changed.
+\******************************************************************************/
+static response_t *get_listing(format_t format)
+{
+        if (!listings[format])
+                listings[format] = build_listing(format);
+        listings[format]->refs++;
+        return listings[format];
+}
+
+/******************************************************************************\
+ Drop the cached listings after the registry changes.
+\******************************************************************************/
+static void invalidate_listings(void)
+{
+        int i;
+
+        for (i = 0; i < FORMATS; i++)
+                release_response(listings + i);
+}
+
+/******************************************************************************\
+ Link a server into the wheel slot for its expiry second.
+\******************************************************************************/
+static void wheel_link(int index)
+{
+        int *head;
+
+        head = wheel + (servers[index].expire & (WHEEL_SLOTS - 1));
+        servers[index].wheel_prev = -1;
+        servers[index].wheel_next = *head;
+        if (*head >= 0)
+                servers[*head].wheel_prev = index;
+        *head = index;
+}
+
+/******************************************************************************\
+ Unlink a server from the timer wheel.
+\******************************************************************************/
+static void wheel_unlink(int index)
+{
+        server_t *server;
+
+        server = servers + index;
+        if (server->wheel_prev >= 0)
+                servers[server->wheel_prev].wheel_next = server->wheel_next;
+        else
+                wheel[server->expire & (WHEEL_SLOTS - 1)] = server->wheel_next;
+        if (server->wheel_next >= 0)
+                servers[server->wheel_next].wheel_prev = server->wheel_prev;
+}
+
+/******************************************************************************\
+ Find a server by address. Returns its index or -1. If [pprev] is not NULL
+ it is set to the bucket link that points to the server.
+\******************************************************************************/
+static int find_server(const char *address, int **pprev)
+{
+        int *link;
+
+        link = buckets + (C_hash_djb2(address) & (BUCKETS - 1));
+        for (; *link >= 0; link = &servers[*link].bucket_next)
+                if (!strcmp(servers[*link].address, address)) {
+                        if (pprev)
+                                *pprev = link;
+                        return *link;
+                }
+        return -1;
+}
+
+/******************************************************************************\
+ Remove a server from the registry.
+\******************************************************************************/
+static void remove_server(const char *address)
+{
+        int index, *link;
+
+        if ((index = find_server(address, &link)) < 0)
+                return;
+        *link = servers[index].bucket_next;
+        wheel_unlink(index);
+        servers[index].used = FALSE;
+        servers[index].bucket_next = free_server;
+        free_server = index;
+        servers_num--;
+        invalidate_listings();
+}
+
+/******************************************************************************\
+ Add a server or refresh its entry. Only changes to what is listed invalidate
+ the cached listings.
+\******************************************************************************/
+static void update_server(const char *address, int protocol,
+                          const char *name, const char *info)
+{
+        server_t *server;
+        int index, *bucket;
+
+        /* New server */
+        if ((index = find_server(address, NULL)) < 0) {
+                if ((index = free_server) < 0) {
+                        C_warning("Master server registry is full");
+                        return;
+                }
+                server = servers + index;
+                free_server = server->bucket_next;
+                bucket = buckets + (C_hash_djb2(address) & (BUCKETS - 1));
+                server->bucket_next = *bucket;
+                *bucket = index;
+                C_strncpy_buf(server->address, address);
+                server->used = TRUE;
+                server->protocol = -1;
+                server->name[0] = server->info[0] = NUL;
+                servers_num++;
+                C_debug("Registered '%s'", address);
+        } else {
+                server = servers + index;
+                wheel_unlink(index);
+        }
+
+        /* Reschedule expiry */
+        server->expire = wheel_second + SERVER_TTL;
+        wheel_link(index);
+
+        /* Update what is listed */
+        if (server->protocol == protocol && !strcmp(server->name, name) &&
+            !strcmp(server->info, info))
+                return;
+        server->protocol = protocol;
+        C_strncpy_buf(server->name, name);
+        C_strncpy_buf(server->info, info);
+        invalidate_listings();
+}
+
+/******************************************************************************\
+ Expire servers up to the current second.
+\******************************************************************************/
+static void expire_servers(void)
+{
+        int now, steps;
+
+        now = c_time_msec / 1000;
+        for (steps = 0; wheel_second < now; steps++) {
+                int *head;
+
+                /* If we fell far behind, every slot has been visited but
+                   time must still catch up */
+                if (steps >= WHEEL_SLOTS) {
+                        wheel_second = now;
+                        break;
+                }
+                head = wheel + (++wheel_second & (WHEEL_SLOTS - 1));
+                while (*head >= 0) {
+                        C_debug("Expired '%s'", servers[*head].address);
+                        remove_server(servers[*head].address);
+                }
+        }
+}
+
+/******************************************************************************\
+ Find [key] in a URL-encoded form and decode its value into [value]. Returns
+ FALSE if the key is not present or the value does not fit.
+\******************************************************************************/
+static bool form_value(const char *form, const char *key, char *value,
+                       int size)
+{
+        int key_len, i;
+
+        if (!form)
+                return FALSE;
+        key_len = C_strlen(key);
+        for (;;) {
+                if (!strncmp(form, key, key_len) && form[key_len] == '=')
+                        break;
+                if (!(form = strchr(form, '&')))
+                        return FALSE;
+                form++;
+        }
+        for (form += key_len + 1, i = 0; *form && *form != '&'; form++) {
+                int ch;
+
+                if (i >= size - 1)
+                        return FALSE;
+                ch = *form;
+                if (ch == '+')
+                        ch = ' ';
+                else if (ch == '%' && isxdigit(form[1]) &&
+                         isxdigit(form[2])) {
+                        char hex[3] = {form[1], form[2], NUL};
+
+                        ch = (int)strtol(hex, NULL, 16);
+                        form += 2;
+                }
+                value[i++] = (char)ch;
+        }
+        value[i] = NUL;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Returns TRUE if [s] is a string that can go into the listing.
+\******************************************************************************/
+static bool valid_string(const char *s)
+{
+        for (; *s; s++)
+                if (strchr("=[];\"'<>&", *s) || (unsigned char)*s < ' ')
+                        return FALSE;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Returns TRUE if [s] is a non-empty string of digits.
+\******************************************************************************/
+static bool valid_number(const char *s)
+{
+        if (!*s)
+                return FALSE;
+        for (; *s; s++)
+                if (!isdigit(*s))
+                        return FALSE;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Handle a request from [peer]. Heartbeats are recorded and the response is
+ either a listing or a short acknowledgement.
+\******************************************************************************/
+static response_t *handle_request(const char *peer, const char *query,
+                                  const char *body)
+{
+        format_t format;
+        char port[8], protocol[8], name[STRING_MAX + 1],
+             info[STRING_MAX + 1], value[8];
+        const char *form;
+
+        /* Fields can come from the body or the query string */
+        form = body && *body ? body : query;
+
+        /* A heartbeat */
+        if (form_value(form, "port", port, sizeof (port))) {
+                char *address;
+
+                if (!valid_number(port))
+                        return new_response("400 Bad Request", "text/plain",
+                                            "Invalid port\n", 13);
+                address = C_va("%s:%s", peer, port);
+                if (!form_value(form, "name", name, sizeof (name)))
+                        remove_server(address);
+                else if (!form_value(form, "info", info, sizeof (info)) ||
+                         !form_value(form, "protocol", protocol,
+                                     sizeof (protocol)) ||
+                         !valid_string(name) || !valid_string(info) ||
+                         !valid_number(protocol))
+                        return new_response("400 Bad Request", "text/plain",
+                                            "Invalid\n", 8);
+                else
+                        update_server(address, atoi(protocol), name, info);
+        }
+
+        /* Hosts ignore the response to a heartbeat so unless they ask for
+           a listing it is not sent */
+        format = FORMAT_NONE;
+        if (form_value(query, "format", value, sizeof (value)) ||
+            form_value(body, "format", value, sizeof (value))) {
+                if (!strcmp(value, "csv"))
+                        format = FORMAT_CSV;
+                else if (!strcmp(value, "html"))
+                        format = FORMAT_HTML;
+                else
+                        return new_response("400 Bad Request", "text/plain",
+                                            "Invalid format\n", 15);
+        } else if (!form)
+                format = FORMAT_HTML;
+        if (format == FORMAT_NONE)
+                return new_response("200 OK", "text/plain", "OK\n", 3);
+        return get_listing(format);
+}
+
+/******************************************************************************\
+ Start sending [response] on a connection. The headers are written for each
+ connection as only they know whether the connection stays open.
+\******************************************************************************/
+static void start_response(connection_t *conn, response_t *response)
+{
+        conn->response = response;
+        conn->sent = 0;
+        conn->header_len = snprintf(conn->header, sizeof (conn->header),
+                                    "HTTP/1.1 %s\r\n"
+                                    "Content-Type: %s\r\n"
+                                    "Content-Length: %d\r\n"
+                                    "Connection: %s\r\n\r\n",
+                                    response->status, response->type,
+                                    response->len,
+                                    conn->close ? "close" : "keep-alive");
+}
+
+/******************************************************************************\
+ See if the connection has received a whole request and handle it if it
+ has. Returns FALSE if more data is needed. The buffer is not modified until
+ the request is complete.
+\******************************************************************************/
+static bool parse_request(connection_t *conn)
+{
+        int content_len;
+        char *pos, *line, *method, *query, *version, *headers_end, *body,
+             saved;
+        bool keep_alive;
+
+        /* Wait for the end of the headers. The game ends lines with just a
+           newline. */
+        conn->buffer[conn->len] = NUL;
+        if (!(headers_end = strstr(conn->buffer, "\n\r\n")) &&
+            !(headers_end = strstr(conn->buffer, "\n\n")))
+                return FALSE;
+        headers_end += headers_end[1] == '\r' ? 3 : 2;
+
+        /* Scan the headers we need */
+        content_len = 0;
+        conn->close = keep_alive = FALSE;
+        for (line = strchr(conn->buffer, '\n') + 1; line < headers_end;
+             line = strchr(line, '\n') + 1) {
+                if (!strncasecmp(line, "Content-Length:", 15))
+                        content_len = atoi(line + 15);
+                else if (!strncasecmp(line, "Connection:", 11)) {
+                        pos = C_skip_spaces(line + 11);
+                        if (!strncasecmp(pos, "close", 5))
+                                conn->close = TRUE;
+                        else if (!strncasecmp(pos, "keep-alive", 10))
+                                keep_alive = TRUE;
+                }
+        }
+        if (content_len < 0 ||
+            headers_end + content_len > conn->buffer + REQUEST_MAX) {
+                conn->close = TRUE;
+                start_response(conn, new_response("413 Request Too Large",
+                                                  "text/plain", "", 0));
+                return TRUE;
+        }
+        if (headers_end + content_len > conn->buffer + conn->len)
+                return FALSE;
+        conn->used = (int)(headers_end - conn->buffer) + content_len;
+
+        /* Request line */
+        line = conn->buffer;
+        *strchr(line, '\n') = NUL;
+        method = C_token(&line, NULL);
+        query = C_token(&line, NULL);
+        version = C_token(&line, NULL);
+        if ((query = strchr(query, '?')))
+                *query++ = NUL;
+        if (strcmp(version, "HTTP/1.1") && !keep_alive)
+                conn->close = TRUE;
+
+        /* The body ends where the next request may begin */
+        body = headers_end;
+        saved = body[content_len];
+        body[content_len] = NUL;
+        if (!strcmp(method, "POST"))
+                start_response(conn, handle_request(conn->address, query,
+                                                    body));
+        else if (!strcmp(method, "GET"))
+                start_response(conn, handle_request(conn->address, query,
+                                                    NULL));
+        else
+                start_response(conn, new_response("405 Method Not Allowed",
+                                                  "text/plain", "", 0));
+        body[content_len] = saved;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Close a connection and free its slot.
+\******************************************************************************/
+static void close_connection(connection_t *conn)
+{
+        closesocket(conn->socket);
+        conn->socket = INVALID_SOCKET;
+        release_response(&conn->response);
+}
+
+/******************************************************************************\
+ Receive requests on a connection and send the responses back. Returns TRUE
+ if anything happened.
+\******************************************************************************/
+static bool poll_connection(connection_t *conn)
+{
+        const char *error, *data;
+        int ret, len;
+
+        /* Receive the next request unless it is already here */
+        if (!conn->response && !(conn->len > 0 && parse_request(conn))) {
+                ret = (int)recv(conn->socket, conn->buffer + conn->len,
+                                REQUEST_MAX - conn->len, 0);
+                if (!ret || (error = N_socket_error(ret))) {
+                        close_connection(conn);
+                        return TRUE;
+                }
+                if (ret < 0) {
+                        if (c_time_msec > conn->time + (conn->len ?
+                                                        CONNECT_TIMEOUT :
+                                                        KEEPALIVE_TIMEOUT))
+                                close_connection(conn);
+                        return FALSE;
+                }
+                conn->len += ret;
+                conn->time = c_time_msec;
+                if (!parse_request(conn)) {
+                        if (conn->len >= REQUEST_MAX)
+                                close_connection(conn);
+                        return TRUE;
+                }
+        }
+
+        /* Send the headers, then the body */
+        if (conn->sent < conn->header_len) {
+                data = conn->header + conn->sent;
+                len = conn->header_len - conn->sent;
+        } else {
+                data = conn->response->data + conn->sent - conn->header_len;
+                len = conn->response->len + conn->header_len - conn->sent;
+        }
+        ret = len > 0 ? (int)send(conn->socket, data, len, 0) : 0;
+        if ((error = N_socket_error(ret)) ||
+            (ret < 0 && c_time_msec > conn->time + CONNECT_TIMEOUT)) {
+                close_connection(conn);
+                return TRUE;
+        }
+        if (ret < 0)
+                return FALSE;
+        conn->sent += ret;
+        if (conn->sent < conn->header_len + conn->response->len)
+                return TRUE;
+
+        /* Done with this request, keep the connection for the next one */
+        if (conn->close) {
+                close_connection(conn);
+                return TRUE;
+        }
+        release_response(&conn->response);
+        conn->len -= conn->used;
+        memmove(conn->buffer, conn->buffer + conn->used, conn->len);
+        conn->time = c_time_msec;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Find a slot for a new connection. When every slot is taken, the connection
+ that has been idle the longest is closed to make room.
+\******************************************************************************/
+static connection_t *free_connection(void)
+{
+        connection_t *idle;
+        int i;
+
+        for (idle = NULL, i = 0; i < CONNECTIONS_MAX; i++) {
+                if (connections[i].socket == INVALID_SOCKET)
+                        return connections + i;
+                if (!connections[i].response && !connections[i].len &&
+                    (!idle || connections[i].time < idle->time))
+                        idle = connections + i;
+        }
+        if (idle)
+                close_connection(idle);
+        return idle;
+}
+
+/******************************************************************************\
+ Accept new connections.
+\******************************************************************************/
+static bool accept_connections(void)
+{
+        struct sockaddr_in addr;
+        socklen_t socklen;
+        connection_t *conn;
+        SOCKET socket;
+        bool accepted;
+
+        for (accepted = FALSE; ; accepted = TRUE) {
+                socklen = sizeof (addr);
+                if ((socket = accept(master_socket, (struct sockaddr *)&addr,
+                                     &socklen)) == INVALID_SOCKET)
+                        break;
+                if (!(conn = free_connection())) {
+                        C_debug("Master server busy, rejected connection");
+                        closesocket(socket);
+                        continue;
+                }
+                N_socket_no_block(socket);
+                conn->socket = socket;
+                conn->len = 0;
+                conn->time = c_time_msec;
+                C_strncpy_buf(conn->address, inet_ntoa(addr.sin_addr));
+        }
+        return accepted;
+}
+
+/******************************************************************************\
+ Serve master server requests. Returns TRUE if anything happened so that the
+ caller can sleep when idle.
+\******************************************************************************/
+bool N_poll_master(void)
+{
+        bool busy;
+        int i;
+
+        if (master_socket == INVALID_SOCKET)
+                return FALSE;
+        expire_servers();
+        busy = accept_connections();
+        for (i = 0; i < CONNECTIONS_MAX; i++)
+                if (connections[i].socket != INVALID_SOCKET &&
+                    poll_connection(connections + i))
+                        busy = TRUE;
+        return busy;
+}
+
+/******************************************************************************\
+ Stop the master server and forget every registered game.
+\******************************************************************************/
+void N_stop_master(void)
+{
+        int i;
+
+        if (master_socket == INVALID_SOCKET)
+                return;
+        for (i = 0; i < CONNECTIONS_MAX; i++)
+                if (connections[i].socket != INVALID_SOCKET)
+                        close_connection(connections + i);
+        C_free(connections);
+        connections = NULL;
+        invalidate_listings();
+        closesocket(master_socket);
+        master_socket = INVALID_SOCKET;
+        C_debug("Stopped master server, %d games were listed", servers_num);
+}
+
+/******************************************************************************\
+ Start serving master server requests on [port]. Returns TRUE on success.
+\******************************************************************************/
+bool N_start_master(int port)
+{
+        struct sockaddr_in addr;
+        int i;
+#if defined(WINDOWS) || defined(SOLARIS)
+        char yes;
+#else
+        int yes;
+#endif
+
+        N_stop_master();
+
+        /* Empty registry */
+        for (i = 0; i < BUCKETS; i++)
+                buckets[i] = -1;
+        for (i = 0; i < WHEEL_SLOTS; i++)
+                wheel[i] = -1;
+        for (i = 0; i < SERVERS_MAX; i++) {
+                servers[i].used = FALSE;
+                servers[i].bucket_next = i + 1 < SERVERS_MAX ? i + 1 : -1;
+        }
+        free_server = 0;
+        servers_num = 0;
+        wheel_second = c_time_msec / 1000;
+
+        /* Bind the listen socket */
+        master_socket = socket(PF_INET, SOCK_STREAM, 0);
+        yes = 1;
+        setsockopt(master_socket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof (yes));
+        C_zero(&addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (bind(master_socket, (struct sockaddr *)&addr, sizeof (addr)) ||
+            listen(master_socket, 128)) {
+                C_warning("Master server failed to bind to port %d", port);
+                closesocket(master_socket);
+                master_socket = INVALID_SOCKET;
+                return FALSE;
+        }
+        N_socket_no_block(master_socket);
+
+        connections = C_malloc(sizeof (*connections) * CONNECTIONS_MAX);
+        for (i = 0; i < CONNECTIONS_MAX; i++) {
+                connections[i].socket = INVALID_SOCKET;
+                connections[i].response = NULL;
+        }
+        C_debug("Started master server on port %d", port);
+        return TRUE;
+}
@@ -0,0 +1,306 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Priority send queues. Messages to remote clients wait in one queue per
+   message class and are moved into the send buffer a little at a time, so
+   that a burst of bulk data cannot delay the messages sent after it. Critical
+   messages always go first, since messages of the other classes can refer to
+   ships that a critical message introduces. The other classes take turns by
+   deficit round robin, each sending up to its weight worth of bytes per
+   turn, and each client can be capped to a number of bytes per second with a
+   token bucket.
+
+   A message that updates something that an earlier queued message updates,
+   as identified by its token and the first few bytes after it, replaces the
+   earlier message. The new message goes to the back of the queue so that the
+   client ends up with the same state as if both had been sent. */
+
+#include "n_common.h"
+
+/* Largest amount of data queued for a client before it is dropped */
+#define QUEUED_MAX (4 * 1024 * 1024)
+
+/* Bytes a class may send per turn for each unit of weight */
+#define QUANTUM 256
+
+/* Milliseconds of traffic a capped client may send at once after being
+   idle */
+#define BURST_MSEC 250
+
+/* One message class for one client. Messages are kept back to back with
+   their size prefixes from [head] to [len]. */
+typedef struct queue {
+        char *buffer;
+        int head, len, size, deficit;
+} queue_t;
+
+/* Per-client scheduling state */
+typedef struct schedule {
+        queue_t queues[N_CLASSES];
+        int current, peeked, tokens, refill_time;
+        bool visited;
+} schedule_t;
+
+/* How each message token is queued */
+typedef struct token_class {
+        n_class_t class;
+        int key_size;
+} token_class_t;
+
+static schedule_t schedules[N_CLIENTS_MAX];
+static token_class_t token_classes[256];
+
+/* Relative share of the bandwidth each class gets when they all have data
+   waiting. Critical messages are not rationed. */
+static const int weights[N_CLASSES] = {
+        [N_CLASS_MOVEMENT] = 4,
+        [N_CLASS_TRADE] = 2,
+        [N_CLASS_CHAT] = 8,
+        [N_CLASS_BULK] = 1,
+};
+
+/******************************************************************************\
+ Set the class of messages starting with [token]. If [key_size] is not zero,
+ queued messages with this token supersede each other when the [key_size]
+ bytes after the token match. Only use it for messages that carry the whole
+ of whatever state the key identifies. Tokens default to N_CLASS_CRITICAL.
+\******************************************************************************/
+void N_queue_class(int token, n_class_t class, int key_size)
+{
+        C_assert(token >= 0 && token < 256);
+        C_assert(class >= 0 && class < N_CLASSES);
+        token_classes[token].class = class;
+        token_classes[token].key_size = key_size;
+}
+
+/******************************************************************************\
+ Returns the size of the queued message at [pos].
+\******************************************************************************/
+static int message_size(const queue_t *queue, int pos)
+{
+        int size;
+
+        N_unpack_short(queue->buffer + pos, &size);
+        return size;
+}
+
+/******************************************************************************\
+ Throw away every message queued for [client] and reset its bandwidth cap.
+ The queue buffers are kept for the next client to use the slot.
+\******************************************************************************/
+void N_queue_reset(n_client_id_t client)
+{
+        schedule_t *schedule;
+        int i;
+
+        if (client <= N_HOST_CLIENT_ID || client >= N_CLIENTS_MAX)
+                return;
+        schedule = schedules + client;
+        for (i = 0; i < N_CLASSES; i++) {
+                schedule->queues[i].head = schedule->queues[i].len = 0;
+                schedule->queues[i].deficit = 0;
+        }
+        schedule->current = schedule->peeked = 0;
+        schedule->visited = FALSE;
+        schedule->tokens = 0;
+        schedule->refill_time = c_time_msec - BURST_MSEC;
+        n_clients[client].queued_len = 0;
+}
+
+/******************************************************************************\
+ Free the queue buffers of every client.
+\******************************************************************************/
+void N_queue_cleanup(void)
+{
+        int i, j;
+
+        for (i = 0; i < N_CLIENTS_MAX; i++) {
+                N_queue_reset(i);
+                for (j = 0; j < N_CLASSES; j++) {
+                        C_free(schedules[i].queues[j].buffer);
+                        schedules[i].queues[j].buffer = NULL;
+                        schedules[i].queues[j].size = 0;
+                }
+        }
+}
+
+/******************************************************************************\
+ Remove the queued message that [data] supersedes, if there is one. There is
+ never more than one because each message removes the one before it.
+\******************************************************************************/
+static void supersede(queue_t *queue, int *queued_len, const char *data,
+                      int key_size)
+{
+        int pos, size;
+
+        for (pos = queue->head; pos < queue->len; pos += size) {
+                size = message_size(queue, pos);
+                if (size < 3 + key_size || queue->buffer[pos + 2] != data[2] ||
+                    memcmp(queue->buffer + pos + 3, data + 3, key_size))
+                        continue;
+                memmove(queue->buffer + pos, queue->buffer + pos + size,
+                        queue->len - pos - size);
+                queue->len -= size;
+                *queued_len -= size;
+                return;
+        }
+}
+
+/******************************************************************************\
+ Queue a message for a remote [client]. The [data] includes the size prefix.
+ Returns FALSE if the client has too much data queued already.
+\******************************************************************************/
+bool N_queue_push(n_client_id_t client, const char *data, int size)
+{
+        token_class_t *token_class;
+        queue_t *queue;
+        int *queued_len;
+
+        C_assert(client > N_HOST_CLIENT_ID && client < N_CLIENTS_MAX);
+        token_class = token_classes + (size > 2 ? (unsigned char)data[2] : 0);
+        queue = schedules[client].queues + token_class->class;
+        queued_len = &n_clients[client].queued_len;
+        if (token_class->key_size && size >= 3 + token_class->key_size)
+                supersede(queue, queued_len, data, token_class->key_size);
+        if (*queued_len + size > QUEUED_MAX)
+                return FALSE;
+
+        /* Reclaim the space taken by messages already sent before growing
+           the buffer */
+        if (queue->len + size > queue->size && queue->head) {
+                queue->len -= queue->head;
+                memmove(queue->buffer, queue->buffer + queue->head,
+                        queue->len);
+                queue->head = 0;
+        }
+        if (queue->len + size > queue->size) {
+                if (!queue->size)
+                        queue->size = 1024;
+                while (queue->size < queue->len + size)
+                        queue->size *= 2;
+                queue->buffer = C_realloc(queue->buffer, queue->size);
+        }
+        memcpy(queue->buffer + queue->len, data, size);
+        queue->len += size;
+        *queued_len += size;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Find the queue of [client] that should send next and return its first
+ message, or NULL if nothing is queued. Returns the same message until it is
+ popped, unless a critical message is queued in between.
+\******************************************************************************/
+const char *N_queue_peek(n_client_id_t client, int *size)
+{
+        schedule_t *schedule;
+        queue_t *queue;
+
+        if (client <= N_HOST_CLIENT_ID || client >= N_CLIENTS_MAX ||
+            !n_clients[client].queued_len)
+                return NULL;
+        schedule = schedules + client;
+
+        /* Critical messages go ahead of everything else */
+        queue = schedule->queues + N_CLASS_CRITICAL;
+        if (queue->head < queue->len) {
+                schedule->peeked = N_CLASS_CRITICAL;
+                *size = message_size(queue, queue->head);
+                return queue->buffer + queue->head;
+        }
+
+        /* Every queue that has data gains its quantum once per visit so this
+           always finds a message eventually */
+        for (;;) {
+                queue = schedule->queues + schedule->current;
+                if (queue->head < queue->len) {
+                        if (!schedule->visited) {
+                                queue->deficit += weights[schedule->current] *
+                                                  QUANTUM;
+                                schedule->visited = TRUE;
+                        }
+                        *size = message_size(queue, queue->head);
+                        if (queue->deficit >= *size) {
+                                schedule->peeked = schedule->current;
+                                return queue->buffer + queue->head;
+                        }
+                } else
+                        queue->deficit = 0;
+                schedule->current = (schedule->current + 1) % N_CLASSES;
+                schedule->visited = FALSE;
+        }
+}
+
+/******************************************************************************\
+ Remove the message returned by N_queue_peek() from its queue.
+\******************************************************************************/
+void N_queue_pop(n_client_id_t client)
+{
+        queue_t *queue;
+        int size;
+
+        C_assert(client > N_HOST_CLIENT_ID && client < N_CLIENTS_MAX);
+        queue = schedules[client].queues + schedules[client].peeked;
+        C_assert(queue->head < queue->len);
+        size = message_size(queue, queue->head);
+        queue->deficit -= size;
+        queue->head += size;
+
+        /* A class that runs out of messages loses the rest of its turn */
+        if (queue->head >= queue->len) {
+                queue->head = queue->len = 0;
+                queue->deficit = 0;
+        }
+        n_clients[client].queued_len -= size;
+}
+
+/******************************************************************************\
+ Returns TRUE if [client] may be sent more data under its bandwidth cap.
+\******************************************************************************/
+bool N_queue_ready(n_client_id_t client)
+{
+        schedule_t *schedule;
+        int rate, elapsed, credit, burst;
+
+        rate = n_client_rate.value.n;
+        if (rate <= 0 || client <= N_HOST_CLIENT_ID ||
+            client >= N_CLIENTS_MAX)
+                return TRUE;
+        schedule = schedules + client;
+
+        /* The clock is only advanced when whole bytes are credited so that
+           low rates still add up at high frame rates */
+        elapsed = c_time_msec - schedule->refill_time;
+        if (elapsed > BURST_MSEC)
+                elapsed = BURST_MSEC;
+        if ((credit = rate * elapsed / 1000) > 0) {
+                burst = rate * BURST_MSEC / 1000;
+                schedule->tokens += credit;
+                if (schedule->tokens > burst)
+                        schedule->tokens = burst;
+                schedule->refill_time = c_time_msec;
+        }
+        return schedule->tokens > 0;
+}
+
+/******************************************************************************\
+ Take [size] bytes sent to [client] out of its bandwidth allowance. The
+ allowance may go negative so that a large message does not need to fit in
+ the bucket.
+\******************************************************************************/
+void N_queue_charge(n_client_id_t client, int size)
+{
+        if (n_client_rate.value.n <= 0 || client <= N_HOST_CLIENT_ID ||
+            client >= N_CLIENTS_MAX)
+                return;
+        schedules[client].tokens -= size;
+}
@@ -0,0 +1,239 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Hostname resolution. Lookups block for as long as the name server takes to
+   answer so they are done on a helper thread, started the first time a name
+   needs resolving. Answers are cached and looked up again once they expire.
+   Only the main thread reads the clock or logs; the thread only fills in the
+   entries it was asked for. */
+
+#include "n_common.h"
+
+/* Number of cached hostnames */
+#define ENTRIES 16
+
+/* Milliseconds before a resolved or failed hostname is looked up again */
+#define RESOLVED_TTL 300000
+#define FAILED_TTL 30000
+
+/* Cache entry state. Entries are only modified by the thread while queued
+   and only by the main thread otherwise. */
+typedef enum {
+        ENTRY_FREE,
+        ENTRY_QUEUED,
+        ENTRY_RESOLVED,
+        ENTRY_FAILED,
+} entry_state_t;
+
+/* Cached hostname. The expiry time is set when the main thread first sees the
+   answer. */
+typedef struct entry {
+        char hostname[256], address[32];
+        int expire, used;
+        volatile int state;
+} entry_t;
+
+static entry_t entries[ENTRIES];
+static SDL_Thread *thread;
+static SDL_sem *queued;
+static volatile bool thread_running;
+
+/******************************************************************************\
+ Resolver thread. Waits for entries to be queued and resolves them one at a
+ time. gethostbyname() is not reentrant but this is the only caller.
+\******************************************************************************/
+static int thread_main(void *unused)
+{
+        for (;;) {
+                struct hostent *host;
+                unsigned char *ip;
+                int i;
+
+                SDL_SemWait(queued);
+                if (!thread_running)
+                        break;
+                for (i = 0; i < ENTRIES; i++) {
+                        if (entries[i].state != ENTRY_QUEUED)
+                                continue;
+                        host = gethostbyname(entries[i].hostname);
+                        if (!host || host->h_addrtype != AF_INET) {
+                                C_barrier();
+                                entries[i].state = ENTRY_FAILED;
+                                continue;
+                        }
+
+                        /* inet_ntoa() has a static buffer that the main
+                           thread may be using */
+                        ip = (unsigned char *)host->h_addr;
+                        snprintf(entries[i].address,
+                                 sizeof (entries[i].address),
+                                 "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
+                        C_barrier();
+                        entries[i].state = ENTRY_RESOLVED;
+                }
+        }
+        return 0;
+}
+
+/******************************************************************************\
+ Start the resolver thread if it is not running yet.
+\******************************************************************************/
+static bool start_thread(void)
+{
+        if (thread)
+                return TRUE;
+        if (!queued && !(queued = SDL_CreateSemaphore(0))) {
+                C_warning("Failed to create resolver semaphore");
+                return FALSE;
+        }
+        thread_running = TRUE;
+        C_barrier();
+        if (!(thread = SDL_CreateThread(thread_main, NULL))) {
+                C_warning("Failed to start resolver thread");
+                thread_running = FALSE;
+                return FALSE;
+        }
+        C_debug("Started resolver thread");
+        return TRUE;
+}
+
+/******************************************************************************\
+ Stop the resolver thread. Waits for a lookup that is in progress to finish.
+\******************************************************************************/
+void N_stop_resolver(void)
+{
+        int i;
+
+        if (thread) {
+                thread_running = FALSE;
+                C_barrier();
+                SDL_SemPost(queued);
+                SDL_WaitThread(thread, NULL);
+                thread = NULL;
+                C_debug("Stopped resolver thread");
+        }
+        if (queued) {
+                SDL_DestroySemaphore(queued);
+                queued = NULL;
+        }
+        for (i = 0; i < ENTRIES; i++)
+                entries[i].state = ENTRY_FREE;
+}
+
+/******************************************************************************\
+ Queue [hostname] for the thread. If no [entry] is given, the least recently
+ used entry that is not already queued is taken.
+\******************************************************************************/
+static void queue_hostname(entry_t *entry, const char *hostname)
+{
+        int i;
+
+        if (!start_thread())
+                return;
+        if (!entry)
+                for (i = 0; i < ENTRIES; i++) {
+                        if (entries[i].state == ENTRY_QUEUED)
+                                continue;
+                        if (!entry || entries[i].state == ENTRY_FREE ||
+                            (entry->state != ENTRY_FREE &&
+                             entries[i].used < entry->used))
+                                entry = entries + i;
+                }
+        if (!entry)
+                return;
+        if (entry->hostname != hostname)
+                C_strncpy_buf(entry->hostname, hostname);
+        entry->address[0] = NUL;
+        entry->expire = 0;
+        entry->used = c_time_msec;
+        C_barrier();
+        entry->state = ENTRY_QUEUED;
+        SDL_SemPost(queued);
+}
+
+/******************************************************************************\
+ Resolve a hostname without blocking. A port number after the last colon in
+ [hostname] is written to [port]. Dotted addresses are returned right away,
+ anything else is handed to the resolver thread. Keep calling with the same
+ [hostname] until something other than N_RESOLVE_PENDING is returned.
+\******************************************************************************/
+n_resolve_t N_resolve(char *address, int size, int *port,
+                      const char *hostname)
+{
+        entry_t *entry;
+        int i, last_colon;
+        char buffer[256];
+
+        /* Parse the port out of the hostname string */
+        for (last_colon = -1, i = 0; hostname[i]; i++)
+                if (hostname[i] == ':')
+                        last_colon = i;
+        if (last_colon >= 0) {
+                int value;
+
+                if ((value = atoi(hostname + last_colon + 1)))
+                        *port = value;
+                if (last_colon >= sizeof (buffer))
+                        last_colon = sizeof (buffer) - 1;
+                memcpy(buffer, hostname, last_colon);
+                buffer[last_colon] = NUL;
+                hostname = buffer;
+        }
+        if (!*hostname)
+                return N_RESOLVE_FAILED;
+
+        /* Already an address */
+        if (inet_addr(hostname) != INADDR_NONE) {
+                C_strncpy(address, hostname, size);
+                return N_RESOLVE_DONE;
+        }
+
+        /* Find the hostname in the cache */
+        for (entry = NULL, i = 0; i < ENTRIES; i++)
+                if (entries[i].state != ENTRY_FREE &&
+                    !strcmp(entries[i].hostname, hostname)) {
+                        entry = entries + i;
+                        break;
+                }
+        if (!entry) {
+                queue_hostname(NULL, hostname);
+                return N_RESOLVE_PENDING;
+        }
+        if (entry->state == ENTRY_QUEUED)
+                return N_RESOLVE_PENDING;
+        C_barrier();
+
+        /* Look the hostname up again once the answer expires */
+        if (entry->expire && c_time_msec >= entry->expire) {
+                queue_hostname(entry, hostname);
+                return N_RESOLVE_PENDING;
+        }
+        entry->used = c_time_msec;
+
+        /* First time we see this answer */
+        if (!entry->expire) {
+                if (entry->state == ENTRY_RESOLVED) {
+                        entry->expire = c_time_msec + RESOLVED_TTL;
+                        C_debug("Resolved '%s' to %s", hostname,
+                                entry->address);
+                } else {
+                        entry->expire = c_time_msec + FAILED_TTL;
+                        C_warning("Failed to resolve hostname '%s'",
+                                  hostname);
+                }
+        }
+
+        if (entry->state == ENTRY_FAILED)
+                return N_RESOLVE_FAILED;
+        C_strncpy(address, entry->address, size);
+        return N_RESOLVE_DONE;
+}
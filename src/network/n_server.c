@@ -16,9 +16,29 @@
 n_client_t n_clients[N_CLIENTS_MAX + 1];
 int n_clients_num;
 
+/* Connected clients and clients selected for N_SELECTED_ID messages */
+n_client_set_t n_connected, n_selected;
+
 /* Server socket for listening for incoming connections */
 static SOCKET listen_socket;
 
+/******************************************************************************\
+ Mark a client slot as connected or disconnected and empty its send buffers.
+ The buffers themselves are kept for the next client to use the slot.
+\******************************************************************************/
+void N_set_connected(n_client_id_t client, bool connected)
+{
+        n_clients[client].connected = connected;
+        n_clients[client].holding = FALSE;
+        N_discard(client);
+        N_udp_reset(client);
+        N_session_reset(client);
+        if (connected)
+                N_stats_reset(client);
+        if (client >= 0 && client < N_CLIENTS_MAX)
+                C_bit_set(n_connected, client, connected);
+}
+
 /******************************************************************************\
  Close server sockets and stop accepting connections.
 \******************************************************************************/
@@ -30,6 +50,9 @@ void N_stop_server(void)
                 return;
         n_server_func(N_HOST_CLIENT_ID, N_EV_DISCONNECTED);
         n_client_id = N_INVALID_ID;
+        N_stop_thread();
+        N_udp_close();
+        N_stop_sessions();
 
         /* Close listen server socket */
         if (listen_socket != INVALID_SOCKET)
@@ -37,11 +60,12 @@ void N_stop_server(void)
         listen_socket = INVALID_SOCKET;
 
         /* Disconnect any active clients */
-        for (i = 0; i < N_CLIENTS_MAX; i++)
-                if (n_clients[i].connected) {
+        N_clients_for(i, n_connected) {
+                if (i != N_HOST_CLIENT_ID &&
+                    n_clients[i].socket != INVALID_SOCKET)
                         closesocket(n_clients[i].socket);
-                        n_clients[i].connected = FALSE;
-                }
+                N_set_connected(i, FALSE);
+        }
 
         C_debug("Stopped listen server");
 }
@@ -52,6 +76,7 @@ void N_stop_server(void)
 int N_start_server(n_callback_f server_func, n_callback_f client_func)
 {
         struct sockaddr_in addr;
+        int i;
 #if defined(WINDOWS) || defined(SOLARIS)
         char yes;
 #else
@@ -66,13 +91,15 @@ int N_start_server(n_callback_f server_func, n_callback_f client_func)
         n_client_id = N_HOST_CLIENT_ID;
         n_server_func = server_func;
         n_client_func = client_func;
-        C_zero(&n_clients);
+        for (i = 0; i <= N_CLIENTS_MAX; i++) {
+                N_set_connected(i, FALSE);
+                n_clients[i].socket = INVALID_SOCKET;
+        }
+        C_zero_buf(n_selected);
 
         /* Setup the host's client */
-        n_clients[N_HOST_CLIENT_ID].connected = TRUE;
-        n_clients[N_HOST_CLIENT_ID].buffer_len = 0;
-        n_clients[N_SERVER_ID].connected = TRUE;
-        n_clients[N_SERVER_ID].buffer_len = 0;
+        N_set_connected(N_HOST_CLIENT_ID, TRUE);
+        N_set_connected(N_SERVER_ID, TRUE);
         n_clients_num = 1;
         n_server_func(N_HOST_CLIENT_ID, N_EV_CONNECTED);
         n_client_func(N_SERVER_ID, N_EV_CONNECTED);
@@ -101,6 +128,16 @@ int N_start_server(n_callback_f server_func, n_callback_f client_func)
         }
         N_socket_no_block(listen_socket);
         C_debug("Started listen server");
+
+        /* Datagrams use the same port number */
+        C_var_unlatch(&n_udp);
+        if (n_udp.value.n)
+                N_udp_open(n_port.value.n);
+
+        /* Hand the sockets over to the network thread */
+        C_var_unlatch(&n_thread);
+        if (n_thread.value.n)
+                N_start_thread(listen_socket);
         return TRUE;
 }
 
@@ -129,12 +166,32 @@ static void accept_connections(void)
         C_debug("Connected '%s' as client %d", inet_ntoa(addr.sin_addr), i);
         N_socket_no_block(socket);
 
-        /* Initialize the client */
-        n_clients[i].connected = TRUE;
-        n_clients[i].buffer_len = 0;
+        /* Initialize the client, it joins the game once it says hello */
+        N_set_connected(i, TRUE);
         n_clients[i].socket = socket;
         n_clients_num++;
-        n_server_func(i, N_EV_CONNECTED);
+        N_session_accept(i);
+}
+
+/******************************************************************************\
+ Occupy or free a client slot that has no socket behind it. Used to replay
+ recorded games, where clients come and go as they did in the recording.
+\******************************************************************************/
+void N_attach_client(n_client_id_t client, bool attach)
+{
+        if (n_client_id != N_HOST_CLIENT_ID || client <= N_HOST_CLIENT_ID ||
+            client >= N_CLIENTS_MAX || n_clients[client].connected == attach)
+                return;
+        if (attach) {
+                N_set_connected(client, TRUE);
+                n_clients[client].socket = INVALID_SOCKET;
+                n_clients_num++;
+                n_server_func(client, N_EV_CONNECTED);
+                return;
+        }
+        N_set_connected(client, FALSE);
+        n_clients_num--;
+        n_server_func(client, N_EV_DISCONNECTED);
 }
 
 /******************************************************************************\
@@ -154,8 +211,7 @@ void N_drop_client(int client)
                 C_warning("Tried to drop unconnected client %d", client);
                 return;
         }
-        n_clients[client].connected = FALSE;
-        n_clients[client].buffer_len = 0;
+        N_set_connected(client, FALSE);
         n_clients_num--;
 
         /* The server kicked itself */
@@ -166,7 +222,10 @@ void N_drop_client(int client)
         }
 
         n_server_func(client, N_EV_DISCONNECTED);
-        closesocket(n_clients[client].socket);
+        if (n_threaded)
+                N_thread_drop(client);
+        else if (n_clients[client].socket != INVALID_SOCKET)
+                closesocket(n_clients[client].socket);
         C_debug("Dropped client %d", client);
 }
 
@@ -179,11 +238,68 @@ void N_poll_server(void)
 
         if (n_client_id != N_HOST_CLIENT_ID)
                 return;
+        N_poll_udp();
+        if (n_threaded) {
+                N_poll_thread();
+                return;
+        }
         accept_connections();
+        N_poll_sessions();
 
-        /* Send to and receive from clients */
-        for (i = 0; i < N_CLIENTS_MAX; i++)
-                if (!N_send_buffer(i) || !N_receive(i))
+        /* Send to and receive from clients. Clients that lose their
+           connection may get to resume their session. */
+        N_clients_for(i, n_connected) {
+                if (N_session_suspended(i))
+                        continue;
+                if ((!N_send_buffer(i) || !N_receive(i)) &&
+                    !N_session_lost(i))
                         N_drop_client(i);
+        }
 }
 
+/******************************************************************************\
+ Sleep until someone tries to connect or a client or datagram sends data, or
+ [msec] milliseconds have passed. Lets a server idle without polling and
+ still handle messages as soon as they arrive. Returns TRUE if there is
+ something to poll.
+\******************************************************************************/
+bool N_wait_server(int msec)
+{
+        struct timeval tv;
+        fd_set fds;
+        SOCKET udp_socket;
+        int i, nfds;
+
+        if (msec < 0)
+                msec = 0;
+
+        /* Nothing to wait on or the network thread owns the sockets */
+        if (n_client_id != N_HOST_CLIENT_ID || n_threaded ||
+            listen_socket == INVALID_SOCKET) {
+                SDL_Delay(msec);
+                return FALSE;
+        }
+
+        FD_ZERO(&fds);
+        FD_SET(listen_socket, &fds);
+        nfds = (int)listen_socket;
+        if ((udp_socket = N_udp_socket()) != INVALID_SOCKET) {
+                FD_SET(udp_socket, &fds);
+                if ((int)udp_socket > nfds)
+                        nfds = (int)udp_socket;
+        }
+        N_clients_for(i, n_connected) {
+                SOCKET socket;
+
+                socket = n_clients[i].socket;
+                if (i == N_HOST_CLIENT_ID || socket == INVALID_SOCKET ||
+                    N_session_suspended(i))
+                        continue;
+                FD_SET(socket, &fds);
+                if ((int)socket > nfds)
+                        nfds = (int)socket;
+        }
+        tv.tv_sec = msec / 1000;
+        tv.tv_usec = msec % 1000 * 1000;
+        return select(nfds + 1, &fds, NULL, NULL, &tv) > 0;
+}
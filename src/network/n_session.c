@@ -0,0 +1,459 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Session resume. A new connection first says hello with the token of the
+   session it wants to resume, if any, and the number of messages it has
+   received. Fresh clients are given a session token and the server keeps a
+   ring of the messages most recently sent to each of them. If a connection
+   drops, the client's slot, and everything it owns, is held for the grace
+   period. A client that reconnects in time is sent only the messages it
+   missed, or is sent the world again if it missed more than the ring holds.
+
+   Control messages have a zero token, which the game never uses, and are not
+   counted or kept in the ring. Sessions are not available when the server
+   sockets are serviced by the network thread. */
+
+#include "n_common.h"
+
+/* Bytes of recently sent messages kept for each client. The missed messages
+   are replayed into an empty send buffer so this must leave room in it. */
+#define HISTORY_SIZE (N_SYNC_MAX / 2)
+
+/* Control message types */
+typedef enum {
+        CTL_HELLO,
+        CTL_SESSION,
+} ctl_t;
+
+/* Server-side session state for a client. The [history] ring holds [used]
+   bytes starting at [tail], the oldest being message number [first_seq]. */
+typedef struct session {
+        char *history;
+        int token, tail, used, first_seq, seq, accept_time, lost_time;
+        bool pending, suspended;
+} session_t;
+
+static session_t sessions[N_CLIENTS_MAX];
+
+/* Client-side session state */
+static int client_token, client_seq, client_grace, lost_time;
+
+/******************************************************************************\
+ Forget the session in a client slot.
+\******************************************************************************/
+void N_session_reset(n_client_id_t client)
+{
+        if (client < 0 || client >= N_CLIENTS_MAX)
+                return;
+        C_free(sessions[client].history);
+        C_zero(sessions + client);
+}
+
+/******************************************************************************\
+ Client forgets its session.
+\******************************************************************************/
+void N_session_forget(void)
+{
+        client_token = client_seq = client_grace = lost_time = 0;
+}
+
+/******************************************************************************\
+ Copy [size] bytes into or out of the history ring at offset [pos], wrapping
+ around the end of the ring.
+\******************************************************************************/
+static void ring_write(session_t *session, int pos, const char *data, int size)
+{
+        int len;
+
+        pos %= HISTORY_SIZE;
+        len = HISTORY_SIZE - pos;
+        if (len > size)
+                len = size;
+        memcpy(session->history + pos, data, len);
+        memcpy(session->history, data + len, size - len);
+}
+
+static void ring_read(const session_t *session, int pos, char *data, int size)
+{
+        int len;
+
+        pos %= HISTORY_SIZE;
+        len = HISTORY_SIZE - pos;
+        if (len > size)
+                len = size;
+        memcpy(data, session->history + pos, len);
+        memcpy(data + len, session->history, size - len);
+}
+
+/******************************************************************************\
+ Returns the size of the message at offset [pos] of the history ring.
+\******************************************************************************/
+static int ring_message_size(const session_t *session, int pos)
+{
+        char prefix[2];
+        int size;
+
+        ring_read(session, pos, prefix, 2);
+        N_unpack_short(prefix, &size);
+        return size;
+}
+
+/******************************************************************************\
+ Record a message as it goes into the send buffer of [client], dropping the
+ oldest messages to make room.
+\******************************************************************************/
+void N_session_record(n_client_id_t client, const char *data, int size)
+{
+        session_t *session;
+
+        if (client < 0 || client >= N_CLIENTS_MAX || !sessions[client].token)
+                return;
+        session = sessions + client;
+        session->seq++;
+        if (size > HISTORY_SIZE) {
+                session->used = 0;
+                session->first_seq = session->seq;
+                return;
+        }
+        while (session->used + size > HISTORY_SIZE) {
+                int old_size;
+
+                old_size = ring_message_size(session, session->tail);
+                session->tail = (session->tail + old_size) % HISTORY_SIZE;
+                session->used -= old_size;
+                session->first_seq++;
+        }
+        if (!session->history)
+                session->history = C_malloc(HISTORY_SIZE);
+        ring_write(session, session->tail + session->used, data, size);
+        session->used += size;
+}
+
+/******************************************************************************\
+ Send a control message.
+\******************************************************************************/
+static void send_control(n_client_id_t client, ctl_t type, int token, int seq,
+                         int grace)
+{
+        static n_message_t msg;
+
+        N_message_start(&msg);
+        N_message_write_char(&msg, 0);
+        N_message_write_char(&msg, type);
+        N_message_write_int(&msg, token);
+        N_message_write_int(&msg, seq);
+        N_message_write_int(&msg, grace);
+        N_pack_short(msg.buffer, msg.size);
+        N_send_raw(client, msg.buffer, msg.size);
+}
+
+/******************************************************************************\
+ Returns TRUE if the connection to [client] is lost and its slot is being held
+ for it.
+\******************************************************************************/
+bool N_session_suspended(n_client_id_t client)
+{
+        return client >= 0 && client < N_CLIENTS_MAX &&
+               sessions[client].suspended;
+}
+
+/******************************************************************************\
+ A connection was accepted into the [client] slot. It does not count as
+ connected until it says whether it is resuming a session.
+\******************************************************************************/
+void N_session_accept(n_client_id_t client)
+{
+        N_session_reset(client);
+        sessions[client].pending = TRUE;
+        sessions[client].accept_time = c_time_msec;
+        C_bit_set(n_connected, client, FALSE);
+}
+
+/******************************************************************************\
+ Returns a random number for the network code. It has its own generator so
+ that connections, tokens and the packet loss test do not disturb the game's
+ random number sequence, which recordings depend on.
+\******************************************************************************/
+int N_rand(void)
+{
+        static unsigned int state;
+
+        if (!state)
+                state = ((unsigned int)time(NULL) ^ (c_time_msec << 8)) | 1;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (int)state;
+}
+
+/******************************************************************************\
+ A pending client is joining as a new client.
+\******************************************************************************/
+static void session_start(n_client_id_t client)
+{
+        session_t *session;
+
+        session = sessions + client;
+        session->pending = FALSE;
+        C_bit_set(n_connected, client, TRUE);
+        C_var_unlatch(&n_resume_grace);
+        if (n_resume_grace.value.n > 0)
+                while (!session->token)
+                        session->token = N_rand();
+        send_control(client, CTL_SESSION, session->token, 0,
+                     n_resume_grace.value.n);
+        n_server_func(client, N_EV_CONNECTED);
+}
+
+/******************************************************************************\
+ Close a pending connection without the game ever hearing of it.
+\******************************************************************************/
+static void release_pending(n_client_id_t client)
+{
+        if (n_clients[client].socket != INVALID_SOCKET)
+                closesocket(n_clients[client].socket);
+        n_clients[client].socket = INVALID_SOCKET;
+        N_set_connected(client, FALSE);
+        n_clients_num--;
+}
+
+/******************************************************************************\
+ Send [client] every message from number [seq] on.
+\******************************************************************************/
+static void replay(n_client_id_t client, int seq)
+{
+        static char data[HISTORY_SIZE];
+        session_t *session;
+        int i, pos, used, size;
+
+        session = sessions + client;
+        pos = session->tail;
+        used = session->used;
+        for (i = session->first_seq; i < seq; i++) {
+                size = ring_message_size(session, pos);
+                pos += size;
+                used -= size;
+        }
+        ring_read(session, pos, data, used);
+        N_send_raw(client, data, used);
+}
+
+/******************************************************************************\
+ The connection in the pending slot [from] is resuming the session in slot
+ [to], having received [seq] messages in it.
+\******************************************************************************/
+static void resume(n_client_id_t from, n_client_id_t to, int seq)
+{
+        session_t *session;
+
+        /* Move the connection into the held slot */
+        n_clients[to].socket = n_clients[from].socket;
+        n_clients[from].socket = INVALID_SOCKET;
+        release_pending(from);
+        session = sessions + to;
+        session->suspended = FALSE;
+        C_var_unlatch(&n_resume_grace);
+
+        /* Send what it missed */
+        if (seq >= session->first_seq && seq <= session->seq) {
+                C_debug("%s resumed after %d msec, replaying %d messages",
+                        N_client_to_string(to),
+                        c_time_msec - session->lost_time, session->seq - seq);
+                send_control(to, CTL_SESSION, session->token, seq,
+                             n_resume_grace.value.n);
+                replay(to, seq);
+                return;
+        }
+
+        /* Too far behind, messages held since the connection was lost are
+           superseded by the world being sent again */
+        C_debug("%s resumed %d messages behind, resending the world",
+                N_client_to_string(to), session->seq - seq);
+        session->used = 0;
+        session->first_seq = session->seq;
+        N_discard(to);
+        send_control(to, CTL_SESSION, session->token, session->seq,
+                     n_resume_grace.value.n);
+        n_server_func(to, N_EV_RESYNC);
+}
+
+/******************************************************************************\
+ Server received a control message from [client].
+\******************************************************************************/
+static void server_control(n_client_id_t client)
+{
+        int i, type, token, seq;
+
+        type = N_receive_char();
+        token = N_receive_int();
+        seq = N_receive_int();
+        if (client < 0 || client >= N_CLIENTS_MAX ||
+            !sessions[client].pending || type != CTL_HELLO)
+                return;
+        if (token)
+                for (i = 1; i < N_CLIENTS_MAX; i++)
+                        if (sessions[i].suspended &&
+                            sessions[i].token == token) {
+                                resume(client, i, seq);
+                                return;
+                        }
+        session_start(client);
+}
+
+/******************************************************************************\
+ Client received a control message from the server.
+\******************************************************************************/
+static void client_control(void)
+{
+        int type, token, seq, grace;
+
+        type = N_receive_char();
+        token = N_receive_int();
+        seq = N_receive_int();
+        grace = N_receive_int();
+        if (type != CTL_SESSION)
+                return;
+        if (lost_time) {
+                if (token != client_token) {
+                        C_warning("Server did not resume the session");
+                        N_disconnect();
+                        return;
+                }
+                C_debug("Resumed session after %d msec",
+                        c_time_msec - lost_time);
+        }
+        client_token = token;
+        client_seq = seq;
+        client_grace = grace;
+        lost_time = 0;
+}
+
+/******************************************************************************\
+ Handle the message that was just received from [client] if it is a control
+ message. Returns TRUE if the message should not be passed on to the game.
+\******************************************************************************/
+bool N_session_control(n_client_id_t client)
+{
+        /* Game messages are counted by the client. Older clients send a game
+           message without saying hello first. */
+        if (n_receive_msg.size < 3 || n_receive_msg.buffer[2]) {
+                if (n_client_id != N_HOST_CLIENT_ID)
+                        client_seq++;
+                else if (client >= 0 && client < N_CLIENTS_MAX &&
+                         sessions[client].pending) {
+                        session_start(client);
+                        return !n_clients[client].connected;
+                }
+                return FALSE;
+        }
+        n_receive_msg.pos = 3;
+        if (n_client_id == N_HOST_CLIENT_ID)
+                server_control(client);
+        else
+                client_control();
+        return TRUE;
+}
+
+/******************************************************************************\
+ Client says hello to the server, asking to resume its session if it has one.
+\******************************************************************************/
+void N_session_hello(void)
+{
+        send_control(N_SERVER_ID, CTL_HELLO, client_token, client_seq, 0);
+}
+
+/******************************************************************************\
+ The connection to [client] was lost. Returns TRUE if its slot is being held
+ for it to resume, otherwise it should be dropped.
+\******************************************************************************/
+bool N_session_lost(n_client_id_t client)
+{
+        session_t *session;
+
+        if (client <= N_HOST_CLIENT_ID || client >= N_CLIENTS_MAX)
+                return FALSE;
+        session = sessions + client;
+        C_var_unlatch(&n_resume_grace);
+        if (!session->token || n_resume_grace.value.n <= 0)
+                return FALSE;
+        closesocket(n_clients[client].socket);
+        n_clients[client].socket = INVALID_SOCKET;
+        n_clients[client].buffer_len = 0;
+        session->suspended = TRUE;
+        session->lost_time = c_time_msec;
+        C_debug("Lost %s, holding its slot for %d msec",
+                N_client_to_string(client), n_resume_grace.value.n);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Client lost its connection to the server. Returns TRUE if it should try to
+ resume its session, which it can do for as long as the server holds its
+ slot.
+\******************************************************************************/
+bool N_session_resumable(void)
+{
+        if (!client_token)
+                return FALSE;
+        if (!lost_time) {
+                C_warning("Lost connection to server, trying to resume");
+                lost_time = c_time_msec;
+        }
+        return c_time_msec - lost_time < client_grace;
+}
+
+/******************************************************************************\
+ Service pending connections and give up on clients that did not come back in
+ time.
+\******************************************************************************/
+void N_poll_sessions(void)
+{
+        int i;
+
+        C_var_unlatch(&n_resume_grace);
+        for (i = 1; i < N_CLIENTS_MAX; i++) {
+                session_t *session;
+
+                session = sessions + i;
+
+                /* Clients that have not said hello yet. Older clients never
+                   do and are let in when the wait is over. */
+                if (session->pending) {
+                        if (!N_send_buffer(i) || !N_receive(i)) {
+                                if (session->pending)
+                                        release_pending(i);
+                        } else if (session->pending && c_time_msec -
+                                   session->accept_time > CONNECT_TIMEOUT)
+                                session_start(i);
+                        continue;
+                }
+
+                if (session->suspended && c_time_msec - session->lost_time >
+                                          n_resume_grace.value.n) {
+                        C_debug("%s did not resume in time",
+                                N_client_to_string(i));
+                        N_drop_client(i);
+                }
+        }
+}
+
+/******************************************************************************\
+ Close connections that never joined when the server stops.
+\******************************************************************************/
+void N_stop_sessions(void)
+{
+        int i;
+
+        for (i = 1; i < N_CLIENTS_MAX; i++)
+                if (sessions[i].pending)
+                        release_pending(i);
+}
@@ -27,7 +27,7 @@ typedef int SOCKET;
 typedef enum {
         N_INVALID_ID = -1,
         N_HOST_CLIENT_ID = 0,
-        N_CLIENTS_MAX = 32,
+        N_CLIENTS_MAX = 256,
         N_SERVER_ID = N_CLIENTS_MAX,
         N_UNASSIGNED_ID,
         N_BROADCAST_ID,
@@ -41,20 +41,63 @@ typedef enum {
         N_EV_CONNECT_FAILED,
         N_EV_DISCONNECTED,
         N_EV_SEND_COMPLETE,
+        N_EV_UDP_READY,
+        N_EV_DATAGRAM,
+        N_EV_RESYNC,
+        N_EV_RECEIVE_COMPLETE,
 } n_event_t;
 
+/* Send priority classes for messages to clients, see n_queue.c */
+typedef enum {
+        N_CLASS_CRITICAL,
+        N_CLASS_MOVEMENT,
+        N_CLASS_TRADE,
+        N_CLASS_CHAT,
+        N_CLASS_BULK,
+        N_CLASSES,
+} n_class_t;
+
+/* Hostname resolution progress */
+typedef enum {
+        N_RESOLVE_PENDING,
+        N_RESOLVE_DONE,
+        N_RESOLVE_FAILED,
+} n_resolve_t;
+
+/* Message builder and reader. The first two bytes of [buffer] hold the size of
+   the message. Messages are independent of each other and can be declared on
+   the stack or allocated wherever convenient. While network statistics are
+   collected, [start_usec] is when the message being written was started. */
+typedef struct n_message {
+        int pos, size;
+        unsigned int start_usec;
+        char buffer[N_SYNC_MAX];
+} n_message_t;
+
 /* Client/server network callback function */
 typedef void (*n_callback_f)(n_client_id_t, n_event_t);
 
-/* HTTP network callback function */
+/* HTTP network callback function. Response bodies arrive in pieces with
+   N_EV_MESSAGE, an error response is a single N_EV_MESSAGE with a NULL
+   [text], and N_EV_RECEIVE_COMPLETE ends each response. */
 typedef void (*n_callback_http_f)(n_event_t, const char *text, int length);
 
-/* Structure for connected clients */
+/* Set of client IDs, one bit per client */
+typedef c_bits_t n_client_set_t[C_BITS_WORDS(N_CLIENTS_MAX)];
+
+/* Iterate [i] over the clients in [set] */
+#define N_clients_for(i, set) C_bits_for(i, set, N_CLIENTS_MAX)
+
+/* Structure for connected clients. The send buffer is allocated as it is
+   needed so that idle slots cost next to nothing. Messages to remote clients
+   wait in the priority queues, [queued_len] bytes in all, until there is room
+   in the send buffer. Messages sent while the client is held wait in order in
+   the held buffer. */
 typedef struct n_client {
         SOCKET socket;
-        int buffer_len;
-        char buffer[N_SYNC_MAX];
-        bool connected, selected;
+        int buffer_len, buffer_size, held_len, held_size, queued_len;
+        char *buffer, *held;
+        bool connected, holding;
 } n_client_t;
 
 /* n_client.c */
@@ -69,33 +112,202 @@ void N_poll_client(void);
 extern n_client_id_t n_client_id;
 
 /* n_http.c */
-void N_connect_http(const char *address, n_callback_http_f);
-bool N_connect_http_wait(const char *address, n_callback_http_f);
+bool N_connect_http(const char *address, n_callback_http_f);
 void N_disconnect_http(void);
 void N_poll_http(void);
-bool N_resolve(char *address, int address_max, int *port, const char *hostname);
-#define N_resolve_buf(a, p, h) N_resolve((a), sizeof (a), (p), (h))
 void N_send_get(const char *url);
 #define N_send_post(url, ...) N_send_post_full(url, ## __VA_ARGS__, NULL)
 void N_send_post_full(const char *url, ...);
 
+/* n_master.c */
+bool N_poll_master(void);
+bool N_start_master(int port);
+void N_stop_master(void);
+
+/* n_queue.c */
+void N_queue_class(int token, n_class_t, int key_size);
+
+/* n_resolve.c */
+n_resolve_t N_resolve(char *address, int address_max, int *port,
+                      const char *hostname);
+#define N_resolve_buf(a, p, h) N_resolve((a), sizeof (a), (p), (h))
+
 /* n_server.c */
+void N_attach_client(n_client_id_t, bool attach);
 void N_drop_client(n_client_id_t);
 void N_poll_server(void);
 int N_start_server(n_callback_f server, n_callback_f client);
 void N_stop_server(void);
+bool N_wait_server(int msec);
 
 extern n_client_t n_clients[N_CLIENTS_MAX + 1];
+extern n_client_set_t n_connected, n_selected;
 extern int n_clients_num;
 
+/******************************************************************************\
+ Returns TRUE if [client] is a regular client ID and is in [set].
+\******************************************************************************/
+static inline bool N_client_in(const c_bits_t *set, int client)
+{
+        return client >= 0 && client < N_CLIENTS_MAX && C_bit_get(set, client);
+}
+
+/* Broadcast to everyone except client [c] */
+#define N_EXCEPT_ID(c) (-(c) - 1)
+
+/* Fixed-layout packing for message codecs. Each function writes or reads one
+   little-endian value at [p] and returns the position following it. Bounds
+   are checked once per message by N_message_reserve() and
+   N_message_read_reserve(), not here. */
+static inline char *N_pack_char(char *p, int value)
+{
+        *p = (char)value;
+        return p + 1;
+}
+
+static inline char *N_pack_short(char *p, int value)
+{
+        Uint16 n;
+
+        n = SDL_SwapLE16((Uint16)value);
+        memcpy(p, &n, 2);
+        return p + 2;
+}
+
+static inline char *N_pack_int(char *p, int value)
+{
+        Uint32 n;
+
+        n = SDL_SwapLE32((Uint32)value);
+        memcpy(p, &n, 4);
+        return p + 4;
+}
+
+static inline char *N_pack_float(char *p, float value)
+{
+        union {
+                float f;
+                Uint32 n;
+        } u;
+
+        u.f = value;
+        u.n = SDL_SwapLE32(u.n);
+        memcpy(p, &u.n, 4);
+        return p + 4;
+}
+
+static inline char *N_pack_string(char *p, const char *value)
+{
+        int len;
+
+        if (!value)
+                value = "";
+        len = (int)strlen(value) + 1;
+        memcpy(p, value, len);
+        return p + len;
+}
+
+/* Client sets are sent as a byte count followed by that many bytes of the
+   set with trailing zero bytes trimmed */
+static inline int N_clients_size(const c_bits_t *set)
+{
+        int i, last;
+
+        last = -1;
+        N_clients_for(i, set)
+                last = i;
+        return 1 + (last + 8) / 8;
+}
+
+static inline char *N_pack_clients(char *p, const c_bits_t *set)
+{
+        int i, bytes;
+
+        bytes = N_clients_size(set) - 1;
+        *p++ = (char)bytes;
+        for (i = 0; i < bytes; i++)
+                *p++ = (char)(set[i / 4] >> (i % 4 * 8));
+        return p;
+}
+
+static inline const char *N_unpack_char(const char *p, int *value)
+{
+        *value = *p;
+        return p + 1;
+}
+
+static inline const char *N_unpack_short(const char *p, int *value)
+{
+        Uint16 n;
+
+        memcpy(&n, p, 2);
+        *value = (short)SDL_SwapLE16(n);
+        return p + 2;
+}
+
+static inline const char *N_unpack_int(const char *p, int *value)
+{
+        Uint32 n;
+
+        memcpy(&n, p, 4);
+        *value = (int)SDL_SwapLE32(n);
+        return p + 4;
+}
+
+static inline const char *N_unpack_float(const char *p, float *value)
+{
+        union {
+                float f;
+                Uint32 n;
+        } u;
+
+        memcpy(&u.n, p, 4);
+        u.n = SDL_SwapLE32(u.n);
+        *value = u.f;
+        return p + 4;
+}
+
+/* n_stats.c */
+void N_stats_names(const char **server, int server_len, const char **client,
+                   int client_len);
+void N_stats_print(void);
+void N_stats_rtt(n_client_id_t, int msec);
+
 /* n_sync.c */
 #define N_broadcast(f, ...) \
         N_send_full(__FILE__, __LINE__, __func__, N_BROADCAST_ID, f, \
                     ## __VA_ARGS__, N_SENTINEL)
 #define N_broadcast_except(c, f, ...) \
-        N_send_full(__FILE__, __LINE__, __func__, -(c) - 1, f, \
+        N_send_full(__FILE__, __LINE__, __func__, N_EXCEPT_ID(c), f, \
                     ## __VA_ARGS__, N_SENTINEL)
+void N_discard(n_client_id_t);
+void N_hold(n_client_id_t, bool hold);
+char *N_hold_take(n_client_id_t, int *len);
+char N_message_read_char(n_message_t *);
+float N_message_read_float(n_message_t *);
+int N_message_read_int(n_message_t *);
+const char *N_message_read_reserve(n_message_t *, int size);
+short N_message_read_short(n_message_t *);
+void N_message_read_string(n_message_t *, char *buffer, int size);
+#define N_message_read_string_buf(m, b) \
+        N_message_read_string(m, b, sizeof (b))
+const char *N_message_read_string_ptr(n_message_t *);
+bool N_message_read_clients(n_message_t *, c_bits_t *set);
+bool N_message_load(n_message_t *, const char *data, int size);
+char *N_message_reserve(n_message_t *, int size);
+void N_message_rewind(n_message_t *);
+void N_message_send(n_message_t *, int client);
+bool N_message_send_ahead(n_message_t *, n_client_id_t);
+void N_message_start(n_message_t *);
+bool N_message_write_char(n_message_t *, char);
+bool N_message_write_clients(n_message_t *, const c_bits_t *set);
+bool N_message_write_data(n_message_t *, const char *data, int size);
+bool N_message_write_float(n_message_t *, float);
+bool N_message_write_int(n_message_t *, int);
+bool N_message_write_short(n_message_t *, short);
+bool N_message_write_string(n_message_t *, const char *);
 char N_receive_char(void);
+bool N_receive_clients(c_bits_t *set);
 float N_receive_float(void);
 int N_receive_int(void);
 short N_receive_short(void);
@@ -107,7 +319,8 @@ void N_receive_string(char *buffer, int size);
                                               N_SELECTED_ID, fmt, \
                                               ## __VA_ARGS__, N_SENTINEL)
 
-bool N_send_char(char);;
+bool N_send_char(char);
+bool N_send_clients(const c_bits_t *set);
 bool N_send_short(short);
 bool N_send_int(int);
 bool N_send_float(float);
@@ -116,10 +329,18 @@ void N_send_full(const char *file, int line, const char *func,
 void N_send_start(void);
 bool N_send_string(const char *);
 
+extern n_message_t n_receive_msg, n_send_msg;
 extern int n_bytes_received, n_bytes_sent;
 
+/* n_udp.c */
+void N_message_send_udp(n_message_t *, n_client_id_t);
+void N_udp_confirm(n_client_id_t);
+void N_udp_connect(int token);
+bool N_udp_ready(n_client_id_t);
+int N_udp_token(n_client_id_t);
+
 /* n_variables.c */
 void N_register_variables(void);
 
-extern c_var_t n_port;
+extern c_var_t n_port, n_test_udp_loss, n_udp;
 
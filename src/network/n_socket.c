@@ -14,42 +14,6 @@
 
 #include "n_common.h"
 
-/******************************************************************************\
- Resolve a hostname.
-\******************************************************************************/
-bool N_resolve(char *address, int size, int *port, const char *hostname)
-{
-        struct hostent *host;
-        int i, last_colon;
-        char buffer[64], *host_ip;
-
-        /* Parse the port out of the hostname string */
-        for (last_colon = -1, i = 0; hostname[i]; i++)
-                if (hostname[i] == ':')
-                        last_colon = i;
-        if (last_colon >= 0) {
-                int value;
-
-                if ((value = atoi(hostname + last_colon + 1)))
-                        *port = value;
-                memcpy(buffer, hostname, last_colon);
-                buffer[last_colon] = NUL;
-                hostname = buffer;
-        }
-
-        /* Resolve hostname */
-        host = gethostbyname(hostname);
-        if (!host) {
-                C_warning("Failed to resolve hostname '%s'", hostname);
-                *buffer = NUL;
-                return FALSE;
-        }
-        host_ip = inet_ntoa(*((struct in_addr *)host->h_addr));
-        C_strncpy(address, host_ip, size);
-        C_debug("Resolved '%s' to %s", hostname, host_ip);
-        return TRUE;
-}
-
 /******************************************************************************\
  Make a generic TCP/IP socket connection.
 \******************************************************************************/
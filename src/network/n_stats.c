@@ -0,0 +1,432 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Network telemetry. While [n_stats] is set, every message that goes over the
+   network is counted by its token along with its size and the time spent
+   encoding or handling it. The host also keeps a histogram of the echo round
+   trip times of each client and samples the depth of its send queue every
+   frame. Setting [n_stats_print] prints the totals and if [n_stats_csv] is
+   set, a row for every message token and client is appended to CSV files
+   every [n_stats_interval] milliseconds. */
+
+#include "n_common.h"
+
+/* Message tokens are one byte */
+#define TOKENS 256
+
+/* Upper bounds of the round trip time histogram buckets in milliseconds. The
+   last bucket holds everything slower. */
+static const int rtt_bounds[] = {25, 50, 100, 200, 400, 800};
+#define RTT_BUCKETS (int)(sizeof (rtt_bounds) / sizeof (*rtt_bounds) + 1)
+
+/* Counters for one message token in one direction. A message broadcast to
+   several clients is counted for each but only timed once. */
+typedef struct token_stats {
+        int count, bytes, timed;
+        unsigned int usec;
+} token_stats_t;
+
+/* Counters for one client */
+typedef struct client_stats {
+        int rtt[RTT_BUCKETS], rtt_sum, echoes, depth_max, samples;
+        float depth_sum;
+} client_stats_t;
+
+/* A set of counters */
+typedef struct stats {
+        token_stats_t sent[TOKENS], received[TOKENS];
+        client_stats_t clients[N_CLIENTS_MAX];
+        int start_time;
+} stats_t;
+
+/* Counters since collection started and since the last CSV rows */
+static stats_t totals, interval;
+static bool collecting;
+
+/* Message names provided by the game */
+static const char **server_names, **client_names;
+static int server_names_len, client_names_len;
+
+/* CSV output */
+static c_file_t messages_csv, clients_csv;
+static char csv_prefix[256];
+static int csv_time;
+
+/******************************************************************************\
+ Give the names of the game's message tokens. Messages from the server are
+ named by [server] and messages from clients by [client].
+\******************************************************************************/
+void N_stats_names(const char **server, int server_len, const char **client,
+                   int client_len)
+{
+        server_names = server;
+        server_names_len = server_len;
+        client_names = client;
+        client_names_len = client_len;
+}
+
+/******************************************************************************\
+ Returns the name of a message [token] that was sent if [sent] is TRUE or
+ received otherwise.
+\******************************************************************************/
+static const char *token_name(int token, bool sent)
+{
+        const char **names;
+        int len;
+
+        if (!token)
+                return "control";
+
+        /* The host sends server messages and receives client messages */
+        if ((n_client_id == N_HOST_CLIENT_ID) == sent) {
+                names = server_names;
+                len = server_names_len;
+        } else {
+                names = client_names;
+                len = client_names_len;
+        }
+        if (token < len && names[token])
+                return names[token];
+        return C_va("%d", token);
+}
+
+/******************************************************************************\
+ Returns TRUE if statistics are being collected, starting collection if they
+ were just enabled.
+\******************************************************************************/
+static bool stats_enabled(void)
+{
+        if (!n_stats.value.n) {
+                collecting = FALSE;
+                return FALSE;
+        }
+        if (!collecting) {
+                C_zero(&totals);
+                C_zero(&interval);
+                totals.start_time = interval.start_time = c_time_msec;
+                collecting = TRUE;
+        }
+        return TRUE;
+}
+
+/******************************************************************************\
+ Count the messages in [data] going over the network to [client]. The data
+ may hold several messages, each with its size prefix.
+\******************************************************************************/
+void N_stats_sent(n_client_id_t client, const char *data, int size)
+{
+        int pos, msg_size, token;
+
+        if (!stats_enabled())
+                return;
+
+        /* Messages between the host and its own client stay local */
+        if (n_client_id == N_HOST_CLIENT_ID &&
+            (client == N_HOST_CLIENT_ID || client == N_SERVER_ID))
+                return;
+
+        for (pos = 0; pos + 3 <= size; pos += msg_size) {
+                N_unpack_short(data + pos, &msg_size);
+                if (msg_size < 3)
+                        break;
+                token = (unsigned char)data[pos + 2];
+                totals.sent[token].count++;
+                totals.sent[token].bytes += msg_size;
+                interval.sent[token].count++;
+                interval.sent[token].bytes += msg_size;
+        }
+}
+
+/******************************************************************************\
+ A message was encoded into [msg] and is being sent. Adds the time since the
+ message was started to its token.
+\******************************************************************************/
+void N_stats_encoded(n_message_t *msg)
+{
+        unsigned int usec;
+        int token;
+
+        if (!msg->start_usec || msg->size < 3)
+                return;
+        if (stats_enabled()) {
+                usec = C_usec() - msg->start_usec;
+                token = (unsigned char)msg->buffer[2];
+                totals.sent[token].usec += usec;
+                totals.sent[token].timed++;
+                interval.sent[token].usec += usec;
+                interval.sent[token].timed++;
+        }
+        msg->start_usec = 0;
+}
+
+/******************************************************************************\
+ A message with [token] and [size] arrived over the network and took [usec]
+ microseconds to handle.
+\******************************************************************************/
+void N_stats_received(int token, int size, unsigned int usec)
+{
+        if (!stats_enabled())
+                return;
+        token &= TOKENS - 1;
+        totals.received[token].count++;
+        totals.received[token].bytes += size;
+        totals.received[token].usec += usec;
+        totals.received[token].timed++;
+        interval.received[token].count++;
+        interval.received[token].bytes += size;
+        interval.received[token].usec += usec;
+        interval.received[token].timed++;
+}
+
+/******************************************************************************\
+ Add an echo round trip time to a client's histogram.
+\******************************************************************************/
+static void add_rtt(client_stats_t *stats, int msec)
+{
+        int i;
+
+        for (i = 0; i < RTT_BUCKETS - 1 && msec >= rtt_bounds[i]; i++);
+        stats->rtt[i]++;
+        stats->rtt_sum += msec;
+        stats->echoes++;
+}
+
+/******************************************************************************\
+ The host measured a round trip time of [msec] to [client].
+\******************************************************************************/
+void N_stats_rtt(n_client_id_t client, int msec)
+{
+        if (client < 0 || client >= N_CLIENTS_MAX || !stats_enabled())
+                return;
+        add_rtt(totals.clients + client, msec);
+        add_rtt(interval.clients + client, msec);
+}
+
+/******************************************************************************\
+ A new client took the [client] slot.
+\******************************************************************************/
+void N_stats_reset(n_client_id_t client)
+{
+        if (client < 0 || client >= N_CLIENTS_MAX)
+                return;
+        C_zero(totals.clients + client);
+        C_zero(interval.clients + client);
+}
+
+/******************************************************************************\
+ Sample the send queue depth of a client.
+\******************************************************************************/
+static void add_depth(client_stats_t *stats, int depth)
+{
+        stats->depth_sum += depth;
+        stats->samples++;
+        if (depth > stats->depth_max)
+                stats->depth_max = depth;
+}
+
+/******************************************************************************\
+ Close the CSV files.
+\******************************************************************************/
+static void close_csv(void)
+{
+        if (!csv_prefix[0])
+                return;
+        C_file_cleanup(&messages_csv);
+        C_file_cleanup(&clients_csv);
+        csv_prefix[0] = NUL;
+}
+
+/******************************************************************************\
+ Open the CSV files named by [n_stats_csv] if they are not already open.
+ Returns FALSE if there is nothing to write to.
+\******************************************************************************/
+static bool open_csv(void)
+{
+        if (!strcmp(csv_prefix, n_stats_csv.value.s))
+                return csv_prefix[0] != NUL;
+        close_csv();
+        if (!n_stats_csv.value.s[0])
+                return FALSE;
+        if (!C_file_init_write(&messages_csv, C_va("%s-messages.csv",
+                                                   n_stats_csv.value.s)) ||
+            !C_file_init_write(&clients_csv, C_va("%s-clients.csv",
+                                                  n_stats_csv.value.s))) {
+                C_warning("Failed to open network statistics files '%s'",
+                          n_stats_csv.value.s);
+                C_file_cleanup(&messages_csv);
+                C_var_set(&n_stats_csv, "");
+                return FALSE;
+        }
+        C_strncpy_buf(csv_prefix, n_stats_csv.value.s);
+        C_file_printf(&messages_csv, "msec,direction,token,name,count,bytes,"
+                                     "timed,usec\n");
+        C_file_printf(&clients_csv, "msec,client,echoes,rtt_mean,rtt_25,"
+                                    "rtt_50,rtt_100,rtt_200,rtt_400,rtt_800,"
+                                    "rtt_slower,depth_mean,depth_max\n");
+        csv_time = c_time_msec + n_stats_interval.value.n;
+        C_debug("Writing network statistics to '%s'", csv_prefix);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Write a row for every token and client that had activity in the interval.
+\******************************************************************************/
+static void write_csv(void)
+{
+        int i, j, msec;
+
+        msec = c_time_msec - totals.start_time;
+        for (i = 0; i < TOKENS; i++) {
+                const token_stats_t *sent, *received;
+
+                sent = interval.sent + i;
+                received = interval.received + i;
+                if (sent->count)
+                        C_file_printf(&messages_csv,
+                                      "%d,out,%d,%s,%d,%d,%d,%u\n", msec, i,
+                                      token_name(i, TRUE), sent->count,
+                                      sent->bytes, sent->timed, sent->usec);
+                if (received->count)
+                        C_file_printf(&messages_csv,
+                                      "%d,in,%d,%s,%d,%d,%d,%u\n", msec, i,
+                                      token_name(i, FALSE), received->count,
+                                      received->bytes, received->timed,
+                                      received->usec);
+        }
+        for (i = 0; i < N_CLIENTS_MAX; i++) {
+                const client_stats_t *client;
+
+                client = interval.clients + i;
+                if (!client->echoes && !client->samples)
+                        continue;
+                C_file_printf(&clients_csv, "%d,%d,%d,%.1f", msec, i,
+                              client->echoes, client->echoes ?
+                              (float)client->rtt_sum / client->echoes : 0.f);
+                for (j = 0; j < RTT_BUCKETS; j++)
+                        C_file_printf(&clients_csv, ",%d", client->rtt[j]);
+                C_file_printf(&clients_csv, ",%.0f,%d\n", client->samples ?
+                              client->depth_sum / client->samples : 0.f,
+                              client->depth_max);
+        }
+        C_file_flush(&messages_csv);
+        C_file_flush(&clients_csv);
+}
+
+/******************************************************************************\
+ Sample send queues and write CSV rows when it is time. Called every frame.
+\******************************************************************************/
+void N_poll_stats(void)
+{
+        int i;
+
+        if (!stats_enabled()) {
+                close_csv();
+                return;
+        }
+        if (n_client_id == N_HOST_CLIENT_ID)
+                N_clients_for(i, n_connected) {
+                        int depth;
+
+                        if (i == N_HOST_CLIENT_ID)
+                                continue;
+                        depth = n_clients[i].buffer_len +
+                                n_clients[i].held_len +
+                                n_clients[i].queued_len;
+                        add_depth(totals.clients + i, depth);
+                        add_depth(interval.clients + i, depth);
+                }
+        if (!open_csv() || c_time_msec < csv_time)
+                return;
+        write_csv();
+        C_zero(&interval);
+        interval.start_time = c_time_msec;
+        csv_time = c_time_msec + (n_stats_interval.value.n > 100 ?
+                                  n_stats_interval.value.n : 100);
+}
+
+/******************************************************************************\
+ Print one direction of the message totals.
+\******************************************************************************/
+static void print_tokens(const token_stats_t *stats, bool sent, float seconds)
+{
+        int i, bytes;
+
+        for (bytes = i = 0; i < TOKENS; i++)
+                bytes += stats[i].bytes;
+        C_print(C_va("%s: %d bytes, %.0f bytes/sec",
+                     sent ? "Sent" : "Received", bytes, bytes / seconds));
+        if (!bytes)
+                return;
+        for (i = 0; i < TOKENS; i++) {
+                if (!stats[i].count)
+                        continue;
+                C_print(C_va("  %-20s %7d msgs %9d bytes %5.1f%% "
+                             "%6.1f bytes/msg %6.2f usec/msg",
+                             token_name(i, sent), stats[i].count,
+                             stats[i].bytes, 100.f * stats[i].bytes / bytes,
+                             (float)stats[i].bytes / stats[i].count,
+                             stats[i].timed ?
+                             (float)stats[i].usec / stats[i].timed : 0.f));
+        }
+}
+
+/******************************************************************************\
+ Print the totals collected so far.
+\******************************************************************************/
+void N_stats_print(void)
+{
+        float seconds;
+        int i, j;
+
+        if (!stats_enabled()) {
+                C_print("Set n_stats to collect network statistics");
+                return;
+        }
+        seconds = (c_time_msec - totals.start_time) / 1000.f;
+        if (seconds < 0.001f)
+                seconds = 0.001f;
+        C_print(C_va("Network statistics over %.0f seconds", seconds));
+        print_tokens(totals.sent, TRUE, seconds);
+        print_tokens(totals.received, FALSE, seconds);
+        for (i = 0; i < N_CLIENTS_MAX; i++) {
+                const client_stats_t *client;
+                char buffer[128];
+                int len;
+
+                client = totals.clients + i;
+                if (!client->echoes && !client->samples)
+                        continue;
+                len = snprintf(buffer, sizeof (buffer), "  Client %3d rtt",
+                               i);
+                for (j = 0; j < RTT_BUCKETS - 1; j++)
+                        len += snprintf(buffer + len, sizeof (buffer) - len,
+                                        " <%d:%d", rtt_bounds[j],
+                                        client->rtt[j]);
+                snprintf(buffer + len, sizeof (buffer) - len, " slower:%d",
+                         client->rtt[j]);
+                C_print(C_va("%s, %.0f msec mean, queue %.0f bytes mean %d "
+                             "max", buffer, client->echoes ?
+                             (float)client->rtt_sum / client->echoes : 0.f,
+                             client->samples ?
+                             client->depth_sum / client->samples : 0.f,
+                             client->depth_max));
+        }
+}
+
+/******************************************************************************\
+ Stop collecting and close the CSV files.
+\******************************************************************************/
+void N_cleanup_stats(void)
+{
+        close_csv();
+        collecting = FALSE;
+}
@@ -16,88 +16,171 @@
 /* Receive function that arriving messages are routed to */
 n_callback_f n_client_func, n_server_func;
 
-static int sync_pos, sync_size;
-static char sync_buffer[N_SYNC_MAX];
+/* Default messages used by the N_send_* and N_receive_* functions. Sending and
+   receiving use separate messages so that a receive handler can reply without
+   losing the message it is reading. */
+n_message_t n_send_msg, n_receive_msg;
+
+/* Largest amount of data held for a client before it is dropped */
+#define HELD_MAX (4 * 1024 * 1024)
+
+/* Queued messages are only moved into the send buffer while it, and whatever
+   is waiting beyond it, holds less than this many bytes. This is as long as a
+   new message can wait behind data already on its way. */
+#define SEND_WINDOW 16384
 
 /* Number of bytes sent/received in the last second */
 int n_bytes_received, n_bytes_sent;
 
 /******************************************************************************\
- Call these functions to retrieve an argument from the current message from
- within the [n_receive_f] function when it is called.
+ Call these functions to read an argument from a message. Reading past the end
+ of the message returns zero.
 \******************************************************************************/
-char N_receive_char(void)
+char N_message_read_char(n_message_t *msg)
 {
-        char value;
-
-        if (sync_pos + 1 > sync_size)
+        if (msg->pos + 1 > msg->size)
                 return NUL;
-        value = sync_buffer[sync_pos++];
-        return value;
+        return msg->buffer[msg->pos++];
 }
 
-int N_receive_int(void)
+int N_message_read_int(n_message_t *msg)
 {
         int value;
 
-        if (sync_pos + 4 > sync_size)
+        if (msg->pos + 4 > msg->size)
                 return 0;
-        value = (int)SDL_SwapLE32(*(Uint32 *)(sync_buffer + sync_pos));
-        sync_pos += 4;
+        value = (int)SDL_SwapLE32(*(Uint32 *)(msg->buffer + msg->pos));
+        msg->pos += 4;
         return value;
 }
 
-float N_receive_float(void)
+float N_message_read_float(n_message_t *msg)
 {
         union {
                 int n;
                 float f;
         } value;
 
-        value.n = N_receive_int();
+        value.n = N_message_read_int(msg);
         return value.f;
 }
 
-short N_receive_short(void)
+short N_message_read_short(n_message_t *msg)
 {
         short value;
 
-        if (sync_pos + 2 > sync_size)
+        if (msg->pos + 2 > msg->size)
                 return 0;
-        value = (short)SDL_SwapLE16(*(Uint16 *)(sync_buffer + sync_pos));
-        sync_pos += 2;
+        value = (short)SDL_SwapLE16(*(Uint16 *)(msg->buffer + msg->pos));
+        msg->pos += 2;
         return value;
 }
 
-void N_receive_string(char *buffer, int size)
+void N_message_read_string(n_message_t *msg, char *buffer, int size)
 {
         int from, len;
 
         if (!buffer || size < 1) {
                 return;
         }
-        for (from = sync_pos; sync_buffer[sync_pos]; sync_pos++)
-                if (sync_pos > sync_size) {
+        for (from = msg->pos; msg->buffer[msg->pos]; msg->pos++)
+                if (msg->pos > msg->size) {
                         *buffer = NUL;
                         return;
                 }
-        len = ++sync_pos - from;
+        len = ++msg->pos - from;
         if (len > size)
                 len = size;
-        memmove(buffer, sync_buffer + from, len);
+        memmove(buffer, msg->buffer + from, len);
 }
 
 /******************************************************************************\
- Write bytes to the data buffer. The datum is assumed to be an integer or
- float that needs byte-order rearranging.
+ Read a set of clients into [set]. Returns FALSE if the message is too short or
+ the set is too large.
 \******************************************************************************/
-static bool write_bytes(int offset, int bytes, void *data)
+bool N_message_read_clients(n_message_t *msg, c_bits_t *set)
+{
+        const unsigned char *data;
+        int i, bytes;
+
+        memset(set, 0, sizeof (n_client_set_t));
+        bytes = (unsigned char)N_message_read_char(msg);
+        if (bytes > N_CLIENTS_MAX / 8 ||
+            !(data = (const unsigned char *)N_message_read_reserve(msg, bytes)))
+                return FALSE;
+        for (i = 0; i < bytes; i++)
+                set[i / 4] |= (c_bits_t)data[i] << (i % 4 * 8);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Returns a pointer to the next [size] bytes of the message and skips past
+ them, or NULL if the message is too short. Message codecs use this to check
+ the length of their fixed fields once.
+\******************************************************************************/
+const char *N_message_read_reserve(n_message_t *msg, int size)
+{
+        const char *data;
+
+        if (size < 0 || msg->pos + size > msg->size)
+                return NULL;
+        data = msg->buffer + msg->pos;
+        msg->pos += size;
+        return data;
+}
+
+/******************************************************************************\
+ Returns a pointer to a string inside the message and skips past it. The
+ pointer is only valid as long as the message is not overwritten. Returns NULL
+ if the string is not terminated inside the message.
+\******************************************************************************/
+const char *N_message_read_string_ptr(n_message_t *msg)
+{
+        const char *string;
+
+        string = msg->buffer + msg->pos;
+        for (; msg->pos < msg->size; msg->pos++)
+                if (!msg->buffer[msg->pos]) {
+                        msg->pos++;
+                        return string;
+                }
+        return NULL;
+}
+
+/******************************************************************************\
+ Rewind to the start of the message so that it can be read from the beginning.
+ Works on a message that was just built as well.
+\******************************************************************************/
+void N_message_rewind(n_message_t *msg)
+{
+        msg->pos = 2;
+}
+
+/******************************************************************************\
+ Copy a complete message, including its size prefix, into [msg] for reading.
+ Returns FALSE if the size is invalid.
+\******************************************************************************/
+bool N_message_load(n_message_t *msg, const char *data, int size)
+{
+        if (size < 2 || size > N_SYNC_MAX)
+                return FALSE;
+        memcpy(msg->buffer, data, size);
+        msg->pos = 2;
+        msg->size = size;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Write bytes to the message. The datum is assumed to be an integer or float
+ that needs byte-order rearranging.
+\******************************************************************************/
+static bool write_bytes(n_message_t *msg, int offset, int bytes, void *data)
 {
         void *to;
 
         if (offset + bytes > N_SYNC_MAX)
                 return FALSE;
-        to = sync_buffer + offset;
+        to = msg->buffer + offset;
         switch (bytes) {
         case 1:
                 *(char *)to = *(char *)data;
@@ -110,78 +193,427 @@ static bool write_bytes(int offset, int bytes, void *data)
                 *(Uint32 *)to = SDL_SwapLE32(*(Uint32 *)data);
                 break;
         }
-        if (offset + bytes > sync_size)
-                sync_size = offset + bytes;
+        if (offset + bytes > msg->size)
+                msg->size = offset + bytes;
         return TRUE;
 }
 
 /******************************************************************************\
- Reset the sync buffer. Use before sending via N_send_* calls.
+ Reset a message before writing to it.
 \******************************************************************************/
-void N_send_start(void)
+void N_message_start(n_message_t *msg)
 {
-        sync_size = 2;
+        msg->pos = 2;
+        msg->size = 2;
+        msg->start_usec = n_stats.value.n ? C_usec() : 0;
 }
 
 /******************************************************************************\
- Add data to the send buffer. Call N_send(client, NULL) to finish sending data.
- Returns FALSE if the buffer overflowed.
+ Start a new message of exactly [size] bytes and return a pointer to where it
+ should be written. Returns NULL if the message is too large.
 \******************************************************************************/
-bool N_send_char(char ch)
+char *N_message_reserve(n_message_t *msg, int size)
 {
-        return write_bytes(sync_size, 1, &ch);
+        if (size < 0 || size + 2 > N_SYNC_MAX)
+                return NULL;
+        msg->pos = 2;
+        msg->size = size + 2;
+        msg->start_usec = n_stats.value.n ? C_usec() : 0;
+        return msg->buffer + 2;
 }
 
-bool N_send_short(short n)
+/******************************************************************************\
+ Add data to the end of a message. Returns FALSE if the buffer overflowed.
+\******************************************************************************/
+bool N_message_write_char(n_message_t *msg, char ch)
 {
-        return write_bytes(sync_size, 2, &n);
+        return write_bytes(msg, msg->size, 1, &ch);
 }
 
-bool N_send_int(int n)
+bool N_message_write_short(n_message_t *msg, short n)
 {
-        return write_bytes(sync_size, 4, &n);
+        return write_bytes(msg, msg->size, 2, &n);
 }
 
-bool N_send_float(float f)
+bool N_message_write_int(n_message_t *msg, int n)
 {
-        return write_bytes(sync_size, 4, &f);
+        return write_bytes(msg, msg->size, 4, &n);
 }
 
-bool N_send_string(const char *string)
+bool N_message_write_float(n_message_t *msg, float f)
+{
+        return write_bytes(msg, msg->size, 4, &f);
+}
+
+bool N_message_write_clients(n_message_t *msg, const c_bits_t *set)
+{
+        int size;
+
+        size = N_clients_size(set);
+        if (msg->size + size > N_SYNC_MAX)
+                return FALSE;
+        N_pack_clients(msg->buffer + msg->size, set);
+        msg->size += size;
+        return TRUE;
+}
+
+bool N_message_write_data(n_message_t *msg, const char *data, int size)
+{
+        if (size < 0 || msg->size + size > N_SYNC_MAX)
+                return FALSE;
+        memcpy(msg->buffer + msg->size, data, size);
+        msg->size += size;
+        return TRUE;
+}
+
+bool N_message_write_string(n_message_t *msg, const char *string)
 {
         int string_len;
 
         string_len = C_strlen(string) + 1;
         if (string_len <= 1) {
-                if (sync_size > N_SYNC_MAX - 1)
+                if (msg->size > N_SYNC_MAX - 1)
                         return FALSE;
-                sync_buffer[sync_size++] = NUL;
+                msg->buffer[msg->size++] = NUL;
                 return TRUE;
         }
-        if (sync_size + string_len > N_SYNC_MAX)
+        if (msg->size + string_len > N_SYNC_MAX)
                return FALSE;
-        memcpy(sync_buffer + sync_size, string, string_len);
-        sync_size += string_len;
+        memcpy(msg->buffer + msg->size, string, string_len);
+        msg->size += string_len;
         return TRUE;
 }
 
 /******************************************************************************\
- Pack the current message buffer into the send buffers of a client.
+ Append [size] bytes to a growable buffer of at most [max] bytes. Returns FALSE
+ if the data does not fit.
 \******************************************************************************/
-static void send_buffer(n_client_id_t client)
+static bool append_buffer(char **buffer, int *len, int *buffer_size, int max,
+                          const char *data, int size)
 {
-        /* Overflow */
-        if (n_clients[client].buffer_len + sync_size >=
-            sizeof (n_clients[client].buffer)) {
+        int new_len;
+
+        new_len = *len + size;
+        if (new_len >= max)
+                return FALSE;
+        if (new_len > *buffer_size) {
+                if (!*buffer_size)
+                        *buffer_size = 1024;
+                while (*buffer_size < new_len)
+                        *buffer_size *= 2;
+                if (*buffer_size > max)
+                        *buffer_size = max;
+                *buffer = C_realloc(*buffer, *buffer_size);
+        }
+        memcpy(*buffer + *len, data, size);
+        *len = new_len;
+        return TRUE;
+}
+
+/******************************************************************************\
+ Append a message to the send buffer of [client], recording it in the
+ client's session history and taking it out of its bandwidth allowance.
+ Returns FALSE if it does not fit.
+\******************************************************************************/
+static bool buffer_message(n_client_id_t client, const char *data, int size)
+{
+        n_client_t *pclient;
+
+        pclient = n_clients + client;
+        if (!append_buffer(&pclient->buffer, &pclient->buffer_len,
+                           &pclient->buffer_size, N_SYNC_MAX, data, size))
+                return FALSE;
+        N_session_record(client, data, size);
+        N_stats_sent(client, data, size);
+        N_queue_charge(client, size);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Append bytes to the send buffer of [client] as they are, without holding or
+ recording them. Used for session control messages and replaying history.
+\******************************************************************************/
+bool N_send_raw(n_client_id_t client, const char *data, int size)
+{
+        n_client_t *pclient;
+
+        pclient = n_clients + client;
+        if (!append_buffer(&pclient->buffer, &pclient->buffer_len,
+                           &pclient->buffer_size, N_SYNC_MAX, data, size))
+                return FALSE;
+        N_stats_sent(client, data, size);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Move everything in the priority queues of [client] into its held buffer, in
+ the order it would have been sent. Returns FALSE if it does not fit.
+\******************************************************************************/
+static bool hold_queued(n_client_id_t client)
+{
+        n_client_t *pclient;
+        const char *data;
+        int size;
+
+        pclient = n_clients + client;
+        while ((data = N_queue_peek(client, &size))) {
+                if (!append_buffer(&pclient->held, &pclient->held_len,
+                                   &pclient->held_size, HELD_MAX, data, size))
+                        return FALSE;
+                N_queue_pop(client);
+        }
+        return TRUE;
+}
+
+/******************************************************************************\
+ Pack a message into the send buffers of a client. Messages to remote clients
+ go into the priority queues. If the client is held or its connection is
+ lost, the message waits in the held buffer behind any messages already
+ waiting there, and anything still in the queues goes ahead of it.
+\******************************************************************************/
+static void send_buffer(const n_message_t *msg, n_client_id_t client)
+{
+        n_client_t *pclient;
+
+        pclient = n_clients + client;
+        if (!pclient->holding && !pclient->held_len &&
+            !N_session_suspended(client)) {
+                if (client > N_HOST_CLIENT_ID && client < N_CLIENTS_MAX) {
+                        if (N_queue_push(client, msg->buffer, msg->size))
+                                return;
+                } else if (buffer_message(client, msg->buffer, msg->size))
+                        return;
+        }
+        if (hold_queued(client) &&
+            append_buffer(&pclient->held, &pclient->held_len,
+                          &pclient->held_size, HELD_MAX, msg->buffer,
+                          msg->size))
+                return;
+        C_warning("%s buffer overflow", N_client_to_string(client));
+        N_drop_client(client);
+}
+
+/******************************************************************************\
+ Move whole messages from the held buffer and then from the priority queues
+ into the send buffer as they fit. Queued messages only go while less than
+ the send window is waiting to be sent, counting the [backlog] bytes that are
+ already past the send buffer, and while the client's bandwidth cap allows.
+ Does nothing while the client is held.
+\******************************************************************************/
+void N_send_pending(n_client_id_t client, int backlog)
+{
+        n_client_t *pclient;
+        const char *data;
+        int pos, size;
+
+        pclient = n_clients + client;
+        if (pclient->holding)
+                return;
+        for (pos = 0; pos + 2 <= pclient->held_len; pos += size) {
+                N_unpack_short(pclient->held + pos, &size);
+                if (size < 2 || pos + size > pclient->held_len ||
+                    !N_queue_ready(client) ||
+                    !buffer_message(client, pclient->held + pos, size))
+                        break;
+        }
+        if (pos) {
+                pclient->held_len -= pos;
+                memmove(pclient->held, pclient->held + pos,
+                        pclient->held_len);
+        }
+        if (pclient->held_len)
+                return;
+        while (pclient->buffer_len + backlog < SEND_WINDOW &&
+               N_queue_ready(client) &&
+               (data = N_queue_peek(client, &size)) &&
+               buffer_message(client, data, size))
+                N_queue_pop(client);
+}
+
+/******************************************************************************\
+ Throw away everything waiting to be sent to [client].
+\******************************************************************************/
+void N_discard(n_client_id_t client)
+{
+        n_clients[client].buffer_len = 0;
+        n_clients[client].held_len = 0;
+        N_queue_reset(client);
+}
+
+/******************************************************************************\
+ Hold messages sent to [client] in its held buffer instead of sending them.
+ Messages still in the priority queues are held along with them. When
+ released, held messages are sent in order as the send buffer drains.
+\******************************************************************************/
+void N_hold(n_client_id_t client, bool hold)
+{
+        if (client < 0 || client >= N_CLIENTS_MAX)
+                return;
+        n_clients[client].holding = hold;
+        if (hold && !hold_queued(client)) {
                 C_warning("%s buffer overflow", N_client_to_string(client));
                 N_drop_client(client);
+        }
+}
+
+/******************************************************************************\
+ Take everything held for [client] so far, leaving the held buffer empty. The
+ returned buffer belongs to the caller and must be freed with C_free().
+\******************************************************************************/
+char *N_hold_take(n_client_id_t client, int *len)
+{
+        char *data;
+
+        data = n_clients[client].held;
+        *len = n_clients[client].held_len;
+        n_clients[client].held = NULL;
+        n_clients[client].held_len = n_clients[client].held_size = 0;
+        return data;
+}
+
+/******************************************************************************\
+ Send a message to a single [client] ahead of any held messages, for streaming
+ large amounts of data to a held client. Returns FALSE without sending if the
+ send buffer is more than half full so that the caller can try again later.
+\******************************************************************************/
+bool N_message_send_ahead(n_message_t *msg, n_client_id_t client)
+{
+        n_client_t *pclient;
+
+        pclient = n_clients + client;
+        if (!pclient->connected || N_session_suspended(client) ||
+            pclient->buffer_len + msg->size > N_SYNC_MAX / 2 ||
+            !N_queue_ready(client))
+                return FALSE;
+        write_bytes(msg, 0, 2, &msg->size);
+        return buffer_message(client, msg->buffer, msg->size);
+}
+
+/******************************************************************************\
+ Sends a message to [client]. Broadcast client IDs are handled the same way as
+ for N_send_full(). The message is not modified other than for its size prefix
+ so it can be sent again.
+\******************************************************************************/
+void N_message_send(n_message_t *msg, int client)
+{
+        /* We're not connected */
+        if (n_client_id < 0)
+                return;
+
+        /* Clients don't send messages to anyone but the server */
+        if (n_client_id != N_HOST_CLIENT_ID && client != N_SERVER_ID)
+                return;
+
+        /* Write the size of the message as the first 2-bytes */
+        write_bytes(msg, 0, 2, &msg->size);
+        N_stats_encoded(msg);
+
+        /* Broadcast to every connected client */
+        if (client == N_BROADCAST_ID || client < 0) {
+                int i, except;
+
+                C_assert(n_client_id == N_HOST_CLIENT_ID);
+                except = -client - 1;
+                N_clients_for(i, n_connected)
+                        if (i != except)
+                                send_buffer(msg, i);
+                return;
+        }
+
+        /* Send to selected clients */
+        if (client == N_SELECTED_ID) {
+                int i;
+
+                C_assert(n_client_id == N_HOST_CLIENT_ID);
+                N_clients_for(i, n_selected)
+                        if (n_clients[i].connected)
+                                send_buffer(msg, i);
                 return;
         }
 
-        /* Pack message into the buffer */
-        memcpy(n_clients[client].buffer + n_clients[client].buffer_len,
-               sync_buffer, sync_size);
-        n_clients[client].buffer_len += sync_size;
+        /* Single-client message */
+        if (!n_clients[client].connected) {
+                C_warning("Tried to message unconnected %s",
+                          N_client_to_string(client));
+                return;
+        }
+        send_buffer(msg, client);
+}
+
+/******************************************************************************\
+ Call these functions to retrieve an argument from the current message from
+ within the [n_receive_f] function when it is called.
+\******************************************************************************/
+char N_receive_char(void)
+{
+        return N_message_read_char(&n_receive_msg);
+}
+
+bool N_receive_clients(c_bits_t *set)
+{
+        return N_message_read_clients(&n_receive_msg, set);
+}
+
+int N_receive_int(void)
+{
+        return N_message_read_int(&n_receive_msg);
+}
+
+float N_receive_float(void)
+{
+        return N_message_read_float(&n_receive_msg);
+}
+
+short N_receive_short(void)
+{
+        return N_message_read_short(&n_receive_msg);
+}
+
+void N_receive_string(char *buffer, int size)
+{
+        N_message_read_string(&n_receive_msg, buffer, size);
+}
+
+/******************************************************************************\
+ Reset the default send message. Use before sending via N_send_* calls.
+\******************************************************************************/
+void N_send_start(void)
+{
+        N_message_start(&n_send_msg);
+}
+
+/******************************************************************************\
+ Add data to the default send message. Call N_send(client, NULL) to finish
+ sending data. Returns FALSE if the buffer overflowed.
+\******************************************************************************/
+bool N_send_char(char ch)
+{
+        return N_message_write_char(&n_send_msg, ch);
+}
+
+bool N_send_clients(const c_bits_t *set)
+{
+        return N_message_write_clients(&n_send_msg, set);
+}
+
+bool N_send_short(short n)
+{
+        return N_message_write_short(&n_send_msg, n);
+}
+
+bool N_send_int(int n)
+{
+        return N_message_write_int(&n_send_msg, n);
+}
+
+bool N_send_float(float f)
+{
+        return N_message_write_float(&n_send_msg, f);
+}
+
+bool N_send_string(const char *string)
+{
+        return N_message_write_string(&n_send_msg, string);
 }
 
 /******************************************************************************\
@@ -194,9 +626,9 @@ static void send_buffer(n_client_id_t client)
    f       float      4 bytes
    s       string     NULL-terminated
 
- If [client] is (-id - 1), all clients except id will receive the message. Note
- that you can either be receiving or sending. The moment you send a new
- message, the one you were receiving is lost!
+ If [client] is (-id - 1), all clients except id will receive the message. The
+ message is built in the default send message and does not disturb the one
+ that is being received.
 \******************************************************************************/
 void N_send_full(const char *file, int line, const char *func,
                  int client, const char *format, ...)
@@ -212,11 +644,11 @@ void N_send_full(const char *file, int line, const char *func,
         if (n_client_id != N_HOST_CLIENT_ID && client != N_SERVER_ID)
                 return;
 
-        /* Pack the message into the sync buffer */
+        /* Pack the message into the default send message */
         if (!format || !format[0])
                 goto skip;
         va_start(va, format);
-        for (sync_size = 2; *format; format++)
+        for (N_send_start(); *format; format++)
                 switch (*format) {
                 case '1':
                 case 'c':
@@ -253,31 +685,8 @@ void N_send_full(const char *file, int line, const char *func,
                 C_error_full(file, line, func, "Missing sentinel");
         va_end(va);
 
-        /* Write the size of the message as the first 2-bytes */
-skip:   write_bytes(0, 2, &sync_size);
-
-        /* Broadcast to every client */
-        if (client == N_BROADCAST_ID || client == N_SELECTED_ID || client < 0) {
-                int i, except;
-
-                C_assert(n_client_id == N_HOST_CLIENT_ID);
-                except = -client - 1;
-                for (i = 0; i < N_CLIENTS_MAX; i++) {
-                        if (!n_clients[i].connected || i == except ||
-                            (!n_clients[i].selected && client == N_SELECTED_ID))
-                                continue;
-                        send_buffer(i);
-                }
-                return;
-        }
-
-        /* Single-client message */
-        if (!n_clients[client].connected) {
-                C_warning("Tried to message unconnected %s",
-                          N_client_to_string(client));
-                return;
-        }
-        send_buffer(client);
+        /* Size the message and route it */
+skip:   N_message_send(&n_send_msg, client);
         return;
 
 overflow:
@@ -286,33 +695,37 @@ overflow:
 }
 
 /******************************************************************************\
- Try to send buffer.
+ Try to send buffer. Keeps refilling the send buffer from the queues for as
+ long as the socket takes everything.
 \******************************************************************************/
 bool N_send_buffer(n_client_id_t client)
 {
         SOCKET socket;
-        int ret;
+        int ret, len;
 
-        if (!n_clients[client].connected)
-                return TRUE;
+        for (;;) {
+                N_send_pending(client, 0);
+                len = n_clients[client].buffer_len;
+                if (!n_clients[client].connected || !len)
+                        return TRUE;
 
-        /* Local messages don't need to be sent */
-        if (n_client_id == N_HOST_CLIENT_ID &&
-            (client == N_HOST_CLIENT_ID || client == N_SERVER_ID))
-                return TRUE;
+                /* Local messages don't need to be sent */
+                if (n_client_id == N_HOST_CLIENT_ID &&
+                    (client == N_HOST_CLIENT_ID || client == N_SERVER_ID))
+                        return TRUE;
 
-        /* Send TCP/IP message */
-        socket = N_client_to_socket(client);
-        ret = N_socket_send(socket, n_clients[client].buffer,
-                            n_clients[client].buffer_len);
-        n_bytes_sent += n_clients[client].buffer_len;
-        if (ret > 0) {
+                /* Send TCP/IP message */
+                socket = N_client_to_socket(client);
+                ret = N_socket_send(socket, n_clients[client].buffer, len);
+                n_bytes_sent += len;
+                if (ret < 0)
+                        return FALSE;
                 n_clients[client].buffer_len -= ret;
                 memmove(n_clients[client].buffer, n_clients[client].buffer +
                         ret, n_clients[client].buffer_len);
-        } else if (ret < 0)
-                return FALSE;
-        return TRUE;
+                if (ret < len || !n_clients[client].queued_len)
+                        return TRUE;
+        }
 }
 
 /******************************************************************************\
@@ -340,23 +753,54 @@ static bool receive_local(n_client_id_t client)
 
         /* Dispatch messages in order */
         for (pos = 0; pos < pclient->buffer_len; ) {
-                sync_pos = 0;
+                int size;
 
                 /* Unpack the message size */
-                sync_buffer[0] = pclient->buffer[pos];
-                sync_buffer[1] = pclient->buffer[pos + 1];
-                sync_size = N_receive_short();
-                C_assert(sync_size <= pclient->buffer_len - pos);
-
-                /* Copy the entire message into the sync buffer */
-                memcpy(sync_buffer, pclient->buffer + pos, sync_size);
-                pos += sync_size;
+                size = (Uint16)SDL_SwapLE16(*(Uint16 *)(pclient->buffer + pos));
+                C_assert(size <= pclient->buffer_len - pos);
+
+                /* Copy the entire message into the receive message */
+                N_message_load(&n_receive_msg, pclient->buffer + pos, size);
+                pos += size;
                 callback(client, N_EV_MESSAGE);
         }
         pclient->buffer_len = 0;
         return TRUE;
 }
 
+/******************************************************************************\
+ Pass the received message from [client] on to the game unless it is a
+ session control message.
+\******************************************************************************/
+static void dispatch(n_client_id_t client)
+{
+        unsigned int start;
+        int token, size;
+
+        if (N_session_control(client))
+                return;
+        token = n_receive_msg.size > 2 ? n_receive_msg.buffer[2] : 0;
+        size = n_receive_msg.size;
+        start = n_stats.value.n ? C_usec() : 0;
+        if (n_client_id == N_HOST_CLIENT_ID)
+                n_server_func(client, N_EV_MESSAGE);
+        else
+                n_client_func(N_SERVER_ID, N_EV_MESSAGE);
+        if (start)
+                N_stats_received(token, size, C_usec() - start);
+}
+
+/******************************************************************************\
+ Dispatch a complete message that arrived from [client] by some other means
+ than N_receive(). The [data] includes the size prefix.
+\******************************************************************************/
+void N_receive_buffer(n_client_id_t client, const char *data, int size)
+{
+        if (!N_message_load(&n_receive_msg, data, size))
+                C_error("Invalid message size %d", size);
+        dispatch(client);
+}
+
 /******************************************************************************\
  Receive data from a socket. Returns FALSE if an error occured and the
  connection should be dropped.
@@ -375,7 +819,8 @@ bool N_receive(n_client_id_t client)
                 const char *error;
 
                 /* Receive the message size */
-                len = (int)recv(socket, sync_buffer, N_SYNC_MAX, MSG_PEEK);
+                len = (int)recv(socket, n_receive_msg.buffer, N_SYNC_MAX,
+                                MSG_PEEK);
 
                 /* Orderly shutdown */
                 if (!len)
@@ -393,8 +838,8 @@ bool N_receive(n_client_id_t client)
                         return TRUE;
 
                 /* Read the message length */
-                sync_pos = 0;
-                sync_size = 2;
+                n_receive_msg.pos = 0;
+                n_receive_msg.size = 2;
                 message_size = N_receive_short();
                 if (message_size < 1 || message_size > N_SYNC_MAX) {
                         C_warning("Invalid message size %d "
@@ -409,15 +854,17 @@ bool N_receive(n_client_id_t client)
                 n_bytes_received += message_size;
 
                 /* Read the entire message */
-                recv(socket, sync_buffer, message_size, 0);
+                recv(socket, n_receive_msg.buffer, message_size, 0);
 
                 /* Dispatch the message */
-                sync_pos = 2;
-                sync_size = message_size;
-                if (n_client_id == N_HOST_CLIENT_ID)
-                        n_server_func(client, N_EV_MESSAGE);
-                else
-                        n_client_func(N_SERVER_ID, N_EV_MESSAGE);
+                n_receive_msg.pos = 2;
+                n_receive_msg.size = message_size;
+                dispatch(client);
+
+                /* The client may have been dropped or its connection moved
+                   to the slot of the session it resumed */
+                if (!n_clients[client].connected)
+                        return TRUE;
         }
 }
 
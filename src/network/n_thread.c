@@ -0,0 +1,514 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Optional network thread. On a server the thread owns the listen socket and
+   every remote client socket. On a client connected to a remote server it
+   services the connection to the server instead, using the slot of
+   [N_SERVER_ID]. It talks to the main loop through a pair of lock-free
+   single-producer, single-consumer byte queues per connection. Messages keep
+   their size prefix inside the queues so the main thread can dispatch them to
+   [n_server_func] or [n_client_func] exactly as N_receive() would. */
+
+#include "n_common.h"
+
+/* Size of each queue in bytes, must be a power of two and hold at least one
+   full message */
+#define QUEUE_SIZE 65536
+
+/* The thread wakes up at least this often to pick up outgoing data */
+#define SELECT_USEC 1000
+
+/* Client slot ownership. A slot is only ever modified by the thread while
+   free or open and only by the main thread while closed. The socket of the
+   server's slot belongs to n_client.c, which closes it, so that the main
+   thread can still look up the server's address. */
+typedef enum {
+        SLOT_FREE,
+        SLOT_OPEN,
+        SLOT_CLOSED,
+        SLOT_LOCAL,
+} slot_state_t;
+
+/* Byte queue. The producer only writes [head] and the consumer only writes
+   [tail]. Both count up forever and are masked when indexing. */
+typedef struct queue {
+        char buffer[QUEUE_SIZE];
+        volatile unsigned int head, tail;
+} queue_t;
+
+/* Per-client data shared with the thread */
+typedef struct slot {
+        queue_t in, out;
+        SOCKET socket;
+        volatile int state;
+        volatile bool drop;
+        bool attached;
+} slot_t;
+
+/* TRUE while the network thread is running */
+bool n_threaded;
+
+static slot_t *slots;
+static SDL_Thread *thread;
+static SOCKET thread_listen;
+static volatile bool thread_running;
+static volatile int thread_bytes_received, thread_bytes_sent;
+static int main_bytes_received, main_bytes_sent;
+
+/******************************************************************************\
+ Returns the number of bytes that can be written to the queue in one piece
+ starting at the current head.
+\******************************************************************************/
+static int queue_space(const queue_t *queue)
+{
+        int space, to_end;
+
+        space = QUEUE_SIZE - (int)(queue->head - queue->tail);
+        to_end = QUEUE_SIZE - (queue->head & (QUEUE_SIZE - 1));
+        return space < to_end ? space : to_end;
+}
+
+/******************************************************************************\
+ Returns the number of bytes that can be read from the queue in one piece
+ starting at the current tail.
+\******************************************************************************/
+static int queue_used(const queue_t *queue)
+{
+        int used, to_end;
+
+        used = (int)(queue->head - queue->tail);
+        to_end = QUEUE_SIZE - (queue->tail & (QUEUE_SIZE - 1));
+        return used < to_end ? used : to_end;
+}
+
+/******************************************************************************\
+ Copy [size] bytes out of the queue starting [offset] bytes past the tail
+ without consuming them. The caller must know the bytes are available.
+\******************************************************************************/
+static void queue_peek(const queue_t *queue, int offset, char *to, int size)
+{
+        int i;
+
+        for (i = 0; i < size; i++)
+                to[i] = queue->buffer[(queue->tail + offset + i) &
+                                      (QUEUE_SIZE - 1)];
+}
+
+/******************************************************************************\
+ Producer side. Write as much of [data] into the queue as will fit and
+ return the number of bytes written.
+\******************************************************************************/
+static int queue_write(queue_t *queue, const char *data, int size)
+{
+        int written, len;
+
+        for (written = 0; written < size; written += len) {
+                if ((len = queue_space(queue)) <= 0)
+                        break;
+                if (len > size - written)
+                        len = size - written;
+                memcpy(queue->buffer + (queue->head & (QUEUE_SIZE - 1)),
+                       data + written, len);
+                C_barrier();
+                queue->head += len;
+        }
+        return written;
+}
+
+/******************************************************************************\
+ Consumer side. Pops a complete message from the queue into [buffer] and
+ returns its size. Returns zero if no complete message is queued yet or -1
+ if the stream is corrupt.
+\******************************************************************************/
+static int queue_read_message(queue_t *queue, char *buffer)
+{
+        unsigned short size;
+        int available;
+        char prefix[2];
+
+        available = (int)(queue->head - queue->tail);
+        if (available < 2)
+                return 0;
+        C_barrier();
+        queue_peek(queue, 0, prefix, 2);
+        size = SDL_SwapLE16(*(Uint16 *)prefix);
+        if (size < 2 || size > N_SYNC_MAX)
+                return -1;
+        if (available < size)
+                return 0;
+        queue_peek(queue, 0, buffer, size);
+        C_barrier();
+        queue->tail += size;
+        return size;
+}
+
+/******************************************************************************\
+ Thread side. Close a client's socket and hand the slot back to the main
+ thread for cleanup.
+\******************************************************************************/
+static void close_slot(slot_t *slot)
+{
+        if (slot != slots + N_SERVER_ID)
+                closesocket(slot->socket);
+        slot->socket = INVALID_SOCKET;
+        C_barrier();
+        slot->state = SLOT_CLOSED;
+}
+
+/******************************************************************************\
+ Thread side. Accept a pending connection into a free slot.
+\******************************************************************************/
+static void accept_slot(void)
+{
+        struct sockaddr_in addr;
+        socklen_t socklen;
+        SOCKET socket;
+        int i;
+
+        socklen = sizeof (addr);
+        if ((socket = accept(thread_listen, (struct sockaddr *)&addr,
+                             &socklen)) == INVALID_SOCKET)
+                return;
+        for (i = 0; slots[i].state != SLOT_FREE; i++)
+                if (i >= N_CLIENTS_MAX - 1) {
+                        closesocket(socket);
+                        return;
+                }
+        N_socket_no_block(socket);
+        slots[i].socket = socket;
+        C_barrier();
+        slots[i].state = SLOT_OPEN;
+}
+
+/******************************************************************************\
+ Thread side. Move data between a client's socket and its queues. Returns
+ FALSE if the connection was lost.
+\******************************************************************************/
+static bool service_slot(slot_t *slot, bool readable, bool writable)
+{
+        int len, ret;
+
+        /* Send queued data */
+        if (writable && (len = queue_used(&slot->out)) > 0) {
+                C_barrier();
+                ret = (int)send(slot->socket, slot->out.buffer +
+                                (slot->out.tail & (QUEUE_SIZE - 1)), len, 0);
+                if (N_socket_error(ret))
+                        return FALSE;
+                if (ret > 0) {
+                        C_barrier();
+                        slot->out.tail += ret;
+                        thread_bytes_sent += ret;
+                }
+        }
+
+        /* Receive straight into the incoming queue. If the queue is full we
+           leave the data in the socket until the main thread catches up. */
+        while (readable && (len = queue_space(&slot->in)) > 0) {
+                ret = (int)recv(slot->socket, slot->in.buffer +
+                                (slot->in.head & (QUEUE_SIZE - 1)), len, 0);
+                if (!ret || N_socket_error(ret))
+                        return FALSE;
+                if (ret < 0)
+                        break;
+                C_barrier();
+                slot->in.head += ret;
+                thread_bytes_received += ret;
+                if (ret < len)
+                        break;
+        }
+        return TRUE;
+}
+
+/******************************************************************************\
+ Network thread entry point.
+\******************************************************************************/
+static int thread_main(void *unused)
+{
+        while (thread_running) {
+                struct timeval tv;
+                fd_set read_fds, write_fds;
+                int i, nfds;
+
+                FD_ZERO(&read_fds);
+                FD_ZERO(&write_fds);
+                nfds = 0;
+                if (thread_listen != INVALID_SOCKET) {
+                        FD_SET(thread_listen, &read_fds);
+                        nfds = (int)thread_listen;
+                }
+                for (i = 0; i <= N_CLIENTS_MAX; i++) {
+                        if (slots[i].state != SLOT_OPEN)
+                                continue;
+                        if (slots[i].drop) {
+                                close_slot(slots + i);
+                                continue;
+                        }
+                        FD_SET(slots[i].socket, &read_fds);
+                        if (slots[i].out.head != slots[i].out.tail)
+                                FD_SET(slots[i].socket, &write_fds);
+                        if ((int)slots[i].socket > nfds)
+                                nfds = (int)slots[i].socket;
+                }
+                tv.tv_sec = 0;
+                tv.tv_usec = SELECT_USEC;
+                if (select(nfds + 1, &read_fds, &write_fds, NULL, &tv) < 0)
+                        continue;
+                if (thread_listen != INVALID_SOCKET &&
+                    FD_ISSET(thread_listen, &read_fds))
+                        accept_slot();
+                for (i = 0; i <= N_CLIENTS_MAX; i++) {
+                        if (slots[i].state != SLOT_OPEN ||
+                            slots[i].socket == INVALID_SOCKET)
+                                continue;
+                        if (!service_slot(slots + i,
+                                          FD_ISSET(slots[i].socket, &read_fds),
+                                          FD_ISSET(slots[i].socket,
+                                                   &write_fds)))
+                                close_slot(slots + i);
+                }
+        }
+        return 0;
+}
+
+/******************************************************************************\
+ Start the network thread, accepting connections on [listen_socket] unless it
+ is invalid. The [server] socket, if valid, is serviced from the start.
+ Returns TRUE if the thread is running.
+\******************************************************************************/
+static bool start_thread(SOCKET listen_socket, SOCKET server)
+{
+        int i;
+
+        N_stop_thread();
+        slots = C_calloc(sizeof (*slots) * (N_CLIENTS_MAX + 1));
+        for (i = 0; i <= N_CLIENTS_MAX; i++)
+                slots[i].socket = INVALID_SOCKET;
+        if (listen_socket != INVALID_SOCKET)
+                slots[N_HOST_CLIENT_ID].state = SLOT_LOCAL;
+        if (server != INVALID_SOCKET) {
+                slots[N_SERVER_ID].socket = server;
+                slots[N_SERVER_ID].state = SLOT_OPEN;
+                slots[N_SERVER_ID].attached = TRUE;
+        }
+        thread_listen = listen_socket;
+        thread_bytes_received = thread_bytes_sent = 0;
+        main_bytes_received = main_bytes_sent = 0;
+        thread_running = TRUE;
+        C_barrier();
+        if (!(thread = SDL_CreateThread(thread_main, NULL))) {
+                C_warning("Failed to start network thread");
+                thread_running = FALSE;
+                C_free(slots);
+                slots = NULL;
+                return FALSE;
+        }
+        n_threaded = TRUE;
+        C_debug("Started network thread");
+        return TRUE;
+}
+
+/******************************************************************************\
+ Start the network thread on an open listen socket. Returns TRUE if the
+ thread is running.
+\******************************************************************************/
+bool N_start_thread(SOCKET listen_socket)
+{
+        return start_thread(listen_socket, INVALID_SOCKET);
+}
+
+/******************************************************************************\
+ Hand a client's connected [socket] to the server over to a new network
+ thread. The socket stays open when the thread stops. Returns TRUE if the
+ thread is running.
+\******************************************************************************/
+bool N_thread_connect(SOCKET socket)
+{
+        return start_thread(INVALID_SOCKET, socket);
+}
+
+/******************************************************************************\
+ Stop the network thread and close every socket it owned. The listen socket
+ and the socket to the server are left for their owners to close.
+\******************************************************************************/
+void N_stop_thread(void)
+{
+        int i;
+
+        if (!n_threaded)
+                return;
+        thread_running = FALSE;
+        SDL_WaitThread(thread, NULL);
+        thread = NULL;
+        for (i = 0; i < N_CLIENTS_MAX; i++)
+                if (slots[i].socket != INVALID_SOCKET)
+                        closesocket(slots[i].socket);
+        C_free(slots);
+        slots = NULL;
+        n_threaded = FALSE;
+        C_debug("Stopped network thread");
+}
+
+/******************************************************************************\
+ Ask the network thread to close a client's connection. The slot is freed
+ during the next N_poll_thread() after the thread has let go of it.
+\******************************************************************************/
+void N_thread_drop(n_client_id_t client)
+{
+        C_assert(n_threaded && client > 0 && client < N_CLIENTS_MAX);
+        slots[client].drop = TRUE;
+}
+
+/******************************************************************************\
+ Main thread side. Give a closed slot back to the network thread.
+\******************************************************************************/
+static void release_slot(slot_t *slot)
+{
+        slot->in.head = slot->in.tail = 0;
+        slot->out.head = slot->out.tail = 0;
+        slot->drop = FALSE;
+        slot->attached = FALSE;
+        C_barrier();
+        slot->state = SLOT_FREE;
+}
+
+/******************************************************************************\
+ Main thread side. Account for traffic the thread has handled since the last
+ poll.
+\******************************************************************************/
+static void count_bytes(void)
+{
+        int received, sent;
+
+        received = thread_bytes_received;
+        sent = thread_bytes_sent;
+        n_bytes_received += received - main_bytes_received;
+        n_bytes_sent += sent - main_bytes_sent;
+        main_bytes_received = received;
+        main_bytes_sent = sent;
+}
+
+/******************************************************************************\
+ Main thread side. Move [client]'s send buffer into its outgoing queue,
+ counting what the thread has not sent yet against the send window.
+\******************************************************************************/
+static void queue_sends(n_client_id_t client)
+{
+        slot_t *slot;
+        int len;
+
+        slot = slots + client;
+        N_send_pending(client, (int)(slot->out.head - slot->out.tail));
+        len = queue_write(&slot->out, n_clients[client].buffer,
+                          n_clients[client].buffer_len);
+        if (len > 0) {
+                n_clients[client].buffer_len -= len;
+                memmove(n_clients[client].buffer,
+                        n_clients[client].buffer + len,
+                        n_clients[client].buffer_len);
+        }
+}
+
+/******************************************************************************\
+ Called from N_poll_server() in place of polling the sockets. Picks up new
+ and lost connections, queues outgoing data and dispatches every complete
+ message the thread has received.
+\******************************************************************************/
+void N_poll_thread(void)
+{
+        static char buffer[N_SYNC_MAX];
+        int i;
+
+        count_bytes();
+
+        /* The host's client never leaves the main thread */
+        N_receive(N_HOST_CLIENT_ID);
+
+        for (i = 1; i < N_CLIENTS_MAX; i++) {
+                slot_t *slot;
+                int size;
+
+                slot = slots + i;
+
+                /* New connection */
+                if (slot->state == SLOT_OPEN && !slot->attached) {
+                        C_debug("Connected client %d", i);
+                        slot->attached = TRUE;
+                        N_set_connected(i, TRUE);
+                        n_clients[i].socket = INVALID_SOCKET;
+                        n_clients_num++;
+                        n_server_func(i, N_EV_CONNECTED);
+                }
+
+                /* Connected and lost again before it was picked up */
+                if (slot->state == SLOT_CLOSED && !slot->attached) {
+                        release_slot(slot);
+                        continue;
+                }
+                if (!slot->attached)
+                        continue;
+
+                /* Lost connection */
+                if (slot->state == SLOT_CLOSED) {
+                        if (n_clients[i].connected)
+                                N_drop_client(i);
+                        release_slot(slot);
+                        continue;
+                }
+
+                /* Waiting for a drop to go through */
+                if (!n_clients[i].connected)
+                        continue;
+
+                queue_sends(i);
+
+                /* Dispatch incoming messages. The callback may drop the
+                   client so check after every message. */
+                while (n_clients[i].connected &&
+                       (size = queue_read_message(&slot->in, buffer))) {
+                        if (size < 0) {
+                                C_warning("Invalid message size from %s",
+                                          N_client_to_string(i));
+                                N_drop_client(i);
+                                break;
+                        }
+                        N_receive_buffer(i, buffer, size);
+                }
+        }
+}
+
+/******************************************************************************\
+ Called from N_poll_client() in place of polling the connection to the
+ server. Queues outgoing data and dispatches every complete message the
+ thread has received. Returns FALSE if the connection was lost.
+\******************************************************************************/
+bool N_poll_thread_client(void)
+{
+        static char buffer[N_SYNC_MAX];
+        int size;
+
+        count_bytes();
+        if (slots[N_SERVER_ID].state == SLOT_CLOSED)
+                return FALSE;
+        queue_sends(N_SERVER_ID);
+
+        /* A message may disconnect us, which stops the thread */
+        while (n_threaded && n_clients[N_SERVER_ID].connected &&
+               (size = queue_read_message(&slots[N_SERVER_ID].in, buffer))) {
+                if (size < 0) {
+                        C_warning("Invalid message size from server");
+                        return FALSE;
+                }
+                N_receive_buffer(N_SERVER_ID, buffer, size);
+        }
+        return TRUE;
+}
@@ -0,0 +1,300 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Optional unreliable side channel. The server listens for datagrams on the
+   same port number as the TCP listen socket and hands each client a token
+   over TCP. The client sends the token back in a hello datagram until the
+   server answers, which proves datagrams get through in both directions.
+   Datagrams from the server carry a sequence number and anything older than
+   the last datagram received is dropped, so only messages that later ones
+   supersede should be sent this way. */
+
+#include "n_common.h"
+
+/* Largest datagram, kept under common path MTUs */
+#define UDP_MAX 1200
+
+/* Datagram header holds the token and sequence number */
+#define UDP_HEADER 8
+
+/* Milliseconds between hello datagrams during the handshake */
+#define HELLO_INTERVAL 500
+
+/* Side channel state for a client or, on a client, for the server */
+typedef struct udp_client {
+        struct sockaddr_in addr;
+        int token, seq;
+        bool addressed, ready;
+} udp_client_t;
+
+static udp_client_t udp_clients[N_CLIENTS_MAX + 1];
+static SOCKET udp_socket = INVALID_SOCKET;
+static int hello_time, hello_expire;
+
+/******************************************************************************\
+ Forget a client's side channel state.
+\******************************************************************************/
+void N_udp_reset(n_client_id_t client)
+{
+        C_zero(udp_clients + client);
+}
+
+/******************************************************************************\
+ Close the datagram socket.
+\******************************************************************************/
+void N_udp_close(void)
+{
+        if (udp_socket == INVALID_SOCKET)
+                return;
+        closesocket(udp_socket);
+        udp_socket = INVALID_SOCKET;
+        C_zero_buf(udp_clients);
+        C_debug("Closed UDP socket");
+}
+
+/******************************************************************************\
+ Returns the datagram socket, or INVALID_SOCKET if it is not open.
+\******************************************************************************/
+SOCKET N_udp_socket(void)
+{
+        return udp_socket;
+}
+
+/******************************************************************************\
+ Open the server's datagram socket on [port]. Returns FALSE if the socket
+ could not be bound, in which case clients only use TCP.
+\******************************************************************************/
+bool N_udp_open(int port)
+{
+        struct sockaddr_in addr;
+
+        N_udp_close();
+        udp_socket = socket(PF_INET, SOCK_DGRAM, 0);
+        C_zero(&addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (udp_socket == INVALID_SOCKET ||
+            bind(udp_socket, (struct sockaddr *)&addr, sizeof (addr))) {
+                C_warning("Failed to bind UDP port %d", port);
+                N_udp_close();
+                return FALSE;
+        }
+        N_socket_no_block(udp_socket);
+        C_debug("Listening for UDP on port %d", port);
+        return TRUE;
+}
+
+/******************************************************************************\
+ Returns the token [client] needs to open its side channel, or zero if the
+ server is not accepting datagrams.
+\******************************************************************************/
+int N_udp_token(n_client_id_t client)
+{
+        if (udp_socket == INVALID_SOCKET || client < 0 ||
+            client >= N_CLIENTS_MAX)
+                return 0;
+        while (!udp_clients[client].token)
+                udp_clients[client].token = N_rand();
+        return udp_clients[client].token;
+}
+
+/******************************************************************************\
+ Returns TRUE if datagrams can be exchanged with [client].
+\******************************************************************************/
+bool N_udp_ready(n_client_id_t client)
+{
+        return udp_socket != INVALID_SOCKET && client >= 0 &&
+               client <= N_CLIENTS_MAX && udp_clients[client].ready;
+}
+
+/******************************************************************************\
+ The client has confirmed over TCP that it can hear the server's datagrams.
+\******************************************************************************/
+void N_udp_confirm(n_client_id_t client)
+{
+        if (client < 0 || client >= N_CLIENTS_MAX ||
+            !udp_clients[client].addressed)
+                return;
+        udp_clients[client].ready = TRUE;
+        C_debug("UDP side channel ready for %s", N_client_to_string(client));
+}
+
+/******************************************************************************\
+ Send one datagram with the given header and payload. Drops the datagram on
+ purpose if testing packet loss.
+\******************************************************************************/
+static void send_datagram(udp_client_t *udp, int seq, const char *data,
+                          int size)
+{
+        char buffer[UDP_MAX], *p;
+
+        C_var_unlatch(&n_test_udp_loss);
+        if (n_test_udp_loss.value.n > 0 &&
+            (unsigned int)N_rand() % 100 < n_test_udp_loss.value.n)
+                return;
+        p = N_pack_int(buffer, udp->token);
+        p = N_pack_int(p, seq);
+        if (size > 0)
+                memcpy(p, data, size);
+        sendto(udp_socket, buffer, UDP_HEADER + size, 0,
+               (struct sockaddr *)&udp->addr, sizeof (udp->addr));
+}
+
+/******************************************************************************\
+ Client is starting the side channel handshake with the [token] the server
+ gave it. Does nothing if the server does not accept datagrams or the side
+ channel is disabled.
+\******************************************************************************/
+void N_udp_connect(int token)
+{
+        udp_client_t *udp;
+        socklen_t socklen;
+
+        C_var_unlatch(&n_udp);
+        udp = udp_clients + N_SERVER_ID;
+        if (!token || !n_udp.value.n ||
+            (udp_socket != INVALID_SOCKET && udp->token == token))
+                return;
+        N_udp_close();
+
+        /* Datagrams go to the same address and port as the connection */
+        socklen = sizeof (udp->addr);
+        if (getpeername(n_clients[N_SERVER_ID].socket,
+                        (struct sockaddr *)&udp->addr, &socklen) ||
+            (udp_socket = socket(PF_INET, SOCK_DGRAM, 0)) == INVALID_SOCKET) {
+                C_warning("Failed to open UDP socket");
+                udp_socket = INVALID_SOCKET;
+                return;
+        }
+        N_socket_no_block(udp_socket);
+        udp->token = token;
+        udp->addressed = TRUE;
+        hello_time = c_time_msec;
+        hello_expire = c_time_msec + CONNECT_TIMEOUT;
+}
+
+/******************************************************************************\
+ Send a message to [client] as a datagram. The message is silently dropped if
+ the side channel is not open, so the caller must be able to do without it.
+\******************************************************************************/
+void N_message_send_udp(n_message_t *msg, n_client_id_t client)
+{
+        udp_client_t *udp;
+
+        if (n_client_id != N_HOST_CLIENT_ID || !N_udp_ready(client))
+                return;
+        if (msg->size + UDP_HEADER > UDP_MAX) {
+                C_warning("Datagram of %d bytes is too large", msg->size);
+                return;
+        }
+        N_pack_short(msg->buffer, msg->size);
+        udp = udp_clients + client;
+        send_datagram(udp, ++udp->seq, msg->buffer, msg->size);
+}
+
+/******************************************************************************\
+ Server received a datagram. Only hellos are expected from clients.
+\******************************************************************************/
+static void server_datagram(const struct sockaddr_in *from, int token)
+{
+        int i;
+
+        N_clients_for(i, n_connected) {
+                udp_client_t *udp;
+
+                udp = udp_clients + i;
+                if (i == N_HOST_CLIENT_ID || !udp->token ||
+                    udp->token != token)
+                        continue;
+                if (!udp->addressed)
+                        C_debug("UDP hello from %s",
+                                N_client_to_string(i));
+                udp->addr = *from;
+                udp->addressed = TRUE;
+                send_datagram(udp, 0, NULL, 0);
+                return;
+        }
+}
+
+/******************************************************************************\
+ Client received a datagram from the server.
+\******************************************************************************/
+static void client_datagram(int token, int seq, const char *data, int size)
+{
+        udp_client_t *udp;
+
+        udp = udp_clients + N_SERVER_ID;
+        if (token != udp->token)
+                return;
+
+        /* Hello answered */
+        if (!seq) {
+                if (udp->ready)
+                        return;
+                udp->ready = TRUE;
+                C_debug("UDP side channel ready");
+                n_client_func(N_SERVER_ID, N_EV_UDP_READY);
+                return;
+        }
+
+        /* Newer datagrams supersede older ones */
+        if (seq <= udp->seq || !N_message_load(&n_receive_msg, data, size))
+                return;
+        udp->seq = seq;
+        n_client_func(N_SERVER_ID, N_EV_DATAGRAM);
+}
+
+/******************************************************************************\
+ Receive pending datagrams and keep the client's handshake going.
+\******************************************************************************/
+void N_poll_udp(void)
+{
+        struct sockaddr_in from;
+        socklen_t socklen;
+        udp_client_t *udp;
+        char buffer[UDP_MAX];
+        int len, token, seq;
+
+        if (udp_socket == INVALID_SOCKET)
+                return;
+        for (;;) {
+                socklen = sizeof (from);
+                len = (int)recvfrom(udp_socket, buffer, sizeof (buffer), 0,
+                                    (struct sockaddr *)&from, &socklen);
+                if (len < UDP_HEADER)
+                        break;
+                N_unpack_int(buffer, &token);
+                N_unpack_int(buffer + 4, &seq);
+                if (n_client_id == N_HOST_CLIENT_ID)
+                        server_datagram(&from, token);
+                else
+                        client_datagram(token, seq, buffer + UDP_HEADER,
+                                        len - UDP_HEADER);
+
+                /* The callback may have disconnected us */
+                if (udp_socket == INVALID_SOCKET)
+                        return;
+        }
+
+        /* Client keeps saying hello until the server answers */
+        udp = udp_clients + N_SERVER_ID;
+        if (n_client_id == N_HOST_CLIENT_ID || udp->ready ||
+            c_time_msec < hello_time)
+                return;
+        if (c_time_msec > hello_expire) {
+                C_debug("No UDP reply from server, using TCP only");
+                N_udp_close();
+                return;
+        }
+        hello_time = c_time_msec + HELLO_INTERVAL;
+        send_datagram(udp, 0, NULL, 0);
+}
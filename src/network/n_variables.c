@@ -12,7 +12,11 @@
 
 #include "n_common.h"
 
-c_var_t n_port;
+c_var_t n_client_rate, n_port, n_resume_grace, n_test_udp_loss, n_thread,
+        n_udp;
+
+/* Telemetry */
+c_var_t n_stats, n_stats_csv, n_stats_interval, n_stats_print;
 
 /******************************************************************************\
  Registers the network namespace variables.
@@ -20,5 +24,38 @@ c_var_t n_port;
 void N_register_variables(void)
 {
         C_register_integer(&n_port, "n_port", 32500, "server port");
+        C_register_integer(&n_resume_grace, "n_resume_grace", 30000,
+                           "milliseconds a lost client's slot is held for it "
+                           "to reconnect, 0 to disable");
+        C_register_integer(&n_client_rate, "n_client_rate", 0,
+                           "bytes per second the server sends each client, "
+                           "0 for no limit");
+        n_client_rate.edit = C_VE_ANYTIME;
+        C_register_integer(&n_thread, "n_thread", FALSE,
+                           "service sockets from a separate thread");
+        C_register_integer(&n_udp, "n_udp", TRUE,
+                           "send movement hints over UDP when possible");
+        C_register_integer(&n_test_udp_loss, "n_test_udp_loss", 0,
+                           "percentage of UDP datagrams to drop for testing");
+        n_test_udp_loss.archive = FALSE;
+        n_test_udp_loss.edit = C_VE_ANYTIME;
+
+        /* Telemetry */
+        C_register_integer(&n_stats, "n_stats", FALSE,
+                           "collect per-message network statistics");
+        n_stats.archive = FALSE;
+        n_stats.edit = C_VE_ANYTIME;
+        C_register_integer(&n_stats_print, "n_stats_print", 0,
+                           "set to print the network statistics");
+        n_stats_print.archive = FALSE;
+        C_register_string(&n_stats_csv, "n_stats_csv", "",
+                          "prefix of CSV files to write network statistics "
+                          "to periodically");
+        n_stats_csv.archive = FALSE;
+        n_stats_csv.edit = C_VE_ANYTIME;
+        C_register_integer(&n_stats_interval, "n_stats_interval", 10000,
+                           "milliseconds between network statistics CSV "
+                           "rows");
+        n_stats_interval.edit = C_VE_ANYTIME;
 }
 
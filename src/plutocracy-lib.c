@@ -29,6 +29,10 @@ static PyObject *c_update(PyObject *pArgs, PyObject *kArgs) {
                 }
                 I_dispatch(&ev);
         }
+
+        /* Update the game before rendering it */
+        G_update();
+
         R_start_globe();
         G_render_globe();
         R_finish_globe();
@@ -39,10 +43,6 @@ static PyObject *c_update(PyObject *pArgs, PyObject *kArgs) {
         R_finish_frame();
         C_time_update();
         C_throttle_fps();
-
-        /* Update the game after rendering everything */
-        G_update_host();
-        G_update_client();
         return Py_BuildValue("i", 0);
 }
 
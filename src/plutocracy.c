@@ -70,16 +70,16 @@ int plutocracy_update( void )
                 }
                 I_dispatch(&ev);
         }
+
+        /* Update the game before rendering it */
+        G_update();
+
         G_render_globe();
         I_render();
         render_status();
         R_finish_frame();
         C_time_update();
         C_throttle_fps();
-
-        /* Update the game after rendering everything */
-        G_update_host();
-        G_update_client();
         return 0;
 }
 
@@ -196,7 +196,6 @@ void R_surface_put(SDL_Surface *, int x, int y, c_color_t);
 int R_surface_save(SDL_Surface *, const char *filename);
 
 /* r_terrain.c */
-extern r_globe_vertex_t r_globe_verts[R_TILES_MAX * 3];
 extern r_vbo_t r_globe_vbo;
 
 extern PyTypeObject R_tile_wrapper_type;
@@ -205,6 +204,13 @@ extern PyTypeObject R_tile_wrapper_type;
 void R_render_normals(int count, c_vec3_t *co, c_vec3_t *no, int stride);
 void R_render_tests(void);
 
+/* r_tiles.c */
+void R_configure_tiles(void);
+void R_generate_tiles(int subdiv4);
+
+extern r_globe_vertex_t r_globe_verts[R_TILES_MAX * 3];
+extern int r_flip_limit;
+
 /* r_variables.c */
 extern c_var_t r_clear, r_depth_bits, r_ext_point_sprites, r_globe,
                r_globe_colors[3], r_atmosphere, r_globe_shininess,
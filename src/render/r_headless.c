@@ -0,0 +1,144 @@
+/******************************************************************************\
+ Plutocracy - Copyright (C) 2008 - Michael Levin
+
+ This program is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+\******************************************************************************/
+
+/* Stands in for the renderer in the dedicated server, which links only the
+   tile geometry from r_tiles.c. The globe is generated the same way as on
+   the clients, models are empty placeholders so that the game has somewhere
+   to keep their position, and everything else does nothing. This file is
+   not part of the client. */
+
+#include "r_common.h"
+
+/* Camera and lighting state the game reads */
+c_vec3_t r_cam_forward, r_cam_origin;
+c_color_t r_fog_color;
+float r_solar_angle;
+
+/******************************************************************************\
+ Model placeholders are freed like any other Python object.
+\******************************************************************************/
+static void model_dealloc(r_model_t *self)
+{
+        self->ob_type->tp_free((PyObject *)self);
+}
+
+static PyTypeObject model_type =
+{
+ PyObject_HEAD_INIT(NULL)
+ 0,                            /*ob_size*/
+ "plutocracy.render.Model",    /*tp_name*/
+ sizeof(r_model_t),            /*tp_basicsize*/
+ 0,                            /*tp_itemsize*/
+ (destructor)model_dealloc,    /*tp_dealloc*/
+ 0,                            /*tp_print*/
+ 0,                            /*tp_getattr*/
+ 0,                            /*tp_setattr*/
+ 0,                            /*tp_compare*/
+ 0,                            /*tp_repr*/
+ 0,                            /*tp_as_number*/
+ 0,                            /*tp_as_sequence*/
+ 0,                            /*tp_as_mapping*/
+ 0,                            /*tp_hash */
+ 0,                            /*tp_call*/
+ 0,                            /*tp_str*/
+ 0,                            /*tp_getattro*/
+ 0,                            /*tp_setattro*/
+ 0,                            /*tp_as_buffer*/
+ Py_TPFLAGS_DEFAULT,           /*tp_flags*/
+ "Model",                      /* tp_doc */
+};
+
+/******************************************************************************\
+ Allocate a model without loading anything. The model has no data so it is
+ never rendered.
+\******************************************************************************/
+r_model_t *R_model_init(const char *filename, bool cull)
+{
+        r_model_t *model;
+
+        if (PyType_Ready(&model_type) < 0 ||
+            !(model = (r_model_t *)model_type.tp_alloc(&model_type, 0)))
+                return NULL;
+        model->scale = 1.f;
+        model->time_left = -1;
+        model->normal = C_vec3(0.f, 1.f, 0.f);
+        model->forward = C_vec3(0.f, 0.f, 1.f);
+        model->modulate = C_color(1.f, 1.f, 1.f, 1.f);
+        return model;
+}
+
+/******************************************************************************\
+ Generate the globe tiles. There are no vertex buffers to fill.
+\******************************************************************************/
+void R_generate_globe(int subdiv4)
+{
+        R_generate_tiles(subdiv4);
+}
+
+/******************************************************************************\
+ Raise the globe tiles to their heights. There is nothing to texture.
+\******************************************************************************/
+void R_configure_globe(void)
+{
+        C_debug("Configuring globe");
+        R_configure_tiles();
+}
+
+/******************************************************************************\
+ Rendering and camera calls made by the game.
+\******************************************************************************/
+void R_adjust_light_for(c_vec3_t origin)
+{
+}
+
+void R_fill_screen(c_color_t color)
+{
+}
+
+void R_hover_tile(int tile, r_select_type_t type)
+{
+}
+
+void R_model_render(r_model_t *model)
+{
+}
+
+void R_render_border(int tile, c_color_t color, bool dashed)
+{
+}
+
+void R_render_ship_boarding(c_vec3_t origin_a, c_vec3_t origin_b,
+                            c_color_t color)
+{
+}
+
+void R_render_ship_status(const r_model_t *model, float left, float left_max,
+                          float right, float right_max, c_color_t modulate,
+                          bool selected, bool own)
+{
+}
+
+void R_render_test_line(c_vec3_t from, c_vec3_t to, c_color_t color)
+{
+}
+
+void R_rotate_cam_to(c_vec3_t origin)
+{
+}
+
+void R_select_path(int tile, const char *path)
+{
+}
+
+void R_select_tile(int tile, r_select_type_t type)
+{
+}
@@ -182,7 +182,7 @@ void R_select_path(int tile, const char *path);
 void R_select_tile(int tile, r_select_type_t);
 void R_start_globe(void);
 
-extern float r_globe_light, r_globe_radius, r_zoom_max;
+extern float r_globe_light, r_zoom_max;
 
 /* r_mode.c */
 void R_cleanup(void);
@@ -249,23 +249,26 @@ void R_window_render(r_window_t *);
 /* r_terrain.c */
 void R_configure_globe(void);
 void R_generate_globe(int subdiv4);
+
+/* r_tests.c */
+void R_free_test_assets(void);
+void R_load_test_assets(void);
+void R_render_test_line(c_vec3_t from, c_vec3_t to, c_color_t);
+
+/* r_tiles.c */
+int R_land_bridge(int tile_a, int tile_b);
+r_terrain_t R_terrain_base(r_terrain_t);
+const char *R_terrain_to_string(r_terrain_t);
 void R_tile_coords(int index, c_vec3_t verts[3]);
 float R_tile_latitude(int tile);
 void R_tile_neighbors(int tile, int neighbors[3]);
 int R_tile_region(int tile, int neighbors[12]);
-int R_land_bridge(int tile_a, int tile_b);
-r_terrain_t R_terrain_base(r_terrain_t);
-const char *R_terrain_to_string(r_terrain_t);
 int R_water_terrain(int terrain);
 
 extern r_tile_t r_tiles[R_TILES_MAX];
+extern float r_globe_radius;
 extern int r_tiles_max;
 
-/* r_tests.c */
-void R_free_test_assets(void);
-void R_load_test_assets(void);
-void R_render_test_line(c_vec3_t from, c_vec3_t to, c_color_t);
-
 /* r_variables.c */
 void R_register_variables(void);
 
@@ -0,0 +1,202 @@
+#!/usr/bin/env python
+#
+################################################################################
+# Plutocracy - Copyright (C) 2008 - Michael Levin
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+################################################################################
+#
+# Headless load generator for stressing a host. Starts a number of bots, each
+# a "pluto.py --bot" process running the real client code without a window,
+# and has them play: they join a nation, move their ships around, trade,
+# change prices and chat. Every few seconds it reports the round-trip times
+# the server measured with its echo requests, the bytes per second sent and
+# received and the number of dropped connections.
+#
+# The bots are built from the game's own client code, so they always speak
+# the current protocol. The dedicated server build must be installed.
+#
+#   tools/loadgen.py --players 64 --seconds 120
+
+import optparse
+import os
+import select
+import signal
+import subprocess
+import sys
+import time
+
+# The game script, relative to this script
+PLUTO = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..',
+                     'pluto.py')
+
+################################################################################
+# Bot processes
+################################################################################
+
+class Bot:
+        def __init__(self, index, options, stats):
+                self.index = index
+                self.stats = stats
+                self.buffer = ''
+                self.connected = False
+                self.bytes_in = self.bytes_out = self.commands = 0
+                address = '%s:%d' % (options.host, options.port)
+                self.process = subprocess.Popen([options.python, PLUTO,
+                                                 '--bot', address,
+                                                 str(int(options.interval *
+                                                         1000))],
+                                                stdout=subprocess.PIPE,
+                                                cwd=os.path.dirname(PLUTO))
+                self.alive = True
+
+        def fileno(self):
+                return self.process.stdout.fileno()
+
+        def drop(self, reason):
+                print 'Player %d dropped: %s' % (self.index, reason)
+                self.stats.dropped += 1
+                self.connected = False
+
+        def receive(self):
+                """Reads the lines the bot printed since the last call"""
+                data = os.read(self.fileno(), 4096)
+                if not data:
+                        self.alive = False
+                        self.process.wait()
+                        if self.connected:
+                                self.drop('exited')
+                        elif not self.bytes_in:
+                                self.drop('failed to join')
+                        return
+                self.buffer += data
+                while '\n' in self.buffer:
+                        line, self.buffer = self.buffer.split('\n', 1)
+                        self.report(line)
+
+        def report(self, line):
+                """Bots print: in game, bytes in, bytes out, commands, rtt"""
+                try:
+                        connected, bytes_in, bytes_out, commands, ping = \
+                                [int(x) for x in line.split()]
+                except ValueError:
+                        return
+                if self.connected and not connected:
+                        self.drop('disconnected')
+                self.connected = bool(connected)
+                self.stats.bytes_in += bytes_in - self.bytes_in
+                self.stats.bytes_out += bytes_out - self.bytes_out
+                self.stats.commands += commands - self.commands
+                self.bytes_in = bytes_in
+                self.bytes_out = bytes_out
+                self.commands = commands
+                if ping >= 0:
+                        self.stats.pings.append(ping)
+
+        def stop(self):
+                if not self.alive:
+                        return
+                try:
+                        self.process.send_signal(signal.SIGINT)
+                except OSError:
+                        pass
+
+################################################################################
+# Statistics
+################################################################################
+
+class Stats:
+        def __init__(self):
+                self.bytes_in = self.bytes_out = 0
+                self.commands = 0
+                self.dropped = 0
+                self.pings = []
+
+        def report(self, bots, seconds):
+                connected = len([b for b in bots if b.connected])
+                line = ('%3d connected, %d dropped, in %.1f kB/s, '
+                        'out %.1f kB/s, %d cmd/s' %
+                        (connected, self.dropped,
+                         self.bytes_in / 1024.0 / seconds,
+                         self.bytes_out / 1024.0 / seconds,
+                         self.commands / seconds))
+                if self.pings:
+                        pings = sorted(self.pings)
+                        line += (', rtt %.1f mean, %d median, %d p99, '
+                                 '%d max msec' %
+                                 (float(sum(pings)) / len(pings),
+                                  pings[len(pings) / 2],
+                                  pings[len(pings) * 99 / 100], pings[-1]))
+                print line
+                sys.stdout.flush()
+
+################################################################################
+# Main
+################################################################################
+
+parser = optparse.OptionParser()
+parser.add_option('--host', default='127.0.0.1', help='server address')
+parser.add_option('--port', type='int', default=32500, help='server port')
+parser.add_option('--players', type='int', default=16,
+                  help='number of bots')
+parser.add_option('--seconds', type='float', default=60.0,
+                  help='how long to run for, 0 to run until interrupted')
+parser.add_option('--interval', type='float', default=1.0,
+                  help='mean seconds between commands from each bot')
+parser.add_option('--ramp', type='float', default=0.05,
+                  help='seconds between bot connections')
+parser.add_option('--report', type='float', default=5.0,
+                  help='seconds between reports')
+parser.add_option('--python', default=sys.executable,
+                  help='interpreter to run the bots with')
+options = parser.parse_args()[0]
+
+print 'Connecting %d bots to %s:%d' % (options.players, options.host,
+                                      options.port)
+stats = Stats()
+total = Stats()
+bots = []
+start = last_report = time.time()
+next_connect = start
+try:
+        while not options.seconds or time.time() - start < options.seconds:
+                now = time.time()
+
+                # Ramp up connections so the server is not hit all at once
+                if len(bots) < options.players and now >= next_connect:
+                        bots.append(Bot(len(bots), options, stats))
+                        next_connect = now + options.ramp
+
+                live = [b for b in bots if b.alive]
+                for bot in select.select(live, [], [], 0.1)[0]:
+                        bot.receive()
+
+                if now - last_report >= options.report:
+                        stats.report(bots, now - last_report)
+                        for name in ('bytes_in', 'bytes_out', 'commands'):
+                                setattr(total, name, getattr(total, name) +
+                                                     getattr(stats, name))
+                                setattr(stats, name, 0)
+                        total.pings += stats.pings
+                        stats.pings = []
+                        last_report = now
+except KeyboardInterrupt:
+        pass
+
+# Totals over the whole run
+for name in ('bytes_in', 'bytes_out', 'commands'):
+        setattr(total, name, getattr(total, name) + getattr(stats, name))
+total.pings += stats.pings
+total.dropped = stats.dropped
+print 'Total:',
+total.report(bots, time.time() - start)
+for bot in bots:
+        bot.stop()
+for bot in bots:
+        bot.process.wait()
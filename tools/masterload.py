@@ -0,0 +1,244 @@
+#!/usr/bin/env python
+#
+################################################################################
+# Plutocracy - Copyright (C) 2008 - Michael Levin
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+################################################################################
+#
+# Load test for the master server. Keeps a number of heartbeats in flight
+# from one process, each on its own connection with the same request the game
+# sends, on behalf of a set of fake hosts. Every so often it fetches the CSV
+# server list and checks that every fake host is listed. At the end it sends
+# the dead heartbeats and checks that they were all removed.
+#
+#   pluto.py --master 8080 &
+#   tools/masterload.py --port 8080 --hosts 2000 --seconds 30
+
+import errno
+import optparse
+import select
+import socket
+import sys
+import time
+
+# Protocol number the fake hosts claim
+PROTOCOL = 1
+
+################################################################################
+# Requests
+################################################################################
+
+def post(options, fields):
+        """Returns a POST request formatted the way the game sends them"""
+        body = '&'.join(['%s=%s' % (k, v) for k, v in fields])
+        return ('POST %s HTTP/1.1\n'
+                'Host: %s:%d\n'
+                'Connection: close\n'
+                'Content-Type: application/x-www-form-urlencoded\n'
+                'Content-Length: %d\n\n%s' %
+                (options.url, options.host, options.port, len(body), body))
+
+def get(options, query):
+        return ('GET %s?%s HTTP/1.1\nHost: %s:%d\nConnection: close\n\n' %
+                (options.url, query, options.host, options.port))
+
+class Request:
+        """One request on its own non-blocking connection"""
+
+        def __init__(self, options, data):
+                self.data = data
+                self.response = ''
+                self.start = time.time()
+                self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                self.sock.setblocking(0)
+                ret = self.sock.connect_ex((options.host, options.port))
+                if ret not in (0, errno.EINPROGRESS, errno.EWOULDBLOCK):
+                        raise socket.error(ret, 'connect failed')
+
+        def fileno(self):
+                return self.sock.fileno()
+
+        def writing(self):
+                return len(self.data) > 0
+
+        def write(self):
+                sent = self.sock.send(self.data)
+                self.data = self.data[sent:]
+
+        def read(self):
+                """Returns True once the server has closed the connection"""
+                data = self.sock.recv(65536)
+                if not data:
+                        self.sock.close()
+                        return True
+                self.response += data
+                return False
+
+        def status(self):
+                parts = self.response.split(' ', 2)
+                if len(parts) < 2 or not parts[1].isdigit():
+                        return 0
+                return int(parts[1])
+
+        def body(self):
+                for sep in ('\r\n\r\n', '\n\n'):
+                        if sep in self.response:
+                                return self.response.split(sep, 1)[1]
+                return ''
+
+def run(requests):
+        """Runs a batch of requests to completion"""
+        pending = list(requests)
+        while pending:
+                writers = [r for r in pending if r.writing()]
+                readable, writable = select.select(pending, writers, [],
+                                                   5.0)[:2]
+                if not readable and not writable:
+                        raise Exception('Timed out waiting for the server')
+                for request in writable:
+                        request.write()
+                for request in readable:
+                        if request.read():
+                                pending.remove(request)
+
+def listed(options, hosts):
+        """Returns how many of the fake hosts are in the CSV listing and the
+           size of the listing"""
+        request = Request(options, get(options, 'format=csv'))
+        run([request])
+        body = request.body()
+        ports = set()
+        for line in body.splitlines()[1:]:
+                fields = [f.strip('"') for f in line.split('","')]
+                if len(fields) == 4 and fields[2].startswith('load'):
+                        ports.add(int(fields[1].rsplit(':', 1)[1]))
+        return len([p for p in hosts if p in ports]), len(body)
+
+################################################################################
+# Statistics
+################################################################################
+
+class Stats:
+        def __init__(self):
+                self.done = self.errors = 0
+                self.latency = []
+
+        def report(self, seconds):
+                line = '%d heartbeats/s, %d errors' % (self.done / seconds,
+                                                       self.errors)
+                if self.latency:
+                        latency = sorted(self.latency)
+                        line += (', latency %.2f median, %.2f p99, '
+                                 '%.2f max msec' %
+                                 (1000 * latency[len(latency) / 2],
+                                  1000 * latency[len(latency) * 99 / 100],
+                                  1000 * latency[-1]))
+                return line
+
+################################################################################
+# Main
+################################################################################
+
+parser = optparse.OptionParser()
+parser.add_option('--host', default='127.0.0.1', help='master server address')
+parser.add_option('--port', type='int', default=8080,
+                  help='master server port')
+parser.add_option('--url', default='/', help='master server URL path')
+parser.add_option('--hosts', type='int', default=1000,
+                  help='number of fake hosts sending heartbeats')
+parser.add_option('--connections', type='int', default=64,
+                  help='heartbeats kept in flight')
+parser.add_option('--seconds', type='float', default=30.0,
+                  help='how long to run for')
+parser.add_option('--report', type='float', default=5.0,
+                  help='seconds between reports and listing checks')
+options = parser.parse_args()[0]
+
+hosts = range(40000, 40000 + options.hosts)
+print ('Sending heartbeats for %d hosts to %s:%d with %d connections' %
+       (options.hosts, options.host, options.port, options.connections))
+stats = Stats()
+total = Stats()
+inflight = []
+sent = 0
+start = last_report = time.time()
+failed = False
+try:
+        while time.time() - start < options.seconds:
+                now = time.time()
+
+                # Keep the pipeline full
+                while len(inflight) < options.connections:
+                        port = hosts[sent % len(hosts)]
+                        fields = [('protocol', PROTOCOL),
+                                  ('name', 'load%d' % port),
+                                  ('info', '%d/8, 30 min' % (sent % 8)),
+                                  ('port', port)]
+                        inflight.append(Request(options,
+                                                post(options, fields)))
+                        sent += 1
+
+                writers = [r for r in inflight if r.writing()]
+                readable, writable = select.select(inflight, writers, [],
+                                                   0.1)[:2]
+                for request in writable:
+                        try:
+                                request.write()
+                        except socket.error:
+                                stats.errors += 1
+                                inflight.remove(request)
+                for request in readable:
+                        try:
+                                if not request.read():
+                                        continue
+                        except socket.error:
+                                stats.errors += 1
+                                inflight.remove(request)
+                                continue
+                        inflight.remove(request)
+                        if request.status() != 200:
+                                stats.errors += 1
+                                continue
+                        stats.done += 1
+                        stats.latency.append(time.time() - request.start)
+
+                # Report and make sure everyone who got a heartbeat through is
+                # listed
+                if now - last_report >= options.report:
+                        count, size = listed(options, hosts[:sent])
+                        expect = min(sent, len(hosts)) - len(inflight)
+                        print ('%s, %d/%d listed in %d bytes' %
+                               (stats.report(now - last_report), count,
+                                min(sent, len(hosts)), size))
+                        sys.stdout.flush()
+                        if count < expect:
+                                failed = True
+                        total.done += stats.done
+                        total.errors += stats.errors
+                        total.latency += stats.latency
+                        stats = Stats()
+                        last_report = now
+except KeyboardInterrupt:
+        pass
+for request in inflight:
+        request.sock.close()
+total.done += stats.done
+total.errors += stats.errors
+total.latency += stats.latency
+print 'Total:', total.report(time.time() - start)
+
+# Dead heartbeats remove every fake host
+for i in range(0, len(hosts), options.connections):
+        run([Request(options, post(options, [('port', port)]))
+             for port in hosts[i:i + options.connections]])
+count = listed(options, hosts)[0]
+print '%d fake hosts left after dead heartbeats' % count
+if count or failed or total.errors:
+        sys.exit(1)